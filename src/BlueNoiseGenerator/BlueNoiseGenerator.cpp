@@ -0,0 +1,495 @@
+// Offline generator for the spatiotemporal blue noise used to jitter the cloud ray march (see cloudRayMarch.glsl)
+//
+// Writes NUM_LAYERS tileable SIZE x SIZE RGBA images, BlueNoise(1).png ... BlueNoise(NUM_LAYERS).png, that the renderer
+// loads as one 2D array texture (see Sky::CreateCloudResources). R and G are two independent blue noise sets;
+// R offsets the start of every ray along the ray, G rotates the cone of light samples around the light direction.
+//
+// Every layer is a void-and-cluster threshold map (Ulichney 1993), so every layer on its own is spatially blue noise and
+// has a perfectly flat histogram. The layers are built together, with an energy term that also pushes apart the ranks a
+// pixel gets in neighbouring layers, so that a pixel's values over time are well spread out too (similar to the
+// spatiotemporal blue noise of Wolfe et al. 2022, "Spatiotemporal Blue Noise Masks").
+//
+// Usage:
+//		BlueNoiseGenerator <output folder>		generate the textures, e.g. "src/CloudScapes/textures/BlueNoise/"
+//		BlueNoiseGenerator --compare			image error of the ray march jitter at equal sample counts:
+//												Halton (what the ray march used before), white noise and blue noise
+
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <random>
+#include <iostream>
+#include <stdexcept>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "../../external/stb_image_write.h"
+
+#define SIZE 64
+#define NUM_LAYERS 16
+#define NUM_PIXELS (SIZE * SIZE)
+
+// Gaussian energy filters. Ulichney suggests a spatial sigma of 1.5
+#define SPATIAL_SIGMA 1.5f
+#define SPATIAL_RADIUS 6 // the filter is cut off where it is practically zero
+#define TEMPORAL_SIGMA 1.0f
+#define TEMPORAL_WEIGHT 2.0f // relative to the spatial energy
+
+#define INITIAL_PATTERN_DENSITY 0.1f // fraction of the pixels that are set in the initial binary pattern
+
+namespace
+{
+	//--------------------------------------------------------
+	//					VOID AND CLUSTER
+	//--------------------------------------------------------
+	/*
+		Void-and-cluster ranks the pixels of a binary pattern by repeatedly removing the pixel in the tightest cluster
+		and inserting pixels into the largest void, both found with a Gaussian energy filter over the set pixels.
+		The rank at which a pixel is removed or inserted becomes its threshold.
+
+		All layers are processed in lock step: every rank is assigned exactly once per layer, which keeps the
+		histogram of every layer flat.
+	*/
+	class VoidAndCluster
+	{
+	public:
+		explicit VoidAndCluster(unsigned int seed) : rng(seed)
+		{
+			for (int d = -SPATIAL_RADIUS; d <= SPATIAL_RADIUS; d++)
+			{
+				spatialFilter[d + SPATIAL_RADIUS] = std::exp(-float(d * d) / (2.0f * SPATIAL_SIGMA * SPATIAL_SIGMA));
+			}
+			for (int d = 0; d < NUM_LAYERS; d++)
+			{
+				int wrapped = std::min(d, NUM_LAYERS - d);
+				temporalFilter[d] = TEMPORAL_WEIGHT * std::exp(-float(wrapped * wrapped) / (2.0f * TEMPORAL_SIGMA * TEMPORAL_SIGMA));
+			}
+		}
+
+		// Returns the rank of every pixel of every layer, [layer][y * SIZE + x], in [0, NUM_PIXELS)
+		std::vector<std::vector<int>> Generate()
+		{
+			std::vector<std::vector<int>> ranks(NUM_LAYERS, std::vector<int>(NUM_PIXELS, -1));
+
+			// Initial binary pattern: random pixels, relaxed until the tightest cluster and the largest void are the same pixel
+			Reset();
+			const int numInitialPoints = int(INITIAL_PATTERN_DENSITY * NUM_PIXELS);
+			std::uniform_int_distribution<int> randomPixel(0, NUM_PIXELS - 1);
+			for (int layer = 0; layer < NUM_LAYERS; layer++)
+			{
+				int placed = 0;
+				while (placed < numInitialPoints)
+				{
+					int pixel = randomPixel(rng);
+					if (!isSet[layer][pixel])
+					{
+						Insert(layer, pixel);
+						placed++;
+					}
+				}
+			}
+
+			for (int layer = 0; layer < NUM_LAYERS; layer++)
+			{
+				for (int iteration = 0; iteration < NUM_PIXELS; iteration++)
+				{
+					int cluster = FindTightestCluster(layer);
+					Remove(layer, cluster);
+					int largestVoid = FindLargestVoid(layer);
+					Insert(layer, largestVoid);
+					if (largestVoid == cluster)
+					{
+						break;
+					}
+				}
+			}
+
+			std::vector<std::vector<bool>> initialPattern = isSet;
+
+			// Phase 1: ranks below the initial pattern's size, removing tightest clusters
+			for (int rank = numInitialPoints - 1; rank >= 0; rank--)
+			{
+				for (int layer = 0; layer < NUM_LAYERS; layer++)
+				{
+					int cluster = FindTightestCluster(layer);
+					Remove(layer, cluster);
+					ranks[layer][cluster] = rank;
+				}
+			}
+
+			// Phase 2 (and 3): the remaining ranks, filling the largest voids. Ulichney switches to removing the tightest
+			// clusters of the unset pixels once more than half are set; filling voids all the way gives practically
+			// the same threshold maps and keeps this simple
+			Reset();
+			for (int layer = 0; layer < NUM_LAYERS; layer++)
+			{
+				for (int pixel = 0; pixel < NUM_PIXELS; pixel++)
+				{
+					if (initialPattern[layer][pixel])
+					{
+						Insert(layer, pixel);
+					}
+				}
+			}
+
+			for (int rank = numInitialPoints; rank < NUM_PIXELS; rank++)
+			{
+				for (int layer = 0; layer < NUM_LAYERS; layer++)
+				{
+					int largestVoid = FindLargestVoid(layer);
+					Insert(layer, largestVoid);
+					ranks[layer][largestVoid] = rank;
+				}
+			}
+
+			return ranks;
+		}
+
+	private:
+		void Reset()
+		{
+			isSet.assign(NUM_LAYERS, std::vector<bool>(NUM_PIXELS, false));
+			energy.assign(NUM_LAYERS, std::vector<float>(NUM_PIXELS, 0.0f));
+		}
+
+		// Adds (sign = 1) or removes (sign = -1) the energy of a set pixel: spatially within its layer (tiled),
+		// and temporally on the same pixel of the other layers
+		void Splat(int layer, int pixel, float sign)
+		{
+			int px = pixel % SIZE;
+			int py = pixel / SIZE;
+			for (int dy = -SPATIAL_RADIUS; dy <= SPATIAL_RADIUS; dy++)
+			{
+				int y = (py + dy + SIZE) % SIZE;
+				for (int dx = -SPATIAL_RADIUS; dx <= SPATIAL_RADIUS; dx++)
+				{
+					int x = (px + dx + SIZE) % SIZE;
+					energy[layer][y * SIZE + x] += sign * spatialFilter[dx + SPATIAL_RADIUS] * spatialFilter[dy + SPATIAL_RADIUS];
+				}
+			}
+
+			for (int other = 0; other < NUM_LAYERS; other++)
+			{
+				if (other != layer)
+				{
+					energy[other][pixel] += sign * temporalFilter[(other - layer + NUM_LAYERS) % NUM_LAYERS];
+				}
+			}
+		}
+
+		void Insert(int layer, int pixel)
+		{
+			isSet[layer][pixel] = true;
+			Splat(layer, pixel, 1.0f);
+		}
+
+		void Remove(int layer, int pixel)
+		{
+			isSet[layer][pixel] = false;
+			Splat(layer, pixel, -1.0f);
+		}
+
+		int FindTightestCluster(int layer) const
+		{
+			int best = -1;
+			for (int pixel = 0; pixel < NUM_PIXELS; pixel++)
+			{
+				if (isSet[layer][pixel] && (best < 0 || energy[layer][pixel] > energy[layer][best]))
+				{
+					best = pixel;
+				}
+			}
+			return best;
+		}
+
+		int FindLargestVoid(int layer) const
+		{
+			int best = -1;
+			for (int pixel = 0; pixel < NUM_PIXELS; pixel++)
+			{
+				if (!isSet[layer][pixel] && (best < 0 || energy[layer][pixel] < energy[layer][best]))
+				{
+					best = pixel;
+				}
+			}
+			return best;
+		}
+
+		std::mt19937 rng;
+		float spatialFilter[2 * SPATIAL_RADIUS + 1];
+		float temporalFilter[NUM_LAYERS];
+
+		std::vector<std::vector<bool>> isSet;
+		std::vector<std::vector<float>> energy;
+	};
+
+	// Thresholds in [0, 1)
+	std::vector<std::vector<float>> GenerateBlueNoise(unsigned int seed)
+	{
+		VoidAndCluster generator(seed);
+		std::vector<std::vector<int>> ranks = generator.Generate();
+
+		std::vector<std::vector<float>> noise(NUM_LAYERS, std::vector<float>(NUM_PIXELS));
+		for (int layer = 0; layer < NUM_LAYERS; layer++)
+		{
+			for (int pixel = 0; pixel < NUM_PIXELS; pixel++)
+			{
+				noise[layer][pixel] = (float(ranks[layer][pixel]) + 0.5f) / float(NUM_PIXELS);
+			}
+		}
+		return noise;
+	}
+
+	void WriteTextures(const std::string& folder, const std::vector<std::vector<float>>& red, const std::vector<std::vector<float>>& green)
+	{
+		std::vector<uint8_t> pixels(NUM_PIXELS * 4);
+		for (int layer = 0; layer < NUM_LAYERS; layer++)
+		{
+			for (int pixel = 0; pixel < NUM_PIXELS; pixel++)
+			{
+				pixels[pixel * 4 + 0] = uint8_t(red[layer][pixel] * 256.0f);
+				pixels[pixel * 4 + 1] = uint8_t(green[layer][pixel] * 256.0f);
+				pixels[pixel * 4 + 2] = 0;
+				pixels[pixel * 4 + 3] = 255;
+			}
+
+			// Same naming scheme as the other texture sets that are loaded slice by slice, see ImageLoadingUtility
+			std::string path = folder + "BlueNoise(" + std::to_string(layer + 1) + ").png";
+			if (!stbi_write_png(path.c_str(), SIZE, SIZE, 4, pixels.data(), SIZE * 4))
+			{
+				throw std::runtime_error("Failed to write " + path);
+			}
+			std::cout << "Wrote " << path << std::endl;
+		}
+	}
+
+	//--------------------------------------------------------
+	//					ERROR COMPARISON
+	//--------------------------------------------------------
+	/*
+		Models what the ray march does for every pixel: integrate the optical depth along the ray with a fixed number of
+		midpoint steps whose start is offset by a jitter value, then turn it into transmittance. The test image has hard
+		edged cloud layers whose positions along the ray change smoothly across the image, which is exactly what makes
+		a ray march band. The jitter sources compared at the same step count:
+			- Halton:		the same 16 base 3 Halton values for every pixel, cycled per frame (what the ray march used to do,
+							the values were indexed by the frame's pixelID)
+			- White noise:	independent random offsets per pixel and frame
+			- Blue noise:	the generated textures, tiled over the image, one layer per frame
+		Reported per source:
+			- RMSE of a single frame
+			- RMSE after a small Gaussian blur, a stand in for what the eye (and the reprojection/TXAA) sees: blue noise
+			  moves the error to high frequencies where the blur removes it
+			- RMSE of the average of NUM_LAYERS frames, what temporal accumulation converges to
+	*/
+	#define TEST_IMAGE_SIZE 256
+	#define REFERENCE_STEPS 4096
+
+	// Extinction along a ray through the test image: two hard edged layers, their depth changes across the image
+	float testExtinction(float t, int x, int y)
+	{
+		float u = float(x) / TEST_IMAGE_SIZE;
+		float v = float(y) / TEST_IMAGE_SIZE;
+		float extinction = 0.0f;
+
+		float layer1Start = 0.15f + 0.3f * u;
+		float layer1End = layer1Start + 0.1f + 0.2f * v;
+		if (t >= layer1Start && t < layer1End)
+		{
+			extinction += 3.0f;
+		}
+
+		float layer2Start = 0.55f + 0.1f * std::sin(6.0f * v + 3.0f * u);
+		float layer2End = layer2Start + 0.08f;
+		if (t >= layer2Start && t < layer2End)
+		{
+			extinction += 6.0f;
+		}
+		return extinction;
+	}
+
+	float marchTransmittance(int x, int y, int numSteps, float offset)
+	{
+		float stepSize = 1.0f / float(numSteps);
+		float opticalDepth = 0.0f;
+		for (int i = 0; i < numSteps; i++)
+		{
+			float t = (float(i) + offset) * stepSize;
+			opticalDepth += testExtinction(t, x, y) * stepSize;
+		}
+		return std::exp(-opticalDepth);
+	}
+
+	float haltonSequenceAt(int index, int base)
+	{
+		// Same as Scene::HaltonSequenceAt
+		float f = 1.0f;
+		float r = 0.0f;
+		int i = index;
+		while (i > 0)
+		{
+			f = f / float(base);
+			r = r + f * (i % base);
+			i = i / base;
+		}
+		return r;
+	}
+
+	std::vector<float> blur(const std::vector<float>& image)
+	{
+		const int radius = 2;
+		const float sigma = 1.0f;
+		float weights[2 * radius + 1];
+		float weightSum = 0.0f;
+		for (int d = -radius; d <= radius; d++)
+		{
+			weights[d + radius] = std::exp(-float(d * d) / (2.0f * sigma * sigma));
+			weightSum += weights[d + radius];
+		}
+
+		std::vector<float> horizontal(image.size());
+		std::vector<float> result(image.size());
+		for (int y = 0; y < TEST_IMAGE_SIZE; y++)
+		{
+			for (int x = 0; x < TEST_IMAGE_SIZE; x++)
+			{
+				float sum = 0.0f;
+				for (int d = -radius; d <= radius; d++)
+				{
+					int sx = std::min(std::max(x + d, 0), TEST_IMAGE_SIZE - 1);
+					sum += image[y * TEST_IMAGE_SIZE + sx] * weights[d + radius];
+				}
+				horizontal[y * TEST_IMAGE_SIZE + x] = sum / weightSum;
+			}
+		}
+		for (int y = 0; y < TEST_IMAGE_SIZE; y++)
+		{
+			for (int x = 0; x < TEST_IMAGE_SIZE; x++)
+			{
+				float sum = 0.0f;
+				for (int d = -radius; d <= radius; d++)
+				{
+					int sy = std::min(std::max(y + d, 0), TEST_IMAGE_SIZE - 1);
+					sum += horizontal[sy * TEST_IMAGE_SIZE + x] * weights[d + radius];
+				}
+				result[y * TEST_IMAGE_SIZE + x] = sum / weightSum;
+			}
+		}
+		return result;
+	}
+
+	float rmse(const std::vector<float>& a, const std::vector<float>& b)
+	{
+		double sum = 0.0;
+		for (size_t i = 0; i < a.size(); i++)
+		{
+			double difference = double(a[i]) - double(b[i]);
+			sum += difference * difference;
+		}
+		return float(std::sqrt(sum / double(a.size())));
+	}
+
+	enum JitterSource { HALTON, WHITE_NOISE, BLUE_NOISE };
+
+	void CompareJitter()
+	{
+		std::cout << "Generating blue noise..." << std::endl;
+		std::vector<std::vector<float>> blueNoise = GenerateBlueNoise(1);
+
+		const int numPixels = TEST_IMAGE_SIZE * TEST_IMAGE_SIZE;
+		std::vector<float> reference(numPixels);
+		for (int y = 0; y < TEST_IMAGE_SIZE; y++)
+		{
+			for (int x = 0; x < TEST_IMAGE_SIZE; x++)
+			{
+				reference[y * TEST_IMAGE_SIZE + x] = marchTransmittance(x, y, REFERENCE_STEPS, 0.5f);
+			}
+		}
+		std::vector<float> blurredReference = blur(reference);
+
+		std::mt19937 rng(7);
+		std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+		const char* sourceNames[] = { "Halton", "White noise", "Blue noise" };
+		const int stepCounts[] = { 8, 16, 24, 32, 48 };
+
+		std::printf("\n%-6s %-12s %14s %14s %14s\n", "Steps", "Jitter", "RMSE", "Blurred RMSE", "16 frame RMSE");
+		for (int numSteps : stepCounts)
+		{
+			for (int source = HALTON; source <= BLUE_NOISE; source++)
+			{
+				std::vector<float> frame(numPixels);
+				std::vector<float> accumulated(numPixels, 0.0f);
+				float frameError = 0.0f;
+				float blurredFrameError = 0.0f;
+
+				for (int frameIndex = 0; frameIndex < NUM_LAYERS; frameIndex++)
+				{
+					for (int y = 0; y < TEST_IMAGE_SIZE; y++)
+					{
+						for (int x = 0; x < TEST_IMAGE_SIZE; x++)
+						{
+							float offset;
+							if (source == HALTON)
+							{
+								offset = haltonSequenceAt(frameIndex + 1, 3);
+							}
+							else if (source == WHITE_NOISE)
+							{
+								offset = uniform(rng);
+							}
+							else
+							{
+								offset = blueNoise[frameIndex][(y % SIZE) * SIZE + (x % SIZE)];
+							}
+
+							float transmittance = marchTransmittance(x, y, numSteps, offset);
+							frame[y * TEST_IMAGE_SIZE + x] = transmittance;
+							accumulated[y * TEST_IMAGE_SIZE + x] += transmittance / float(NUM_LAYERS);
+						}
+					}
+					frameError += rmse(frame, reference) / float(NUM_LAYERS);
+					blurredFrameError += rmse(blur(frame), blurredReference) / float(NUM_LAYERS);
+				}
+
+				std::printf("%-6d %-12s %14.5f %14.5f %14.5f\n", numSteps, sourceNames[source], frameError, blurredFrameError, rmse(accumulated, reference));
+			}
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		std::cout << "Usage: BlueNoiseGenerator <output folder> | --compare" << std::endl;
+		return 1;
+	}
+
+	try
+	{
+		if (std::strcmp(argv[1], "--compare") == 0)
+		{
+			CompareJitter();
+			return 0;
+		}
+
+		std::string folder = argv[1];
+		if (folder.back() != '/' && folder.back() != '\\')
+		{
+			folder += '/';
+		}
+
+		// Different seeds --> independent noise for the two channels
+		std::vector<std::vector<float>> red = GenerateBlueNoise(1);
+		std::vector<std::vector<float>> green = GenerateBlueNoise(2);
+		WriteTextures(folder, red, green);
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
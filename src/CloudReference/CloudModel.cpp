@@ -0,0 +1,457 @@
+#include "CloudModel.h"
+#include <cmath>
+#include <algorithm>
+
+namespace CloudReference
+{
+	//--------------------------------------------------------
+	//						VIEW
+	//--------------------------------------------------------
+
+	View View::FromCameraUBO(const glm::mat4& view, const glm::vec3& cameraEye, const glm::vec2& tanFovBy2)
+	{
+		View result;
+		result.eye = -cameraEye;
+		result.right = glm::normalize(glm::vec3(view[0][0], view[1][0], view[2][0]));
+		result.up = glm::normalize(glm::vec3(view[0][1], view[1][1], view[2][1]));
+		result.look = -glm::normalize(glm::vec3(view[0][2], view[1][2], view[2][2]));
+		result.tanFovBy2 = tanFovBy2;
+		return result;
+	}
+
+	View View::LookAlong(const glm::vec3& eye, const glm::vec3& direction, float fovy, float aspect)
+	{
+		// The rows glm::lookAt would put into the view matrix
+		View result;
+		result.eye = eye;
+		result.look = glm::normalize(direction);
+		result.right = glm::normalize(glm::cross(result.look, glm::vec3(0.0f, 1.0f, 0.0f)));
+		result.up = glm::cross(result.right, result.look);
+		result.tanFovBy2.y = std::abs(std::tan(fovy * 0.5f * (PI / 180.0f)));
+		result.tanFovBy2.x = aspect * result.tanFovBy2.y;
+		return result;
+	}
+
+	//--------------------------------------------------------
+	//					TOOL BOX FUNCTIONS
+	//--------------------------------------------------------
+
+	float getRelativeHeightInAtmosphere(const glm::vec3& point, const glm::vec3& earthCenter, const glm::vec3& startPosOnInnerShell,
+										const glm::vec3& rayDir, const glm::vec3& eye)
+	{
+		float lengthOfRayfromCamera = glm::length(point - eye);
+		float lengthOfRayToInnerShell = glm::length(startPosOnInnerShell - eye);
+		glm::vec3 pointToEarthDir = glm::normalize(point - earthCenter);
+		// assuming RayDir is normalised
+		float cosTheta = glm::dot(rayDir, pointToEarthDir);
+
+		float numerator = std::abs(cosTheta * (lengthOfRayfromCamera - lengthOfRayToInnerShell));
+		return numerator / ATMOSPHERE_THICKNESS;
+	}
+
+	glm::vec3 getRelativePositionInAtmosphere(const glm::vec3& pos, const glm::vec3& earthCenter)
+	{
+		return (pos - glm::vec3(earthCenter.x, ATMOSPHERE_RADIUS_INNER - EARTH_RADIUS, earthCenter.z)) / ATMOSPHERE_THICKNESS;
+	}
+
+	Ray castRay(const View& view, glm::vec2 screenPoint, glm::vec2 ndcOffset)
+	{
+		Ray r;
+
+		// Compute ndc space point from screenspace point //[-1,1] to [0,1] range
+		glm::vec2 NDC_Space_Point = screenPoint * 2.0f - 1.0f;
+		NDC_Space_Point += ndcOffset;
+
+		//convert to camera space
+		glm::vec3 cam_x = NDC_Space_Point.x * view.tanFovBy2.x * view.right;
+		glm::vec3 cam_y = NDC_Space_Point.y * view.tanFovBy2.y * view.up;
+		//convert to world space
+		glm::vec3 ref = view.eye + view.look;
+		glm::vec3 p = ref + cam_x + cam_y; //facing the screen
+
+		r.origin = view.eye;
+		r.direction = glm::normalize(p - view.eye);
+
+		return r;
+	}
+
+	Intersection raySphereIntersection(glm::vec3 rO, glm::vec3 rD, const glm::vec3& sphereCenter, float sphereRadius)
+	{
+		Intersection isect;
+		isect.valid = false;
+		isect.point = glm::vec3(0.0f);
+		isect.normal = glm::vec3(0.0f, 1.0f, 0.0f);
+		isect.t = 0.0f;
+
+		// Transform Ray such that the spheres move down, such that the camera is close to the sky dome
+		rO -= sphereCenter;
+		rO /= sphereRadius;
+
+		float A = glm::dot(rD, rD);
+		float B = 2.0f * glm::dot(rD, rO);
+		float C = glm::dot(rO, rO) - 1.0f; //uniform sphere
+		float discriminant = B * B - 4.0f * A * C;
+
+		//If the discriminant is negative, then there is no real root
+		if (discriminant < 0.0f)
+		{
+			return isect;
+		}
+
+		float t = (-B - std::sqrt(discriminant)) / (2.0f * A);
+
+		if (t < 0.0f)
+		{
+			t = (-B + std::sqrt(discriminant)) / (2.0f * A);
+		}
+
+		if (t >= 0.0f)
+		{
+			glm::vec3 p = rO + t * rD;
+			isect.valid = true;
+			isect.normal = glm::normalize(p);
+
+			p *= sphereRadius;
+			p += sphereCenter;
+
+			isect.point = p;
+			isect.t = glm::length(p - rO);
+		}
+
+		return isect;
+	}
+
+	//--------------------------------------------------------
+	//						LIGHTING
+	//--------------------------------------------------------
+
+	float HenyeyGreenstein(float cos_angle, float eccentricity)
+	{
+		float numerator = 1.0f - eccentricity * eccentricity;
+		float denominator = std::pow((1.0f + eccentricity * eccentricity - 2.0f * eccentricity * cos_angle), 1.5f);
+		return (numerator / denominator) * ONE_OVER_FOUR_PI;
+	}
+
+	float HGModified(float cos_angle, float eccentricity, float silver_intensity, float silver_spread)
+	{
+		return std::max(HenyeyGreenstein(cos_angle, eccentricity),
+						silver_intensity * HenyeyGreenstein(cos_angle, 0.99f - silver_spread));
+	}
+
+	float GetLightEnergy(float height_fraction, float dl, float ds_loded, float phase_probability, float cos_angle, float /*step_size*/, float brightness)
+	{
+		float primary_attenuation = std::exp(-dl);
+		float secondary_attenuation = std::exp(-dl);
+		float attenuation_probability = std::max(remap(cos_angle, 0.7f, 1.0f, secondary_attenuation, secondary_attenuation * 0.25f),
+												 primary_attenuation);
+
+		float depth_probability = 0.05f + std::pow(ds_loded, glm::clamp(remap(height_fraction * 0.125f, 0.3f, 0.85f, 0.5f, 2.0f), 0.5f, 2.0f));
+		float vertical_probability = std::pow(glm::clamp(remap(height_fraction * 1.5f, 0.07f, 0.34f, 0.1f, 1.0f), 0.1f, 1.0f), 0.8f);
+
+		float in_scatter_probability = depth_probability * vertical_probability;
+
+		float light_energy = attenuation_probability * primary_attenuation * in_scatter_probability * phase_probability * brightness;
+		return light_energy;
+	}
+
+	//--------------------------------------------------------
+	//					CLOUD SAMPLING
+	//--------------------------------------------------------
+
+	glm::vec3 skewSamplePointWithWind(glm::vec3 point, float height_fraction, float time)
+	{
+		//skew in wind direction
+		point += height_fraction * WIND_DIRECTION * CLOUD_TOP_OFFSET * 0.009f;
+
+		//Animate clouds in wind direction and add a small upward bias to the wind direction
+		point += (WIND_DIRECTION + glm::vec3(0.0f, 0.1f, 0.0f)) * CLOUD_SPEED * time;
+		return point;
+	}
+
+	float sampleLowFrequency(const NoiseTextures& textures, const glm::vec3& point)
+	{
+		//Read in the low-frequency Perlin-Worley noises and Worley noises
+		glm::vec4 lowFrequencyNoises = textures.baseShape.Sample(point);
+
+		//Build an FBM out of the low-frequency Worley Noises that are used to add detail to the Low-frequency Perlin Worley noise
+		float lowFrequencyFBM = (lowFrequencyNoises.g * 0.625f) +
+								(lowFrequencyNoises.b * 0.25f) +
+								(lowFrequencyNoises.a * 0.125f);
+		lowFrequencyFBM = glm::clamp(lowFrequencyFBM, 0.0f, 1.0f);
+
+		// Define the base cloud shape by dilating it with the low-frequency FBM
+		float baseCloud = remapClamped(lowFrequencyNoises.r, (lowFrequencyFBM - 0.9f), 1.0f, 0.0f, 1.0f);
+
+		// Cloud coverage, a constant in the shader too (the weather map isn't used)
+		float cloud_coverage = 0.6f;
+
+		// Use remap to apply the cloud coverage attribute.
+		float base_cloud_with_coverage = remapClampedBeforeAndAfter(baseCloud, cloud_coverage, 1.0f, 0.0f, 1.0f);
+
+		// Multiply the result by the cloud coverage attribute so that smaller clouds are lighter
+		base_cloud_with_coverage *= cloud_coverage;
+
+		return base_cloud_with_coverage;
+	}
+
+	float erodeCloudWithHighFrequency(const NoiseTextures& textures, float baseCloud, glm::vec3 point, float height_fraction,
+									  float detailWeight, float curlWeight)
+	{
+		if (detailWeight <= 0.0f)
+		{
+			return baseCloud;
+		}
+
+		// Add turbulence to the bottom of the clouds
+		if (curlWeight > 0.0f)
+		{
+			glm::vec4 curlNoise = textures.curl.Sample(glm::vec2(point.x, point.y));
+			point.x += curlNoise.x * (1.0f - height_fraction) * 0.5f * curlWeight;
+			point.y += curlNoise.y * (1.0f - height_fraction) * 0.5f * curlWeight;
+		}
+
+		// Sample High Frequency Noises
+		glm::vec4 highFrequencyNoise = textures.details.Sample(point);
+
+		// Build High Frequency FBM
+		float high_freq_FBM = (highFrequencyNoise.r * 0.625f) +
+							  (highFrequencyNoise.g * 0.25f) +
+							  (highFrequencyNoise.b * 0.125f);
+
+		//Erode the base shape of the cloud with the distorted high frequency worley noises
+		float high_freq_modifier = glm::clamp(glm::mix(high_freq_FBM, 1.0f - high_freq_FBM, glm::clamp(height_fraction * 2.0f, 0.0f, 1.0f)),
+											  0.0f, 1.0f);
+
+		float final_cloud = remap(baseCloud, high_freq_modifier * 0.005f, 1.0f, 0.0f, 1.0f);
+		return glm::mix(baseCloud, final_cloud, detailWeight);
+	}
+
+	//--------------------------------------------------------
+	//					LEVEL OF DETAIL
+	//--------------------------------------------------------
+
+	float lodFade(const Quality& quality, float distanceKm, float fadeStart, float fadeEnd)
+	{
+		if (quality.lodEnabled == 0)
+		{
+			return 1.0f;
+		}
+		return 1.0f - glm::smoothstep(fadeStart, fadeEnd, distanceKm);
+	}
+
+	float lodStepScale(const Quality& quality, float distanceKm)
+	{
+		if (quality.lodEnabled == 0)
+		{
+			return 1.0f;
+		}
+		return glm::clamp(1.0f + (distanceKm - quality.stepGrowthStartDistance) * quality.stepGrowthPerKm, 1.0f, quality.maxStepScale);
+	}
+
+	int lodLightSamples(const Quality& quality, float distanceKm)
+	{
+		if (quality.lodEnabled == 0 || distanceKm < quality.farLightSampleDistance)
+		{
+			return glm::clamp(quality.nearLightSamples, 1, NUM_CONE_SAMPLES);
+		}
+		return glm::clamp(quality.farLightSamples, 1, NUM_CONE_SAMPLES);
+	}
+
+	//--------------------------------------------------------
+	//					RAY MARCH
+	//--------------------------------------------------------
+
+	void buildConeKernel(const glm::vec3& lightDir, float coneRotation, glm::vec3 kernel[NUM_CONE_SAMPLES])
+	{
+		glm::vec3 maxCompUnitVector;
+		if (std::abs(lightDir[0]) > std::abs(lightDir[1]) && std::abs(lightDir[0]) > std::abs(lightDir[2]))
+		{
+			maxCompUnitVector = glm::vec3(std::abs(lightDir[0]), 0.0f, 0.0f);
+		}
+		else if (std::abs(lightDir[1]) > std::abs(lightDir[0]) && std::abs(lightDir[1]) > std::abs(lightDir[2]))
+		{
+			maxCompUnitVector = glm::vec3(0.0f, std::abs(lightDir[1]), 0.0f);
+		}
+		else
+		{
+			maxCompUnitVector = glm::vec3(0.0f, 0.0f, std::abs(lightDir[2]));
+		}
+
+		glm::vec3 zComponent = glm::cross(lightDir, maxCompUnitVector);
+		glm::vec3 xComponent = glm::cross(zComponent, lightDir);
+
+		const float coneAngle = coneRotation * 2.0f * PI;
+		const float cosCone = std::cos(coneAngle);
+		const float sinCone = std::sin(coneAngle);
+		glm::mat3 coneRotationMatrix = glm::mat3(cosCone, 0.0f, -sinCone,
+												 0.0f, 1.0f, 0.0f,
+												 sinCone, 0.0f, cosCone);
+		glm::mat3 sunRotMatrix = glm::mat3(xComponent, lightDir, zComponent) * coneRotationMatrix;
+
+		kernel[0] = sunRotMatrix * glm::vec3(0.1f, 0.25f, -0.15f);
+		kernel[1] = sunRotMatrix * glm::vec3(0.2f, 0.5f, 0.2f);
+		kernel[2] = sunRotMatrix * glm::vec3(-0.2f, 0.1f, -0.1f);
+		kernel[3] = sunRotMatrix * glm::vec3(-0.05f, 0.75f, 0.05f);
+		kernel[4] = sunRotMatrix * glm::vec3(-0.1f, 1.0f, 0.0f);
+		kernel[5] = sunRotMatrix * glm::vec3(0.0f, 3.0f, 0.0f);	// One sample should be at distance 3x cone length
+	}
+
+	MarchResult rayMarch(const NoiseTextures& textures, const MarchParameters& parameters, const Ray& ray, const glm::vec3& earthCenter,
+						 const glm::vec3& startPos, float start_t, float end_t)
+	{
+		const Quality& quality = parameters.quality;
+		float _dot = glm::dot(ray.direction, glm::vec3(0.0f, 1.0f, 0.0f));
+
+		const float maxSteps = std::floor(glm::mix(quality.minMarchSteps, quality.maxMarchSteps, 1.0f - _dot));
+		const float atmosphereThickness = (end_t - start_t);
+		const float stepSize = (atmosphereThickness / maxSteps);
+		float transmittance = 1.0f;
+
+		float returnColor = 0.0f;
+		float density = 0.0f;
+
+		// Henyey-Greenstein
+		const glm::vec3 lightDir = glm::normalize(parameters.sunDirection);
+		const float cos_angle = glm::dot(glm::normalize(ray.direction), lightDir);
+		const float HG_light = HGModified(cos_angle, HG_ECCENTRICITY, HG_SILVER_INTENSITY, HG_SILVER_SPREAD);
+
+		glm::vec3 noise_kernel[NUM_CONE_SAMPLES];
+		buildConeKernel(lightDir, parameters.coneRotation, noise_kernel);
+
+		MarchResult result;
+		result.firstHit_t = -1.0f;
+		result.saturation_t = -1.0f;
+
+		// Offset all steps by a fraction of a step
+		const float march_start_t = start_t + parameters.stepOffset * stepSize;
+
+		float stepScale = 1.0f;
+		for (float t = march_start_t; t < end_t; t += stepSize * stepScale)
+		{
+			// Level of detail for this sample
+			const float distanceKm = t * METERS_TO_KM;
+			stepScale = lodStepScale(quality, distanceKm);
+			const float detailWeight = lodFade(quality, distanceKm, quality.detailFadeStartDistance, quality.detailFadeEndDistance);
+			const float curlWeight = lodFade(quality, distanceKm, quality.curlFadeStartDistance, quality.curlFadeEndDistance);
+
+			glm::vec3 pos = ray.origin + t * ray.direction;
+			glm::vec3 samplePoint = getRelativePositionInAtmosphere(pos, earthCenter);
+			samplePoint /= 8.0f; //controls the frequency of how we are sampling the noise texture
+
+			float relativeHeight = getRelativeHeightInAtmosphere(pos, earthCenter, startPos, ray.direction, ray.origin);
+			glm::vec3 skewedSamplePoint = skewSamplePointWithWind(samplePoint, relativeHeight, parameters.time);
+
+			float baseDensity = sampleLowFrequency(textures, skewedSamplePoint) * BASE_DENSITY_FACTOR;
+
+			if (baseDensity > 0.0f)
+			{
+				if (result.firstHit_t < 0.0f)
+				{
+					result.firstHit_t = t;
+				}
+
+				float highFreqDensity = erodeCloudWithHighFrequency(textures, baseDensity * 1.4f, skewedSamplePoint, relativeHeight,
+																	detailWeight, curlWeight);
+				density += highFreqDensity * (0.5f * stepScale);
+
+				// Lighting calculations with cone sampling, all samples every step
+				float densityAlongLight = 0.0f;
+				int light_samples = lodLightSamples(quality, distanceKm);
+				for (int i = 0; i < light_samples; ++i)
+				{
+					// With fewer samples than the kernel has, keep the long distance sample (the last one) and drop the ones before it
+					int kernelIndex = (i == light_samples - 1) ? (NUM_CONE_SAMPLES - 1) : i;
+
+					glm::vec3 lightPos = pos + (stepSize * noise_kernel[kernelIndex] * float(kernelIndex));
+					glm::vec3 sampleLightPos = getRelativePositionInAtmosphere(lightPos, earthCenter);
+
+					float currBaseLightDensity = sampleLowFrequency(textures, sampleLightPos);
+					if (currBaseLightDensity > 0.0f)
+					{
+						float currLightDensity = erodeCloudWithHighFrequency(textures, 1.5f * currBaseLightDensity, skewedSamplePoint, relativeHeight,
+																			 detailWeight, curlWeight);
+						densityAlongLight += currLightDensity;
+					}
+				}
+				// Dropped samples would have added density too
+				densityAlongLight *= float(NUM_CONE_SAMPLES) / float(light_samples);
+
+				float totalLightEnergy = GetLightEnergy(relativeHeight, densityAlongLight, baseDensity, HG_light, cos_angle, stepSize, LIGHT_BRIGHTNESS);
+				transmittance = glm::mix(transmittance, totalLightEnergy, (1.0f - density));
+				returnColor += transmittance * stepScale;
+			}
+
+			if (density >= 1.0f)
+			{
+				density = 1.0f;
+				result.saturation_t = t;
+				break;
+			}
+		}
+
+		result.lightEnergy = returnColor;
+		result.density = density;
+		return result;
+	}
+
+	//--------------------------------------------------------
+	//						PIXEL
+	//--------------------------------------------------------
+
+	PixelRay setupPixelRay(const View& view, int pixelX, int pixelY, int width, int height)
+	{
+		PixelRay pixelRay;
+
+		glm::vec2 uv = glm::vec2(float(pixelX), float(pixelY)) / glm::vec2(float(width), float(height));
+		uv.y = 1.0f - uv.y; //cause vulkan inverts y compared to openGL
+		pixelRay.ray = castRay(view, uv);
+
+		const float _dot = glm::dot(glm::vec3(0.0f, 1.0f, 0.0f), pixelRay.ray.direction);
+		pixelRay.march = (_dot >= CLOUD_FADE_OUT_POINT);
+		pixelRay.horizonFade = glm::smoothstep(0.0f, 1.0f, std::min(1.0f, remap(pixelRay.ray.direction.y, CLOUD_FADE_OUT_POINT, 0.2f, 0.0f, 1.0f)));
+
+		pixelRay.earthCenter = view.eye;
+		pixelRay.earthCenter.y = -EARTH_RADIUS; //move earth below camera
+		if (pixelRay.march)
+		{
+			pixelRay.atmosphereInnerIsect = raySphereIntersection(pixelRay.ray.origin, pixelRay.ray.direction, pixelRay.earthCenter, ATMOSPHERE_RADIUS_INNER);
+			Intersection atmosphereOuterIsect = raySphereIntersection(pixelRay.ray.origin, pixelRay.ray.direction, pixelRay.earthCenter, ATMOSPHERE_RADIUS_OUTER);
+			pixelRay.start_t = pixelRay.atmosphereInnerIsect.t;
+			pixelRay.end_t = atmosphereOuterIsect.t;
+		}
+		else
+		{
+			pixelRay.atmosphereInnerIsect = Intersection();
+			pixelRay.start_t = pixelRay.end_t = 0.0f;
+		}
+
+		return pixelRay;
+	}
+
+	CloudPixel finishPixel(const PixelRay& pixelRay, const MarchResult& result)
+	{
+		CloudPixel pixel = { 0.0f, 0.0f, -1.0f };
+		if (!pixelRay.march)
+		{
+			return pixel;
+		}
+
+		pixel.lightEnergy = result.lightEnergy;
+		pixel.coverage = result.density * pixelRay.horizonFade;
+		pixel.firstHitKm = (result.firstHit_t >= 0.0f) ? result.firstHit_t * METERS_TO_KM : -1.0f;
+		return pixel;
+	}
+
+	CloudPixel shadePixel(const NoiseTextures& textures, const MarchParameters& parameters, const View& view,
+						  int pixelX, int pixelY, int width, int height)
+	{
+		const PixelRay pixelRay = setupPixelRay(view, pixelX, pixelY, width, height);
+		MarchResult result = {};
+		if (pixelRay.march)
+		{
+			result = rayMarch(textures, parameters, pixelRay.ray, pixelRay.earthCenter,
+							  pixelRay.atmosphereInnerIsect.point, pixelRay.start_t, pixelRay.end_t);
+		}
+		return finishPixel(pixelRay, result);
+	}
+}
@@ -0,0 +1,213 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include "NoiseTextures.h"
+
+/*
+	Scalar C++ port of the cloud model in cloudRayMarch.glsl: the functions keep the names, arguments and the order of
+	the arithmetic of their GLSL counterparts so that the two can be compared side by side, and changes to the shader
+	are easy to carry over. The float (not RAY_MARCH_FP16) variant of the shader is the one reproduced.
+
+	Everything that needs the GPU's per frame state is left out, the reference always does a full, converged march:
+	- no ray-start hints and no light history: every march covers the whole cloud layer and evaluates all cone light samples
+	- no halton jitter of the ray and no blue noise: the step offset and the cone rotation are fixed (MarchParameters)
+	- no horizon band and no scene depth
+	- no atmosphere: the sky, the sun color and the aerial perspective come from LUTs that only exist on the GPU, so the
+	  result is the grey light energy of the ray march and the cloud coverage, before they are composited over the sky
+*/
+
+//Global Defines for math constants
+#define PI 3.14159265f
+#define ONE_OVER_FOUR_PI 0.07957747154594767f
+
+//Global Defines for Earth and Cloud Layers
+#define EARTH_RADIUS 6371000.0f
+#define ATMOSPHERE_RADIUS_INNER (EARTH_RADIUS + 7500.0f)
+#define ATMOSPHERE_RADIUS_OUTER (EARTH_RADIUS + 20000.0f)
+#define ATMOSPHERE_THICKNESS (ATMOSPHERE_RADIUS_OUTER - ATMOSPHERE_RADIUS_INNER)
+
+#define METERS_TO_KM 0.001f
+
+// Clouds fade in above this y of the view direction, below it only the sky is drawn
+#define CLOUD_FADE_OUT_POINT 0.06f
+
+// Global Wind Defines
+#define WIND_DIRECTION glm::vec3(1.0f, 0.0f, 0.0f)
+#define CLOUD_SPEED 0.080f
+#define CLOUD_TOP_OFFSET 1.0f
+
+// Cone light sampling
+#define NUM_CONE_SAMPLES 6
+
+// Constants of rayMarch
+#define BASE_DENSITY_FACTOR 0.380f
+#define LIGHT_BRIGHTNESS 5.0f
+#define HG_ECCENTRICITY 0.6f
+#define HG_SILVER_INTENSITY 0.7f
+#define HG_SILVER_SPREAD 0.1f
+
+namespace CloudReference
+{
+	struct Ray
+	{
+		glm::vec3 origin;
+		glm::vec3 direction;
+	};
+
+	struct Intersection
+	{
+		glm::vec3 normal;
+		glm::vec3 point;
+		bool valid;
+		float t;
+	};
+
+	// Quality parameters of the ray march, the subset of CloudQuality (Sky.h) the ray march uses, with the same defaults
+	struct Quality
+	{
+		int lodEnabled = 1;
+		float stepGrowthStartDistance = 20.0f;
+		float stepGrowthPerKm = 0.04f;
+		float maxStepScale = 4.0f;
+		float detailFadeStartDistance = 30.0f;
+		float detailFadeEndDistance = 60.0f;
+		float curlFadeStartDistance = 15.0f;
+		float curlFadeEndDistance = 40.0f;
+		float farLightSampleDistance = 40.0f;
+		int nearLightSamples = 6;
+		int farLightSamples = 3;
+		float minMarchSteps = 24.0f;
+		float maxMarchSteps = 40.0f;
+	};
+
+	// Everything a ray march depends on besides the ray
+	struct MarchParameters
+	{
+		Quality quality;
+		glm::vec3 sunDirection = glm::vec3(0.0f, 1.0f, 0.0f);	// towards the sun, as SunAndSky::sunDirection (normalized here)
+		float time = 0.0f;				// seconds, moves the clouds with the wind (time.y in TimeUBO)
+		float stepOffset = 0.5f;		// fraction of a step every step is offset by, blue noise r on the GPU
+		float coneRotation = 0.0f;		// fraction of a turn the light sample cone is rotated by, blue noise g on the GPU
+	};
+
+	// The camera as castRay sees it
+	struct View
+	{
+		glm::vec3 eye;
+		glm::vec3 right;
+		glm::vec3 up;
+		glm::vec3 look;
+		glm::vec2 tanFovBy2;
+
+		// From the CameraUBO contents: the shader takes the axes from the rows of the view matrix and negates camera.eye
+		static View FromCameraUBO(const glm::mat4& view, const glm::vec3& cameraEye, const glm::vec2& tanFovBy2);
+		// A camera at 'eye' (world space, as the shader uses it) looking along 'direction' with y up.
+		// Vertical field of view in degrees, the horizontal one follows from the aspect ratio as in Camera
+		static View LookAlong(const glm::vec3& eye, const glm::vec3& direction, float fovy, float aspect);
+	};
+
+	struct MarchResult
+	{
+		float lightEnergy;		// the (grey) color the ray march returns
+		float density;			// accumDensity, the cloud coverage of the ray before the horizon fade
+		float firstHit_t;		// negative if the ray found no cloud
+		float saturation_t;		// negative if the ray never became opaque
+	};
+
+	// One pixel of the reference image
+	struct CloudPixel
+	{
+		float lightEnergy;		// ray march result, before the sun color and the aerial perspective
+		float coverage;			// alpha of currentFrameResultImage: accumDensity with the horizon fade
+		float firstHitKm;		// distance to the first cloud sample, negative if there is none
+	};
+
+	// What main() decides about a pixel before it ray marches it
+	struct PixelRay
+	{
+		Ray ray;
+		bool march;					// false below the horizon and close to it, no clouds there
+		glm::vec3 earthCenter;
+		Intersection atmosphereInnerIsect;
+		float start_t;
+		float end_t;
+		float horizonFade;			// the smoothstep the coverage is faded into the horizon with
+	};
+
+	//--------------------------------------------------------
+	//					TOOL BOX FUNCTIONS
+	//--------------------------------------------------------
+
+	inline float remap(float value, float original_min, float original_max, float new_min, float new_max)
+	{
+		return new_min + (((value - original_min) / (original_max - original_min)) * (new_max - new_min));
+	}
+
+	inline float remapClamped(float value, float original_min, float original_max, float new_min, float new_max)
+	{
+		float t = new_min + (((value - original_min) / (original_max - original_min)) * (new_max - new_min));
+		return glm::clamp(t, new_min, new_max);
+	}
+
+	inline float remapClampedBeforeAndAfter(float value, float original_min, float original_max, float new_min, float new_max)
+	{
+		value = glm::clamp(value, original_min, original_max);
+		float t = new_min + (((value - original_min) / (original_max - original_min)) * (new_max - new_min));
+		return glm::clamp(t, new_min, new_max);
+	}
+
+	float getRelativeHeightInAtmosphere(const glm::vec3& point, const glm::vec3& earthCenter, const glm::vec3& startPosOnInnerShell,
+										const glm::vec3& rayDir, const glm::vec3& eye);
+	glm::vec3 getRelativePositionInAtmosphere(const glm::vec3& pos, const glm::vec3& earthCenter);
+
+	// Without the halton jitter unless 'ndcOffset' adds one
+	Ray castRay(const View& view, glm::vec2 screenPoint, glm::vec2 ndcOffset = glm::vec2(0.0f));
+
+	// Reproduces the shader exactly, including t being measured from the transformed origin
+	Intersection raySphereIntersection(glm::vec3 rO, glm::vec3 rD, const glm::vec3& sphereCenter, float sphereRadius);
+
+	//--------------------------------------------------------
+	//						LIGHTING
+	//--------------------------------------------------------
+
+	float HenyeyGreenstein(float cos_angle, float eccentricity);
+	float HGModified(float cos_angle, float eccentricity, float silver_intensity, float silver_spread);
+	float GetLightEnergy(float height_fraction, float dl, float ds_loded, float phase_probability, float cos_angle, float step_size, float brightness);
+
+	//--------------------------------------------------------
+	//					CLOUD SAMPLING
+	//--------------------------------------------------------
+
+	glm::vec3 skewSamplePointWithWind(glm::vec3 point, float height_fraction, float time);
+	float sampleLowFrequency(const NoiseTextures& textures, const glm::vec3& point);
+	float erodeCloudWithHighFrequency(const NoiseTextures& textures, float baseCloud, glm::vec3 point, float height_fraction,
+									  float detailWeight, float curlWeight);
+
+	//--------------------------------------------------------
+	//					LEVEL OF DETAIL
+	//--------------------------------------------------------
+
+	float lodFade(const Quality& quality, float distanceKm, float fadeStart, float fadeEnd);
+	float lodStepScale(const Quality& quality, float distanceKm);
+	int lodLightSamples(const Quality& quality, float distanceKm);
+
+	//--------------------------------------------------------
+	//					RAY MARCH
+	//--------------------------------------------------------
+
+	// The cone of light sample offsets (noise_kernel in rayMarch), turned towards the sun and rotated around it
+	void buildConeKernel(const glm::vec3& lightDir, float coneRotation, glm::vec3 kernel[NUM_CONE_SAMPLES]);
+
+	// rayMarch over the whole cloud layer [start_t, end_t)
+	MarchResult rayMarch(const NoiseTextures& textures, const MarchParameters& parameters, const Ray& ray, const glm::vec3& earthCenter,
+						 const glm::vec3& startPos, float start_t, float end_t);
+
+	// The first part of main(): the pixel's ray, whether it can see clouds and where the cloud layer is along it
+	PixelRay setupPixelRay(const View& view, int pixelX, int pixelY, int width, int height);
+	// The last part of main(): the horizon fade of the coverage. Pixels that weren't ray marched get no clouds
+	CloudPixel finishPixel(const PixelRay& pixelRay, const MarchResult& result);
+
+	// setupPixelRay, rayMarch and finishPixel for one pixel
+	CloudPixel shadePixel(const NoiseTextures& textures, const MarchParameters& parameters, const View& view,
+						  int pixelX, int pixelY, int width, int height);
+}
@@ -0,0 +1,249 @@
+// Renders the clouds with the CPU reference renderer (see CpuCloudRenderer.h) and reports the throughput in rays per
+// second per core. Runs from bin/ like the renderer, so the default texture folder is the one Sky::CreateCloudResources uses.
+//
+// Usage:
+//		CloudReferenceRender [options]
+//			--textures <folder>			cloud noise textures, default ../../src/CloudScapes/textures/CloudTextures/
+//			--size <width> <height>		default 640 360
+//			--threads <n>				default: one per hardware thread
+//			--pitch <degrees>			camera pitch above the horizon, default 30
+//			--yaw <degrees>				camera heading, 0 looks along -z (towards the default sun), default 0
+//			--sun <elevation> <azimuth>	in radians like Sky::MoveSun, default 0.26 0
+//			--time <seconds>			wind animation time, default 0
+//			--scalar					one ray at a time instead of packets
+//			--compare					render with packets and scalar, report the speedup and the largest difference
+//			--output <file.png>			writes the clouds (light energy times coverage, over black)
+//
+//		Progressive accumulation of a high quality still (see ProgressiveRenderer.h), with the step counts and light
+//		samples of OfflineQuality unless --steps changes them. Reports the time until the error was low enough:
+//			--accumulate <passes>		accumulate up to this many passes
+//			--error <levels>			stop once the error is below this many levels of 255, default 0.5, 0 --> all passes
+//			--min-passes <n>			passes before the error is trusted, default 16
+//			--seed <n>					of the random step offsets and cone rotations, default 1
+//			--steps <min> <max>			ray march steps straight up and towards the horizon
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+#include "CpuCloudRenderer.h"
+#include "ProgressiveRenderer.h"
+
+#define STB_IMAGE_WRITE_STATIC
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "../../external/stb_image_write.h"
+
+namespace
+{
+	void WritePNG(const std::string& path, const std::vector<CloudReference::CloudPixel>& image, int width, int height)
+	{
+		std::vector<uint8_t> pixels(size_t(width) * height * 4);
+		for (size_t i = 0; i < image.size(); i++)
+		{
+			// The light energy is unbounded, squash it for viewing
+			const float display = CloudReference::DisplayValue(image[i].lightEnergy, image[i].coverage);
+			const uint8_t value = static_cast<uint8_t>(std::min(255.0f, display * 255.0f + 0.5f));
+			pixels[i * 4 + 0] = value;
+			pixels[i * 4 + 1] = value;
+			pixels[i * 4 + 2] = value;
+			pixels[i * 4 + 3] = 255;
+		}
+
+		if (!stbi_write_png(path.c_str(), width, height, 4, pixels.data(), width * 4)) {
+			throw std::runtime_error("failed to write " + path);
+		}
+	}
+
+	float ToRadians(float degrees)
+	{
+		return degrees * (PI / 180.0f);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	std::string textureFolder = "../../src/CloudScapes/textures/CloudTextures/";
+	std::string outputPath;
+	uint32_t threads = 0;
+	float pitch = 30.0f;
+	float yaw = 0.0f;
+	float sunElevation = 0.26f;
+	float sunAzimuth = 0.0f;
+	bool compare = false;
+	bool accumulate = false;
+	bool customSteps = false;
+	float minSteps = 0.0f;
+	float maxSteps = 0.0f;
+
+	CloudReference::RenderSettings settings;
+	CloudReference::AccumulationSettings accumulation;
+
+	for (int i = 1; i < argc; i++)
+	{
+		const std::string arg = argv[i];
+		const bool hasValue = (i + 1 < argc);
+		const bool hasTwoValues = (i + 2 < argc);
+
+		if (arg == "--textures" && hasValue) {
+			textureFolder = argv[++i];
+		}
+		else if (arg == "--size" && hasTwoValues) {
+			settings.width = static_cast<uint32_t>(std::atoi(argv[++i]));
+			settings.height = static_cast<uint32_t>(std::atoi(argv[++i]));
+		}
+		else if (arg == "--threads" && hasValue) {
+			threads = static_cast<uint32_t>(std::atoi(argv[++i]));
+		}
+		else if (arg == "--pitch" && hasValue) {
+			pitch = float(std::atof(argv[++i]));
+		}
+		else if (arg == "--yaw" && hasValue) {
+			yaw = float(std::atof(argv[++i]));
+		}
+		else if (arg == "--sun" && hasTwoValues) {
+			sunElevation = float(std::atof(argv[++i]));
+			sunAzimuth = float(std::atof(argv[++i]));
+		}
+		else if (arg == "--time" && hasValue) {
+			settings.march.time = float(std::atof(argv[++i]));
+		}
+		else if (arg == "--scalar") {
+			settings.packets = false;
+		}
+		else if (arg == "--compare") {
+			compare = true;
+		}
+		else if (arg == "--output" && hasValue) {
+			outputPath = argv[++i];
+		}
+		else if (arg == "--accumulate" && hasValue) {
+			accumulate = true;
+			accumulation.maxPasses = static_cast<uint32_t>(std::atoi(argv[++i]));
+		}
+		else if (arg == "--error" && hasValue) {
+			accumulation.errorThreshold = float(std::atof(argv[++i])) / 255.0f;
+		}
+		else if (arg == "--min-passes" && hasValue) {
+			accumulation.minPasses = static_cast<uint32_t>(std::atoi(argv[++i]));
+		}
+		else if (arg == "--seed" && hasValue) {
+			accumulation.seed = static_cast<uint32_t>(std::atoi(argv[++i]));
+		}
+		else if (arg == "--steps" && hasTwoValues) {
+			customSteps = true;
+			minSteps = float(std::atof(argv[++i]));
+			maxSteps = float(std::atof(argv[++i]));
+		}
+		else
+		{
+			std::cout << "Usage: CloudReferenceRender [--textures <folder>] [--size <width> <height>] [--threads <n>] [--pitch <degrees>] "
+						 "[--yaw <degrees>] [--sun <elevation> <azimuth>] [--time <seconds>] [--scalar] [--compare] [--output <file.png>] "
+						 "[--accumulate <passes>] [--error <levels>] [--min-passes <n>] [--seed <n>] [--steps <min> <max>]" << std::endl;
+			return 1;
+		}
+	}
+
+	try
+	{
+		if (settings.width == 0 || settings.height == 0) {
+			throw std::runtime_error("the image size has to be at least 1x1");
+		}
+		if (textureFolder.back() != '/' && textureFolder.back() != '\\') {
+			textureFolder += '/';
+		}
+		if (accumulate && compare) {
+			throw std::runtime_error("--compare can't be combined with --accumulate");
+		}
+
+		if (accumulate) {
+			settings.march.quality = CloudReference::OfflineQuality();
+		}
+		if (customSteps)
+		{
+			if (minSteps < 1.0f || maxSteps < 1.0f) {
+				throw std::runtime_error("--steps needs at least one step");
+			}
+			settings.march.quality.minMarchSteps = minSteps;
+			settings.march.quality.maxMarchSteps = maxSteps;
+		}
+
+		const glm::vec3 direction(std::cos(ToRadians(pitch)) * std::sin(ToRadians(yaw)), std::sin(ToRadians(pitch)),
+								  -std::cos(ToRadians(pitch)) * std::cos(ToRadians(yaw)));
+		// Camera's default eye, negated like the shader does
+		settings.view = CloudReference::View::LookAlong(glm::vec3(0.0f, 0.0f, -2.0f), direction, 45.0f,
+														float(settings.width) / float(settings.height));
+		// Same convention as Sky::UpdateSunAndSky
+		settings.march.sunDirection = glm::vec3(std::cos(sunElevation) * std::sin(sunAzimuth), std::sin(sunElevation),
+												-std::cos(sunElevation) * std::cos(sunAzimuth));
+
+		CloudReference::NoiseTextures textures;
+		textures.Load(textureFolder);
+
+		CloudReference::CpuCloudRenderer renderer(textures, threads);
+		std::vector<CloudReference::CloudPixel> image;
+
+		if (accumulate)
+		{
+			// Progress at every power of two passes
+			CloudReference::ProgressiveRenderer progressive(renderer);
+			const CloudReference::AccumulationStats stats = progressive.Render(settings, accumulation, image,
+				[](const CloudReference::AccumulationStats& passStats)
+				{
+					if ((passStats.passes & (passStats.passes - 1)) == 0) {
+						std::cout << passStats.Describe() << std::endl;
+					}
+				});
+
+			std::cout << stats.Describe() << std::endl;
+			if (stats.converged) {
+				std::printf("Converged after %u passes in %.3f s\n", stats.passes, stats.seconds);
+			}
+			else {
+				std::printf("Not converged after %u passes in %.3f s, error %.2f of 255 (threshold %.2f)\n", stats.passes, stats.seconds,
+							stats.error * 255.0, accumulation.errorThreshold * 255.0f);
+			}
+		}
+		else
+		{
+			const CloudReference::RenderStats stats = renderer.Render(settings, image);
+			std::cout << stats.Describe() << std::endl;
+
+			if (compare)
+			{
+				CloudReference::RenderSettings otherSettings = settings;
+				otherSettings.packets = !settings.packets;
+				std::vector<CloudReference::CloudPixel> otherImage;
+				const CloudReference::RenderStats otherStats = renderer.Render(otherSettings, otherImage);
+				std::cout << otherStats.Describe() << std::endl;
+
+				float maxEnergyDifference = 0.0f;
+				float maxCoverageDifference = 0.0f;
+				for (size_t i = 0; i < image.size(); i++)
+				{
+					maxEnergyDifference = std::max(maxEnergyDifference, std::abs(image[i].lightEnergy - otherImage[i].lightEnergy));
+					maxCoverageDifference = std::max(maxCoverageDifference, std::abs(image[i].coverage - otherImage[i].coverage));
+				}
+
+				const double packetRate = settings.packets ? stats.RaysPerSecondPerCore() : otherStats.RaysPerSecondPerCore();
+				const double scalarRate = settings.packets ? otherStats.RaysPerSecondPerCore() : stats.RaysPerSecondPerCore();
+				std::printf("Packets vs. scalar: %.2fx, largest difference: light energy %g, coverage %g\n",
+							(scalarRate > 0.0) ? packetRate / scalarRate : 0.0, maxEnergyDifference, maxCoverageDifference);
+			}
+		}
+
+		if (!outputPath.empty()) {
+			WritePNG(outputPath, image, int(settings.width), int(settings.height));
+		}
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,224 @@
+// Renders huge stills (16K, 32K panoramas) with the CPU reference renderer, split into tiles that worker processes on
+// this machine or others render (see TileCoordinator.h). The coordinator streams the image into a PNG without holding
+// it in memory. Runs from bin/ like the renderer, so the default texture folder is the one Sky::CreateCloudResources uses.
+//
+// Usage:
+//		CloudReferenceTiles coordinator [options] --output <file.png>
+//			--port <port>				workers connect here, default 5187
+//			--size <width> <height>		default 16384 4096
+//			--tile <width> <height>		default 256 256
+//			--bands <n>					rows of tiles rendered ahead of the ones written, default 2
+//			--tile-timeout <seconds>	a worker that takes longer for a tile is dropped and the tile handed out again,
+//										0 for no limit, default 600
+//			--pitch <degrees>			camera pitch above the horizon, default 30
+//			--yaw <degrees>				camera heading, 0 looks along -z (towards the default sun), default 0
+//			--fov <degrees>				vertical field of view, default 45, the horizontal one follows from the size
+//			--sun <elevation> <azimuth>	in radians like Sky::MoveSun, default 0.26 0
+//			--time <seconds>			wind animation time, default 0
+//			--passes <n>				progressive accumulation of n passes per tile with OfflineQuality, default 1
+//			--seed <n>					of the accumulation, default 1
+//
+//		CloudReferenceTiles worker [options]
+//			--connect <host> <port>		the coordinator, default localhost 5187
+//			--textures <folder>			cloud noise textures, default ../../src/CloudScapes/textures/CloudTextures/
+//			--threads <n>				default: one per hardware thread
+//
+// Start the coordinator, then any number of workers; workers can join and leave while the image renders.
+
+#include <cmath>
+#include <cstdlib>
+#include <string>
+#include <iostream>
+#include <stdexcept>
+#include "TileCoordinator.h"
+#include "TileWorker.h"
+#include "ProgressiveRenderer.h"
+
+#define DEFAULT_PORT 5187
+
+namespace
+{
+	float ToRadians(float degrees)
+	{
+		return degrees * (PI / 180.0f);
+	}
+
+	void PrintUsage()
+	{
+		std::cout << "Usage: CloudReferenceTiles coordinator [--port <port>] [--size <width> <height>] [--tile <width> <height>] [--bands <n>] "
+					 "[--tile-timeout <seconds>] [--pitch <degrees>] [--yaw <degrees>] [--fov <degrees>] [--sun <elevation> <azimuth>] [--time <seconds>] "
+					 "[--passes <n>] [--seed <n>] --output <file.png>\n"
+					 "       CloudReferenceTiles worker [--connect <host> <port>] [--textures <folder>] [--threads <n>]" << std::endl;
+	}
+
+	int RunCoordinator(int argc, char** argv)
+	{
+		std::string outputPath;
+		uint16_t port = DEFAULT_PORT;
+		float pitch = 30.0f;	// the camera defaults are CloudReferenceRender's, so both render the same image without options
+		float yaw = 0.0f;
+		float fov = 45.0f;
+		float sunElevation = 0.26f;
+		float sunAzimuth = 0.0f;
+
+		CloudReference::TiledImageSettings settings;
+		settings.render.width = 16384;
+		settings.render.height = 4096;
+
+		for (int i = 2; i < argc; i++)
+		{
+			const std::string arg = argv[i];
+			const bool hasValue = (i + 1 < argc);
+			const bool hasTwoValues = (i + 2 < argc);
+
+			if (arg == "--port" && hasValue) {
+				port = static_cast<uint16_t>(std::atoi(argv[++i]));
+			}
+			else if (arg == "--size" && hasTwoValues) {
+				settings.render.width = static_cast<uint32_t>(std::atoi(argv[++i]));
+				settings.render.height = static_cast<uint32_t>(std::atoi(argv[++i]));
+			}
+			else if (arg == "--tile" && hasTwoValues) {
+				settings.tileWidth = static_cast<uint32_t>(std::atoi(argv[++i]));
+				settings.tileHeight = static_cast<uint32_t>(std::atoi(argv[++i]));
+			}
+			else if (arg == "--bands" && hasValue) {
+				settings.maxBandsInFlight = static_cast<uint32_t>(std::atoi(argv[++i]));
+			}
+			else if (arg == "--tile-timeout" && hasValue) {
+				settings.tileTimeoutSeconds = std::atof(argv[++i]);
+			}
+			else if (arg == "--pitch" && hasValue) {
+				pitch = float(std::atof(argv[++i]));
+			}
+			else if (arg == "--yaw" && hasValue) {
+				yaw = float(std::atof(argv[++i]));
+			}
+			else if (arg == "--fov" && hasValue) {
+				fov = float(std::atof(argv[++i]));
+			}
+			else if (arg == "--sun" && hasTwoValues) {
+				sunElevation = float(std::atof(argv[++i]));
+				sunAzimuth = float(std::atof(argv[++i]));
+			}
+			else if (arg == "--time" && hasValue) {
+				settings.render.march.time = float(std::atof(argv[++i]));
+			}
+			else if (arg == "--passes" && hasValue) {
+				settings.passes = static_cast<uint32_t>(std::atoi(argv[++i]));
+			}
+			else if (arg == "--seed" && hasValue) {
+				settings.seed = static_cast<uint32_t>(std::atoi(argv[++i]));
+			}
+			else if (arg == "--output" && hasValue) {
+				outputPath = argv[++i];
+			}
+			else
+			{
+				PrintUsage();
+				return 1;
+			}
+		}
+
+		if (outputPath.empty())
+		{
+			PrintUsage();
+			return 1;
+		}
+		if (settings.render.width == 0 || settings.render.height == 0) {
+			throw std::runtime_error("the image size has to be at least 1x1");
+		}
+		if (fov <= 0.0f || fov >= 180.0f) {
+			throw std::runtime_error("the field of view has to be between 0 and 180 degrees");
+		}
+
+		// The same camera as CloudReferenceRender (with the same defaults), for the whole image; every tile is a part of its frustum
+		const glm::vec3 direction(std::cos(ToRadians(pitch)) * std::sin(ToRadians(yaw)), std::sin(ToRadians(pitch)),
+								  -std::cos(ToRadians(pitch)) * std::cos(ToRadians(yaw)));
+		settings.render.view = CloudReference::View::LookAlong(glm::vec3(0.0f, 0.0f, -2.0f), direction, fov,
+															   float(settings.render.width) / float(settings.render.height));
+		settings.render.march.sunDirection = glm::vec3(std::cos(sunElevation) * std::sin(sunAzimuth), std::sin(sunElevation),
+													   -std::cos(sunElevation) * std::cos(sunAzimuth));
+		if (settings.passes > 1) {
+			settings.render.march.quality = CloudReference::OfflineQuality();
+		}
+
+		CloudReference::TileCoordinator coordinator(settings, port);
+		std::cout << "Rendering " << settings.render.width << "x" << settings.render.height << " into " << outputPath
+				  << ", waiting for workers on port " << port << std::endl;
+
+		const CloudReference::TiledRenderStats stats = coordinator.Run(outputPath);
+		std::cout << stats.Describe() << std::endl;
+		return 0;
+	}
+
+	int RunWorker(int argc, char** argv)
+	{
+		std::string textureFolder = "../../src/CloudScapes/textures/CloudTextures/";
+		std::string host = "localhost";
+		uint16_t port = DEFAULT_PORT;
+		uint32_t threads = 0;
+
+		for (int i = 2; i < argc; i++)
+		{
+			const std::string arg = argv[i];
+			const bool hasValue = (i + 1 < argc);
+			const bool hasTwoValues = (i + 2 < argc);
+
+			if (arg == "--connect" && hasTwoValues) {
+				host = argv[++i];
+				port = static_cast<uint16_t>(std::atoi(argv[++i]));
+			}
+			else if (arg == "--textures" && hasValue) {
+				textureFolder = argv[++i];
+			}
+			else if (arg == "--threads" && hasValue) {
+				threads = static_cast<uint32_t>(std::atoi(argv[++i]));
+			}
+			else
+			{
+				PrintUsage();
+				return 1;
+			}
+		}
+
+		if (textureFolder.back() != '/' && textureFolder.back() != '\\') {
+			textureFolder += '/';
+		}
+
+		CloudReference::NoiseTextures textures;
+		textures.Load(textureFolder);
+
+		CloudReference::TileWorker worker(textures, threads);
+		const uint32_t tiles = worker.Run(host, port);
+		std::cout << tiles << " tiles rendered" << std::endl;
+		return 0;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	try
+	{
+		const std::string mode = argv[1];
+		if (mode == "coordinator") {
+			return RunCoordinator(argc, argv);
+		}
+		if (mode == "worker") {
+			return RunWorker(argc, argv);
+		}
+		PrintUsage();
+		return 1;
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+}
@@ -0,0 +1,168 @@
+#include "CpuCloudRenderer.h"
+#include "RayPacket.h"
+#include <chrono>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <stdexcept>
+
+namespace CloudReference
+{
+	//--------------------------------------------------------
+	//					RenderSettings
+	//--------------------------------------------------------
+
+	PixelRegion RenderSettings::RenderedRegion() const
+	{
+		if (region.width == 0 || region.height == 0)
+		{
+			PixelRegion all;
+			all.width = width;
+			all.height = height;
+			return all;
+		}
+		return region;
+	}
+
+	//--------------------------------------------------------
+	//					RenderStats
+	//--------------------------------------------------------
+
+	double RenderStats::RaysPerSecond() const
+	{
+		return (seconds > 0.0) ? double(rays) / seconds : 0.0;
+	}
+
+	double RenderStats::RaysPerSecondPerCore() const
+	{
+		return (threads > 0) ? RaysPerSecond() / double(threads) : 0.0;
+	}
+
+	std::string RenderStats::Describe() const
+	{
+		std::ostringstream line;
+		line << std::fixed << std::setprecision(3) << seconds << " s, "
+			 << rays << " rays (" << marchedRays << " marched), "
+			 << threads << " threads, " << (packets ? std::string("packets of ") + std::to_string(PACKET_SIZE) + " (" + SimdInstructionSet() + ")" : "scalar")
+			 << ", " << tiles << " tiles (" << stolenTiles << " stolen): "
+			 << std::setprecision(0) << RaysPerSecond() << " rays/s, " << RaysPerSecondPerCore() << " rays/s per core";
+		return line.str();
+	}
+
+	//--------------------------------------------------------
+	//					CpuCloudRenderer
+	//--------------------------------------------------------
+
+	CpuCloudRenderer::CpuCloudRenderer(const NoiseTextures& textures, uint32_t threadCount)
+		: textures(textures), threadPool(threadCount)
+	{
+	}
+
+	uint32_t CpuCloudRenderer::GetThreadCount() const
+	{
+		return threadPool.GetThreadCount();
+	}
+
+	RenderStats CpuCloudRenderer::Render(const RenderSettings& settings, std::vector<CloudPixel>& image)
+	{
+		if (settings.width == 0 || settings.height == 0) {
+			throw std::runtime_error("CpuCloudRenderer: empty image");
+		}
+		if (settings.tileWidth == 0 || settings.tileWidth % PACKET_SIZE != 0 || settings.tileHeight == 0) {
+			throw std::runtime_error("CpuCloudRenderer: the tile width has to be a multiple of the packet size");
+		}
+
+		const PixelRegion region = settings.RenderedRegion();
+		if (uint64_t(region.x) + region.width > settings.width || uint64_t(region.y) + region.height > settings.height) {
+			throw std::runtime_error("CpuCloudRenderer: the region is outside of the image");
+		}
+
+		const CloudPixel noClouds = { 0.0f, 0.0f, -1.0f };
+		image.assign(size_t(region.width) * region.height, noClouds);
+
+		const uint32_t tilesX = (region.width + settings.tileWidth - 1) / settings.tileWidth;
+		const uint32_t tilesY = (region.height + settings.tileHeight - 1) / settings.tileHeight;
+		std::vector<uint64_t> marchedRays(threadPool.GetThreadCount(), 0);
+
+		const std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+		threadPool.ParallelFor(tilesX * tilesY, [&](uint32_t tile, uint32_t worker)
+		{
+			marchedRays[worker] += RenderTile(settings, tile % tilesX, tile / tilesX, image);
+		});
+		const std::chrono::high_resolution_clock::time_point end = std::chrono::high_resolution_clock::now();
+
+		RenderStats stats;
+		stats.rays = uint64_t(region.width) * region.height;
+		for (uint64_t count : marchedRays) {
+			stats.marchedRays += count;
+		}
+		stats.seconds = std::chrono::duration<double>(end - start).count();
+		stats.threads = threadPool.GetThreadCount();
+		stats.tiles = tilesX * tilesY;
+		stats.stolenTiles = threadPool.GetStolenTaskCount();
+		stats.packets = settings.packets;
+		return stats;
+	}
+
+	uint64_t CpuCloudRenderer::RenderTile(const RenderSettings& settings, uint32_t tileX, uint32_t tileY, std::vector<CloudPixel>& image) const
+	{
+		// The loops run over the pixels of the region, the rays are set up with their position in the whole image
+		const PixelRegion region = settings.RenderedRegion();
+		const int width = int(settings.width);
+		const int height = int(settings.height);
+		const int regionX = int(region.x);
+		const int regionY = int(region.y);
+		const int x0 = int(tileX * settings.tileWidth);
+		const int y0 = int(tileY * settings.tileHeight);
+		const int x1 = std::min(x0 + int(settings.tileWidth), int(region.width));
+		const int y1 = std::min(y0 + int(settings.tileHeight), int(region.height));
+
+		uint64_t marched = 0;
+		for (int y = y0; y < y1; y++)
+		{
+			CloudPixel* row = &image[size_t(y) * region.width];
+
+			if (!settings.packets)
+			{
+				for (int x = x0; x < x1; x++)
+				{
+					const PixelRay pixelRay = setupPixelRay(settings.view, regionX + x, regionY + y, width, height);
+					MarchResult result = {};
+					if (pixelRay.march)
+					{
+						result = rayMarch(textures, settings.march, pixelRay.ray, pixelRay.earthCenter,
+										  pixelRay.atmosphereInnerIsect.point, pixelRay.start_t, pixelRay.end_t);
+						marched++;
+					}
+					row[x] = finishPixel(pixelRay, result);
+				}
+				continue;
+			}
+
+			for (int x = x0; x < x1; x += PACKET_SIZE)
+			{
+				const int count = std::min(PACKET_SIZE, x1 - x);
+				PixelRay pixelRays[PACKET_SIZE];
+				MarchResult results[PACKET_SIZE] = {};
+				bool anyMarching = false;
+				for (int i = 0; i < count; i++)
+				{
+					pixelRays[i] = setupPixelRay(settings.view, regionX + x + i, regionY + y, width, height);
+					anyMarching = anyMarching || pixelRays[i].march;
+				}
+
+				if (anyMarching) {
+					rayMarchPacket(textures, settings.march, pixelRays, count, results);
+				}
+
+				for (int i = 0; i < count; i++)
+				{
+					row[x + i] = finishPixel(pixelRays[i], results[i]);
+					marched += pixelRays[i].march ? 1 : 0;
+				}
+			}
+		}
+
+		return marched;
+	}
+}
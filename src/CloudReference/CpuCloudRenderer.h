@@ -0,0 +1,76 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "CloudModel.h"
+#include "ThreadPool.h"
+
+namespace CloudReference
+{
+	// A rectangle of pixels of the image, top row first
+	struct PixelRegion
+	{
+		uint32_t x = 0;
+		uint32_t y = 0;
+		uint32_t width = 0;		// 0 --> the whole image
+		uint32_t height = 0;
+	};
+
+	struct RenderSettings
+	{
+		uint32_t width = 640;
+		uint32_t height = 360;
+		// Only this part of the image is rendered, with the rays of the whole image, so the parts of an image rendered
+		// separately (tiles of a huge still, see TileCoordinator.h) match the image rendered at once up to the last bit
+		PixelRegion region;
+		View view = View::LookAlong(glm::vec3(0.0f, 0.0f, -2.0f), glm::vec3(0.0f, 0.5f, -1.0f), 45.0f, 640.0f / 360.0f);
+		MarchParameters march;
+		bool packets = true;		// false --> one ray at a time with the scalar rayMarch
+		uint32_t tileWidth = 32;	// multiple of PACKET_SIZE, the packets are rows of a tile
+		uint32_t tileHeight = 8;
+
+		// The region that is rendered, the whole image if 'region' is empty
+		PixelRegion RenderedRegion() const;
+	};
+
+	struct RenderStats
+	{
+		uint64_t rays = 0;			// one per pixel of the rendered region
+		uint64_t marchedRays = 0;	// rays above the horizon fade that were ray marched through the cloud layer
+		double seconds = 0.0;
+		uint32_t threads = 0;
+		uint32_t tiles = 0;
+		uint32_t stolenTiles = 0;	// tiles a thread took over from another one
+		bool packets = false;
+
+		double RaysPerSecond() const;
+		// Throughput of one thread, the number to compare between machines and with the scalar path
+		double RaysPerSecondPerCore() const;
+		// One line for the console
+		std::string Describe() const;
+	};
+
+	/*
+		Renders the clouds of cloudRayMarch.glsl on the CPU, every pixel fully ray marched (see CloudModel.h for what
+		is left out). The image is split into tiles that the thread pool's workers take and steal; within a tile the
+		rows are ray marched PACKET_SIZE pixels at a time (RayPacket.h), or pixel by pixel with the scalar code.
+		The image is stored top row first, like the GPU's images, and holds only the rendered region.
+	*/
+	class CpuCloudRenderer
+	{
+	public:
+		// The textures have to stay alive as long as the renderer. 0 threads --> one per hardware thread
+		explicit CpuCloudRenderer(const NoiseTextures& textures, uint32_t threadCount = 0);
+
+		RenderStats Render(const RenderSettings& settings, std::vector<CloudPixel>& image);
+
+		uint32_t GetThreadCount() const;
+
+	private:
+		// Returns the number of rays that were ray marched
+		uint64_t RenderTile(const RenderSettings& settings, uint32_t tileX, uint32_t tileY, std::vector<CloudPixel>& image) const;
+
+		const NoiseTextures& textures;
+		ThreadPool threadPool;
+	};
+}
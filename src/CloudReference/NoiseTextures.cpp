@@ -0,0 +1,150 @@
+#include "NoiseTextures.h"
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+// The renderer has its own stb_image (ImageLoadingUtility.cpp), keep this one private to the library
+#define STB_IMAGE_STATIC
+#define STB_IMAGE_IMPLEMENTATION
+#include "../../external/stb_image.h"
+
+namespace CloudReference
+{
+	namespace
+	{
+		inline int wrap(int i, int size)
+		{
+			i %= size;
+			return (i < 0) ? i + size : i;
+		}
+
+		// Texels on both sides of a coordinate and the weight of the second one, with repeat addressing
+		inline void linearTexels(float coordinate, int size, int& i0, int& i1, float& weight)
+		{
+			const float texel = coordinate * float(size) - 0.5f;
+			const float texelFloor = std::floor(texel);
+			weight = texel - texelFloor;
+			i0 = wrap(int(texelFloor), size);
+			i1 = (i0 + 1 == size) ? 0 : i0 + 1;
+		}
+
+		std::vector<float> toNormalizedFloats(const uint8_t* texels, size_t count)
+		{
+			std::vector<float> result(count);
+			for (size_t i = 0; i < count; i++) {
+				result[i] = float(texels[i]) / 255.0f;
+			}
+			return result;
+		}
+
+		// Same naming as ImageLoadingUtility::loadMany2DTextures: <folder><baseName>(1)<extension> ... (numImages)
+		std::vector<uint8_t> loadSlices(const std::string& folder, const std::string& baseName, const std::string& extension,
+										int width, int height, int numImages)
+		{
+			const size_t imageSize = size_t(width) * size_t(height) * 4;
+			std::vector<uint8_t> allPixels(imageSize * numImages);
+
+			for (int i = 0; i < numImages; i++)
+			{
+				const std::string path = folder + baseName + "(" + std::to_string(i + 1) + ")" + extension;
+				int texWidth, texHeight, texChannels;
+				stbi_uc* pixels = stbi_load(path.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+				if (!pixels) {
+					throw std::runtime_error("failed to load texture image " + path);
+				}
+				if (texWidth != width || texHeight != height) {
+					stbi_image_free(pixels);
+					throw std::runtime_error("unexpected size for texture image " + path);
+				}
+
+				memcpy(&allPixels[i * imageSize], pixels, imageSize);
+				stbi_image_free(pixels);
+			}
+
+			return allPixels;
+		}
+	}
+
+	//--------------------------------------------------------
+	//					NoiseTexture3D
+	//--------------------------------------------------------
+
+	void NoiseTexture3D::Create(int width, int height, int depth, const uint8_t* texels)
+	{
+		this->width = width;
+		this->height = height;
+		this->depth = depth;
+		this->texels = toNormalizedFloats(texels, size_t(width) * size_t(height) * size_t(depth) * 4);
+	}
+
+	glm::vec4 NoiseTexture3D::Fetch(int x, int y, int z) const
+	{
+		const float* texel = &texels[((size_t(z) * height + y) * width + x) * 4];
+		return glm::vec4(texel[0], texel[1], texel[2], texel[3]);
+	}
+
+	glm::vec4 NoiseTexture3D::Sample(const glm::vec3& uvw) const
+	{
+		int x0, x1, y0, y1, z0, z1;
+		float wx, wy, wz;
+		linearTexels(uvw.x, width, x0, x1, wx);
+		linearTexels(uvw.y, height, y0, y1, wy);
+		linearTexels(uvw.z, depth, z0, z1, wz);
+
+		const glm::vec4 front = glm::mix(glm::mix(Fetch(x0, y0, z0), Fetch(x1, y0, z0), wx),
+										 glm::mix(Fetch(x0, y1, z0), Fetch(x1, y1, z0), wx), wy);
+		const glm::vec4 back = glm::mix(glm::mix(Fetch(x0, y0, z1), Fetch(x1, y0, z1), wx),
+										glm::mix(Fetch(x0, y1, z1), Fetch(x1, y1, z1), wx), wy);
+		return glm::mix(front, back, wz);
+	}
+
+	//--------------------------------------------------------
+	//					NoiseTexture2D
+	//--------------------------------------------------------
+
+	void NoiseTexture2D::Create(int width, int height, const uint8_t* texels)
+	{
+		this->width = width;
+		this->height = height;
+		this->texels = toNormalizedFloats(texels, size_t(width) * size_t(height) * 4);
+	}
+
+	glm::vec4 NoiseTexture2D::Fetch(int x, int y) const
+	{
+		const float* texel = &texels[(size_t(y) * width + x) * 4];
+		return glm::vec4(texel[0], texel[1], texel[2], texel[3]);
+	}
+
+	glm::vec4 NoiseTexture2D::Sample(const glm::vec2& uv) const
+	{
+		int x0, x1, y0, y1;
+		float wx, wy;
+		linearTexels(uv.x, width, x0, x1, wx);
+		linearTexels(uv.y, height, y0, y1, wy);
+
+		return glm::mix(glm::mix(Fetch(x0, y0), Fetch(x1, y0), wx),
+						glm::mix(Fetch(x0, y1), Fetch(x1, y1), wx), wy);
+	}
+
+	//--------------------------------------------------------
+	//					NoiseTextures
+	//--------------------------------------------------------
+
+	void NoiseTextures::Load(const std::string& folder)
+	{
+		std::vector<uint8_t> pixels = loadSlices(folder + "LowFrequency/", "LowFrequency", ".tga", 128, 128, 128);
+		baseShape.Create(128, 128, 128, pixels.data());
+
+		pixels = loadSlices(folder + "HighFrequency/", "HighFrequency", ".tga", 32, 32, 32);
+		details.Create(32, 32, 32, pixels.data());
+
+		const std::string curlNoisePath = folder + "curlNoise.png";
+		int texWidth, texHeight, texChannels;
+		stbi_uc* curlPixels = stbi_load(curlNoisePath.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+		if (!curlPixels) {
+			throw std::runtime_error("failed to load texture image " + curlNoisePath);
+		}
+		curl.Create(texWidth, texHeight, curlPixels);
+		stbi_image_free(curlPixels);
+	}
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+namespace CloudReference
+{
+	/*
+		CPU copies of the cloud noise textures, sampled the way the ray march's samplers do it: linear filtering,
+		repeat addressing, no mip maps. Texel i covers the coordinates [i, i+1) / size and its centre is at (i + 0.5) / size.
+		The texels are kept as normalized floats (VK_FORMAT_R8G8B8A8_UNORM on the GPU), RGBA interleaved.
+		The GPU filters with a few bits of fixed point weights, so the results agree to about 1/256, not exactly.
+	*/
+	class NoiseTexture3D
+	{
+	public:
+		// 'depth' RGBA8 slices of width x height, slice 0 first
+		void Create(int width, int height, int depth, const uint8_t* texels);
+
+		glm::vec4 Sample(const glm::vec3& uvw) const;
+		glm::vec4 Fetch(int x, int y, int z) const;	// no wrapping
+
+		int GetWidth() const { return width; }
+		int GetHeight() const { return height; }
+		int GetDepth() const { return depth; }
+
+	private:
+		int width = 0;
+		int height = 0;
+		int depth = 0;
+		std::vector<float> texels;
+	};
+
+	class NoiseTexture2D
+	{
+	public:
+		void Create(int width, int height, const uint8_t* texels);
+
+		glm::vec4 Sample(const glm::vec2& uv) const;
+		glm::vec4 Fetch(int x, int y) const;	// no wrapping
+
+		int GetWidth() const { return width; }
+		int GetHeight() const { return height; }
+
+	private:
+		int width = 0;
+		int height = 0;
+		std::vector<float> texels;
+	};
+
+	// The three textures the ray march samples, see Sky.h for what is in them
+	struct NoiseTextures
+	{
+		NoiseTexture3D baseShape;	// cloudBaseShapeTexture, 128^3
+		NoiseTexture3D details;		// cloudDetailsTexture, 32^3
+		NoiseTexture2D curl;		// cloudMotionTexture, 128^2
+
+		// Loads the same files as Sky::CreateCloudResources from 'folder', e.g. "../../src/CloudScapes/textures/CloudTextures/".
+		// Throws if a file is missing or has the wrong size
+		void Load(const std::string& folder);
+	};
+}
@@ -0,0 +1,164 @@
+#include "ProgressiveRenderer.h"
+#include <cmath>
+#include <chrono>
+#include <random>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <stdexcept>
+
+namespace CloudReference
+{
+	namespace
+	{
+		// Same as Scene::HaltonSequenceAt
+		float HaltonSequenceAt(int index, int base)
+		{
+			float f = 1.0f;
+			float r = 0.0f;
+			while (index > 0)
+			{
+				f = f / float(base);
+				r += f * float(index % base);
+				index = index / base;
+			}
+			return r;
+		}
+	}
+
+	Quality OfflineQuality()
+	{
+		Quality quality;
+		quality.lodEnabled = 0;
+		quality.nearLightSamples = NUM_CONE_SAMPLES;
+		quality.farLightSamples = NUM_CONE_SAMPLES;
+		quality.minMarchSteps = 128.0f;
+		quality.maxMarchSteps = 256.0f;
+		return quality;
+	}
+
+	//--------------------------------------------------------
+	//					AccumulationStats
+	//--------------------------------------------------------
+
+	std::string AccumulationStats::Describe() const
+	{
+		std::ostringstream line;
+		line << passes << " passes, " << std::fixed << std::setprecision(3) << seconds << " s, error "
+			 << std::setprecision(2) << error * 255.0 << " of 255, " << rays << " rays (" << marchedRays << " marched)";
+		return line.str();
+	}
+
+	//--------------------------------------------------------
+	//					ProgressiveRenderer
+	//--------------------------------------------------------
+
+	ProgressiveRenderer::ProgressiveRenderer(CpuCloudRenderer& renderer)
+		: renderer(renderer)
+	{
+	}
+
+	const std::vector<AccumulatedPixel>& ProgressiveRenderer::GetAccumulation() const
+	{
+		return accumulation;
+	}
+
+	AccumulationStats ProgressiveRenderer::Render(const RenderSettings& settings, const AccumulationSettings& accumulationSettings,
+												  std::vector<CloudPixel>& image, const PassCallback& onPass)
+	{
+		if (accumulationSettings.maxPasses == 0) {
+			throw std::runtime_error("ProgressiveRenderer: at least one pass is needed");
+		}
+
+		const PixelRegion region = settings.RenderedRegion();
+		const AccumulatedPixel empty = { 0.0f, 0.0f, 0.0f, 0.0f, -1.0f };
+		accumulation.assign(size_t(region.width) * region.height, empty);
+
+		// Random shift of the Halton points, wrapped around [0, 1)
+		std::mt19937 generator(accumulationSettings.seed);
+		std::uniform_real_distribution<float> distribution(0.0f, 1.0f);
+		const float stepOffsetShift = distribution(generator);
+		const float coneRotationShift = distribution(generator);
+
+		AccumulationStats stats;
+		const std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+		RenderSettings passSettings = settings;
+		while (stats.passes < accumulationSettings.maxPasses)
+		{
+			const int haltonIndex = int(stats.passes) + 1;	// index 0 is 0 in every base
+			passSettings.march.stepOffset = std::fmod(HaltonSequenceAt(haltonIndex, 2) + stepOffsetShift, 1.0f);
+			passSettings.march.coneRotation = std::fmod(HaltonSequenceAt(haltonIndex, 3) + coneRotationShift, 1.0f);
+
+			const RenderStats passStats = renderer.Render(passSettings, passImage);
+			Accumulate(passImage, stats.passes);
+
+			stats.passes++;
+			stats.rays += passStats.rays;
+			stats.marchedRays += passStats.marchedRays;
+			stats.error = ComputeError(stats.passes);
+			stats.seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+			stats.converged = (stats.passes >= std::max(accumulationSettings.minPasses, 2u)) &&
+							  (stats.error < double(accumulationSettings.errorThreshold));
+
+			if (onPass) {
+				onPass(stats);
+			}
+			if (stats.converged) {
+				break;
+			}
+		}
+
+		Resolve(image);
+		return stats;
+	}
+
+	void ProgressiveRenderer::Accumulate(const std::vector<CloudPixel>& pass, uint32_t passIndex)
+	{
+		const float weight = 1.0f / float(passIndex + 1);
+		for (size_t i = 0; i < pass.size(); i++)
+		{
+			const CloudPixel& sample = pass[i];
+			AccumulatedPixel& pixel = accumulation[i];
+
+			pixel.energy += (sample.lightEnergy * sample.coverage - pixel.energy) * weight;
+			pixel.coverage += (sample.coverage - pixel.coverage) * weight;
+
+			const float value = DisplayValue(sample.lightEnergy, sample.coverage);
+			const float delta = value - pixel.displayMean;
+			pixel.displayMean += delta * weight;
+			pixel.displayM2 += delta * (value - pixel.displayMean);
+
+			if (sample.firstHitKm >= 0.0f && (pixel.firstHitKm < 0.0f || sample.firstHitKm < pixel.firstHitKm)) {
+				pixel.firstHitKm = sample.firstHitKm;
+			}
+		}
+	}
+
+	double ProgressiveRenderer::ComputeError(uint32_t passes) const
+	{
+		if (passes < 2 || accumulation.empty()) {
+			return 0.0;
+		}
+
+		// Variance of the mean = sample variance / n
+		const double scale = 1.0 / (double(passes - 1) * double(passes));
+		double sum = 0.0;
+		for (const AccumulatedPixel& pixel : accumulation) {
+			sum += double(pixel.displayM2) * scale;
+		}
+		return std::sqrt(sum / double(accumulation.size()));
+	}
+
+	void ProgressiveRenderer::Resolve(std::vector<CloudPixel>& image) const
+	{
+		image.resize(accumulation.size());
+		for (size_t i = 0; i < accumulation.size(); i++)
+		{
+			const AccumulatedPixel& pixel = accumulation[i];
+			image[i].lightEnergy = (pixel.coverage > 0.0f) ? pixel.energy / pixel.coverage : 0.0f;
+			image[i].coverage = pixel.coverage;
+			image[i].firstHitKm = pixel.firstHitKm;
+		}
+	}
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+#include "CpuCloudRenderer.h"
+
+namespace CloudReference
+{
+	// Step counts and light samples for offline stills: no level of detail (full detail and all cone light samples at any
+	// distance, no step growth) and several times the real-time steps (CloudQuality's 24 to 40)
+	Quality OfflineQuality();
+
+	// The value a CloudPixel is viewed with: the unbounded light energy squashed to [0, 1), times the coverage
+	inline float DisplayValue(float lightEnergy, float coverage)
+	{
+		return lightEnergy / (1.0f + lightEnergy) * coverage;
+	}
+
+	struct AccumulationSettings
+	{
+		uint32_t maxPasses = 1024;				// target sample count, the accumulation stops here even if it didn't converge
+		uint32_t minPasses = 16;				// passes before the error is trusted
+		float errorThreshold = 0.5f / 255.0f;	// stop once the error (AccumulationStats::error) is below, 0 --> run to maxPasses
+		uint32_t seed = 1;						// of the random step offsets and cone rotations
+	};
+
+	// One pixel of the accumulation image, running averages over the passes
+	struct AccumulatedPixel
+	{
+		float energy;			// mean of lightEnergy * coverage
+		float coverage;			// mean coverage
+		float displayMean;		// mean and sum of squared differences (Welford) of DisplayValue, for the error estimate
+		float displayM2;
+		float firstHitKm;		// nearest first hit of all passes, negative if there was none
+	};
+
+	struct AccumulationStats
+	{
+		uint32_t passes = 0;
+		double seconds = 0.0;		// all passes, including the accumulation
+		double error = 0.0;			// RMS over the pixels of the standard error of the mean DisplayValue
+		bool converged = false;		// the error went below the threshold before maxPasses
+		uint64_t rays = 0;			// over all passes
+		uint64_t marchedRays = 0;
+
+		// One line for the console
+		std::string Describe() const;
+	};
+
+	/*
+		Progressive accumulation of many full ray marches of the same view, for stills with far more samples than real
+		time allows. Every pass ray marches every pixel with CpuCloudRenderer (the GPU marches one pixel of every 4x4
+		block per frame) with its own step offset and cone rotation, the two that the blue noise varies on the GPU.
+		They come from a Halton sequence (bases 2 and 3) shifted by a random offset, so the passes cover both evenly
+		without repeating a pattern across renders with different seeds.
+
+		The passes are averaged into a float accumulation image. The spread of a pixel across the passes gives the
+		standard error of its mean; the accumulation stops once the RMS of that error over the image is below the
+		threshold, or after maxPasses.
+	*/
+	class ProgressiveRenderer
+	{
+	public:
+		// Called after every pass with the statistics so far, for progress output
+		typedef std::function<void(const AccumulationStats& stats)> PassCallback;
+
+		// The renderer has to stay alive as long as this
+		explicit ProgressiveRenderer(CpuCloudRenderer& renderer);
+
+		// Accumulates passes of 'settings' (its step offset and cone rotation are replaced) and resolves the accumulation into 'image'
+		AccumulationStats Render(const RenderSettings& settings, const AccumulationSettings& accumulation, std::vector<CloudPixel>& image,
+								 const PassCallback& onPass = PassCallback());
+
+		// The accumulation image of the last Render, top row first, the rendered region only
+		const std::vector<AccumulatedPixel>& GetAccumulation() const;
+
+	private:
+		void Accumulate(const std::vector<CloudPixel>& pass, uint32_t passIndex);
+		double ComputeError(uint32_t passes) const;
+		void Resolve(std::vector<CloudPixel>& image) const;
+
+		CpuCloudRenderer& renderer;
+		std::vector<AccumulatedPixel> accumulation;
+		std::vector<CloudPixel> passImage;
+	};
+}
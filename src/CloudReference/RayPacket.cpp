@@ -0,0 +1,369 @@
+#include "RayPacket.h"
+#include <cmath>
+#include <algorithm>
+
+namespace CloudReference
+{
+	namespace
+	{
+		//--------------------------------------------------------
+		//					TOOL BOX FUNCTIONS
+		//--------------------------------------------------------
+
+		inline Float8 remap(const Float8& value, const Float8& original_min, const Float8& original_max, const Float8& new_min, const Float8& new_max)
+		{
+			return new_min + (((value - original_min) / (original_max - original_min)) * (new_max - new_min));
+		}
+
+		inline Float8 remapClamped(const Float8& value, const Float8& original_min, const Float8& original_max, const Float8& new_min, const Float8& new_max)
+		{
+			return Clamp(remap(value, original_min, original_max, new_min, new_max), new_min, new_max);
+		}
+
+		inline Float8 remapClampedBeforeAndAfter(const Float8& value, const Float8& original_min, const Float8& original_max,
+												 const Float8& new_min, const Float8& new_max)
+		{
+			return remapClamped(Clamp(value, original_min, original_max), original_min, original_max, new_min, new_max);
+		}
+
+		inline Vec3x8 getRelativePositionInAtmosphere(const Vec3x8& pos, const Vec3x8& earthCenter)
+		{
+			const Vec3x8 layerOrigin(earthCenter.x, Float8(ATMOSPHERE_RADIUS_INNER - EARTH_RADIUS), earthCenter.z);
+			return (pos - layerOrigin) / Float8(ATMOSPHERE_THICKNESS);
+		}
+
+		// glm::normalize: v * inversesqrt(dot(v, v))
+		inline Vec3x8 normalize(const Vec3x8& v)
+		{
+			return v * (Float8(1.0f) / Sqrt(Dot(v, v)));
+		}
+
+		//--------------------------------------------------------
+		//					CLOUD SAMPLING
+		//--------------------------------------------------------
+		// The texture lookups are done lane by lane for the lanes in the mask, the other lanes get 0
+
+		void gatherBaseShape(const NoiseTextures& textures, int laneBits, const Vec3x8& point, Float8 channels[4])
+		{
+			float x[PACKET_SIZE], y[PACKET_SIZE], z[PACKET_SIZE];
+			point.x.Store(x);
+			point.y.Store(y);
+			point.z.Store(z);
+
+			float lanes[4][PACKET_SIZE] = {};
+			for (int i = 0; i < PACKET_SIZE; i++)
+			{
+				if ((laneBits >> i) & 1)
+				{
+					const glm::vec4 texel = textures.baseShape.Sample(glm::vec3(x[i], y[i], z[i]));
+					for (int c = 0; c < 4; c++) {
+						lanes[c][i] = texel[c];
+					}
+				}
+			}
+
+			for (int c = 0; c < 4; c++) {
+				channels[c] = Float8::Load(lanes[c]);
+			}
+		}
+
+		Float8 sampleLowFrequency(const NoiseTextures& textures, const Mask8& mask, const Vec3x8& point)
+		{
+			Float8 lowFrequencyNoises[4];
+			gatherBaseShape(textures, mask.Bits(), point, lowFrequencyNoises);
+
+			Float8 lowFrequencyFBM = (lowFrequencyNoises[1] * Float8(0.625f)) +
+									 (lowFrequencyNoises[2] * Float8(0.25f)) +
+									 (lowFrequencyNoises[3] * Float8(0.125f));
+			lowFrequencyFBM = Clamp(lowFrequencyFBM, Float8(0.0f), Float8(1.0f));
+
+			const Float8 baseCloud = remapClamped(lowFrequencyNoises[0], lowFrequencyFBM - Float8(0.9f), Float8(1.0f), Float8(0.0f), Float8(1.0f));
+
+			const Float8 cloud_coverage = Float8(0.6f);
+			const Float8 base_cloud_with_coverage = remapClampedBeforeAndAfter(baseCloud, cloud_coverage, Float8(1.0f), Float8(0.0f), Float8(1.0f));
+			return base_cloud_with_coverage * cloud_coverage;
+		}
+
+		// Lanes outside 'mask' return baseCloud
+		Float8 erodeCloudWithHighFrequency(const NoiseTextures& textures, const Mask8& mask, const Float8& baseCloud, Vec3x8 point,
+										   const Float8& height_fraction, const Float8& detailWeight, const Float8& curlWeight)
+		{
+			const Mask8 eroding = mask & (detailWeight > Float8(0.0f));
+			const int erodingBits = eroding.Bits();
+			if (erodingBits == 0) {
+				return baseCloud;
+			}
+
+			// Turbulence at the bottom of the clouds
+			const Mask8 curling = eroding & (curlWeight > Float8(0.0f));
+			const int curlingBits = curling.Bits();
+			if (curlingBits != 0)
+			{
+				float x[PACKET_SIZE], y[PACKET_SIZE];
+				point.x.Store(x);
+				point.y.Store(y);
+
+				float curlX[PACKET_SIZE] = {};
+				float curlY[PACKET_SIZE] = {};
+				for (int i = 0; i < PACKET_SIZE; i++)
+				{
+					if ((curlingBits >> i) & 1)
+					{
+						const glm::vec4 curlNoise = textures.curl.Sample(glm::vec2(x[i], y[i]));
+						curlX[i] = curlNoise.x;
+						curlY[i] = curlNoise.y;
+					}
+				}
+
+				const Float8 oneMinusHeight = Float8(1.0f) - height_fraction;
+				point.x = Select(curling, point.x + Float8::Load(curlX) * oneMinusHeight * Float8(0.5f) * curlWeight, point.x);
+				point.y = Select(curling, point.y + Float8::Load(curlY) * oneMinusHeight * Float8(0.5f) * curlWeight, point.y);
+			}
+
+			// High frequency noises
+			float x[PACKET_SIZE], y[PACKET_SIZE], z[PACKET_SIZE];
+			point.x.Store(x);
+			point.y.Store(y);
+			point.z.Store(z);
+
+			float lanes[3][PACKET_SIZE] = {};
+			for (int i = 0; i < PACKET_SIZE; i++)
+			{
+				if ((erodingBits >> i) & 1)
+				{
+					const glm::vec4 texel = textures.details.Sample(glm::vec3(x[i], y[i], z[i]));
+					for (int c = 0; c < 3; c++) {
+						lanes[c][i] = texel[c];
+					}
+				}
+			}
+
+			const Float8 high_freq_FBM = (Float8::Load(lanes[0]) * Float8(0.625f)) +
+										 (Float8::Load(lanes[1]) * Float8(0.25f)) +
+										 (Float8::Load(lanes[2]) * Float8(0.125f));
+
+			const Float8 high_freq_modifier = Clamp(Mix(high_freq_FBM, Float8(1.0f) - high_freq_FBM,
+														Clamp(height_fraction * Float8(2.0f), Float8(0.0f), Float8(1.0f))),
+													Float8(0.0f), Float8(1.0f));
+
+			const Float8 final_cloud = remap(baseCloud, high_freq_modifier * Float8(0.005f), Float8(1.0f), Float8(0.0f), Float8(1.0f));
+			return Select(eroding, Mix(baseCloud, final_cloud, detailWeight), baseCloud);
+		}
+
+		//--------------------------------------------------------
+		//						LIGHTING
+		//--------------------------------------------------------
+
+		Float8 GetLightEnergy(const Float8& height_fraction, const Float8& dl, const Float8& ds_loded, const Float8& phase_probability,
+							  const Float8& cos_angle, const Float8& brightness)
+		{
+			const Float8 primary_attenuation = Map(Float8(0.0f) - dl, [](float x) { return std::exp(x); });
+			const Float8 secondary_attenuation = primary_attenuation;
+			const Float8 attenuation_probability = Max(remap(cos_angle, Float8(0.7f), Float8(1.0f), secondary_attenuation, secondary_attenuation * Float8(0.25f)),
+													   primary_attenuation);
+
+			const Float8 depthExponent = Clamp(remap(height_fraction * Float8(0.125f), Float8(0.3f), Float8(0.85f), Float8(0.5f), Float8(2.0f)),
+											   Float8(0.5f), Float8(2.0f));
+			const Float8 depth_probability = Float8(0.05f) + Map(ds_loded, depthExponent, [](float x, float y) { return std::pow(x, y); });
+			const Float8 vertical_probability = Map(Clamp(remap(height_fraction * Float8(1.5f), Float8(0.07f), Float8(0.34f), Float8(0.1f), Float8(1.0f)),
+														  Float8(0.1f), Float8(1.0f)),
+													[](float x) { return std::pow(x, 0.8f); });
+
+			const Float8 in_scatter_probability = depth_probability * vertical_probability;
+
+			return attenuation_probability * primary_attenuation * in_scatter_probability * phase_probability * brightness;
+		}
+	}
+
+	void rayMarchPacket(const NoiseTextures& textures, const MarchParameters& parameters,
+						const PixelRay pixelRays[PACKET_SIZE], int count, MarchResult results[PACKET_SIZE])
+	{
+		const Quality& quality = parameters.quality;
+
+		// Everything rayMarch sets up once per ray, lane by lane with the scalar functions
+		float originX[PACKET_SIZE] = {}, originY[PACKET_SIZE] = {}, originZ[PACKET_SIZE] = {};
+		float directionX[PACKET_SIZE] = {}, directionY[PACKET_SIZE] = {}, directionZ[PACKET_SIZE] = {};
+		float earthCenterX[PACKET_SIZE] = {}, earthCenterY[PACKET_SIZE] = {}, earthCenterZ[PACKET_SIZE] = {};
+		float lengthToInnerShell[PACKET_SIZE] = {};
+		float march_start_t[PACKET_SIZE] = {}, end_t[PACKET_SIZE] = {};
+		float stepSizes[PACKET_SIZE] = {};
+		float cosAngles[PACKET_SIZE] = {}, HGLights[PACKET_SIZE] = {};
+		bool marching[PACKET_SIZE] = {};
+
+		const glm::vec3 lightDir = glm::normalize(parameters.sunDirection);
+		for (int i = 0; i < count; i++)
+		{
+			const PixelRay& pixelRay = pixelRays[i];
+			if (!pixelRay.march) {
+				continue;
+			}
+			marching[i] = true;
+
+			const Ray& ray = pixelRay.ray;
+			originX[i] = ray.origin.x;
+			originY[i] = ray.origin.y;
+			originZ[i] = ray.origin.z;
+			directionX[i] = ray.direction.x;
+			directionY[i] = ray.direction.y;
+			directionZ[i] = ray.direction.z;
+			earthCenterX[i] = pixelRay.earthCenter.x;
+			earthCenterY[i] = pixelRay.earthCenter.y;
+			earthCenterZ[i] = pixelRay.earthCenter.z;
+			lengthToInnerShell[i] = glm::length(pixelRay.atmosphereInnerIsect.point - ray.origin);
+
+			const float _dot = glm::dot(ray.direction, glm::vec3(0.0f, 1.0f, 0.0f));
+			const float maxSteps = std::floor(glm::mix(quality.minMarchSteps, quality.maxMarchSteps, 1.0f - _dot));
+			stepSizes[i] = (pixelRay.end_t - pixelRay.start_t) / maxSteps;
+			march_start_t[i] = pixelRay.start_t + parameters.stepOffset * stepSizes[i];
+			end_t[i] = pixelRay.end_t;
+
+			cosAngles[i] = glm::dot(glm::normalize(ray.direction), lightDir);
+			HGLights[i] = HGModified(cosAngles[i], HG_ECCENTRICITY, HG_SILVER_INTENSITY, HG_SILVER_SPREAD);
+		}
+
+		const Vec3x8 origin(Float8::Load(originX), Float8::Load(originY), Float8::Load(originZ));
+		const Vec3x8 direction(Float8::Load(directionX), Float8::Load(directionY), Float8::Load(directionZ));
+		const Vec3x8 earthCenter(Float8::Load(earthCenterX), Float8::Load(earthCenterY), Float8::Load(earthCenterZ));
+		const Float8 lengthOfRayToInnerShell = Float8::Load(lengthToInnerShell);
+		const Float8 endT = Float8::Load(end_t);
+		const Float8 stepSize = Float8::Load(stepSizes);
+		const Float8 cos_angle = Float8::Load(cosAngles);
+		const Float8 HG_light = Float8::Load(HGLights);
+
+		// The cone only depends on the sun, the same for all rays
+		glm::vec3 noise_kernel[NUM_CONE_SAMPLES];
+		buildConeKernel(lightDir, parameters.coneRotation, noise_kernel);
+
+		// skewSamplePointWithWind: the wind offset is the same for every sample
+		const glm::vec3 windOffset = (WIND_DIRECTION + glm::vec3(0.0f, 0.1f, 0.0f)) * CLOUD_SPEED * parameters.time;
+
+		// Per ray state of the march
+		Mask8 active = Mask8::FromBools(marching);
+		Float8 t = Float8::Load(march_start_t);
+		Float8 stepScale = Float8(1.0f);
+		Float8 transmittance = Float8(1.0f);
+		Float8 returnColor = Float8(0.0f);
+		Float8 density = Float8(0.0f);
+		Float8 firstHit_t = Float8(-1.0f);
+		Float8 saturation_t = Float8(-1.0f);
+
+		for (;;)
+		{
+			active = active & (t < endT);
+			if (!active.Any()) {
+				break;
+			}
+
+			// Level of detail for this sample
+			const Float8 distanceKm = t * Float8(METERS_TO_KM);
+			Float8 detailWeight = Float8(1.0f);
+			Float8 curlWeight = Float8(1.0f);
+			if (quality.lodEnabled != 0)
+			{
+				stepScale = Clamp(Float8(1.0f) + (distanceKm - Float8(quality.stepGrowthStartDistance)) * Float8(quality.stepGrowthPerKm),
+								  Float8(1.0f), Float8(quality.maxStepScale));
+				detailWeight = Float8(1.0f) - SmoothStep(Float8(quality.detailFadeStartDistance), Float8(quality.detailFadeEndDistance), distanceKm);
+				curlWeight = Float8(1.0f) - SmoothStep(Float8(quality.curlFadeStartDistance), Float8(quality.curlFadeEndDistance), distanceKm);
+			}
+
+			const Vec3x8 pos = origin + direction * t;
+			const Vec3x8 samplePoint = getRelativePositionInAtmosphere(pos, earthCenter) / Float8(8.0f);
+
+			// getRelativeHeightInAtmosphere
+			const Float8 lengthOfRayfromCamera = Length(pos - origin);
+			const Float8 cosTheta = Dot(direction, normalize(pos - earthCenter));
+			const Float8 relativeHeight = Abs(cosTheta * (lengthOfRayfromCamera - lengthOfRayToInnerShell)) / Float8(ATMOSPHERE_THICKNESS);
+
+			// skewSamplePointWithWind
+			Vec3x8 skewedSamplePoint = samplePoint;
+			skewedSamplePoint.x = skewedSamplePoint.x + relativeHeight * Float8(WIND_DIRECTION.x * CLOUD_TOP_OFFSET) * Float8(0.009f);
+			skewedSamplePoint = skewedSamplePoint + Vec3x8(Float8(windOffset.x), Float8(windOffset.y), Float8(windOffset.z));
+
+			const Float8 baseDensity = sampleLowFrequency(textures, active, skewedSamplePoint) * Float8(BASE_DENSITY_FACTOR);
+
+			const Mask8 inCloud = active & (baseDensity > Float8(0.0f));
+			if (inCloud.Any())
+			{
+				firstHit_t = Select(inCloud & (firstHit_t < Float8(0.0f)), t, firstHit_t);
+
+				const Float8 highFreqDensity = erodeCloudWithHighFrequency(textures, inCloud, baseDensity * Float8(1.4f), skewedSamplePoint,
+																		   relativeHeight, detailWeight, curlWeight);
+				density = Select(inCloud, density + highFreqDensity * (Float8(0.5f) * stepScale), density);
+
+				// Cone light samples. The far rays of a packet may use fewer samples than the near ones
+				float distances[PACKET_SIZE];
+				distanceKm.Store(distances);
+				int lightSamples[PACKET_SIZE];
+				int maxLightSamples = 0;
+				for (int i = 0; i < PACKET_SIZE; i++)
+				{
+					lightSamples[i] = lodLightSamples(quality, distances[i]);
+					maxLightSamples = std::max(maxLightSamples, lightSamples[i]);
+				}
+
+				Float8 densityAlongLight = Float8(0.0f);
+				for (int s = 0; s < maxLightSamples; s++)
+				{
+					// Offset of this sample for every ray: stepSize * noise_kernel[kernelIndex] * float(kernelIndex)
+					bool sampling[PACKET_SIZE];
+					float kernelX[PACKET_SIZE], kernelY[PACKET_SIZE], kernelZ[PACKET_SIZE], kernelScale[PACKET_SIZE];
+					for (int i = 0; i < PACKET_SIZE; i++)
+					{
+						sampling[i] = s < lightSamples[i];
+						const int kernelIndex = (s == lightSamples[i] - 1) ? (NUM_CONE_SAMPLES - 1) : s;
+						kernelX[i] = noise_kernel[kernelIndex].x;
+						kernelY[i] = noise_kernel[kernelIndex].y;
+						kernelZ[i] = noise_kernel[kernelIndex].z;
+						kernelScale[i] = float(kernelIndex);
+					}
+
+					const Float8 scale = Float8::Load(kernelScale);
+					const Vec3x8 lightPos(pos.x + stepSize * Float8::Load(kernelX) * scale,
+										  pos.y + stepSize * Float8::Load(kernelY) * scale,
+										  pos.z + stepSize * Float8::Load(kernelZ) * scale);
+					const Vec3x8 sampleLightPos = getRelativePositionInAtmosphere(lightPos, earthCenter);
+
+					const Mask8 sampleMask = inCloud & Mask8::FromBools(sampling);
+					const Float8 currBaseLightDensity = sampleLowFrequency(textures, sampleMask, sampleLightPos);
+
+					const Mask8 lightMask = sampleMask & (currBaseLightDensity > Float8(0.0f));
+					if (lightMask.Any())
+					{
+						const Float8 currLightDensity = erodeCloudWithHighFrequency(textures, lightMask, Float8(1.5f) * currBaseLightDensity,
+																					skewedSamplePoint, relativeHeight, detailWeight, curlWeight);
+						densityAlongLight = Select(lightMask, densityAlongLight + currLightDensity, densityAlongLight);
+					}
+				}
+
+				// Dropped samples would have added density too
+				float sampleCorrection[PACKET_SIZE];
+				for (int i = 0; i < PACKET_SIZE; i++) {
+					sampleCorrection[i] = float(NUM_CONE_SAMPLES) / float(lightSamples[i]);
+				}
+				densityAlongLight = densityAlongLight * Float8::Load(sampleCorrection);
+
+				const Float8 totalLightEnergy = GetLightEnergy(relativeHeight, densityAlongLight, baseDensity, HG_light, cos_angle, Float8(LIGHT_BRIGHTNESS));
+				transmittance = Select(inCloud, Mix(transmittance, totalLightEnergy, Float8(1.0f) - density), transmittance);
+				returnColor = Select(inCloud, returnColor + transmittance * stepScale, returnColor);
+			}
+
+			const Mask8 saturated = active & (density >= Float8(1.0f));
+			density = Select(saturated, Float8(1.0f), density);
+			saturation_t = Select(saturated, t, saturation_t);
+			active = AndNot(active, saturated);
+
+			t = Select(active, t + stepSize * stepScale, t);
+		}
+
+		for (int i = 0; i < count; i++)
+		{
+			if (marching[i])
+			{
+				results[i].lightEnergy = returnColor.Lane(i);
+				results[i].density = density.Lane(i);
+				results[i].firstHit_t = firstHit_t.Lane(i);
+				results[i].saturation_t = saturation_t.Lane(i);
+			}
+		}
+	}
+}
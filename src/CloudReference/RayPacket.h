@@ -0,0 +1,25 @@
+#pragma once
+
+#include "CloudModel.h"
+#include "Simd8.h"
+
+namespace CloudReference
+{
+	/*
+		rayMarch (CloudModel.cpp) for PACKET_SIZE rays at once.
+
+		The rays of a packet are neighbouring pixels of a row, they march in lock step: step k of every ray is evaluated
+		together, with the arithmetic in Float8 and a mask for the rays that are still marching (and for the ones that
+		are inside a cloud at this step). The noise texture lookups are gathers, done lane by lane. A packet runs until its
+		last ray leaves the cloud layer or saturates, so rays that finish early idle in their lane; neighbouring rays march
+		similar stretches of cloud, which keeps that waste small.
+
+		The operations and their order are the same as in the scalar version, so both produce the same image up to the
+		last bit or so (exp and pow are the same std:: functions, only FMA contraction by the compiler can differ).
+	*/
+
+	// 'pixelRays' holds 'count' rays (the rest of the lanes are unused). Results for the rays that don't march
+	// (PixelRay::march false) are left untouched
+	void rayMarchPacket(const NoiseTextures& textures, const MarchParameters& parameters,
+						const PixelRay pixelRays[PACKET_SIZE], int count, MarchResult results[PACKET_SIZE]);
+}
@@ -0,0 +1,320 @@
+#pragma once
+
+// 8 wide float vectors for the ray packets of the CPU reference renderer (see RayPacket.h).
+// With AVX a Float8 is one register, with SSE2 two, otherwise 8 floats the compiler may or may not vectorize.
+// Build with CLOUD_REFERENCE_AVX2 (see src/CMakeLists.txt) to get the AVX path.
+//
+// Only what the ray march needs: arithmetic, comparisons to masks, selects and square roots in SIMD.
+// exp and pow have no SIMD instruction; Map applies the std:: function lane by lane, which also keeps their results
+// identical to the scalar reference (CloudModel.cpp).
+
+#include <cmath>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define CLOUD_REFERENCE_SIMD_AVX 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CLOUD_REFERENCE_SIMD_SSE 1
+#endif
+
+#define PACKET_SIZE 8
+
+namespace CloudReference
+{
+	// Name of the instruction set the packets use, for the statistics
+	inline const char* SimdInstructionSet()
+	{
+#if defined(CLOUD_REFERENCE_SIMD_AVX)
+		return "AVX";
+#elif defined(CLOUD_REFERENCE_SIMD_SSE)
+		return "SSE2";
+#else
+		return "scalar";
+#endif
+	}
+
+	// Result of a comparison, all bits set in the lanes where it holds
+	struct Mask8
+	{
+#if defined(CLOUD_REFERENCE_SIMD_AVX)
+		__m256 v;
+#elif defined(CLOUD_REFERENCE_SIMD_SSE)
+		__m128 lo, hi;
+#else
+		bool v[PACKET_SIZE];
+#endif
+
+		static Mask8 FromBools(const bool lanes[PACKET_SIZE])
+		{
+			Mask8 mask;
+#if defined(CLOUD_REFERENCE_SIMD_AVX)
+			mask.v = _mm256_castsi256_ps(_mm256_setr_epi32(-int(lanes[0]), -int(lanes[1]), -int(lanes[2]), -int(lanes[3]),
+														   -int(lanes[4]), -int(lanes[5]), -int(lanes[6]), -int(lanes[7])));
+#elif defined(CLOUD_REFERENCE_SIMD_SSE)
+			mask.lo = _mm_castsi128_ps(_mm_setr_epi32(-int(lanes[0]), -int(lanes[1]), -int(lanes[2]), -int(lanes[3])));
+			mask.hi = _mm_castsi128_ps(_mm_setr_epi32(-int(lanes[4]), -int(lanes[5]), -int(lanes[6]), -int(lanes[7])));
+#else
+			for (int i = 0; i < PACKET_SIZE; i++) {
+				mask.v[i] = lanes[i];
+			}
+#endif
+			return mask;
+		}
+
+		// One bit per lane, lane 0 in bit 0
+		int Bits() const
+		{
+#if defined(CLOUD_REFERENCE_SIMD_AVX)
+			return _mm256_movemask_ps(v);
+#elif defined(CLOUD_REFERENCE_SIMD_SSE)
+			return _mm_movemask_ps(lo) | (_mm_movemask_ps(hi) << 4);
+#else
+			int bits = 0;
+			for (int i = 0; i < PACKET_SIZE; i++) {
+				bits |= v[i] ? (1 << i) : 0;
+			}
+			return bits;
+#endif
+		}
+
+		bool Any() const { return Bits() != 0; }
+		bool Lane(int i) const { return (Bits() >> i) & 1; }
+	};
+
+	inline Mask8 operator&(const Mask8& a, const Mask8& b)
+	{
+		Mask8 r;
+#if defined(CLOUD_REFERENCE_SIMD_AVX)
+		r.v = _mm256_and_ps(a.v, b.v);
+#elif defined(CLOUD_REFERENCE_SIMD_SSE)
+		r.lo = _mm_and_ps(a.lo, b.lo);
+		r.hi = _mm_and_ps(a.hi, b.hi);
+#else
+		for (int i = 0; i < PACKET_SIZE; i++) {
+			r.v[i] = a.v[i] && b.v[i];
+		}
+#endif
+		return r;
+	}
+
+	// a and not b
+	inline Mask8 AndNot(const Mask8& a, const Mask8& b)
+	{
+		Mask8 r;
+#if defined(CLOUD_REFERENCE_SIMD_AVX)
+		r.v = _mm256_andnot_ps(b.v, a.v);
+#elif defined(CLOUD_REFERENCE_SIMD_SSE)
+		r.lo = _mm_andnot_ps(b.lo, a.lo);
+		r.hi = _mm_andnot_ps(b.hi, a.hi);
+#else
+		for (int i = 0; i < PACKET_SIZE; i++) {
+			r.v[i] = a.v[i] && !b.v[i];
+		}
+#endif
+		return r;
+	}
+
+	struct Float8
+	{
+#if defined(CLOUD_REFERENCE_SIMD_AVX)
+		__m256 v;
+#elif defined(CLOUD_REFERENCE_SIMD_SSE)
+		__m128 lo, hi;
+#else
+		float v[PACKET_SIZE];
+#endif
+
+		Float8() {}
+		Float8(float f)
+		{
+#if defined(CLOUD_REFERENCE_SIMD_AVX)
+			v = _mm256_set1_ps(f);
+#elif defined(CLOUD_REFERENCE_SIMD_SSE)
+			lo = hi = _mm_set1_ps(f);
+#else
+			for (int i = 0; i < PACKET_SIZE; i++) {
+				v[i] = f;
+			}
+#endif
+		}
+
+		static Float8 Load(const float lanes[PACKET_SIZE])
+		{
+			Float8 r;
+#if defined(CLOUD_REFERENCE_SIMD_AVX)
+			r.v = _mm256_loadu_ps(lanes);
+#elif defined(CLOUD_REFERENCE_SIMD_SSE)
+			r.lo = _mm_loadu_ps(lanes);
+			r.hi = _mm_loadu_ps(lanes + 4);
+#else
+			for (int i = 0; i < PACKET_SIZE; i++) {
+				r.v[i] = lanes[i];
+			}
+#endif
+			return r;
+		}
+
+		void Store(float lanes[PACKET_SIZE]) const
+		{
+#if defined(CLOUD_REFERENCE_SIMD_AVX)
+			_mm256_storeu_ps(lanes, v);
+#elif defined(CLOUD_REFERENCE_SIMD_SSE)
+			_mm_storeu_ps(lanes, lo);
+			_mm_storeu_ps(lanes + 4, hi);
+#else
+			for (int i = 0; i < PACKET_SIZE; i++) {
+				lanes[i] = v[i];
+			}
+#endif
+		}
+
+		float Lane(int i) const
+		{
+			float lanes[PACKET_SIZE];
+			Store(lanes);
+			return lanes[i];
+		}
+	};
+
+	// Element wise operators, one intrinsic (or two with SSE) each
+#if defined(CLOUD_REFERENCE_SIMD_AVX)
+#define FLOAT8_BINARY(name, intrinsic, scalarExpression) \
+	inline Float8 name(const Float8& a, const Float8& b) { Float8 r; r.v = _mm256_##intrinsic##_ps(a.v, b.v); return r; }
+#define FLOAT8_COMPARE(name, predicate, scalarOperator) \
+	inline Mask8 name(const Float8& a, const Float8& b) { Mask8 r; r.v = _mm256_cmp_ps(a.v, b.v, predicate); return r; }
+#elif defined(CLOUD_REFERENCE_SIMD_SSE)
+#define FLOAT8_BINARY(name, intrinsic, scalarExpression) \
+	inline Float8 name(const Float8& a, const Float8& b) \
+	{ Float8 r; r.lo = _mm_##intrinsic##_ps(a.lo, b.lo); r.hi = _mm_##intrinsic##_ps(a.hi, b.hi); return r; }
+#define FLOAT8_COMPARE(name, predicate, scalarOperator) \
+	inline Mask8 name(const Float8& a, const Float8& b) \
+	{ Mask8 r; r.lo = _mm_cmp##scalarOperator##_ps(a.lo, b.lo); r.hi = _mm_cmp##scalarOperator##_ps(a.hi, b.hi); return r; }
+#else
+#define FLOAT8_BINARY(name, intrinsic, scalarExpression) \
+	inline Float8 name(const Float8& a, const Float8& b) \
+	{ Float8 r; for (int i = 0; i < PACKET_SIZE; i++) { float x = a.v[i]; float y = b.v[i]; r.v[i] = scalarExpression; } return r; }
+#define FLOAT8_COMPARE(name, predicate, scalarOperator) \
+	inline Mask8 name(const Float8& a, const Float8& b) \
+	{ Mask8 r; for (int i = 0; i < PACKET_SIZE; i++) { r.v[i] = Compare_##scalarOperator(a.v[i], b.v[i]); } return r; }
+	inline bool Compare_lt(float x, float y) { return x < y; }
+	inline bool Compare_le(float x, float y) { return x <= y; }
+	inline bool Compare_gt(float x, float y) { return x > y; }
+	inline bool Compare_ge(float x, float y) { return x >= y; }
+#endif
+
+	FLOAT8_BINARY(operator+, add, x + y)
+	FLOAT8_BINARY(operator-, sub, x - y)
+	FLOAT8_BINARY(operator*, mul, x * y)
+	FLOAT8_BINARY(operator/, div, x / y)
+	// Like GLSL: the second operand is returned when the comparison fails (NaN)
+	FLOAT8_BINARY(Min, min, (y < x) ? y : x)
+	FLOAT8_BINARY(Max, max, (x < y) ? y : x)
+
+	FLOAT8_COMPARE(operator<, _CMP_LT_OQ, lt)
+	FLOAT8_COMPARE(operator<=, _CMP_LE_OQ, le)
+	FLOAT8_COMPARE(operator>, _CMP_GT_OQ, gt)
+	FLOAT8_COMPARE(operator>=, _CMP_GE_OQ, ge)
+
+#undef FLOAT8_BINARY
+#undef FLOAT8_COMPARE
+
+	inline Float8& operator+=(Float8& a, const Float8& b) { a = a + b; return a; }
+
+	// mask ? a : b, lane by lane
+	inline Float8 Select(const Mask8& mask, const Float8& a, const Float8& b)
+	{
+		Float8 r;
+#if defined(CLOUD_REFERENCE_SIMD_AVX)
+		r.v = _mm256_blendv_ps(b.v, a.v, mask.v);
+#elif defined(CLOUD_REFERENCE_SIMD_SSE)
+		r.lo = _mm_or_ps(_mm_and_ps(mask.lo, a.lo), _mm_andnot_ps(mask.lo, b.lo));
+		r.hi = _mm_or_ps(_mm_and_ps(mask.hi, a.hi), _mm_andnot_ps(mask.hi, b.hi));
+#else
+		for (int i = 0; i < PACKET_SIZE; i++) {
+			r.v[i] = mask.v[i] ? a.v[i] : b.v[i];
+		}
+#endif
+		return r;
+	}
+
+	inline Float8 Sqrt(const Float8& a)
+	{
+		Float8 r;
+#if defined(CLOUD_REFERENCE_SIMD_AVX)
+		r.v = _mm256_sqrt_ps(a.v);
+#elif defined(CLOUD_REFERENCE_SIMD_SSE)
+		r.lo = _mm_sqrt_ps(a.lo);
+		r.hi = _mm_sqrt_ps(a.hi);
+#else
+		for (int i = 0; i < PACKET_SIZE; i++) {
+			r.v[i] = std::sqrt(a.v[i]);
+		}
+#endif
+		return r;
+	}
+
+	inline Float8 Clamp(const Float8& x, const Float8& minVal, const Float8& maxVal)
+	{
+		return Min(Max(x, minVal), maxVal);
+	}
+
+	// Same operation order as glm::mix
+	inline Float8 Mix(const Float8& x, const Float8& y, const Float8& a)
+	{
+		return x + a * (y - x);
+	}
+
+	// Same operation order as glm::smoothstep
+	inline Float8 SmoothStep(const Float8& edge0, const Float8& edge1, const Float8& x)
+	{
+		const Float8 tmp = Clamp((x - edge0) / (edge1 - edge0), Float8(0.0f), Float8(1.0f));
+		return tmp * tmp * (Float8(3.0f) - Float8(2.0f) * tmp);
+	}
+
+	inline Float8 Abs(const Float8& a)
+	{
+		return Max(a, Float8(0.0f) - a);
+	}
+
+	// Applies a scalar function lane by lane (exp, pow, ...)
+	template <typename Function>
+	inline Float8 Map(const Float8& a, Function function)
+	{
+		float lanes[PACKET_SIZE];
+		a.Store(lanes);
+		for (int i = 0; i < PACKET_SIZE; i++) {
+			lanes[i] = function(lanes[i]);
+		}
+		return Float8::Load(lanes);
+	}
+
+	template <typename Function>
+	inline Float8 Map(const Float8& a, const Float8& b, Function function)
+	{
+		float lanesA[PACKET_SIZE];
+		float lanesB[PACKET_SIZE];
+		a.Store(lanesA);
+		b.Store(lanesB);
+		for (int i = 0; i < PACKET_SIZE; i++) {
+			lanesA[i] = function(lanesA[i], lanesB[i]);
+		}
+		return Float8::Load(lanesA);
+	}
+
+	// Three Float8s, one per component: a packet of vec3s in SoA layout
+	struct Vec3x8
+	{
+		Float8 x, y, z;
+
+		Vec3x8() {}
+		Vec3x8(const Float8& x, const Float8& y, const Float8& z) : x(x), y(y), z(z) {}
+	};
+
+	inline Vec3x8 operator+(const Vec3x8& a, const Vec3x8& b) { return Vec3x8(a.x + b.x, a.y + b.y, a.z + b.z); }
+	inline Vec3x8 operator-(const Vec3x8& a, const Vec3x8& b) { return Vec3x8(a.x - b.x, a.y - b.y, a.z - b.z); }
+	inline Vec3x8 operator*(const Vec3x8& a, const Float8& s) { return Vec3x8(a.x * s, a.y * s, a.z * s); }
+	inline Vec3x8 operator/(const Vec3x8& a, const Float8& s) { return Vec3x8(a.x / s, a.y / s, a.z / s); }
+	inline Float8 Dot(const Vec3x8& a, const Vec3x8& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+	inline Float8 Length(const Vec3x8& a) { return Sqrt(Dot(a, a)); }
+}
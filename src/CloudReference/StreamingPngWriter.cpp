@@ -0,0 +1,194 @@
+#include "StreamingPngWriter.h"
+#include <algorithm>
+#include <stdexcept>
+
+// Largest stored deflate block
+#define DEFLATE_STORED_BLOCK_SIZE 65535u
+
+namespace CloudReference
+{
+	namespace
+	{
+		uint32_t Crc32(const uint8_t* data, size_t size, uint32_t crc)
+		{
+			static uint32_t table[256];
+			static bool tableBuilt = false;
+			if (!tableBuilt)
+			{
+				for (uint32_t n = 0; n < 256; n++)
+				{
+					uint32_t c = n;
+					for (int k = 0; k < 8; k++) {
+						c = (c & 1u) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+					}
+					table[n] = c;
+				}
+				tableBuilt = true;
+			}
+
+			crc = ~crc;
+			for (size_t i = 0; i < size; i++) {
+				crc = table[(crc ^ data[i]) & 0xFFu] ^ (crc >> 8);
+			}
+			return ~crc;
+		}
+
+		uint32_t Adler32(const uint8_t* data, size_t size, uint32_t adler)
+		{
+			uint32_t a = adler & 0xFFFFu;
+			uint32_t b = adler >> 16;
+			while (size > 0)
+			{
+				// The most bytes before the sums can overflow 32 bits
+				const size_t chunk = std::min<size_t>(size, 5552);
+				for (size_t i = 0; i < chunk; i++)
+				{
+					a += data[i];
+					b += a;
+				}
+				a %= 65521u;
+				b %= 65521u;
+				data += chunk;
+				size -= chunk;
+			}
+			return (b << 16) | a;
+		}
+
+		void AppendUint32BigEndian(std::vector<uint8_t>& bytes, uint32_t value)
+		{
+			bytes.push_back(uint8_t(value >> 24));
+			bytes.push_back(uint8_t(value >> 16));
+			bytes.push_back(uint8_t(value >> 8));
+			bytes.push_back(uint8_t(value));
+		}
+	}
+
+	StreamingPngWriter::StreamingPngWriter(const std::string& path, uint32_t width, uint32_t height)
+		: file(path, std::ios::binary), path(path), width(width), height(height)
+	{
+		if (width == 0 || height == 0) {
+			throw std::runtime_error("StreamingPngWriter: empty image");
+		}
+		if (!file) {
+			throw std::runtime_error("failed to open " + path);
+		}
+
+		const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+		file.write(reinterpret_cast<const char*>(signature), sizeof(signature));
+
+		std::vector<uint8_t> header;
+		AppendUint32BigEndian(header, width);
+		AppendUint32BigEndian(header, height);
+		header.push_back(8);	// bit depth
+		header.push_back(0);	// greyscale
+		header.push_back(0);	// deflate
+		header.push_back(0);	// adaptive filtering, every row uses filter 0 (none)
+		header.push_back(0);	// not interlaced
+		WriteChunk("IHDR", header);
+	}
+
+	uint32_t StreamingPngWriter::GetRowsWritten() const
+	{
+		return rowsWritten;
+	}
+
+	void StreamingPngWriter::WriteRows(const uint8_t* rows, uint32_t rowCount)
+	{
+		if (finished || uint64_t(rowsWritten) + rowCount > height) {
+			throw std::runtime_error("StreamingPngWriter: more rows than the image has");
+		}
+
+		for (uint32_t row = 0; row < rowCount; row++)
+		{
+			pending.push_back(0);	// filter type: none
+			pending.insert(pending.end(), rows + size_t(row) * width, rows + size_t(row + 1) * width);
+		}
+		rowsWritten += rowCount;
+
+		FlushBlocks(false);
+	}
+
+	void StreamingPngWriter::Finish()
+	{
+		if (finished) {
+			return;
+		}
+		if (rowsWritten != height) {
+			throw std::runtime_error("StreamingPngWriter: " + path + " is missing rows");
+		}
+
+		FlushBlocks(true);
+		WriteChunk("IEND", std::vector<uint8_t>());
+		file.close();
+		finished = true;
+
+		if (!file) {
+			throw std::runtime_error("failed to write " + path);
+		}
+	}
+
+	void StreamingPngWriter::FlushBlocks(bool final)
+	{
+		std::vector<uint8_t> data;
+		if (!zlibHeaderWritten)
+		{
+			// Deflate with a 32K window, no preset dictionary, fastest "compression"
+			data.push_back(0x78);
+			data.push_back(0x01);
+			zlibHeaderWritten = true;
+		}
+
+		size_t offset = 0;
+		for (;;)
+		{
+			const size_t left = pending.size() - offset;
+			const bool lastBlock = final && left <= DEFLATE_STORED_BLOCK_SIZE;
+			if (!lastBlock && left < DEFLATE_STORED_BLOCK_SIZE) {
+				break;
+			}
+
+			// Stored block: BFINAL and BTYPE 00 in the first byte, then LEN and its complement, little endian
+			const uint16_t length = uint16_t(std::min<size_t>(left, DEFLATE_STORED_BLOCK_SIZE));
+			data.push_back(lastBlock ? 1 : 0);
+			data.push_back(uint8_t(length));
+			data.push_back(uint8_t(length >> 8));
+			data.push_back(uint8_t(~length));
+			data.push_back(uint8_t(uint16_t(~length) >> 8));
+			data.insert(data.end(), pending.begin() + offset, pending.begin() + offset + length);
+
+			adler = Adler32(pending.data() + offset, length, adler);
+			offset += length;
+
+			if (lastBlock) {
+				break;
+			}
+		}
+		pending.erase(pending.begin(), pending.begin() + offset);
+
+		if (final) {
+			AppendUint32BigEndian(data, adler);
+		}
+		if (!data.empty()) {
+			WriteChunk("IDAT", data);
+		}
+	}
+
+	void StreamingPngWriter::WriteChunk(const char type[4], const std::vector<uint8_t>& data)
+	{
+		std::vector<uint8_t> length;
+		AppendUint32BigEndian(length, uint32_t(data.size()));
+
+		uint32_t crc = Crc32(reinterpret_cast<const uint8_t*>(type), 4, 0);
+		crc = Crc32(data.data(), data.size(), crc);
+		std::vector<uint8_t> checksum;
+		AppendUint32BigEndian(checksum, crc);
+
+		file.write(reinterpret_cast<const char*>(length.data()), 4);
+		file.write(type, 4);
+		file.write(reinterpret_cast<const char*>(data.data()), std::streamsize(data.size()));
+		file.write(reinterpret_cast<const char*>(checksum.data()), 4);
+		if (!file) {
+			throw std::runtime_error("failed to write " + path);
+		}
+	}
+}
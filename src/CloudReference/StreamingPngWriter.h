@@ -0,0 +1,46 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <fstream>
+
+namespace CloudReference
+{
+	/*
+		Writes an 8 bit greyscale PNG row by row, for images that are too large to hold in memory (stb_image_write
+		needs the whole image). The rows are stored without compression: the zlib stream is made of stored deflate
+		blocks, so the file is about width * height bytes, and every WriteRows call adds an IDAT chunk with the blocks
+		that are complete. Only a block's worth of rows is held back at any time.
+	*/
+	class StreamingPngWriter
+	{
+	public:
+		// Writes the signature and the header right away
+		StreamingPngWriter(const std::string& path, uint32_t width, uint32_t height);
+
+		// 'rowCount' rows of 'width' bytes, top row first, following the ones written before
+		void WriteRows(const uint8_t* rows, uint32_t rowCount);
+
+		// After the last row: the final block, the checksum and the end chunk. Throws if rows are missing
+		void Finish();
+
+		uint32_t GetRowsWritten() const;
+
+	private:
+		// Stored deflate blocks of everything pending, all of it if 'final', only full blocks otherwise
+		void FlushBlocks(bool final);
+		void WriteChunk(const char type[4], const std::vector<uint8_t>& data);
+
+		std::ofstream file;
+		std::string path;
+		uint32_t width;
+		uint32_t height;
+		uint32_t rowsWritten = 0;
+		bool finished = false;
+
+		std::vector<uint8_t> pending;	// filtered rows that aren't in a block yet
+		uint32_t adler = 1;				// zlib checksum of all the filtered rows
+		bool zlibHeaderWritten = false;
+	};
+}
@@ -0,0 +1,135 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+namespace CloudReference
+{
+	ThreadPool::ThreadPool(uint32_t threadCount)
+	{
+		if (threadCount == 0) {
+			threadCount = std::max(1u, std::thread::hardware_concurrency());
+		}
+
+		for (uint32_t i = 0; i < threadCount; i++) {
+			queues.push_back(new WorkQueue());
+		}
+		for (uint32_t i = 0; i < threadCount; i++) {
+			threads.push_back(std::thread(&ThreadPool::WorkerLoop, this, i));
+		}
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			quit = true;
+		}
+		workAvailable.notify_all();
+
+		for (std::thread& thread : threads) {
+			thread.join();
+		}
+		for (WorkQueue* queue : queues) {
+			delete queue;
+		}
+	}
+
+	uint32_t ThreadPool::GetThreadCount() const
+	{
+		return static_cast<uint32_t>(threads.size());
+	}
+
+	uint32_t ThreadPool::GetStolenTaskCount() const
+	{
+		return stolenTasks;
+	}
+
+	void ThreadPool::ParallelFor(uint32_t count, const Task& task)
+	{
+		const uint32_t threadCount = GetThreadCount();
+
+		// Contiguous blocks, worker i starts on [i * count / n, (i + 1) * count / n)
+		for (uint32_t i = 0; i < threadCount; i++)
+		{
+			const uint32_t first = static_cast<uint32_t>(uint64_t(count) * i / threadCount);
+			const uint32_t last = static_cast<uint32_t>(uint64_t(count) * (i + 1) / threadCount);
+
+			std::lock_guard<std::mutex> lock(queues[i]->mutex);
+			for (uint32_t index = first; index < last; index++) {
+				queues[i]->indices.push_back(index);
+			}
+		}
+
+		std::unique_lock<std::mutex> lock(mutex);
+		currentTask = &task;
+		stolenTasks = 0;
+		busyWorkers = threadCount;
+		generation++;
+		workAvailable.notify_all();
+
+		workDone.wait(lock, [this] { return busyWorkers == 0; });
+		currentTask = nullptr;
+	}
+
+	bool ThreadPool::TakeTask(uint32_t worker, uint32_t& index)
+	{
+		// Own queue first, newest task: its neighbours were just worked on
+		{
+			WorkQueue& own = *queues[worker];
+			std::lock_guard<std::mutex> lock(own.mutex);
+			if (!own.indices.empty())
+			{
+				index = own.indices.back();
+				own.indices.pop_back();
+				return true;
+			}
+		}
+
+		// Then steal the oldest task of the next worker that still has some. The owner works from the other end
+		const uint32_t threadCount = GetThreadCount();
+		for (uint32_t offset = 1; offset < threadCount; offset++)
+		{
+			WorkQueue& victim = *queues[(worker + offset) % threadCount];
+			std::lock_guard<std::mutex> lock(victim.mutex);
+			if (!victim.indices.empty())
+			{
+				index = victim.indices.front();
+				victim.indices.pop_front();
+
+				std::lock_guard<std::mutex> poolLock(mutex);
+				stolenTasks++;
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	void ThreadPool::WorkerLoop(uint32_t worker)
+	{
+		uint64_t seenGeneration = 0;
+		for (;;)
+		{
+			const Task* task;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				workAvailable.wait(lock, [&] { return quit || generation != seenGeneration; });
+				if (quit) {
+					return;
+				}
+				seenGeneration = generation;
+				task = currentTask;
+			}
+
+			// Tasks are only added before the workers are woken up, so once no queue has any left this worker is done
+			uint32_t index;
+			while (TakeTask(worker, index)) {
+				(*task)(index, worker);
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			if (--busyWorkers == 0) {
+				workDone.notify_one();
+			}
+		}
+	}
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+namespace CloudReference
+{
+	/*
+		A fixed set of worker threads that run parallel loops with work stealing.
+
+		ParallelFor hands every worker a contiguous block of the task indices, so neighbouring tiles of an image start
+		out on the same thread. A worker takes its tasks from the back of its own queue; once that is empty it steals
+		from the front of the other queues. The cost of a tile varies a lot (sky below the horizon is free, thick clouds
+		are not), so with a static split the threads with the cheap tiles would sit idle at the end.
+	*/
+	class ThreadPool
+	{
+	public:
+		typedef std::function<void(uint32_t index, uint32_t worker)> Task;
+
+		// 0 threads --> one per hardware thread
+		explicit ThreadPool(uint32_t threadCount = 0);
+		~ThreadPool();
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		uint32_t GetThreadCount() const;
+
+		// Runs task(index, worker) for every index in [0, count) and returns once all of them are done.
+		// 'worker' is in [0, GetThreadCount()), for per thread scratch data and statistics
+		void ParallelFor(uint32_t count, const Task& task);
+
+		// Tasks the workers took from another worker's queue during the last ParallelFor
+		uint32_t GetStolenTaskCount() const;
+
+	private:
+		struct WorkQueue
+		{
+			std::mutex mutex;
+			std::deque<uint32_t> indices;
+		};
+
+		void WorkerLoop(uint32_t worker);
+		bool TakeTask(uint32_t worker, uint32_t& index);
+
+		std::vector<std::thread> threads;
+		std::vector<WorkQueue*> queues;
+
+		std::mutex mutex;
+		std::condition_variable workAvailable;
+		std::condition_variable workDone;
+		const Task* currentTask = nullptr;
+		uint64_t generation = 0;		// incremented by every ParallelFor, wakes up the workers
+		uint32_t busyWorkers = 0;
+		uint32_t stolenTasks = 0;
+		bool quit = false;
+	};
+}
@@ -0,0 +1,352 @@
+#include "TileCoordinator.h"
+#include "ProgressiveRenderer.h"
+#include <chrono>
+#include <sstream>
+#include <iomanip>
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+
+namespace CloudReference
+{
+	//--------------------------------------------------------
+	//					TiledRenderStats
+	//--------------------------------------------------------
+
+	std::string TiledRenderStats::Describe() const
+	{
+		std::ostringstream line;
+		line << tiles << " tiles, " << workers << " workers (" << reassignedTiles << " tiles reassigned), "
+			 << std::fixed << std::setprecision(3) << seconds << " s, " << workerSeconds << " s on the workers, "
+			 << rays << " rays (" << marchedRays << " marched)";
+		return line.str();
+	}
+
+	//--------------------------------------------------------
+	//					TileCoordinator
+	//--------------------------------------------------------
+
+	TileCoordinator::TileCoordinator(const TiledImageSettings& settings, uint16_t port)
+		: settings(settings)
+	{
+		if (settings.render.width == 0 || settings.render.height == 0) {
+			throw std::runtime_error("TileCoordinator: empty image");
+		}
+		if (settings.tileWidth == 0 || settings.tileHeight == 0) {
+			throw std::runtime_error("TileCoordinator: empty tiles");
+		}
+		if (settings.passes == 0 || settings.maxBandsInFlight == 0) {
+			throw std::runtime_error("TileCoordinator: at least one pass and one band in flight are needed");
+		}
+		if (settings.tileTimeoutSeconds < 0.0) {
+			throw std::runtime_error("TileCoordinator: negative tile timeout");
+		}
+
+		tilesX = (settings.render.width + settings.tileWidth - 1) / settings.tileWidth;
+		tilesY = (settings.render.height + settings.tileHeight - 1) / settings.tileHeight;
+
+		// Listening right away, workers can connect before Run
+		listener = Socket::Listen(port);
+	}
+
+	TileCoordinator::~TileCoordinator()
+	{
+		for (Worker* worker : workers) {
+			delete worker;
+		}
+		for (Band* band : bands) {
+			delete band;
+		}
+		delete writer;
+	}
+
+	PixelRegion TileCoordinator::GetTileRegion(uint32_t tile) const
+	{
+		PixelRegion region;
+		region.x = (tile % tilesX) * settings.tileWidth;
+		region.y = (tile / tilesX) * settings.tileHeight;
+		region.width = std::min(settings.tileWidth, settings.render.width - region.x);
+		region.height = std::min(settings.tileHeight, settings.render.height - region.y);
+		return region;
+	}
+
+	uint32_t TileCoordinator::GetBandCount() const
+	{
+		return tilesY;
+	}
+
+	TiledRenderStats TileCoordinator::Run(const std::string& outputPath)
+	{
+		const uint32_t tileCount = tilesX * tilesY;
+		pendingTiles.clear();
+		for (uint32_t tile = 0; tile < tileCount; tile++) {
+			pendingTiles.insert(tile);
+		}
+		tileDone.assign(tileCount, false);
+		bands.assign(GetBandCount(), nullptr);
+		nextBandToWrite = 0;
+
+		stats = TiledRenderStats();
+		stats.tiles = tileCount;
+
+		writer = new StreamingPngWriter(outputPath, settings.render.width, settings.render.height);
+
+		const std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+		HandOutTiles();
+		while (nextBandToWrite < GetBandCount())
+		{
+			std::vector<const Socket*> sockets;
+			sockets.push_back(&listener);
+			for (Worker* worker : workers) {
+				sockets.push_back(&worker->socket);
+			}
+
+			// Wakes up for the first tile deadline even if nothing arrives
+			const std::vector<size_t> ready = WaitForReadable(sockets, GetSecondsToNextDeadline());
+
+			// Workers are removed after the loop, the indices refer to 'sockets'
+			std::vector<Worker*> lostWorkers;
+			for (size_t index : ready)
+			{
+				if (index == 0) {
+					AcceptWorker();
+				}
+				else if (!HandleMessage(*workers[index - 1])) {
+					lostWorkers.push_back(workers[index - 1]);
+				}
+			}
+
+			// A worker that is stuck, or whose machine is gone without the connection showing it yet, would keep its tile forever
+			if (settings.tileTimeoutSeconds > 0.0)
+			{
+				const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+				for (Worker* worker : workers)
+				{
+					if (worker->tile >= 0 && now >= worker->deadline &&
+						std::find(lostWorkers.begin(), lostWorkers.end(), worker) == lostWorkers.end())
+					{
+						std::cout << "Worker " << worker->name << ": no tile after " << settings.tileTimeoutSeconds
+								  << " s, dropping it" << std::endl;
+						lostWorkers.push_back(worker);
+					}
+				}
+			}
+			for (Worker* worker : lostWorkers) {
+				RemoveWorker(worker);
+			}
+
+			WriteFinishedBands();
+			HandOutTiles();
+		}
+
+		writer->Finish();
+		delete writer;
+		writer = nullptr;
+		stats.seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+		for (Worker* worker : workers)
+		{
+			try {
+				WriteMessage(worker->socket, MessageType::Quit, std::vector<uint8_t>());
+			}
+			catch (const std::exception&) {
+				// It is gone already, nothing left to tell it
+			}
+			delete worker;
+		}
+		workers.clear();
+
+		return stats;
+	}
+
+	void TileCoordinator::AcceptWorker()
+	{
+		// A connection that fails while it is accepted (e.g. reset by the worker) doesn't end the render
+		Socket socket;
+		try {
+			socket = listener.Accept();
+		}
+		catch (const std::exception& e)
+		{
+			std::cout << e.what() << std::endl;
+			return;
+		}
+
+		Worker* worker = new Worker();
+		worker->socket = std::move(socket);
+		worker->name = worker->socket.GetPeerName();
+		workers.push_back(worker);
+	}
+
+	bool TileCoordinator::HandleMessage(Worker& worker)
+	{
+		try
+		{
+			Message message;
+			if (!ReadMessage(worker.socket, message))
+			{
+				std::cout << "Worker " << worker.name << " disconnected" << std::endl;
+				return false;
+			}
+
+			if (message.type == MessageType::Hello && !worker.ready)
+			{
+				const WorkerHello hello = WorkerHello::Deserialize(message.payload);
+				if (hello.version != TILE_PROTOCOL_VERSION) {
+					throw std::runtime_error("protocol version " + std::to_string(hello.version) + ", expected " + std::to_string(TILE_PROTOCOL_VERSION));
+				}
+				worker.ready = true;
+				stats.workers++;
+				std::cout << "Worker " << worker.name << " connected, " << hello.threads << " threads" << std::endl;
+				return true;
+			}
+
+			if (message.type == MessageType::Tile && worker.tile >= 0)
+			{
+				const TileResult result = TileResult::Deserialize(message.payload);
+				const PixelRegion region = GetTileRegion(uint32_t(worker.tile));
+				if (result.tileIndex != uint32_t(worker.tile) || result.region.x != region.x || result.region.y != region.y ||
+					result.region.width != region.width || result.region.height != region.height) {
+					throw std::runtime_error("sent a tile that it wasn't asked for");
+				}
+
+				StoreTile(result);
+				worker.tile = -1;
+				stats.workerSeconds += result.seconds;
+				stats.rays += result.rays;
+				stats.marchedRays += result.marchedRays;
+				return true;
+			}
+
+			throw std::runtime_error("sent an unexpected message");
+		}
+		catch (const std::exception& e)
+		{
+			std::cout << "Worker " << worker.name << ": " << e.what() << std::endl;
+			return false;
+		}
+	}
+
+	void TileCoordinator::RemoveWorker(Worker* worker)
+	{
+		if (worker->tile >= 0)
+		{
+			pendingTiles.insert(uint32_t(worker->tile));
+			stats.reassignedTiles++;
+		}
+
+		workers.erase(std::find(workers.begin(), workers.end(), worker));
+		delete worker;
+	}
+
+	void TileCoordinator::StoreTile(const TileResult& result)
+	{
+		const uint32_t band = result.tileIndex / tilesX;
+		Band* rows = bands[band];
+		if (rows == nullptr || tileDone[result.tileIndex]) {
+			throw std::runtime_error("TileCoordinator: tile " + std::to_string(result.tileIndex) + " arrived twice");
+		}
+
+		// Into the band as 8 bit grey, like CloudReferenceRender's images
+		const uint32_t bandY = band * settings.tileHeight;
+		for (uint32_t y = 0; y < result.region.height; y++)
+		{
+			const CloudPixel* source = &result.pixels[size_t(y) * result.region.width];
+			uint8_t* destination = &rows->rows[size_t(result.region.y - bandY + y) * settings.render.width + result.region.x];
+			for (uint32_t x = 0; x < result.region.width; x++)
+			{
+				const float display = DisplayValue(source[x].lightEnergy, source[x].coverage);
+				destination[x] = static_cast<uint8_t>(std::min(255.0f, display * 255.0f + 0.5f));
+			}
+		}
+
+		tileDone[result.tileIndex] = true;
+		rows->tilesLeft--;
+	}
+
+	void TileCoordinator::HandOutTiles()
+	{
+		for (Worker* worker : workers)
+		{
+			if (!worker->ready || worker->tile >= 0) {
+				continue;
+			}
+			if (pendingTiles.empty()) {
+				break;
+			}
+
+			// Bands further ahead would have to be held until the ones before them are written
+			const uint32_t tile = *pendingTiles.begin();
+			const uint32_t band = tile / tilesX;
+			if (band >= nextBandToWrite + settings.maxBandsInFlight) {
+				break;
+			}
+
+			if (bands[band] == nullptr)
+			{
+				const uint32_t bandHeight = GetTileRegion(tile).height;
+				bands[band] = new Band();
+				bands[band]->rows.assign(size_t(bandHeight) * settings.render.width, 0);
+				bands[band]->tilesLeft = tilesX;
+			}
+
+			TileJob job;
+			job.tileIndex = tile;
+			job.settings = settings.render;
+			job.settings.region = GetTileRegion(tile);
+			job.passes = settings.passes;
+			job.seed = settings.seed;
+
+			try {
+				WriteMessage(worker->socket, MessageType::Job, job.Serialize());
+			}
+			catch (const std::exception& e)
+			{
+				// It will show up as disconnected, the tile stays pending
+				std::cout << "Worker " << worker->name << ": " << e.what() << std::endl;
+				continue;
+			}
+
+			pendingTiles.erase(pendingTiles.begin());
+			worker->tile = int(tile);
+			worker->deadline = std::chrono::steady_clock::now() +
+				std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(settings.tileTimeoutSeconds));
+		}
+	}
+
+	double TileCoordinator::GetSecondsToNextDeadline() const
+	{
+		if (settings.tileTimeoutSeconds <= 0.0) {
+			return -1.0;
+		}
+
+		double seconds = -1.0;
+		const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		for (const Worker* worker : workers)
+		{
+			if (worker->tile < 0) {
+				continue;
+			}
+			const double left = std::max(0.0, std::chrono::duration<double>(worker->deadline - now).count());
+			if (seconds < 0.0 || left < seconds) {
+				seconds = left;
+			}
+		}
+		return seconds;
+	}
+
+	void TileCoordinator::WriteFinishedBands()
+	{
+		while (nextBandToWrite < GetBandCount() && bands[nextBandToWrite] != nullptr && bands[nextBandToWrite]->tilesLeft == 0)
+		{
+			Band* band = bands[nextBandToWrite];
+			writer->WriteRows(band->rows.data(), uint32_t(band->rows.size() / settings.render.width));
+			delete band;
+			bands[nextBandToWrite] = nullptr;
+			nextBandToWrite++;
+
+			std::cout << "Band " << nextBandToWrite << "/" << GetBandCount() << " written, " << writer->GetRowsWritten()
+					  << " rows" << std::endl;
+		}
+	}
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <set>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "TileProtocol.h"
+#include "StreamingPngWriter.h"
+
+namespace CloudReference
+{
+	struct TiledImageSettings
+	{
+		RenderSettings render;			// the whole image, its region is ignored
+		uint32_t tileWidth = 256;
+		uint32_t tileHeight = 256;
+		uint32_t passes = 1;			// > 1 --> progressive accumulation of every tile, see TileJob
+		uint32_t seed = 1;
+		uint32_t maxBandsInFlight = 2;	// rows of tiles that are handed out before the first unfinished one is written
+		double tileTimeoutSeconds = 600.0;	// a worker that hasn't sent its tile by then is dropped, 0 --> no limit
+	};
+
+	struct TiledRenderStats
+	{
+		uint32_t tiles = 0;
+		uint32_t workers = 0;			// that connected during the render
+		uint32_t reassignedTiles = 0;	// handed out again because their worker went away
+		double seconds = 0.0;			// wall time from the first job to the end of the file
+		double workerSeconds = 0.0;		// render time summed over the workers
+		uint64_t rays = 0;
+		uint64_t marchedRays = 0;
+
+		// One line for the console
+		std::string Describe() const;
+	};
+
+	/*
+		Renders a huge still with worker processes (TileWorker.h), on this machine or others, and streams it into a PNG.
+
+		The image is split into tiles. A tile's job is the settings of the whole image with the tile as the region that
+		is rendered: the view is the camera's frustum cut down to the tile, an off-axis projection of it, and its rays
+		are exactly the ones of the image rendered at once. With the same time, sun, quality and seed in every job, and
+		the same noise textures on every worker, the tiles join without seams.
+
+		Tiles are handed out a row of tiles (a band) at a time, in order, to whichever worker is free. The rows of
+		finished bands go to the StreamingPngWriter as soon as the bands before them are written, so the coordinator
+		only holds maxBandsInFlight bands of 8 bit pixels, never the whole image. Workers may connect at any time;
+		the tile of a worker that goes away is handed out again. So is the tile of a worker that hangs without
+		closing its connection: it is dropped once its tile is tileTimeoutSeconds late (and a machine that drops off
+		the network shows up as disconnected through the keepalive probes).
+	*/
+	class TileCoordinator
+	{
+	public:
+		// Starts listening for workers on 'port' of every interface
+		TileCoordinator(const TiledImageSettings& settings, uint16_t port);
+		~TileCoordinator();
+
+		TileCoordinator(const TileCoordinator&) = delete;
+		TileCoordinator& operator=(const TileCoordinator&) = delete;
+
+		// Returns once 'outputPath' is complete. Tells the workers to quit at the end
+		TiledRenderStats Run(const std::string& outputPath);
+
+	private:
+		struct Worker
+		{
+			Socket socket;
+			std::string name;
+			int tile = -1;			// the tile it is rendering, -1 --> idle
+			std::chrono::steady_clock::time_point deadline;	// for the tile
+			bool ready = false;		// said Hello
+		};
+
+		struct Band
+		{
+			std::vector<uint8_t> rows;	// 8 bit grey, band height x image width
+			uint32_t tilesLeft = 0;
+		};
+
+		PixelRegion GetTileRegion(uint32_t tile) const;
+		uint32_t GetBandCount() const;
+
+		void AcceptWorker();
+		// False if the worker went away or broke the protocol
+		bool HandleMessage(Worker& worker);
+		// Puts its tile back into the pending ones
+		void RemoveWorker(Worker* worker);
+		void StoreTile(const TileResult& result);
+		void HandOutTiles();
+		void WriteFinishedBands();
+		// Seconds until the first tile deadline, < 0 --> no tile is out or there is no limit
+		double GetSecondsToNextDeadline() const;
+
+		TiledImageSettings settings;
+		uint32_t tilesX;
+		uint32_t tilesY;
+
+		Socket listener;
+		std::vector<Worker*> workers;
+
+		std::set<uint32_t> pendingTiles;	// the first one is handed out next
+		std::vector<bool> tileDone;
+		std::vector<Band*> bands;			// nullptr until the band's first tile is handed out and after it is written
+		uint32_t nextBandToWrite = 0;
+
+		StreamingPngWriter* writer = nullptr;
+		TiledRenderStats stats;
+	};
+}
@@ -0,0 +1,624 @@
+#include "TileProtocol.h"
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#endif
+
+namespace CloudReference
+{
+	namespace
+	{
+#ifdef _WIN32
+		const Socket::Handle INVALID_HANDLE = Socket::Handle(INVALID_SOCKET);
+
+		void CloseHandle(Socket::Handle handle)
+		{
+			closesocket(SOCKET(handle));
+		}
+
+		// WSAStartup once for the whole process
+		void InitializeSockets()
+		{
+			static bool initialized = false;
+			if (!initialized)
+			{
+				WSADATA data;
+				if (WSAStartup(MAKEWORD(2, 2), &data) != 0) {
+					throw std::runtime_error("failed to initialize winsock");
+				}
+				initialized = true;
+			}
+		}
+#else
+		const Socket::Handle INVALID_HANDLE = -1;
+
+		void CloseHandle(Socket::Handle handle)
+		{
+			close(handle);
+		}
+
+		void InitializeSockets()
+		{
+		}
+#endif
+
+#ifdef MSG_NOSIGNAL
+		// A closed connection is reported by send, not by SIGPIPE killing the process
+		const int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+		const int SEND_FLAGS = 0;
+#endif
+
+		// Tiles and jobs are sent as soon as they are ready, without waiting for more data to fill a packet
+		void DisableNagle(Socket::Handle handle)
+		{
+			int enable = 1;
+			setsockopt(handle, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&enable), sizeof(enable));
+		}
+
+		// An idle connection to a machine that dropped off the network never shows up as closed by itself. With keepalive
+		// probes it does after a few minutes (where the probe timing can be set, the system default is two hours)
+		void EnableKeepAlive(Socket::Handle handle)
+		{
+			int enable = 1;
+			setsockopt(handle, SOL_SOCKET, SO_KEEPALIVE, reinterpret_cast<const char*>(&enable), sizeof(enable));
+#if defined(TCP_KEEPIDLE) && defined(TCP_KEEPINTVL) && defined(TCP_KEEPCNT)
+			int idleSeconds = 60;
+			int intervalSeconds = 10;
+			int probes = 6;
+			setsockopt(handle, IPPROTO_TCP, TCP_KEEPIDLE, reinterpret_cast<const char*>(&idleSeconds), sizeof(idleSeconds));
+			setsockopt(handle, IPPROTO_TCP, TCP_KEEPINTVL, reinterpret_cast<const char*>(&intervalSeconds), sizeof(intervalSeconds));
+			setsockopt(handle, IPPROTO_TCP, TCP_KEEPCNT, reinterpret_cast<const char*>(&probes), sizeof(probes));
+#endif
+		}
+
+		void StoreUint32(uint8_t* bytes, uint32_t value)
+		{
+			bytes[0] = uint8_t(value);
+			bytes[1] = uint8_t(value >> 8);
+			bytes[2] = uint8_t(value >> 16);
+			bytes[3] = uint8_t(value >> 24);
+		}
+
+		uint32_t LoadUint32(const uint8_t* bytes)
+		{
+			return uint32_t(bytes[0]) | (uint32_t(bytes[1]) << 8) | (uint32_t(bytes[2]) << 16) | (uint32_t(bytes[3]) << 24);
+		}
+	}
+
+	//--------------------------------------------------------
+	//					Socket
+	//--------------------------------------------------------
+
+	Socket::Socket()
+		: handle(INVALID_HANDLE)
+	{
+	}
+
+	Socket::Socket(Handle handle)
+		: handle(handle)
+	{
+	}
+
+	Socket::~Socket()
+	{
+		Close();
+	}
+
+	Socket::Socket(Socket&& other)
+		: handle(other.handle)
+	{
+		other.handle = INVALID_HANDLE;
+	}
+
+	Socket& Socket::operator=(Socket&& other)
+	{
+		if (this != &other)
+		{
+			Close();
+			handle = other.handle;
+			other.handle = INVALID_HANDLE;
+		}
+		return *this;
+	}
+
+	void Socket::Close()
+	{
+		if (handle != INVALID_HANDLE)
+		{
+			CloseHandle(handle);
+			handle = INVALID_HANDLE;
+		}
+	}
+
+	bool Socket::IsValid() const
+	{
+		return handle != INVALID_HANDLE;
+	}
+
+	Socket::Handle Socket::GetHandle() const
+	{
+		return handle;
+	}
+
+	Socket Socket::Listen(uint16_t port)
+	{
+		InitializeSockets();
+
+		Socket listener(Handle(socket(AF_INET, SOCK_STREAM, IPPROTO_TCP)));
+		if (!listener.IsValid()) {
+			throw std::runtime_error("failed to create a socket");
+		}
+
+		// A coordinator restarted right away can take the port again
+		int enable = 1;
+		setsockopt(listener.handle, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&enable), sizeof(enable));
+
+		sockaddr_in address;
+		std::memset(&address, 0, sizeof(address));
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = htonl(INADDR_ANY);
+		address.sin_port = htons(port);
+		if (bind(listener.handle, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+			throw std::runtime_error("failed to bind to port " + std::to_string(port));
+		}
+		if (listen(listener.handle, SOMAXCONN) != 0) {
+			throw std::runtime_error("failed to listen on port " + std::to_string(port));
+		}
+		return listener;
+	}
+
+	Socket Socket::Connect(const std::string& host, uint16_t port)
+	{
+		InitializeSockets();
+
+		addrinfo hints;
+		std::memset(&hints, 0, sizeof(hints));
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = SOCK_STREAM;
+		hints.ai_protocol = IPPROTO_TCP;
+
+		addrinfo* addresses = nullptr;
+		if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addresses) != 0) {
+			throw std::runtime_error("failed to resolve " + host);
+		}
+
+		Socket connection;
+		for (addrinfo* address = addresses; address != nullptr; address = address->ai_next)
+		{
+			Socket candidate(Handle(socket(address->ai_family, address->ai_socktype, address->ai_protocol)));
+			if (candidate.IsValid() && connect(candidate.handle, address->ai_addr, int(address->ai_addrlen)) == 0)
+			{
+				connection = std::move(candidate);
+				break;
+			}
+		}
+		freeaddrinfo(addresses);
+
+		if (!connection.IsValid()) {
+			throw std::runtime_error("failed to connect to " + host + ":" + std::to_string(port));
+		}
+		DisableNagle(connection.handle);
+		EnableKeepAlive(connection.handle);
+		return connection;
+	}
+
+	Socket Socket::Accept()
+	{
+		Socket connection(Handle(accept(handle, nullptr, nullptr)));
+		if (!connection.IsValid()) {
+			throw std::runtime_error("failed to accept a connection");
+		}
+		DisableNagle(connection.handle);
+		EnableKeepAlive(connection.handle);
+		return connection;
+	}
+
+	std::string Socket::GetPeerName() const
+	{
+		sockaddr_storage address;
+		socklen_t length = sizeof(address);
+		if (getpeername(handle, reinterpret_cast<sockaddr*>(&address), &length) != 0) {
+			return "?";
+		}
+
+		char host[NI_MAXHOST];
+		char port[NI_MAXSERV];
+		if (getnameinfo(reinterpret_cast<const sockaddr*>(&address), length, host, sizeof(host), port, sizeof(port),
+						NI_NUMERICHOST | NI_NUMERICSERV) != 0) {
+			return "?";
+		}
+		return std::string(host) + ":" + port;
+	}
+
+	void Socket::SendAll(const void* data, size_t size)
+	{
+		const char* bytes = static_cast<const char*>(data);
+		while (size > 0)
+		{
+			const int chunk = int(std::min<size_t>(size, 1u << 30));
+			const int sent = int(send(handle, bytes, chunk, SEND_FLAGS));
+			if (sent <= 0) {
+				throw std::runtime_error("connection lost while sending");
+			}
+			bytes += sent;
+			size -= size_t(sent);
+		}
+	}
+
+	bool Socket::ReceiveAll(void* data, size_t size)
+	{
+		char* bytes = static_cast<char*>(data);
+		size_t received = 0;
+		while (received < size)
+		{
+			const int chunk = int(std::min<size_t>(size - received, 1u << 30));
+			const int count = int(recv(handle, bytes + received, chunk, 0));
+			if (count == 0 && received == 0) {
+				return false;
+			}
+			if (count <= 0) {
+				throw std::runtime_error("connection lost while receiving");
+			}
+			received += size_t(count);
+		}
+		return true;
+	}
+
+	std::vector<size_t> WaitForReadable(const std::vector<const Socket*>& sockets, double timeoutSeconds)
+	{
+		fd_set readable;
+		FD_ZERO(&readable);
+		Socket::Handle maxHandle = 0;
+		for (const Socket* socket : sockets)
+		{
+			FD_SET(socket->GetHandle(), &readable);
+			maxHandle = std::max(maxHandle, socket->GetHandle());
+		}
+
+		timeval timeout;
+		timeval* timeoutPointer = nullptr;
+		if (timeoutSeconds >= 0.0)
+		{
+			const double wholeSeconds = double(long(timeoutSeconds));
+			timeout.tv_sec = long(wholeSeconds);
+			timeout.tv_usec = long((timeoutSeconds - wholeSeconds) * 1e6);
+			timeoutPointer = &timeout;
+		}
+
+		if (select(int(maxHandle + 1), &readable, nullptr, nullptr, timeoutPointer) < 0) {
+			throw std::runtime_error("select failed");
+		}
+
+		std::vector<size_t> ready;
+		for (size_t i = 0; i < sockets.size(); i++)
+		{
+			if (FD_ISSET(sockets[i]->GetHandle(), &readable)) {
+				ready.push_back(i);
+			}
+		}
+		return ready;
+	}
+
+	void WriteMessage(Socket& socket, MessageType type, const std::vector<uint8_t>& payload)
+	{
+		uint8_t header[12];
+		StoreUint32(header + 0, TILE_PROTOCOL_MAGIC);
+		StoreUint32(header + 4, uint32_t(type));
+		StoreUint32(header + 8, uint32_t(payload.size()));
+		socket.SendAll(header, sizeof(header));
+		if (!payload.empty()) {
+			socket.SendAll(payload.data(), payload.size());
+		}
+	}
+
+	bool ReadMessage(Socket& socket, Message& message)
+	{
+		uint8_t header[12];
+		if (!socket.ReceiveAll(header, sizeof(header))) {
+			return false;
+		}
+		if (LoadUint32(header) != TILE_PROTOCOL_MAGIC) {
+			throw std::runtime_error("not a tile protocol message");
+		}
+
+		const uint32_t size = LoadUint32(header + 8);
+		if (size > TILE_PROTOCOL_MAX_PAYLOAD) {
+			throw std::runtime_error("tile protocol message too large");
+		}
+
+		message.type = MessageType(LoadUint32(header + 4));
+		message.payload.resize(size);
+		if (size > 0 && !socket.ReceiveAll(message.payload.data(), size)) {
+			throw std::runtime_error("connection lost while receiving");
+		}
+		return true;
+	}
+
+	//--------------------------------------------------------
+	//				Payload serialization
+	//--------------------------------------------------------
+
+	void PayloadWriter::PutUint32(uint32_t value)
+	{
+		uint8_t data[4];
+		StoreUint32(data, value);
+		bytes.insert(bytes.end(), data, data + 4);
+	}
+
+	void PayloadWriter::PutUint64(uint64_t value)
+	{
+		PutUint32(uint32_t(value));
+		PutUint32(uint32_t(value >> 32));
+	}
+
+	void PayloadWriter::PutFloat(float value)
+	{
+		uint32_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		PutUint32(bits);
+	}
+
+	void PayloadWriter::PutDouble(double value)
+	{
+		uint64_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		PutUint64(bits);
+	}
+
+	void PayloadWriter::PutVec2(const glm::vec2& value)
+	{
+		PutFloat(value.x);
+		PutFloat(value.y);
+	}
+
+	void PayloadWriter::PutVec3(const glm::vec3& value)
+	{
+		PutFloat(value.x);
+		PutFloat(value.y);
+		PutFloat(value.z);
+	}
+
+	PayloadReader::PayloadReader(const std::vector<uint8_t>& bytes)
+		: bytes(bytes)
+	{
+	}
+
+	const uint8_t* PayloadReader::Take(size_t size)
+	{
+		if (bytes.size() - offset < size) {
+			throw std::runtime_error("tile protocol message too short");
+		}
+		const uint8_t* data = bytes.data() + offset;
+		offset += size;
+		return data;
+	}
+
+	uint32_t PayloadReader::GetUint32()
+	{
+		return LoadUint32(Take(4));
+	}
+
+	uint64_t PayloadReader::GetUint64()
+	{
+		const uint64_t low = GetUint32();
+		const uint64_t high = GetUint32();
+		return low | (high << 32);
+	}
+
+	float PayloadReader::GetFloat()
+	{
+		const uint32_t bits = GetUint32();
+		float value;
+		std::memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+
+	double PayloadReader::GetDouble()
+	{
+		const uint64_t bits = GetUint64();
+		double value;
+		std::memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+
+	glm::vec2 PayloadReader::GetVec2()
+	{
+		const float x = GetFloat();
+		const float y = GetFloat();
+		return glm::vec2(x, y);
+	}
+
+	glm::vec3 PayloadReader::GetVec3()
+	{
+		const float x = GetFloat();
+		const float y = GetFloat();
+		const float z = GetFloat();
+		return glm::vec3(x, y, z);
+	}
+
+	void PayloadReader::ExpectEnd() const
+	{
+		if (offset != bytes.size()) {
+			throw std::runtime_error("tile protocol message too long");
+		}
+	}
+
+	//--------------------------------------------------------
+	//					Tile messages
+	//--------------------------------------------------------
+
+	std::vector<uint8_t> WorkerHello::Serialize() const
+	{
+		PayloadWriter writer;
+		writer.PutUint32(version);
+		writer.PutUint32(threads);
+		return writer.bytes;
+	}
+
+	WorkerHello WorkerHello::Deserialize(const std::vector<uint8_t>& payload)
+	{
+		PayloadReader reader(payload);
+		WorkerHello hello;
+		hello.version = reader.GetUint32();
+		hello.threads = reader.GetUint32();
+		reader.ExpectEnd();
+		return hello;
+	}
+
+	std::vector<uint8_t> TileJob::Serialize() const
+	{
+		PayloadWriter writer;
+		writer.PutUint32(tileIndex);
+		writer.PutUint32(passes);
+		writer.PutUint32(seed);
+
+		writer.PutUint32(settings.width);
+		writer.PutUint32(settings.height);
+		writer.PutUint32(settings.region.x);
+		writer.PutUint32(settings.region.y);
+		writer.PutUint32(settings.region.width);
+		writer.PutUint32(settings.region.height);
+
+		writer.PutVec3(settings.view.eye);
+		writer.PutVec3(settings.view.right);
+		writer.PutVec3(settings.view.up);
+		writer.PutVec3(settings.view.look);
+		writer.PutVec2(settings.view.tanFovBy2);
+
+		const Quality& quality = settings.march.quality;
+		writer.PutUint32(uint32_t(quality.lodEnabled));
+		writer.PutFloat(quality.stepGrowthStartDistance);
+		writer.PutFloat(quality.stepGrowthPerKm);
+		writer.PutFloat(quality.maxStepScale);
+		writer.PutFloat(quality.detailFadeStartDistance);
+		writer.PutFloat(quality.detailFadeEndDistance);
+		writer.PutFloat(quality.curlFadeStartDistance);
+		writer.PutFloat(quality.curlFadeEndDistance);
+		writer.PutFloat(quality.farLightSampleDistance);
+		writer.PutUint32(uint32_t(quality.nearLightSamples));
+		writer.PutUint32(uint32_t(quality.farLightSamples));
+		writer.PutFloat(quality.minMarchSteps);
+		writer.PutFloat(quality.maxMarchSteps);
+
+		writer.PutVec3(settings.march.sunDirection);
+		writer.PutFloat(settings.march.time);
+		writer.PutFloat(settings.march.stepOffset);
+		writer.PutFloat(settings.march.coneRotation);
+
+		writer.PutUint32(settings.packets ? 1u : 0u);
+		return writer.bytes;
+	}
+
+	TileJob TileJob::Deserialize(const std::vector<uint8_t>& payload)
+	{
+		PayloadReader reader(payload);
+		TileJob job;
+		job.tileIndex = reader.GetUint32();
+		job.passes = reader.GetUint32();
+		job.seed = reader.GetUint32();
+
+		job.settings.width = reader.GetUint32();
+		job.settings.height = reader.GetUint32();
+		job.settings.region.x = reader.GetUint32();
+		job.settings.region.y = reader.GetUint32();
+		job.settings.region.width = reader.GetUint32();
+		job.settings.region.height = reader.GetUint32();
+
+		job.settings.view.eye = reader.GetVec3();
+		job.settings.view.right = reader.GetVec3();
+		job.settings.view.up = reader.GetVec3();
+		job.settings.view.look = reader.GetVec3();
+		job.settings.view.tanFovBy2 = reader.GetVec2();
+
+		Quality& quality = job.settings.march.quality;
+		quality.lodEnabled = int(reader.GetUint32());
+		quality.stepGrowthStartDistance = reader.GetFloat();
+		quality.stepGrowthPerKm = reader.GetFloat();
+		quality.maxStepScale = reader.GetFloat();
+		quality.detailFadeStartDistance = reader.GetFloat();
+		quality.detailFadeEndDistance = reader.GetFloat();
+		quality.curlFadeStartDistance = reader.GetFloat();
+		quality.curlFadeEndDistance = reader.GetFloat();
+		quality.farLightSampleDistance = reader.GetFloat();
+		quality.nearLightSamples = int(reader.GetUint32());
+		quality.farLightSamples = int(reader.GetUint32());
+		quality.minMarchSteps = reader.GetFloat();
+		quality.maxMarchSteps = reader.GetFloat();
+
+		job.settings.march.sunDirection = reader.GetVec3();
+		job.settings.march.time = reader.GetFloat();
+		job.settings.march.stepOffset = reader.GetFloat();
+		job.settings.march.coneRotation = reader.GetFloat();
+
+		job.settings.packets = (reader.GetUint32() != 0);
+		reader.ExpectEnd();
+		return job;
+	}
+
+	std::vector<uint8_t> TileResult::Serialize() const
+	{
+		PayloadWriter writer;
+		writer.bytes.reserve(64 + pixels.size() * 12);
+		writer.PutUint32(tileIndex);
+		writer.PutUint32(region.x);
+		writer.PutUint32(region.y);
+		writer.PutUint32(region.width);
+		writer.PutUint32(region.height);
+		writer.PutDouble(seconds);
+		writer.PutUint64(rays);
+		writer.PutUint64(marchedRays);
+
+		writer.PutUint32(uint32_t(pixels.size()));
+		for (const CloudPixel& pixel : pixels)
+		{
+			writer.PutFloat(pixel.lightEnergy);
+			writer.PutFloat(pixel.coverage);
+			writer.PutFloat(pixel.firstHitKm);
+		}
+		return writer.bytes;
+	}
+
+	TileResult TileResult::Deserialize(const std::vector<uint8_t>& payload)
+	{
+		PayloadReader reader(payload);
+		TileResult result;
+		result.tileIndex = reader.GetUint32();
+		result.region.x = reader.GetUint32();
+		result.region.y = reader.GetUint32();
+		result.region.width = reader.GetUint32();
+		result.region.height = reader.GetUint32();
+		result.seconds = reader.GetDouble();
+		result.rays = reader.GetUint64();
+		result.marchedRays = reader.GetUint64();
+
+		const uint32_t pixelCount = reader.GetUint32();
+		if (uint64_t(pixelCount) != uint64_t(result.region.width) * result.region.height) {
+			throw std::runtime_error("tile protocol: the pixels don't match the tile");
+		}
+		result.pixels.resize(pixelCount);
+		for (CloudPixel& pixel : result.pixels)
+		{
+			pixel.lightEnergy = reader.GetFloat();
+			pixel.coverage = reader.GetFloat();
+			pixel.firstHitKm = reader.GetFloat();
+		}
+		reader.ExpectEnd();
+		return result;
+	}
+}
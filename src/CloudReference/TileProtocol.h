@@ -0,0 +1,167 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "CpuCloudRenderer.h"
+
+/*
+	The messages between the coordinator (TileCoordinator.h) and the workers (TileWorker.h) of a tiled render, over TCP.
+
+	Every message is a header of three 32 bit words (TILE_PROTOCOL_MAGIC, MessageType, payload size) followed by the
+	payload. All numbers are little endian and floats are sent as their bits, so the machines can differ in byte order
+	but not in the float format. A worker connects and says Hello, the coordinator answers with a Job, the worker with
+	the Tile, and so on until the coordinator sends Quit or goes away.
+*/
+
+#define TILE_PROTOCOL_MAGIC 0x4C544352u		// "RCTL"
+#define TILE_PROTOCOL_VERSION 1u
+#define TILE_PROTOCOL_MAX_PAYLOAD (256u * 1024u * 1024u)
+
+namespace CloudReference
+{
+	enum class MessageType : uint32_t
+	{
+		Hello = 1,		// worker --> coordinator: protocol version and thread count
+		Job = 2,		// coordinator --> worker: a TileJob
+		Tile = 3,		// worker --> coordinator: a TileResult
+		Quit = 4		// coordinator --> worker: no more tiles
+	};
+
+	struct Message
+	{
+		MessageType type;
+		std::vector<uint8_t> payload;
+	};
+
+	//--------------------------------------------------------
+	//					Socket
+	//--------------------------------------------------------
+
+	// A blocking TCP socket, closed by the destructor. Errors throw std::runtime_error. Connections send keepalive
+	// probes, so a peer that vanished without closing the connection eventually reads as closed
+	class Socket
+	{
+	public:
+#ifdef _WIN32
+		typedef uintptr_t Handle;
+#else
+		typedef int Handle;
+#endif
+
+		Socket();
+		~Socket();
+		Socket(Socket&& other);
+		Socket& operator=(Socket&& other);
+		Socket(const Socket&) = delete;
+		Socket& operator=(const Socket&) = delete;
+
+		// Listens on 'port' of every interface
+		static Socket Listen(uint16_t port);
+		static Socket Connect(const std::string& host, uint16_t port);
+		Socket Accept();
+
+		bool IsValid() const;
+		Handle GetHandle() const;
+		// "address:port" of the other end
+		std::string GetPeerName() const;
+
+		void SendAll(const void* data, size_t size);
+		// False if the other end closed the connection before the first byte, throws if it does so in the middle
+		bool ReceiveAll(void* data, size_t size);
+
+		void Close();
+
+	private:
+		explicit Socket(Handle handle);
+
+		Handle handle;
+	};
+
+	// Waits until at least one of the sockets can be read (data, a connection to accept or a closed connection) and
+	// returns their indices. Gives up after 'timeoutSeconds' (< 0 --> waits as long as it takes) with none
+	std::vector<size_t> WaitForReadable(const std::vector<const Socket*>& sockets, double timeoutSeconds = -1.0);
+
+	void WriteMessage(Socket& socket, MessageType type, const std::vector<uint8_t>& payload);
+	// False if the connection was closed between messages
+	bool ReadMessage(Socket& socket, Message& message);
+
+	//--------------------------------------------------------
+	//				Payload serialization
+	//--------------------------------------------------------
+
+	class PayloadWriter
+	{
+	public:
+		void PutUint32(uint32_t value);
+		void PutUint64(uint64_t value);
+		void PutFloat(float value);
+		void PutDouble(double value);
+		void PutVec2(const glm::vec2& value);
+		void PutVec3(const glm::vec3& value);
+
+		std::vector<uint8_t> bytes;
+	};
+
+	// Throws if the payload is shorter than what is read
+	class PayloadReader
+	{
+	public:
+		explicit PayloadReader(const std::vector<uint8_t>& bytes);
+
+		uint32_t GetUint32();
+		uint64_t GetUint64();
+		float GetFloat();
+		double GetDouble();
+		glm::vec2 GetVec2();
+		glm::vec3 GetVec3();
+
+		// Throws if bytes are left over
+		void ExpectEnd() const;
+
+	private:
+		const uint8_t* Take(size_t size);
+
+		const std::vector<uint8_t>& bytes;
+		size_t offset = 0;
+	};
+
+	//--------------------------------------------------------
+	//					Tile messages
+	//--------------------------------------------------------
+
+	struct WorkerHello
+	{
+		uint32_t version = TILE_PROTOCOL_VERSION;
+		uint32_t threads = 0;
+
+		std::vector<uint8_t> Serialize() const;
+		static WorkerHello Deserialize(const std::vector<uint8_t>& payload);
+	};
+
+	// Everything a worker needs to render a tile: the settings of the whole image with the tile as its region. The
+	// noise textures are the worker's own, they have to be the same files everywhere
+	struct TileJob
+	{
+		uint32_t tileIndex = 0;
+		RenderSettings settings;
+		uint32_t passes = 1;	// > 1 --> progressive accumulation of that many passes (ProgressiveRenderer.h)
+		uint32_t seed = 1;		// of the accumulation, the same for all tiles
+
+		std::vector<uint8_t> Serialize() const;
+		static TileJob Deserialize(const std::vector<uint8_t>& payload);
+	};
+
+	struct TileResult
+	{
+		uint32_t tileIndex = 0;
+		PixelRegion region;
+		double seconds = 0.0;		// render time on the worker
+		uint64_t rays = 0;
+		uint64_t marchedRays = 0;
+		std::vector<CloudPixel> pixels;
+
+		std::vector<uint8_t> Serialize() const;
+		static TileResult Deserialize(const std::vector<uint8_t>& payload);
+	};
+}
@@ -0,0 +1,73 @@
+#include "TileWorker.h"
+#include "ProgressiveRenderer.h"
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+
+namespace CloudReference
+{
+	TileWorker::TileWorker(const NoiseTextures& textures, uint32_t threadCount)
+		: renderer(textures, threadCount)
+	{
+	}
+
+	uint32_t TileWorker::Run(const std::string& host, uint16_t port)
+	{
+		Socket socket = Socket::Connect(host, port);
+
+		WorkerHello hello;
+		hello.threads = renderer.GetThreadCount();
+		WriteMessage(socket, MessageType::Hello, hello.Serialize());
+
+		uint32_t tiles = 0;
+		Message message;
+		while (ReadMessage(socket, message))
+		{
+			if (message.type == MessageType::Quit) {
+				break;
+			}
+			if (message.type != MessageType::Job) {
+				throw std::runtime_error("TileWorker: unexpected message from the coordinator");
+			}
+
+			const TileJob job = TileJob::Deserialize(message.payload);
+			const TileResult result = RenderTile(job);
+			WriteMessage(socket, MessageType::Tile, result.Serialize());
+			tiles++;
+
+			std::cout << "Tile " << job.tileIndex << " (" << job.settings.region.width << "x" << job.settings.region.height
+					  << " at " << job.settings.region.x << ", " << job.settings.region.y << "): " << result.seconds << " s" << std::endl;
+		}
+		return tiles;
+	}
+
+	TileResult TileWorker::RenderTile(const TileJob& job)
+	{
+		TileResult result;
+		result.tileIndex = job.tileIndex;
+		result.region = job.settings.RenderedRegion();
+
+		const std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+		if (job.passes > 1)
+		{
+			// A fixed number of passes: stopping at an error threshold would give every tile its own amount of noise
+			AccumulationSettings accumulation;
+			accumulation.maxPasses = job.passes;
+			accumulation.errorThreshold = 0.0f;
+			accumulation.seed = job.seed;
+
+			ProgressiveRenderer progressive(renderer);
+			const AccumulationStats stats = progressive.Render(job.settings, accumulation, result.pixels);
+			result.rays = stats.rays;
+			result.marchedRays = stats.marchedRays;
+		}
+		else
+		{
+			const RenderStats stats = renderer.Render(job.settings, result.pixels);
+			result.rays = stats.rays;
+			result.marchedRays = stats.marchedRays;
+		}
+		result.seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+		return result;
+	}
+}
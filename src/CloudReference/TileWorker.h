@@ -0,0 +1,27 @@
+#pragma once
+
+#include <string>
+#include "TileProtocol.h"
+
+namespace CloudReference
+{
+	/*
+		The worker side of a tiled render (TileCoordinator.h): connects to the coordinator and renders the tiles it is
+		sent with CpuCloudRenderer, one at a time with all of its threads, until the coordinator says Quit or goes away.
+		No window and no GPU, any machine that can reach the coordinator and has the noise textures can help.
+	*/
+	class TileWorker
+	{
+	public:
+		// The textures have to stay alive as long as the worker. 0 threads --> one per hardware thread
+		TileWorker(const NoiseTextures& textures, uint32_t threadCount = 0);
+
+		// Returns the number of tiles it rendered
+		uint32_t Run(const std::string& host, uint16_t port);
+
+	private:
+		TileResult RenderTile(const TileJob& job);
+
+		CpuCloudRenderer renderer;
+	};
+}
@@ -30,4 +30,35 @@ namespace FormatUtils
 									VK_IMAGE_TILING_OPTIMAL, 
 									VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT );
 	}
+
+	// Narrowest of 'candidates' (ordered narrowest first) that compute shaders can write to and sample with linear filtering.
+	// Put a format every GPU supports last, e.g. VK_FORMAT_R16G16B16A16_SFLOAT
+	inline VkFormat FindStorageImageFormat(VkPhysicalDevice physicalDevice, const std::vector<VkFormat>& candidates)
+	{
+		return FindSupportedFormat( physicalDevice, candidates, VK_IMAGE_TILING_OPTIMAL,
+									VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT );
+	}
+
+	// Bytes per texel of the color formats the renderer uses
+	inline uint32_t GetTexelSize(VkFormat format)
+	{
+		switch (format)
+		{
+		case VK_FORMAT_R8_UNORM:
+			return 1;
+		case VK_FORMAT_R16_SFLOAT:
+			return 2;
+		case VK_FORMAT_R8G8B8A8_UNORM:
+		case VK_FORMAT_R8G8B8A8_SNORM:
+		case VK_FORMAT_B10G11R11_UFLOAT_PACK32:
+		case VK_FORMAT_R32_SFLOAT:
+			return 4;
+		case VK_FORMAT_R16G16B16A16_SFLOAT:
+			return 8;
+		case VK_FORMAT_R32G32B32A32_SFLOAT:
+			return 16;
+		default:
+			throw std::runtime_error("Unknown texel size");
+		}
+	}
 }
\ No newline at end of file
@@ -0,0 +1,203 @@
+#include "FrameGraph.h"
+#include <stdexcept>
+
+uint32_t FrameGraph::AddResource(const std::string& name, bool carriedOver)
+{
+	Resource resource;
+	resource.name = name;
+	resource.carriedOver = carriedOver;
+	resource.output = false;
+	resource.readerStages = 0;
+	resources.push_back(resource);
+	compiled = false;
+	return static_cast<uint32_t>(resources.size() - 1);
+}
+
+void FrameGraph::MarkOutput(uint32_t resource, VkPipelineStageFlags readerStages)
+{
+	resources.at(resource).output = true;
+	resources.at(resource).readerStages |= readerStages;
+	compiled = false;
+}
+
+void FrameGraph::AddPass(const std::string& name, uint32_t profilerPass, VkPipelineStageFlags stages,
+						 const std::vector<uint32_t>& reads, const std::vector<uint32_t>& writes, const RecordFunction& record)
+{
+	for (uint32_t resource : reads) {
+		resources.at(resource);
+	}
+	for (uint32_t resource : writes) {
+		resources.at(resource);
+	}
+
+	Pass pass;
+	pass.name = name;
+	pass.profilerPass = profilerPass;
+	pass.stages = stages;
+	pass.reads = reads;
+	pass.writes = writes;
+	pass.record = record;
+	passes.push_back(pass);
+	compiled = false;
+}
+
+void FrameGraph::Compile()
+{
+	//---------- Culling ----------
+	// Walk backwards from the outputs: a pass is needed if it writes something that is needed, and then so is everything it reads.
+	// Passes only ever update parts of their targets (the ray march rewrites one pixel in 16), so a write never ends a dependency
+	std::vector<bool> needed(resources.size(), false);
+	for (size_t r = 0; r < resources.size(); r++)
+	{
+		needed[r] = resources[r].output;
+	}
+
+	for (size_t p = passes.size(); p-- > 0;)
+	{
+		Pass& pass = passes[p];
+		pass.culled = true;
+		for (uint32_t resource : pass.writes)
+		{
+			if (needed[resource]) {
+				pass.culled = false;
+			}
+		}
+		if (!pass.culled)
+		{
+			for (uint32_t resource : pass.reads) {
+				needed[resource] = true;
+			}
+		}
+	}
+
+	//---------- Barriers ----------
+	// The passes between two barriers form a segment. A resource accessed in the current segment can't be accessed again
+	// (written, or read after a write) before a barrier ends the segment. The previous submission's work counts as segment 0
+	// for the carried over resources, so the first barrier also waits for the stages of every pass of the graph. Outputs read
+	// outside the graph are in segment 0 as well, and the first barrier waits for their readers' stages too
+	VkPipelineStageFlags allStages = 0;
+	VkPipelineStageFlags readerStages = 0;
+	outputStages = 0;
+	for (const Pass& pass : passes)
+	{
+		if (pass.culled) {
+			continue;
+		}
+		allStages |= pass.stages;
+		for (uint32_t resource : pass.writes)
+		{
+			if (resources[resource].output) {
+				outputStages |= pass.stages;
+			}
+		}
+	}
+
+	const int none = -1;
+	std::vector<int> lastWriteSegment(resources.size(), none);
+	std::vector<int> lastReadSegment(resources.size(), none);
+	for (size_t r = 0; r < resources.size(); r++)
+	{
+		if (resources[r].carriedOver || resources[r].readerStages != 0)
+		{
+			lastWriteSegment[r] = 0;
+			lastReadSegment[r] = 0;
+		}
+		if (resources[r].output) {
+			readerStages |= resources[r].readerStages;
+		}
+	}
+
+	int segment = 0;
+	VkPipelineStageFlags segmentStages = 0;
+	for (Pass& pass : passes)
+	{
+		pass.barrierSrcStages = 0;
+		if (pass.culled) {
+			continue;
+		}
+
+		bool hazard = false;
+		for (uint32_t resource : pass.reads) {
+			hazard = hazard || lastWriteSegment[resource] == segment;
+		}
+		for (uint32_t resource : pass.writes) {
+			hazard = hazard || lastWriteSegment[resource] == segment || lastReadSegment[resource] == segment;
+		}
+
+		if (hazard)
+		{
+			pass.barrierSrcStages = segmentStages | (segment == 0 ? allStages | readerStages : 0);
+			segment++;
+			segmentStages = 0;
+		}
+
+		for (uint32_t resource : pass.reads) {
+			lastReadSegment[resource] = segment;
+		}
+		for (uint32_t resource : pass.writes) {
+			lastWriteSegment[resource] = segment;
+		}
+		segmentStages |= pass.stages;
+	}
+
+	compiled = true;
+}
+
+void FrameGraph::Record(VkCommandBuffer commandBuffer, uint32_t variant, GpuProfiler* profiler, uint32_t querySet) const
+{
+	if (!compiled) {
+		throw std::runtime_error("Frame graph has to be compiled before it is recorded");
+	}
+
+	for (const Pass& pass : passes)
+	{
+		if (pass.culled) {
+			continue;
+		}
+
+		if (pass.barrierSrcStages != 0)
+		{
+			// Everything written before is made visible to the reads and writes of this pass
+			VkMemoryBarrier memoryBarrier = {};
+			memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+			memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+			vkCmdPipelineBarrier(commandBuffer, pass.barrierSrcStages, pass.stages, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+		}
+
+		if (pass.profilerPass != Untimed) {
+			profiler->RecordBeginPass(commandBuffer, querySet, pass.profilerPass);
+		}
+		pass.record(commandBuffer, variant);
+		if (pass.profilerPass != Untimed) {
+			profiler->RecordEndPass(commandBuffer, querySet, pass.profilerPass);
+		}
+	}
+}
+
+void FrameGraph::RecordOutputBarrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags dstStages) const
+{
+	if (!compiled) {
+		throw std::runtime_error("Frame graph has to be compiled before its output barrier is recorded");
+	}
+	if (outputStages == 0) {
+		return;
+	}
+
+	// Global, so buffers (the exposure) are covered as well as images
+	VkMemoryBarrier memoryBarrier = {};
+	memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+	vkCmdPipelineBarrier(commandBuffer, outputStages, dstStages, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+}
+
+void FrameGraph::Clear()
+{
+	resources.clear();
+	passes.clear();
+	outputStages = 0;
+	compiled = false;
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <functional>
+#include <string>
+#include <vector>
+#include "GpuProfiler.h"
+
+/*
+	A small frame graph for the passes recorded into one command buffer.
+
+	Passes are added in the order they run and declare the resources they read and write. A resource is a logical image
+	or buffer, or a group of them that is always used together (e.g. a pixel's cloud color, ray-start hint and light
+	history); which physical images stand behind it is up to the pass, so both ping pong variants share one graph.
+	Compile then
+	- culls every pass that doesn't contribute to an output (a resource read after the graph, by another queue or by a
+	  later frame), so optional passes can be added unconditionally and only run when something uses their result
+	- places a barrier only in front of the passes that actually depend on work since the last barrier (read after write,
+	  write after write, or write after read). A single barrier orders everything before it, so a pass whose inputs were
+	  made visible by an earlier barrier doesn't get another one
+	Record records the kept passes with their barriers and profiler timestamps, once per ping pong variant.
+	RecordOutputBarrier records the barrier the consumers of the outputs need into their own command buffer: a global
+	memory barrier from the stages of the passes that write outputs, so it covers images and buffers alike.
+
+	What the graph deliberately doesn't do:
+	- layout transitions: resources carry no layout. Every storage image the compute passes touch stays in
+	  VK_IMAGE_LAYOUT_GENERAL, so the barriers are plain memory barriers
+	- queue ownership and semaphores: the graph only records barriers. When the consumer runs on another queue the
+	  submissions still have to be ordered by the caller; Renderer::Frame has the graphics submission wait on a
+	  semaphore the compute submission signals. No queue family ownership transfers are recorded: the images and
+	  buffers are created with exclusive sharing, as they always were, which is only exact when the compute and
+	  graphics queues are of one family
+	- ping pong variants: nothing is generated. The renderer creates the descriptor sets of both variants
+	  (pingPongCloudResultSet1/2, cloudUpsampleSet1/2, toneMapSet1/2, TXAASet1/2) and the record functions pick
+	  theirs by 'variant'. The graph only saves recording the passes twice by hand
+	- the graphics command buffers: their passes aren't in the graph. It only provides the barrier in front of them
+	  (RecordOutputBarrier)
+	- memory aliasing: every target has its own memory. The occlusion mask is history (the ray march rewrites one pixel
+	  in 16 per frame), the cloud images, the final god rays and the exposure are read by the graphics queue or the next
+	  frame. The one target that dies within the frame is the god rays blur intermediate (godRaysTexture1): written by
+	  the downsampling and read by the last blur pass, all inside the god rays pass. It is a downsampled single channel
+	  image, and nothing else is alive over a disjoint part of the frame to share its memory with
+*/
+class FrameGraph
+{
+public:
+	// Records a pass' commands. 'variant' picks the ping pong descriptor sets the pass binds
+	typedef std::function<void(VkCommandBuffer commandBuffer, uint32_t variant)> RecordFunction;
+
+	// Profiler pass of passes that aren't timed
+	static const uint32_t Untimed = ~0u;
+
+	// 'carriedOver': also accessed by the previous submission of the graph (history that is ping ponged or accumulated
+	// over frames, or a resource a later frame rewrites while an earlier one might still read it). The first access in
+	// the graph then waits for the previous submission's passes
+	uint32_t AddResource(const std::string& name, bool carriedOver = false);
+	// Read after the graph, by another queue or by a later frame. Passes that don't lead to an output are culled.
+	// 'readerStages': the stages a consumer outside the graph reads it in, when those reads are on the queue the graph is
+	// submitted to. The next submission may rewrite the output while they still run, so like a carried over resource its
+	// first access waits, and the first barrier's source scope includes these stages (e.g. the fragment shaders of the
+	// separate post processing passes, which compute passes alone would never wait for)
+	void MarkOutput(uint32_t resource, VkPipelineStageFlags readerStages = 0);
+
+	// Passes that dispatch several times (e.g. the god rays chain) place the barriers between their own dispatches
+	void AddPass(const std::string& name, uint32_t profilerPass, VkPipelineStageFlags stages,
+				 const std::vector<uint32_t>& reads, const std::vector<uint32_t>& writes, const RecordFunction& record);
+
+	// Culls the passes and places the barriers, call once everything is added
+	void Compile();
+
+	// Records the compiled graph; resets nothing in the profiler, the caller owns the query set
+	void Record(VkCommandBuffer commandBuffer, uint32_t variant, GpuProfiler* profiler, uint32_t querySet) const;
+
+	// Records, into the consumer's command buffer, the barrier that makes the outputs written by the graph visible
+	// to the reads in 'dstStages'. Nothing is recorded if no kept pass writes an output
+	void RecordOutputBarrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags dstStages) const;
+
+	// Empties the graph so that it can be built again (e.g. after the options changed)
+	void Clear();
+
+private:
+	struct Resource
+	{
+		std::string name;
+		bool carriedOver;
+		bool output;
+		VkPipelineStageFlags readerStages;
+	};
+
+	struct Pass
+	{
+		std::string name;
+		uint32_t profilerPass;
+		VkPipelineStageFlags stages;
+		std::vector<uint32_t> reads;
+		std::vector<uint32_t> writes;
+		RecordFunction record;
+
+		// Set by Compile
+		bool culled = false;
+		VkPipelineStageFlags barrierSrcStages = 0;	// 0 --> no barrier in front of the pass
+	};
+
+	std::vector<Resource> resources;
+	std::vector<Pass> passes;
+	VkPipelineStageFlags outputStages = 0;	// of the kept passes that write an output, set by Compile
+	bool compiled = false;
+};
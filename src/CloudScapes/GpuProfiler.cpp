@@ -0,0 +1,135 @@
+#include "GpuProfiler.h"
+#include "Commands.h"
+#include <algorithm>
+#include <stdexcept>
+
+GpuProfiler::GpuProfiler(VulkanDevice* device, VkPhysicalDevice physicalDevice, VkCommandPool commandPool,
+						 uint32_t numQuerySets, const std::vector<std::string>& passNames)
+	: device(device), logicalDevice(device->GetVkDevice()), numQuerySets(numQuerySets), passNames(passNames),
+	  passMilliseconds(passNames.size(), 0.0)
+{
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	timestampPeriod = properties.limits.timestampPeriod;
+
+	// Passes run on both the compute and the graphics queue, both have to write timestamps
+	uint32_t queueFamilyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+	const int computeFamilyIndex = device->GetInstance()->GetQueueFamilyIndices()[QueueFlags::Compute];
+	const int graphicsFamilyIndex = device->GetInstance()->GetQueueFamilyIndices()[QueueFlags::Graphics];
+	timestampsSupported = computeFamilyIndex >= 0 && graphicsFamilyIndex >= 0 &&
+						  queueFamilies[computeFamilyIndex].timestampValidBits > 0 &&
+						  queueFamilies[graphicsFamilyIndex].timestampValidBits > 0;
+	if (!timestampsSupported)
+	{
+		return;
+	}
+
+	uint32_t validBits = std::min(queueFamilies[computeFamilyIndex].timestampValidBits, queueFamilies[graphicsFamilyIndex].timestampValidBits);
+	timestampMask = (validBits >= 64) ? ~0ull : ((1ull << validBits) - 1ull);
+
+	// Two timestamps per pass and query set
+	VkQueryPoolCreateInfo queryPoolInfo = {};
+	queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	queryPoolInfo.queryCount = numQuerySets * static_cast<uint32_t>(passNames.size()) * 2;
+
+	if (vkCreateQueryPool(logicalDevice, &queryPoolInfo, nullptr, &timestampQueryPool) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create profiler timestamp query pool");
+	}
+
+	// Queries start out in an undefined state; reset them all once so that reading a set that hasn't run yet
+	// (or a pass that isn't recorded in some set) simply reports it as not available
+	VkCommandBuffer commandBuffer = beginSingleTimeCommands(device, commandPool);
+	vkCmdResetQueryPool(commandBuffer, timestampQueryPool, 0, queryPoolInfo.queryCount);
+	endSingleTimeCommands(device, commandPool, device->GetQueue(QueueFlags::Compute), commandBuffer);
+}
+
+GpuProfiler::~GpuProfiler()
+{
+	if (timestampQueryPool != VK_NULL_HANDLE)
+	{
+		vkDestroyQueryPool(logicalDevice, timestampQueryPool, nullptr);
+	}
+}
+
+bool GpuProfiler::IsSupported() const
+{
+	return timestampsSupported;
+}
+
+uint32_t GpuProfiler::QueryIndex(uint32_t querySet, uint32_t pass) const
+{
+	return (querySet * static_cast<uint32_t>(passNames.size()) + pass) * 2;
+}
+
+void GpuProfiler::RecordReset(VkCommandBuffer commandBuffer, uint32_t querySet)
+{
+	if (timestampsSupported)
+	{
+		vkCmdResetQueryPool(commandBuffer, timestampQueryPool, QueryIndex(querySet, 0), static_cast<uint32_t>(passNames.size()) * 2);
+	}
+}
+void GpuProfiler::RecordBeginPass(VkCommandBuffer commandBuffer, uint32_t querySet, uint32_t pass)
+{
+	if (timestampsSupported)
+	{
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestampQueryPool, QueryIndex(querySet, pass));
+	}
+}
+void GpuProfiler::RecordEndPass(VkCommandBuffer commandBuffer, uint32_t querySet, uint32_t pass)
+{
+	if (timestampsSupported)
+	{
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampQueryPool, QueryIndex(querySet, pass) + 1);
+	}
+}
+
+void GpuProfiler::CollectResults()
+{
+	if (!timestampsSupported)
+	{
+		return;
+	}
+
+	for (uint32_t querySet = 0; querySet < numQuerySets; querySet++)
+	{
+		for (uint32_t pass = 0; pass < passNames.size(); pass++)
+		{
+			// Without the wait bit this returns VK_NOT_READY while the pass is still in flight (or was never recorded in this set)
+			uint64_t timestamps[2];
+			if (vkGetQueryPoolResults(logicalDevice, timestampQueryPool, QueryIndex(querySet, pass), 2, sizeof(timestamps), timestamps,
+									  sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS)
+			{
+				// timestampPeriod is the number of nanoseconds per tick
+				uint64_t ticks = (timestamps[1] - timestamps[0]) & timestampMask;
+				passMilliseconds[pass] = static_cast<double>(ticks) * timestampPeriod / 1000000.0;
+			}
+		}
+	}
+}
+
+double GpuProfiler::GetPassMilliseconds(uint32_t pass) const
+{
+	return passMilliseconds[pass];
+}
+double GpuProfiler::GetFrameMilliseconds() const
+{
+	double milliseconds = 0.0;
+	for (double passTime : passMilliseconds)
+	{
+		milliseconds += passTime;
+	}
+	return milliseconds;
+}
+const std::string& GpuProfiler::GetPassName(uint32_t pass) const
+{
+	return passNames[pass];
+}
+uint32_t GpuProfiler::GetPassCount() const
+{
+	return static_cast<uint32_t>(passNames.size());
+}
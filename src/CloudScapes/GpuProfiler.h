@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <string>
+#include <vector>
+#include "VulkanDevice.h"
+
+/*
+	Per pass GPU timings of the running renderer, from timestamp queries.
+
+	The renderer's command buffers are recorded once and resubmitted every frame, so every one of them gets its own
+	range of queries (a 'query set') and resets it at its start. Each pass inside a command buffer is bracketed by two
+	timestamps. CollectResults never waits for the GPU: it picks up whatever passes finished since the last call, so
+	the timings lag a frame or two behind, which is plenty for anything that reacts over many frames (QualityGovernor).
+*/
+class GpuProfiler
+{
+public:
+	GpuProfiler() = delete;
+	GpuProfiler(VulkanDevice* device, VkPhysicalDevice physicalDevice, VkCommandPool commandPool,
+				uint32_t numQuerySets, const std::vector<std::string>& passNames);
+	~GpuProfiler();
+
+	// False if the graphics or the compute queue can't write timestamps; every other call is a no-op then
+	bool IsSupported() const;
+
+	// Recorded into the command buffer that owns 'querySet'. The reset has to come first and outside of a render pass
+	void RecordReset(VkCommandBuffer commandBuffer, uint32_t querySet);
+	void RecordBeginPass(VkCommandBuffer commandBuffer, uint32_t querySet, uint32_t pass);
+	void RecordEndPass(VkCommandBuffer commandBuffer, uint32_t querySet, uint32_t pass);
+
+	// Picks up every pass timing the GPU finished since the last call, never waits
+	void CollectResults();
+
+	double GetPassMilliseconds(uint32_t pass) const;	// latest timing of a pass, 0 until it has been measured once
+	double GetFrameMilliseconds() const;				// sum of the latest timings of all passes
+	const std::string& GetPassName(uint32_t pass) const;
+	uint32_t GetPassCount() const;
+
+private:
+	uint32_t QueryIndex(uint32_t querySet, uint32_t pass) const;
+
+	VulkanDevice* device;
+	VkDevice logicalDevice;
+	VkQueryPool timestampQueryPool = VK_NULL_HANDLE;
+
+	// Nanoseconds per timestamp tick, and the bits of a timestamp that are valid on both queues
+	float timestampPeriod;
+	uint64_t timestampMask;
+	bool timestampsSupported;
+
+	uint32_t numQuerySets;
+	std::vector<std::string> passNames;
+	std::vector<double> passMilliseconds;
+};
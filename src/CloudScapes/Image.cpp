@@ -350,13 +350,14 @@ void Image::setImageLayout( VkCommandBuffer cmdbuffer,
 							VkImage image,
 							VkImageAspectFlags aspectMask,
 							VkImageLayout oldImageLayout,
-							VkImageLayout newImageLayout)
+							VkImageLayout newImageLayout,
+							uint32_t layerCount)
 {
 	VkImageSubresourceRange subresourceRange = {};
 	subresourceRange.aspectMask = aspectMask;
 	subresourceRange.baseMipLevel = 0;
 	subresourceRange.levelCount = 1;
-	subresourceRange.layerCount = 1;
+	subresourceRange.layerCount = layerCount; // all the layers of array textures
 
 	// Create an image barrier object
 	VkImageMemoryBarrier imageMemoryBarrier = {};
@@ -26,5 +26,5 @@ namespace Image
 	void createSampler(VulkanDevice* device, VkSampler& sampler, VkSamplerAddressMode addressMode, float maxAnisotropy);
 
 	void setImageLayout(VkCommandBuffer cmdbuffer, VkImage image, VkImageAspectFlags aspectMask,
-						VkImageLayout oldImageLayout, VkImageLayout newImageLayout);
+						VkImageLayout oldImageLayout, VkImageLayout newImageLayout, uint32_t layerCount = 1);
 }
\ No newline at end of file
@@ -138,6 +138,34 @@ void ImageLoadingUtility::create3DTextureFromMany2DTextures(VulkanDevice* device
 	vkFreeMemory(device->GetVkDevice(), stagingBufferMemory, nullptr);
 }
 
+uint8_t* ImageLoadingUtility::loadMany2DTextures(const std::string folder_path, const std::string textureBaseName, const std::string fileExtension,
+												int width, int height, int numImages)
+{
+	const size_t imageSize = static_cast<size_t>(width * height * 4);
+	uint8_t* allPixels = new uint8_t[imageSize * numImages];
+
+	for (int i = 0; i < numImages; i++)
+	{
+		std::string imageIdentifier = folder_path + textureBaseName + "(" + std::to_string(i + 1) + ")" + fileExtension;
+		int texWidth, texHeight, texChannels;
+		stbi_uc* pixels = stbi_load(imageIdentifier.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+		if (!pixels) {
+			delete[] allPixels;
+			throw std::runtime_error("failed to load texture image " + imageIdentifier);
+		}
+		if (texWidth != width || texHeight != height) {
+			stbi_image_free(pixels);
+			delete[] allPixels;
+			throw std::runtime_error("unexpected size for texture image " + imageIdentifier);
+		}
+
+		memcpy(&allPixels[i * imageSize], pixels, imageSize);
+		stbi_image_free(pixels);
+	}
+
+	return allPixels;
+}
+
 void ImageLoadingUtility::create3DTextureImage(VulkanDevice* device, VkDevice logicalDevice, VkImage& image, VkDeviceMemory& imageMemory,
 												VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties,
 												int width, int height, int depth, VkFormat format)
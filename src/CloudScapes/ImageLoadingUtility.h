@@ -27,6 +27,11 @@ namespace ImageLoadingUtility
 		VkImage& texture3DImage, VkDeviceMemory& texture3DMemory, VkFormat textureFormat,
 		int width, int height, int depth, int num2DImages, int numChannels);
 
+	// load numImages 2D textures named like the ones above into one tightly packed RGBA8 buffer, one image after the other
+	// the buffer is allocated with new[], the caller owns it
+	uint8_t* loadMany2DTextures(const std::string folder_path, const std::string textureBaseName, const std::string fileExtension,
+		int width, int height, int numImages);
+
 	void create3DTextureImage(VulkanDevice* device, VkDevice logicalDevice, VkImage& image, VkDeviceMemory& imageMemory,
 							VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties,
 							int width, int height, int depth, VkFormat format);
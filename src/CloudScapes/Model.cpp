@@ -108,6 +108,11 @@ void Model::SetTexture(VulkanDevice* device, VkCommandPool commandPool, const st
 }
 
 void Model::LoadModel(const std::string model_path)
+{
+	LoadOBJ(model_path, vertices, indices);
+}
+
+void Model::LoadOBJ(const std::string& model_path, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
 {
 	// The attrib container holds all of the positions, normals and texture coordinates 
 	// in its attrib.vertices, attrib.normals and attrib.texcoords vectors.
@@ -27,6 +27,8 @@ public:
 
 	void SetTexture(VulkanDevice* device, VkCommandPool commandPool, const std::string texture_path);
 	void LoadModel(const std::string model_path);
+	// The parsing part of LoadModel: triangulated, with the duplicate vertices merged. Appends to the vectors
+	static void LoadOBJ(const std::string& model_path, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
 
 	const std::vector<Vertex>& getVertices() const;
 	const std::vector<uint32_t>& getIndices() const;
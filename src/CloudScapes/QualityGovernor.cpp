@@ -0,0 +1,106 @@
+#include "QualityGovernor.h"
+
+// Weight of the newest frame in the moving average of the frame time
+#define FRAME_TIME_SMOOTHING 0.1
+// A level is dropped once the average stays above target * DOWNGRADE_THRESHOLD for DOWNGRADE_FRAMES frames in a row ...
+#define DOWNGRADE_THRESHOLD 1.05
+#define DOWNGRADE_FRAMES 8
+// ... and raised once it stays below target * UPGRADE_THRESHOLD for UPGRADE_FRAMES frames. The gap between the two thresholds
+// has to be wider than the cost difference between neighbouring levels, or a raise would immediately be followed by a drop
+#define UPGRADE_THRESHOLD 0.8
+#define UPGRADE_FRAMES 60
+// Frames to wait after a change before judging the new level; the GPU timings lag a frame or two and the average needs to catch up
+#define COOLDOWN_FRAMES 30
+
+// Level 2 is what the ray march was tuned with (see CloudQuality); the others scale the step count, the cone light samples,
+// the reach of the detail erosion and the god ray samples together, roughly 25% of ray march cost per level
+const std::vector<QualityLevel> QualityGovernor::Levels = {
+	//  name       steps (up, horizon)  light (near, far)  detail fade (km)  god ray samples
+	{ "lowest",    14.0f, 24.0f,        3, 2,              12.0f, 25.0f,     40 },
+	{ "low",       18.0f, 32.0f,        4, 2,              20.0f, 40.0f,     64 },
+	{ "default",   24.0f, 40.0f,        6, 3,              30.0f, 60.0f,     100 },
+	{ "high",      32.0f, 52.0f,        6, 4,              40.0f, 80.0f,     128 },
+	{ "highest",   40.0f, 64.0f,        6, 6,              50.0f, 100.0f,    160 },
+};
+const unsigned int QualityGovernor::DefaultLevel = 2;
+
+QualityGovernor::QualityGovernor(double targetFrameMilliseconds)
+	: targetFrameMilliseconds(targetFrameMilliseconds), smoothedFrameMilliseconds(0.0), hasMeasurement(false),
+	  level(DefaultLevel), framesOverBudget(0), framesUnderBudget(0), cooldownFrames(0)
+{
+}
+
+bool QualityGovernor::Update(double frameMilliseconds, CloudQuality& quality)
+{
+	// Timings that haven't come back from the GPU yet read as 0
+	if (frameMilliseconds <= 0.0)
+	{
+		return false;
+	}
+
+	if (!hasMeasurement)
+	{
+		smoothedFrameMilliseconds = frameMilliseconds;
+		hasMeasurement = true;
+	}
+	else
+	{
+		smoothedFrameMilliseconds += FRAME_TIME_SMOOTHING * (frameMilliseconds - smoothedFrameMilliseconds);
+	}
+
+	if (cooldownFrames > 0)
+	{
+		cooldownFrames--;
+		return false;
+	}
+
+	framesOverBudget = (smoothedFrameMilliseconds > targetFrameMilliseconds * DOWNGRADE_THRESHOLD) ? framesOverBudget + 1 : 0;
+	framesUnderBudget = (smoothedFrameMilliseconds < targetFrameMilliseconds * UPGRADE_THRESHOLD) ? framesUnderBudget + 1 : 0;
+
+	unsigned int newLevel = level;
+	if (framesOverBudget >= DOWNGRADE_FRAMES && level > 0)
+	{
+		newLevel = level - 1;
+	}
+	else if (framesUnderBudget >= UPGRADE_FRAMES && level + 1 < Levels.size())
+	{
+		newLevel = level + 1;
+	}
+
+	if (newLevel == level)
+	{
+		return false;
+	}
+
+	level = newLevel;
+	framesOverBudget = 0;
+	framesUnderBudget = 0;
+	cooldownFrames = COOLDOWN_FRAMES;
+	Apply(quality);
+	return true;
+}
+
+void QualityGovernor::Apply(CloudQuality& quality) const
+{
+	const QualityLevel& settings = Levels[level];
+	quality.minMarchSteps = settings.minMarchSteps;
+	quality.maxMarchSteps = settings.maxMarchSteps;
+	quality.nearLightSamples = settings.nearLightSamples;
+	quality.farLightSamples = settings.farLightSamples;
+	quality.detailFadeStartDistance = settings.detailFadeStartDistance;
+	quality.detailFadeEndDistance = settings.detailFadeEndDistance;
+	quality.godRaySamples = settings.godRaySamples;
+}
+
+unsigned int QualityGovernor::GetLevel() const
+{
+	return level;
+}
+const std::string& QualityGovernor::GetLevelName() const
+{
+	return Levels[level].name;
+}
+double QualityGovernor::GetSmoothedFrameMilliseconds() const
+{
+	return smoothedFrameMilliseconds;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "Sky.h"
+
+// One rung of the quality ladder: the ray march and god ray parameters the governor is allowed to change
+struct QualityLevel
+{
+	std::string name;
+	float minMarchSteps;
+	float maxMarchSteps;
+	int nearLightSamples;
+	int farLightSamples;
+	float detailFadeStartDistance;
+	float detailFadeEndDistance;
+	int godRaySamples;
+};
+
+/*
+	Holds a target frame time by walking a small ladder of cloud quality levels (QualityGovernor::Levels).
+
+	It is fed the measured GPU time of every frame (see GpuProfiler) and smooths it with an exponential moving average.
+	Dropping a level has to be earned by a few frames in a row over budget, raising one by many frames clearly under it,
+	and after every change the governor waits before it looks again. The asymmetric thresholds and the cooldown keep it
+	from oscillating between two levels whose costs straddle the budget.
+*/
+class QualityGovernor
+{
+public:
+	QualityGovernor() = delete;
+	QualityGovernor(double targetFrameMilliseconds);
+
+	// Feeds the time the last frame took. Returns true if it changed the quality parameters in 'quality',
+	// the caller then has to upload them (Sky::UpdateCloudQuality)
+	bool Update(double frameMilliseconds, CloudQuality& quality);
+
+	// Writes the parameters of the current level into 'quality'
+	void Apply(CloudQuality& quality) const;
+
+	unsigned int GetLevel() const;
+	const std::string& GetLevelName() const;
+	double GetSmoothedFrameMilliseconds() const;
+
+	static const std::vector<QualityLevel> Levels;	// lowest quality first
+	static const unsigned int DefaultLevel;			// the parameters the ray march was hand tuned with
+
+private:
+	double targetFrameMilliseconds;
+	double smoothedFrameMilliseconds;
+	bool hasMeasurement;
+
+	unsigned int level;
+	unsigned int framesOverBudget;
+	unsigned int framesUnderBudget;
+	unsigned int cooldownFrames;
+};
@@ -0,0 +1,527 @@
+#include "RegressionRun.h"
+#include "window.h"
+#include <cmath>
+#include <limits>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include "../../external/stb_image.h"
+#include "../../external/stb_image_write.h"
+
+namespace
+{
+	// Camera of the views: the default eye of main.cpp, turned by the view's pitch and yaw
+	const glm::vec3 regressionEye = glm::vec3(0.0f, 0.0f, 2.0f);
+
+	const std::string gpuFrameTimingName = "gpu frame";
+	const std::string wallFrameTimingName = "wall frame";
+
+	double Median(std::vector<double> values)
+	{
+		if (values.empty())
+		{
+			return 0.0;
+		}
+		std::sort(values.begin(), values.end());
+		return values[values.size() / 2];
+	}
+
+	double Luma(const std::vector<uint8_t>& pixels, size_t pixel)
+	{
+		return 0.299 * pixels[pixel * 4 + 0] + 0.587 * pixels[pixel * 4 + 1] + 0.114 * pixels[pixel * 4 + 2];
+	}
+
+	// The failures can name Windows paths
+	std::string JSONString(const std::string& text)
+	{
+		std::string quoted = "\"";
+		for (char c : text)
+		{
+			if (c == '"' || c == '\\')
+			{
+				quoted += '\\';
+			}
+			quoted += c;
+		}
+		return quoted + "\"";
+	}
+}
+
+//----------------------------------------------
+//------------- Configuration ------------------
+//----------------------------------------------
+RegressionConfig RegressionConfig::Load(const std::string& filePath)
+{
+	std::ifstream file(filePath);
+	if (!file.is_open())
+	{
+		throw std::runtime_error("Could not open the regression configuration " + filePath);
+	}
+
+	RegressionConfig config;
+	std::string line;
+	while (std::getline(file, line))
+	{
+		std::istringstream entry(line);
+		std::string key;
+		if (!(entry >> key) || key[0] == '#')
+		{
+			continue;
+		}
+
+		bool valid = true;
+		if (key == "view")
+		{
+			RegressionView view;
+			valid = static_cast<bool>(entry >> view.name >> view.pitch >> view.yaw >> view.sunElevation >> view.sunAzimuth >> view.time);
+			config.views.push_back(view);
+		}
+		else if (key == "minPSNR")
+		{
+			valid = static_cast<bool>(entry >> config.tolerances.minPSNR);
+		}
+		else if (key == "minSSIM")
+		{
+			valid = static_cast<bool>(entry >> config.tolerances.minSSIM);
+		}
+		else if (key == "maxGpuTimeIncrease")
+		{
+			valid = static_cast<bool>(entry >> config.tolerances.maxGpuTimeIncrease);
+		}
+		else if (key == "maxWallTimeIncrease")
+		{
+			valid = static_cast<bool>(entry >> config.tolerances.maxWallTimeIncrease);
+		}
+		else if (key == "minBaselineMilliseconds")
+		{
+			valid = static_cast<bool>(entry >> config.tolerances.minBaselineMilliseconds);
+		}
+		else
+		{
+			valid = false;
+		}
+
+		if (!valid)
+		{
+			throw std::runtime_error("Invalid line in " + filePath + ": " + line);
+		}
+	}
+
+	if (config.views.empty())
+	{
+		throw std::runtime_error(filePath + " has no views");
+	}
+	return config;
+}
+
+//----------------------------------------------
+//--------------- Regression Run ---------------
+//----------------------------------------------
+RegressionRun::RegressionRun(const std::string& folder, bool updateReferences)
+	: folder(folder), updateReferences(updateReferences)
+{
+	if (!this->folder.empty() && this->folder.back() != '/' && this->folder.back() != '\\')
+	{
+		this->folder += '/';
+	}
+
+	config = RegressionConfig::Load(this->folder + "regression.txt");
+	if (!updateReferences)
+	{
+		LoadBaseline();
+	}
+}
+
+bool RegressionRun::Run(VulkanDevice* device, Renderer* renderer, Camera* camera, Camera* cameraOld, Sky* sky, Scene* scene)
+{
+	results.clear();
+	bool passed = true;
+
+	for (const RegressionView& view : config.views)
+	{
+		results.push_back(RenderView(view, device, renderer, camera, cameraOld, sky, scene));
+		const RegressionResult& result = results.back();
+
+		std::cout << "Regression view " << result.viewName << ": PSNR " << result.psnr << " dB, SSIM " << result.ssim
+				  << ", GPU " << result.gpuFrameMilliseconds << " ms, wall " << result.wallFrameMilliseconds << " ms per frame" << std::endl;
+		for (const std::string& failure : result.failures)
+		{
+			std::cout << "    FAILED: " << failure << std::endl;
+		}
+		passed = passed && result.failures.empty();
+	}
+
+	if (updateReferences)
+	{
+		SaveBaseline();
+		std::cout << "Wrote the reference images and the baseline timings to " << folder << std::endl;
+	}
+	return passed;
+}
+
+RegressionResult RegressionRun::RenderView(const RegressionView& view, VulkanDevice* device, Renderer* renderer, Camera* camera,
+										   Camera* cameraOld, Sky* sky, Scene* scene)
+{
+	RegressionResult result;
+	result.viewName = view.name;
+
+	const std::chrono::steady_clock::time_point viewStart = std::chrono::steady_clock::now();
+
+	// Same convention as CloudReferenceRender and Sky::UpdateSunAndSky: yaw 0 looks along -z
+	const float pitch = glm::radians(view.pitch);
+	const float yaw = glm::radians(view.yaw);
+	const glm::vec3 direction(glm::cos(pitch) * glm::sin(yaw), glm::sin(pitch), -glm::cos(pitch) * glm::cos(yaw));
+	camera->LookAt(regressionEye, regressionEye + direction);
+	camera->UpdateBuffer();
+	camera->CopyToGPUMemory();
+	// No motion into the first frame: the reprojection sees the same camera twice
+	cameraOld->UpdateBuffer(camera);
+	cameraOld->CopyToGPUMemory();
+
+	sky->SetSun(view.sunElevation, view.sunAzimuth);
+	scene->SetFixedTime(view.time);
+	renderer->ResetHistory();
+
+	// The GPU timings of the first frames include the ones of the previous view, and the first frames of a view
+	// aren't representative anyway; only the second half is measured
+	const unsigned int frames = renderer->GetConvergenceFrames();
+	const unsigned int firstMeasuredFrame = frames / 2;
+	GpuProfiler* gpuProfiler = renderer->GetGpuProfiler();
+
+	std::vector<double> gpuFrameSamples;
+	std::vector<double> wallFrameSamples;
+	std::vector<std::vector<double>> passSamples(gpuProfiler->GetPassCount());
+
+	for (unsigned int frame = 0; frame < frames; frame++)
+	{
+		glfwPollEvents();
+
+		const std::chrono::steady_clock::time_point frameStart = std::chrono::steady_clock::now();
+		scene->UpdateTime();
+		sky->UpdateSunAndSky();
+		renderer->Frame();
+		cameraOld->UpdateBuffer(camera);
+		cameraOld->CopyToGPUMemory();
+
+		// One frame at a time, so the wall time is the time of this frame and the timestamps are all in
+		vkDeviceWaitIdle(device->GetVkDevice());
+		const std::chrono::steady_clock::time_point frameEnd = std::chrono::steady_clock::now();
+
+		if (frame < firstMeasuredFrame)
+		{
+			continue;
+		}
+
+		wallFrameSamples.push_back(std::chrono::duration<double, std::milli>(frameEnd - frameStart).count());
+		if (gpuProfiler->IsSupported())
+		{
+			gpuProfiler->CollectResults();
+			gpuFrameSamples.push_back(gpuProfiler->GetFrameMilliseconds());
+			for (uint32_t pass = 0; pass < gpuProfiler->GetPassCount(); pass++)
+			{
+				passSamples[pass].push_back(gpuProfiler->GetPassMilliseconds(pass));
+			}
+		}
+	}
+
+	result.gpuFrameMilliseconds = Median(gpuFrameSamples);
+	result.wallFrameMilliseconds = Median(wallFrameSamples);
+	for (uint32_t pass = 0; pass < gpuProfiler->GetPassCount(); pass++)
+	{
+		result.passMilliseconds.push_back(std::make_pair(gpuProfiler->GetPassName(pass), Median(passSamples[pass])));
+	}
+
+	std::vector<uint8_t> pixels;
+	uint32_t width, height;
+	renderer->ReadFinalImage(pixels, width, height);
+	result.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - viewStart).count();
+
+	if (updateReferences)
+	{
+		const std::string referencePath = folder + view.name + ".png";
+		if (!stbi_write_png(referencePath.c_str(), width, height, 4, pixels.data(), width * 4))
+		{
+			result.failures.push_back("could not write " + referencePath);
+		}
+		result.hasReference = true;
+		result.psnr = std::numeric_limits<double>::infinity();
+		result.ssim = 1.0;
+		return result;
+	}
+
+	CompareImage(result, pixels, width, height);
+	CompareTimings(result);
+	return result;
+}
+
+//----------------------------------------------
+//------------- Image Comparison ---------------
+//----------------------------------------------
+void RegressionRun::CompareImage(RegressionResult& result, const std::vector<uint8_t>& pixels, uint32_t width, uint32_t height) const
+{
+	const std::string referencePath = folder + result.viewName + ".png";
+	int referenceWidth, referenceHeight, referenceChannels;
+	stbi_uc* referencePixels = stbi_load(referencePath.c_str(), &referenceWidth, &referenceHeight, &referenceChannels, STBI_rgb_alpha);
+	if (!referencePixels)
+	{
+		result.failures.push_back("no reference image " + referencePath + " (--regression-update renders it)");
+		return;
+	}
+
+	const std::vector<uint8_t> reference(referencePixels, referencePixels + size_t(referenceWidth) * referenceHeight * 4);
+	stbi_image_free(referencePixels);
+	if (uint32_t(referenceWidth) != width || uint32_t(referenceHeight) != height)
+	{
+		std::ostringstream failure;
+		failure << "the reference image is " << referenceWidth << "x" << referenceHeight << ", the window " << width << "x" << height;
+		result.failures.push_back(failure.str());
+		return;
+	}
+
+	result.hasReference = true;
+	result.psnr = ComputePSNR(pixels, reference);
+	result.ssim = ComputeSSIM(pixels, reference, width, height);
+
+	const RegressionTolerances& tolerances = config.tolerances;
+	if (result.psnr < tolerances.minPSNR || result.ssim < tolerances.minSSIM)
+	{
+		std::ostringstream failure;
+		failure << "image differs from the reference: PSNR " << result.psnr << " dB (at least " << tolerances.minPSNR
+				<< "), SSIM " << result.ssim << " (at least " << tolerances.minSSIM << ")";
+		result.failures.push_back(failure.str());
+
+		// Next to the report, to look at what changed
+		const std::string actualPath = "regression_" + result.viewName + ".png";
+		stbi_write_png(actualPath.c_str(), width, height, 4, pixels.data(), width * 4);
+	}
+}
+
+double RegressionRun::ComputePSNR(const std::vector<uint8_t>& a, const std::vector<uint8_t>& b)
+{
+	double squaredError = 0.0;
+	size_t count = 0;
+	for (size_t i = 0; i < a.size(); i++)
+	{
+		// The alpha of the final image means nothing
+		if (i % 4 == 3)
+		{
+			continue;
+		}
+		const double difference = double(a[i]) - double(b[i]);
+		squaredError += difference * difference;
+		count++;
+	}
+
+	if (squaredError == 0.0)
+	{
+		return std::numeric_limits<double>::infinity();
+	}
+	const double meanSquaredError = squaredError / double(count);
+	return 10.0 * std::log10(255.0 * 255.0 / meanSquaredError);
+}
+
+double RegressionRun::ComputeSSIM(const std::vector<uint8_t>& a, const std::vector<uint8_t>& b, uint32_t width, uint32_t height)
+{
+	// Constants of the original SSIM paper for 8 bit images
+	const double c1 = (0.01 * 255.0) * (0.01 * 255.0);
+	const double c2 = (0.03 * 255.0) * (0.03 * 255.0);
+	const uint32_t windowSize = 8;
+	const uint32_t windowStride = 4;
+
+	if (width < windowSize || height < windowSize)
+	{
+		return (a == b) ? 1.0 : 0.0;
+	}
+
+	double ssimSum = 0.0;
+	uint32_t windowCount = 0;
+	for (uint32_t y = 0; y + windowSize <= height; y += windowStride)
+	{
+		for (uint32_t x = 0; x + windowSize <= width; x += windowStride)
+		{
+			double sumA = 0.0, sumB = 0.0, sumAA = 0.0, sumBB = 0.0, sumAB = 0.0;
+			for (uint32_t j = 0; j < windowSize; j++)
+			{
+				for (uint32_t i = 0; i < windowSize; i++)
+				{
+					const size_t pixel = size_t(y + j) * width + (x + i);
+					const double lumaA = Luma(a, pixel);
+					const double lumaB = Luma(b, pixel);
+					sumA += lumaA;
+					sumB += lumaB;
+					sumAA += lumaA * lumaA;
+					sumBB += lumaB * lumaB;
+					sumAB += lumaA * lumaB;
+				}
+			}
+
+			const double n = double(windowSize * windowSize);
+			const double meanA = sumA / n;
+			const double meanB = sumB / n;
+			const double varianceA = sumAA / n - meanA * meanA;
+			const double varianceB = sumBB / n - meanB * meanB;
+			const double covariance = sumAB / n - meanA * meanB;
+
+			ssimSum += ((2.0 * meanA * meanB + c1) * (2.0 * covariance + c2)) /
+					   ((meanA * meanA + meanB * meanB + c1) * (varianceA + varianceB + c2));
+			windowCount++;
+		}
+	}
+	return ssimSum / double(windowCount);
+}
+
+//----------------------------------------------
+//------------ Timing Comparison ---------------
+//----------------------------------------------
+void RegressionRun::CompareTimings(RegressionResult& result) const
+{
+	const RegressionTolerances& tolerances = config.tolerances;
+	CompareTiming(result, wallFrameTimingName, result.wallFrameMilliseconds, tolerances.maxWallTimeIncrease);
+	if (result.gpuFrameMilliseconds > 0.0)
+	{
+		CompareTiming(result, gpuFrameTimingName, result.gpuFrameMilliseconds, tolerances.maxGpuTimeIncrease);
+		for (const auto& pass : result.passMilliseconds)
+		{
+			CompareTiming(result, pass.first, pass.second, tolerances.maxGpuTimeIncrease);
+		}
+	}
+}
+
+void RegressionRun::CompareTiming(RegressionResult& result, const std::string& timingName, double milliseconds, double maxIncrease) const
+{
+	// Timings that aren't in the baseline (a new pass, or no baseline at all) pass, so do the ones too small to compare
+	const auto entry = baseline.find(result.viewName + " " + timingName);
+	if (entry == baseline.end() || entry->second < config.tolerances.minBaselineMilliseconds)
+	{
+		return;
+	}
+
+	const double limit = entry->second * (1.0 + maxIncrease);
+	if (milliseconds > limit)
+	{
+		std::ostringstream failure;
+		failure << std::fixed << std::setprecision(3) << timingName << " took " << milliseconds << " ms, the baseline is "
+				<< entry->second << " ms (at most " << limit << ")";
+		result.failures.push_back(failure.str());
+	}
+}
+
+//----------------------------------------------
+//--------------- Baseline File ----------------
+//----------------------------------------------
+// One entry per line: <view> <milliseconds> <timing name>; the timing names of the passes have spaces in them
+void RegressionRun::LoadBaseline()
+{
+	std::ifstream file(folder + "baseline.txt");
+	if (!file.is_open())
+	{
+		std::cout << "No baseline timings in " << folder << ", the timings are only recorded" << std::endl;
+		return;
+	}
+
+	std::string line;
+	while (std::getline(file, line))
+	{
+		std::istringstream entry(line);
+		std::string viewName, timingName;
+		double milliseconds;
+		if (!(entry >> viewName >> milliseconds) || !(entry >> std::ws) || !std::getline(entry, timingName))
+		{
+			continue;
+		}
+		baseline[viewName + " " + timingName] = milliseconds;
+	}
+}
+
+void RegressionRun::SaveBaseline() const
+{
+	const std::string filePath = folder + "baseline.txt";
+	std::ofstream file(filePath, std::ios::trunc);
+	if (!file.is_open())
+	{
+		std::cout << "Could not write the baseline timings to " << filePath << std::endl;
+		return;
+	}
+
+	file << std::fixed << std::setprecision(4);
+	for (const RegressionResult& result : results)
+	{
+		file << result.viewName << " " << result.wallFrameMilliseconds << " " << wallFrameTimingName << "\n";
+		if (result.gpuFrameMilliseconds <= 0.0)
+		{
+			continue;
+		}
+		file << result.viewName << " " << result.gpuFrameMilliseconds << " " << gpuFrameTimingName << "\n";
+		for (const auto& pass : result.passMilliseconds)
+		{
+			file << result.viewName << " " << pass.second << " " << pass.first << "\n";
+		}
+	}
+}
+
+//----------------------------------------------
+//----------------- Report ---------------------
+//----------------------------------------------
+void RegressionRun::WriteReport(const std::string& filePath) const
+{
+	std::ofstream file(filePath, std::ios::trunc);
+	if (!file.is_open())
+	{
+		std::cout << "Could not write the regression report to " << filePath << std::endl;
+		return;
+	}
+
+	// JSON has no infinity: identical images get a null PSNR
+	const auto number = [](double value) -> std::string
+	{
+		if (!std::isfinite(value))
+		{
+			return "null";
+		}
+		std::ostringstream text;
+		text << std::setprecision(6) << value;
+		return text.str();
+	};
+
+	bool passed = true;
+	for (const RegressionResult& result : results)
+	{
+		passed = passed && result.failures.empty();
+	}
+
+	const RegressionTolerances& tolerances = config.tolerances;
+	file << "{\n";
+	file << "  \"passed\": " << (passed ? "true" : "false") << ",\n";
+	file << "  \"tolerances\": { \"minPSNR\": " << number(tolerances.minPSNR) << ", \"minSSIM\": " << number(tolerances.minSSIM)
+		 << ", \"maxGpuTimeIncrease\": " << number(tolerances.maxGpuTimeIncrease)
+		 << ", \"maxWallTimeIncrease\": " << number(tolerances.maxWallTimeIncrease) << " },\n";
+	file << "  \"views\": [\n";
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const RegressionResult& result = results[i];
+		file << "    {\n";
+		file << "      \"name\": " << JSONString(result.viewName) << ",\n";
+		file << "      \"passed\": " << (result.failures.empty() ? "true" : "false") << ",\n";
+		file << "      \"psnr\": " << (result.hasReference ? number(result.psnr) : "null") << ",\n";
+		file << "      \"ssim\": " << (result.hasReference ? number(result.ssim) : "null") << ",\n";
+		file << "      \"gpuFrameMilliseconds\": " << number(result.gpuFrameMilliseconds) << ",\n";
+		file << "      \"wallFrameMilliseconds\": " << number(result.wallFrameMilliseconds) << ",\n";
+		file << "      \"wallSeconds\": " << number(result.wallSeconds) << ",\n";
+		file << "      \"passMilliseconds\": {";
+		for (size_t pass = 0; pass < result.passMilliseconds.size(); pass++)
+		{
+			file << (pass == 0 ? " " : ", ") << JSONString(result.passMilliseconds[pass].first) << ": " << number(result.passMilliseconds[pass].second);
+		}
+		file << " },\n";
+		file << "      \"failures\": [";
+		for (size_t failure = 0; failure < result.failures.size(); failure++)
+		{
+			file << (failure == 0 ? " " : ", ") << JSONString(result.failures[failure]);
+		}
+		file << " ]\n";
+		file << "    }" << (i + 1 < results.size() ? "," : "") << "\n";
+	}
+	file << "  ]\n";
+	file << "}\n";
+}
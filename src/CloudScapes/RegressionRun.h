@@ -0,0 +1,107 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+#include "Renderer.h"
+
+/*
+	Golden image and performance regression run (--regression in main.cpp).
+
+	Renders a fixed list of views, each one from a clean slate: the camera, the sun and the animation time are set,
+	the renderer's history is cleared (Renderer::ResetHistory) and the frame counters that pick the halton jitter and
+	the 4x4 ray march pattern start at 0. Every view then runs the frames the renderer needs to converge, waiting for
+	the GPU after each one, so two runs on the same driver produce the same image. Meant for a software driver like
+	lavapipe, where that is also true across machines.
+
+	The final image of every view is compared against a reference image (PSNR over rgb, SSIM over the luma) and the
+	GPU time of every pass and the wall time per frame against a baseline. A view fails when the image quality drops
+	below, or a time grows past, the tolerances in the configuration file. Everything that was measured is written to
+	a JSON report.
+
+	The folder holds:
+	- regression.txt: the views and the tolerances, see RegressionConfig
+	- <view>.png: the reference images
+	- baseline.txt: the baseline timings, one per line: <view> <milliseconds> <timing name>
+	Both the references and the baseline are written by a run with 'updateReferences' (--regression-update); they only
+	mean something for the driver they were rendered with.
+*/
+
+// A view of the regression run, a line of regression.txt: view <name> <pitch> <yaw> <sun elevation> <sun azimuth> <time>
+struct RegressionView
+{
+	std::string name;
+	float pitch;			// degrees above the horizon
+	float yaw;				// degrees, 0 looks along -z like the default camera
+	float sunElevation;		// radians, like Sky::SetSun
+	float sunAzimuth;
+	float time;				// seconds of cloud animation
+};
+
+// Lines of regression.txt: <tolerance name> <value>
+struct RegressionTolerances
+{
+	double minPSNR = 40.0;					// dB
+	double minSSIM = 0.98;
+	double maxGpuTimeIncrease = 0.15;		// fraction the GPU time of the frame or of a pass may grow over the baseline
+	double maxWallTimeIncrease = 0.25;		// fraction the wall time per frame may grow over the baseline
+	double minBaselineMilliseconds = 0.05;	// timings below this in the baseline are too noisy to compare
+};
+
+struct RegressionConfig
+{
+	std::vector<RegressionView> views;
+	RegressionTolerances tolerances;
+
+	// Lines starting with # are comments
+	static RegressionConfig Load(const std::string& filePath);
+};
+
+// What was measured for one view
+struct RegressionResult
+{
+	std::string viewName;
+	bool hasReference = false;
+	double psnr = 0.0;
+	double ssim = 0.0;
+	double gpuFrameMilliseconds = 0.0;		// median over the converging frames, 0 without GPU timestamps
+	double wallFrameMilliseconds = 0.0;		// median over the converging frames, submission to idle GPU
+	double wallSeconds = 0.0;				// everything from the reset to the read back
+	std::vector<std::pair<std::string, double>> passMilliseconds;
+	std::vector<std::string> failures;		// empty --> passed
+};
+
+class RegressionRun
+{
+public:
+	RegressionRun() = delete;
+	RegressionRun(const std::string& folder, bool updateReferences);
+
+	// Renders every view; false if any of them regressed. The renderer has to render every frame (idleWhenConverged off)
+	bool Run(VulkanDevice* device, Renderer* renderer, Camera* camera, Camera* cameraOld, Sky* sky, Scene* scene);
+
+	void WriteReport(const std::string& filePath) const;
+
+	// Image comparisons of two RGBA8 images of the same size
+	static double ComputePSNR(const std::vector<uint8_t>& a, const std::vector<uint8_t>& b);
+	// Mean SSIM of 8x8 windows (4 pixels apart) of the luma
+	static double ComputeSSIM(const std::vector<uint8_t>& a, const std::vector<uint8_t>& b, uint32_t width, uint32_t height);
+
+private:
+	RegressionResult RenderView(const RegressionView& view, VulkanDevice* device, Renderer* renderer, Camera* camera, Camera* cameraOld,
+								Sky* sky, Scene* scene);
+	void CompareImage(RegressionResult& result, const std::vector<uint8_t>& pixels, uint32_t width, uint32_t height) const;
+	void CompareTimings(RegressionResult& result) const;
+	void CompareTiming(RegressionResult& result, const std::string& timingName, double milliseconds, double maxIncrease) const;
+
+	void LoadBaseline();
+	void SaveBaseline() const;
+
+	std::string folder;
+	bool updateReferences;
+	RegressionConfig config;
+
+	// "<view> <timing name>" --> milliseconds
+	std::map<std::string, double> baseline;
+	std::vector<RegressionResult> results;
+};
@@ -1,7 +1,7 @@
 #include "Renderer.h"
 
 Renderer::Renderer(VulkanDevice* device, VkPhysicalDevice physicalDevice, VulkanSwapChain* swapChain, 
-	Scene* scene, Sky* sky, Camera* camera, Camera* cameraOld, uint32_t width, uint32_t height)
+	Scene* scene, Sky* sky, Camera* camera, Camera* cameraOld, uint32_t width, uint32_t height, const RendererOptions& options)
 	: device(device),
 	logicalDevice(device->GetVkDevice()),
 	physicalDevice(physicalDevice),
@@ -11,8 +11,55 @@ Renderer::Renderer(VulkanDevice* device, VkPhysicalDevice physicalDevice, Vulkan
 	camera(camera),
 	cameraOld(cameraOld),
 	window_width(width),
-	window_height(height)
+	window_height(height),
+	renderScale(std::min(std::max(options.renderScale, MIN_RENDER_SCALE), MAX_RENDER_SCALE)),
+	cloudResolutionDivisor(options.cloudResolutionDivisor),
+	motionBlurEnabled(options.motionBlur),
+	godRaysEnabled(options.godRays),
+	fusedPostProcessEnabled(options.fusedPostProcess),
+	autoExposureEnabled(options.autoExposure),
+	idleWhenConverged(options.idleWhenConverged),
+	convergenceFrames(CONVERGENCE_STATIC_FRAMES + (options.autoExposure ? AUTO_EXPOSURE_SETTLE_FRAMES : 0)),
+	autotuneWorkgroups(options.autotuneWorkgroups)
 {
+	if (cloudResolutionDivisor != 1 && cloudResolutionDivisor != 2 && cloudResolutionDivisor != 4) {
+		throw std::runtime_error("Cloud resolution divisor has to be 1, 2 or 4");
+	}
+
+	// The density and lighting math of the ray march is mostly normalized values, fine in float16 where the GPU can do it
+	const bool useFloat16RayMarch = options.allowFloat16RayMarch && device->GetInstance()->SupportsShaderFloat16();
+	cloudRayMarchShaderName = useFloat16RayMarch ? "cloudRayMarchFP16" : "cloudRayMarch";
+
+	SelectIntermediateFormats(options.narrowFormats);
+
+	if (options.frameBudgetMilliseconds > 0.0f)
+	{
+		qualityGovernor = new QualityGovernor(options.frameBudgetMilliseconds);
+		qualityGovernor->Apply(sky->GetCloudQuality());
+		sky->UpdateCloudQuality();
+	}
+
+	if (options.horizonBandElevation > 0.0f)
+	{
+		sky->EnableHorizonBand(options.horizonBandElevation);
+	}
+
+	// The fused post process kernel is dispatched in the graphics command buffers, so the graphics queue has to run compute work
+	if (fusedPostProcessEnabled)
+	{
+		uint32_t queueFamilyCount = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+		std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+		vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+		const uint32_t graphicsFamily = device->GetInstance()->GetQueueFamilyIndices()[QueueFlags::Graphics];
+		if (!(queueFamilies[graphicsFamily].queueFlags & VK_QUEUE_COMPUTE_BIT))
+		{
+			std::cout << "The graphics queue can't run compute work, using the separate tone mapping and TXAA passes" << std::endl;
+			fusedPostProcessEnabled = false;
+		}
+	}
+
 	InitializeRenderer();
 }
 
@@ -23,16 +70,30 @@ Renderer::~Renderer()
 	//Command Pools
 	vkDestroyCommandPool(logicalDevice, graphicsCommandPool, nullptr);
 	vkDestroyCommandPool(logicalDevice, computeCommandPool, nullptr);
+
+	vkDestroySemaphore(logicalDevice, sceneDepthSemaphore, nullptr);
+	vkDestroySemaphore(logicalDevice, cloudComputeSemaphore, nullptr);
+	vkDestroySemaphore(logicalDevice, cloudResultSemaphore, nullptr);
+	vkDestroyRenderPass(logicalDevice, sceneDepthRenderPass, nullptr);
+
+	vkDestroyBuffer(logicalDevice, exposureBuffer, nullptr);
+	vkFreeMemory(logicalDevice, exposureBufferMemory, nullptr);
 	
 	//Descriptor Set Layouts
 	vkDestroyDescriptorSetLayout(logicalDevice, cloudComputeSetLayout, nullptr);
 	vkDestroyDescriptorSetLayout(logicalDevice, graphicsSetLayout, nullptr);
 	vkDestroyDescriptorSetLayout(logicalDevice, pingPongCloudResultSetLayout, nullptr);
+	vkDestroyDescriptorSetLayout(logicalDevice, cloudUpsampleSetLayout, nullptr);
+	vkDestroyDescriptorSetLayout(logicalDevice, motionBlurSetLayout, nullptr);
+	vkDestroyDescriptorSetLayout(logicalDevice, horizonBandSetLayout, nullptr);
+	vkDestroyDescriptorSetLayout(logicalDevice, lutOutputSetLayout, nullptr);
+	vkDestroyDescriptorSetLayout(logicalDevice, atmosphereSetLayout, nullptr);
 
 	vkDestroyDescriptorSetLayout(logicalDevice, cameraSetLayout, nullptr);
 	vkDestroyDescriptorSetLayout(logicalDevice, timeSetLayout, nullptr);
 	vkDestroyDescriptorSetLayout(logicalDevice, sunAndSkySetLayout, nullptr);
 	vkDestroyDescriptorSetLayout(logicalDevice, keyPressQuerySetLayout, nullptr);
+	vkDestroyDescriptorSetLayout(logicalDevice, cloudQualitySetLayout, nullptr);
 
 	vkDestroyDescriptorSetLayout(logicalDevice, godRaysSetLayout, nullptr);
 	vkDestroyDescriptorSetLayout(logicalDevice, toneMapSetLayout, nullptr);
@@ -40,19 +101,21 @@ Renderer::~Renderer()
 
 	//Descriptor Set
 	vkDestroyDescriptorPool(logicalDevice, descriptorPool, nullptr);
+	vkDestroyDescriptorPool(logicalDevice, modelDescriptorPool, nullptr);
 
 	//Cloud and sky resources that are independent of size
 	delete sky;
+
+	delete workgroupTuner;
+	delete gpuProfiler;
+	delete qualityGovernor;
 }
 
 void Renderer::DestroyOnWindowResize()
 {
 	vkDeviceWaitIdle(logicalDevice);
 
-	vkFreeCommandBuffers(logicalDevice, graphicsCommandPool, static_cast<uint32_t>(graphicsCommandBuffer1.size()), graphicsCommandBuffer1.data());
-	vkFreeCommandBuffers(logicalDevice, graphicsCommandPool, static_cast<uint32_t>(graphicsCommandBuffer2.size()), graphicsCommandBuffer2.data());
-	vkFreeCommandBuffers(logicalDevice, computeCommandPool, 1, &computeCommandBuffer1);
-	vkFreeCommandBuffers(logicalDevice, computeCommandPool, 1, &computeCommandBuffer2);
+	DestroyCommandBuffers();
 
 	DestroyFrameResources();
 
@@ -65,15 +128,40 @@ void Renderer::DestroyOnWindowResize()
 	vkDestroyPipeline(logicalDevice, graphicsPipeline, nullptr);
 	vkDestroyPipeline(logicalDevice, cloudComputePipeline, nullptr);
 	vkDestroyPipeline(logicalDevice, reprojectionPipeline, nullptr);
+	vkDestroyPipelineLayout(logicalDevice, cloudUpsamplePipelineLayout, nullptr);
+	vkDestroyPipeline(logicalDevice, cloudUpsamplePipeline, nullptr);
+	vkDestroyPipelineLayout(logicalDevice, motionBlurPipelineLayout, nullptr);
+	vkDestroyPipeline(logicalDevice, motionBlurPipeline, nullptr);
+	vkDestroyPipelineLayout(logicalDevice, godRaysPipelineLayout, nullptr);
+	vkDestroyPipeline(logicalDevice, godRaysDownsamplePipeline, nullptr);
+	for (uint32_t pass = 0; pass < GOD_RAYS_BLUR_PASSES; pass++)
+	{
+		vkDestroyPipeline(logicalDevice, godRaysBlurPipelines[pass], nullptr);
+	}
+	vkDestroyPipeline(logicalDevice, horizonBandPipeline, nullptr);
+	vkDestroyPipelineLayout(logicalDevice, transmittanceLUTPipelineLayout, nullptr);
+	vkDestroyPipeline(logicalDevice, transmittanceLUTPipeline, nullptr);
+	vkDestroyPipelineLayout(logicalDevice, multipleScatteringLUTPipelineLayout, nullptr);
+	vkDestroyPipeline(logicalDevice, multipleScatteringLUTPipeline, nullptr);
+	vkDestroyPipelineLayout(logicalDevice, skyViewLUTPipelineLayout, nullptr);
+	vkDestroyPipeline(logicalDevice, skyViewLUTPipeline, nullptr);
+	vkDestroyPipelineLayout(logicalDevice, aerialPerspectivePipelineLayout, nullptr);
+	vkDestroyPipeline(logicalDevice, aerialPerspectivePipeline, nullptr);
+	vkDestroyPipeline(logicalDevice, sceneDepthPipeline, nullptr);
 
 	//Post Process Pipelines
 	vkDestroyPipelineCache(logicalDevice, postProcessPipeLineCache, nullptr);
-	vkDestroyPipelineLayout(logicalDevice, postProcess_GodRays_PipelineLayout, nullptr);
 	vkDestroyPipelineLayout(logicalDevice, postProcess_ToneMap_PipelineLayout, nullptr);
 	vkDestroyPipelineLayout(logicalDevice, postProcess_TXAA_PipelineLayout, nullptr);
-	vkDestroyPipeline(logicalDevice, postProcess_GodRays_PipeLine, nullptr);
 	vkDestroyPipeline(logicalDevice, postProcess_ToneMap_PipeLine, nullptr);
 	vkDestroyPipeline(logicalDevice, postProcess_TXAA_PipeLine, nullptr);
+	vkDestroyPipelineLayout(logicalDevice, postProcess_Fused_PipelineLayout, nullptr);
+	vkDestroyPipelineLayout(logicalDevice, postProcess_Present_PipelineLayout, nullptr);
+	vkDestroyPipeline(logicalDevice, postProcess_Fused_PipeLine, nullptr);
+	vkDestroyPipeline(logicalDevice, postProcess_Present_PipeLine, nullptr);
+	vkDestroyPipelineLayout(logicalDevice, autoExposurePipelineLayout, nullptr);
+	vkDestroyPipeline(logicalDevice, luminanceHistogramPipeline, nullptr);
+	vkDestroyPipeline(logicalDevice, exposureAveragePipeline, nullptr);
 
 	//Render Pass
 	vkDestroyRenderPass(logicalDevice, renderPass, nullptr);
@@ -81,9 +169,30 @@ void Renderer::DestroyOnWindowResize()
 	//Textures
 	delete currentFrameTexture;
 	delete previousFrameTexture;
+	DestroyRenderScaleResources();
+}
+void Renderer::DestroyRenderScaleResources()
+{
 	delete currentCloudsResultTexture;
 	delete previousCloudsResultTexture;
 	delete godRaysCreationDataTexture;
+	delete godRaysTexture1;
+	delete godRaysTexture2;
+	delete currentCloudDistanceTexture;
+	delete previousCloudDistanceTexture;
+	delete currentLightHistoryTexture;
+	delete previousLightHistoryTexture;
+	delete cloudsUpsampledTexture;
+	cloudsUpsampledTexture = nullptr;
+	delete cloudsMotionBlurredTexture;
+	cloudsMotionBlurredTexture = nullptr;
+	delete toneMappedFrameTexture;
+
+	vkDestroyFramebuffer(logicalDevice, sceneDepthFrameBuffer, nullptr);
+	vkDestroySampler(logicalDevice, sceneDepthSampler, nullptr);
+	vkDestroyImageView(logicalDevice, sceneDepthImageView, nullptr);
+	vkFreeMemory(logicalDevice, sceneDepthImageMemory, nullptr);
+	vkDestroyImage(logicalDevice, sceneDepthImage, nullptr);
 }
 
 void Renderer::InitializeRenderer()
@@ -92,17 +201,42 @@ void Renderer::InitializeRenderer()
 	VulkanInitializers::CreateCommandPool(logicalDevice, computeCommandPool, device->GetInstance()->GetQueueFamilyIndices()[QueueFlags::Compute] );
 
 	CreateRenderPass();
+	CreateSceneDepthRenderPass(); // doesn't depend on the window, so unlike the main render pass it lives as long as the renderer
+
+	VkSemaphoreCreateInfo semaphoreInfo = {};
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	if (vkCreateSemaphore(logicalDevice, &semaphoreInfo, nullptr, &sceneDepthSemaphore) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create scene depth semaphore");
+	}
+	if (vkCreateSemaphore(logicalDevice, &semaphoreInfo, nullptr, &cloudComputeSemaphore) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create cloud compute semaphore");
+	}
+	if (vkCreateSemaphore(logicalDevice, &semaphoreInfo, nullptr, &cloudResultSemaphore) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create cloud result semaphore");
+	}
 
 	CreateResources();
 	sky->CreateCloudResources(computeCommandPool);
 
+	// Starts out at FIXED_EXPOSURE with an empty histogram, from then on only the GPU touches it
+	ExposureData initialExposure;
+	BufferUtils::CreateBufferFromData(device, graphicsCommandPool, &initialExposure, sizeof(ExposureData), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+									  exposureBuffer, exposureBufferMemory);
+	sky->CreateAtmosphereResources(computeCommandPool);
+
 	CreateDescriptorPool();
 	CreateAllDescriptorSetLayouts();
 	CreateAllDescriptorSets();
 
 	CreateFrameResources();
 
+	SelectComputeWorkgroupSizes();
 	CreateAllPipeLines(renderPass, 0);
+	if (autotuneWorkgroups)
+	{
+		AutotuneComputeWorkgroupSizes();
+	}
+	BuildAtmosphereLUTs();
 	RecordAllCommandBuffers();
 
 	//Save 3D texture out to ppm image
@@ -115,30 +249,261 @@ void Renderer::RecreateOnResize(uint32_t width, uint32_t height)
 	window_height = height;
 
 	RecreateFrameResources();
+
+	// The new swap chain images have never been rendered to
+	staticFrameCount = 0;
+}
+
+bool Renderer::IsConverged() const
+{
+	return idleWhenConverged && staticFrameCount >= convergenceFrames;
+}
+
+void Renderer::SetRenderScale(float scale)
+{
+	scale = std::min(std::max(scale, MIN_RENDER_SCALE), MAX_RENDER_SCALE);
+	if (scale == renderScale)
+	{
+		return;
+	}
+	renderScale = scale;
+
+	// Nothing at the window resolution changes: the swapchain, the render pass, the pipelines (the passes at the render
+	// resolution set their viewport when they are recorded) and the TXAA history all stay. The history is still valid
+	// at the window resolution, so the TXAA pass hides most of the switch while the new cloud images fill in
+	vkDeviceWaitIdle(logicalDevice);
+	DestroyCommandBuffers();
+	DestroyRenderScaleResources();
+
+	CreateRenderScaleResources();
+	WriteToAndUpdateAllDescriptorSets();
+	RecordAllCommandBuffers();
+
+	staticFrameCount = 0;
+}
+float Renderer::GetRenderScale() const
+{
+	return renderScale;
+}
+
+void Renderer::ResetHistory()
+{
+	vkDeviceWaitIdle(logicalDevice);
+
+	// Everything a frame reads back from the frames before it. The render resolution targets that are written in full
+	// every frame before they are read (tone mapping, god rays, upsampling, motion blur) don't need to be cleared
+	const Texture2D* historyTextures[] = { currentFrameTexture, previousFrameTexture, 
+										   currentCloudsResultTexture, previousCloudsResultTexture,
+										   currentCloudDistanceTexture, previousCloudDistanceTexture,
+										   currentLightHistoryTexture, previousLightHistoryTexture };
+
+	VkClearColorValue clearColor = {};
+	VkImageSubresourceRange clearRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+	ExposureData initialExposure;
+
+	VkCommandBuffer clearCommandBuffer = beginSingleTimeCommands(device, computeCommandPool);
+	for (const Texture2D* texture : historyTextures)
+	{
+		vkCmdClearColorImage(clearCommandBuffer, texture->GetTextureImage(), texture->GetTextureLayout(), &clearColor, 1, &clearRange);
+	}
+	vkCmdUpdateBuffer(clearCommandBuffer, exposureBuffer, 0, sizeof(ExposureData), &initialExposure);
+	endSingleTimeCommands(device, computeCommandPool, device->GetQueue(QueueFlags::Compute), clearCommandBuffer);
+
+	swapPingPongBuffers = false;
+	staticFrameCount = 0;
+	lastFrameTime = std::chrono::steady_clock::time_point();
+	historyReset = true;
+}
+
+void Renderer::ReadFinalImage(std::vector<uint8_t>& pixels, uint32_t& width, uint32_t& height)
+{
+	vkDeviceWaitIdle(logicalDevice);
+
+	// Frame() flips swapPingPongBuffers after its submission; graphicsCommandBuffer1 (TXAASet1) writes currentFrameTexture
+	const Texture2D* finalTexture = swapPingPongBuffers ? previousFrameTexture : currentFrameTexture;
+	width = finalTexture->GetWidth();
+	height = finalTexture->GetHeight();
+	const VkDeviceSize imageSize = VkDeviceSize(width) * height * 4;
+
+	VkBuffer readbackBuffer;
+	VkDeviceMemory readbackBufferMemory;
+	BufferUtils::CreateBuffer(device, VK_BUFFER_USAGE_TRANSFER_DST_BIT, imageSize, 
+							  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, readbackBuffer, readbackBufferMemory);
+
+	VkCommandBuffer copyCommandBuffer = beginSingleTimeCommands(device, graphicsCommandPool);
+
+	// Written as a storage image by the fused post process kernel or the TXAA draw, and it stays in the general layout
+	VkMemoryBarrier shaderWriteBarrier = {};
+	shaderWriteBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	shaderWriteBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	shaderWriteBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	vkCmdPipelineBarrier(copyCommandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 
+						 VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &shaderWriteBarrier, 0, nullptr, 0, nullptr);
+
+	VkBufferImageCopy region = {};
+	region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+	region.imageExtent = { width, height, 1 };
+	vkCmdCopyImageToBuffer(copyCommandBuffer, finalTexture->GetTextureImage(), finalTexture->GetTextureLayout(), readbackBuffer, 1, &region);
+
+	endSingleTimeCommands(device, graphicsCommandPool, device->GetQueue(QueueFlags::Graphics), copyCommandBuffer);
+
+	// R8G8B8A8_SNORM: -127 to 127 stand for -1 to 1, the final image only holds 0 to 1
+	void* data;
+	vkMapMemory(logicalDevice, readbackBufferMemory, 0, imageSize, 0, &data);
+	const int8_t* texels = static_cast<const int8_t*>(data);
+	pixels.resize(static_cast<size_t>(imageSize));
+	for (size_t i = 0; i < pixels.size(); i++)
+	{
+		pixels[i] = static_cast<uint8_t>((std::max<int>(texels[i], 0) * 255 + 63) / 127);
+	}
+	vkUnmapMemory(logicalDevice, readbackBufferMemory);
+
+	vkDestroyBuffer(logicalDevice, readbackBuffer, nullptr);
+	vkFreeMemory(logicalDevice, readbackBufferMemory, nullptr);
+}
+
+unsigned int Renderer::GetConvergenceFrames() const
+{
+	return convergenceFrames;
+}
+
+GpuProfiler* Renderer::GetGpuProfiler() const
+{
+	return gpuProfiler;
 }
 
 //This Function submits command buffers for execution --> so that the application can 
 //actually present one image after another and not just stop after the first image
 void Renderer::Frame()
 {
+	//-------------------------------------------
+	//------- Static View Convergence -----------
+	//-------------------------------------------
+	// Anything that changes how the clouds look restarts the count. Once the view converged nothing is submitted 
+	// (or presented) anymore, so the GPU idles and the last image stays on screen
+	const bool skyChanged = sky->IsSunAndSkyDirty();
+	const bool viewChanged = camera->IsDirty() || skyChanged || scene->IsTimeDirty();
+	camera->ClearDirty();
+	sky->ClearSunAndSkyDirty();
+	scene->ClearTimeDirty();
+
+	if (viewChanged)
+	{
+		staticFrameCount = 0;
+	}
+	else if (staticFrameCount < convergenceFrames)
+	{
+		staticFrameCount++;
+	}
+	if (IsConverged())
+	{
+		// The time spent idling isn't a frame time
+		lastFrameTime = std::chrono::steady_clock::time_point();
+		return;
+	}
+
+	//-------------------------------------------
+	//------------- Horizon Band ----------------
+	//-------------------------------------------
+	// Next slice of the band; a new sun or new quality parameters change the lit band colors, so it starts over
+	sky->AdvanceHorizonBand(camera->GetPosition(), skyChanged || historyReset);
+	historyReset = false;
+
+	//-------------------------------------------
+	//--------- Frame Budget Governor -----------
+	//-------------------------------------------
+	// The GPU timings of the passes come back a frame or two late; that's fine for a controller that reacts over many frames
+	gpuProfiler->CollectResults();
+
+	const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	double cpuFrameMilliseconds = 0.0;
+	if (lastFrameTime != std::chrono::steady_clock::time_point())
+	{
+		cpuFrameMilliseconds = std::chrono::duration<double, std::milli>(now - lastFrameTime).count();
+	}
+	lastFrameTime = now;
+
+	if (qualityGovernor)
+	{
+		// Without timestamps the CPU frame time stands in; it includes waiting for vsync, so budgets below the refresh interval work best
+		const double frameMilliseconds = gpuProfiler->IsSupported() ? gpuProfiler->GetFrameMilliseconds() : cpuFrameMilliseconds;
+		const std::string previousLevelName = qualityGovernor->GetLevelName();
+
+		if (qualityGovernor->Update(frameMilliseconds, sky->GetCloudQuality()))
+		{
+			sky->UpdateCloudQuality();
+			std::cout << "Cloud quality " << previousLevelName << " -> " << qualityGovernor->GetLevelName()
+					  << " (frame " << qualityGovernor->GetSmoothedFrameMilliseconds() << " ms)" << std::endl;
+		}
+	}
+
+	//-------------------------------------------
+	//------- Submit Scene Depth Pre-Pass -------
+	//-------------------------------------------
+	// The scene geometry is drawn into a depth buffer on the graphics queue first. It signals a semaphore 
+	// the compute submission below waits on, so the cloud passes of this frame see this frame's depth.
+	// The other way around, the last frame's ray march and reprojection may still be sampling the depth buffer on the 
+	// compute queue; the clear waits for the semaphore that compute submission signalled (nothing to wait for on the first frame)
+	VkSubmitInfo sceneDepthSubmitInfo = {};
+	sceneDepthSubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	sceneDepthSubmitInfo.commandBufferCount = 1;
+	sceneDepthSubmitInfo.pCommandBuffers = &sceneDepthCommandBuffer;
+	sceneDepthSubmitInfo.signalSemaphoreCount = 1;
+	sceneDepthSubmitInfo.pSignalSemaphores = &sceneDepthSemaphore;
+
+	VkPipelineStageFlags sceneDepthWaitStage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+	if (cloudComputeSemaphorePending)
+	{
+		sceneDepthSubmitInfo.waitSemaphoreCount = 1;
+		sceneDepthSubmitInfo.pWaitSemaphores = &cloudComputeSemaphore;
+		sceneDepthSubmitInfo.pWaitDstStageMask = &sceneDepthWaitStage;
+	}
+
+	if (vkQueueSubmit(device->GetQueue(QueueFlags::Graphics), 1, &sceneDepthSubmitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to submit scene depth command buffer");
+	}
+
 	//-------------------------------------------
 	//--------- Submit Compute Queue ------------
 	//-------------------------------------------
 
-	VkSubmitInfo computeSubmitInfo = {};
-	computeSubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	computeSubmitInfo.commandBufferCount = 1;
+	// The sky-view LUT is only rebuilt when the sun changed. Its command buffer goes first in the same submission 
+	// and ends with a barrier, so the ray march of this frame already sees the new LUT
+	VkCommandBuffer computeCommandBuffers[2];
+	uint32_t computeCommandBufferCount = 0;
+	if (sky->IsSkyViewLUTDirty()) {
+		computeCommandBuffers[computeCommandBufferCount++] = skyViewLUTCommandBuffer;
+		sky->MarkSkyViewLUTUpToDate();
+	}
 	if (swapPingPongBuffers) {
-		computeSubmitInfo.pCommandBuffers = &computeCommandBuffer1;
+		computeCommandBuffers[computeCommandBufferCount++] = computeCommandBuffer1;
 	}
 	else {
-		computeSubmitInfo.pCommandBuffers = &computeCommandBuffer2;
+		computeCommandBuffers[computeCommandBufferCount++] = computeCommandBuffer2;
 	}
 
+	VkSubmitInfo computeSubmitInfo = {};
+	computeSubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	computeSubmitInfo.commandBufferCount = computeCommandBufferCount;
+	computeSubmitInfo.pCommandBuffers = computeCommandBuffers;
+
+	// The ray march and the reprojection read the scene depth in their compute shaders
+	VkPipelineStageFlags computeWaitStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	computeSubmitInfo.waitSemaphoreCount = 1;
+	computeSubmitInfo.pWaitSemaphores = &sceneDepthSemaphore;
+	computeSubmitInfo.pWaitDstStageMask = &computeWaitStage;
+
+	// Once the cloud passes are done reading the scene depth, the next frame's pre-pass may clear it. 
+	// And once they are done writing the clouds, god rays and exposure, this frame's post processing may read them
+	VkSemaphore computeSignalSemaphores[] = { cloudComputeSemaphore, cloudResultSemaphore };
+	computeSubmitInfo.signalSemaphoreCount = 2;
+	computeSubmitInfo.pSignalSemaphores = computeSignalSemaphores;
+
 	// submit the command buffer to the compute queue
 	if (vkQueueSubmit(device->GetQueue(QueueFlags::Compute), 1, &computeSubmitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
 		throw std::runtime_error("Failed to submit compute command buffer");
 	}
+	cloudComputeSemaphorePending = true;
 
 	//-------------------------------------------
 	//--------- Submit Graphics Queue -----------
@@ -156,10 +521,13 @@ void Renderer::Frame()
 	vkFence: GPU to CPU synchronization
 	*/
 
-	VkSemaphore waitSemaphores[] = { swapChain->GetImageAvailableVkSemaphore() };
-	VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+	// The post processing reads what the compute submission above wrote: the fused kernel in its compute shader, 
+	// the separate passes in their fragment shaders
+	const VkPipelineStageFlags cloudReadStage = fusedPostProcessEnabled ? VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT : VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	VkSemaphore waitSemaphores[] = { swapChain->GetImageAvailableVkSemaphore(), cloudResultSemaphore };
+	VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, cloudReadStage };
 	// These parameters specify which semaphores to wait on before execution begins and in which stage(s) of the pipeline to wait
-	graphicsSubmitInfo.waitSemaphoreCount = 1;
+	graphicsSubmitInfo.waitSemaphoreCount = 2;
 	graphicsSubmitInfo.pWaitSemaphores = waitSemaphores;
 	graphicsSubmitInfo.pWaitDstStageMask = waitStages;
 	// We want to wait with writing colors to the image until it's available, so we're specifying the stage of the graphics pipeline 
@@ -265,6 +633,62 @@ void Renderer::CreateRenderPass()
 		throw std::runtime_error("Failed to create render pass");
 	}
 }
+void Renderer::CreateSceneDepthRenderPass()
+{
+	// A single depth attachment. Unlike the depth buffer of the main render pass it is stored, 
+	// and left in a layout the cloud compute passes can sample it in
+	VkAttachmentDescription depthAttachment = {};
+	depthAttachment.format = FormatUtils::FindDepthFormat(physicalDevice);
+	depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+	depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED; // everything is cleared anyway
+	depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+	VkAttachmentReference depthAttachmentRef = {};
+	depthAttachmentRef.attachment = 0;
+	depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	VkSubpassDescription subpass = {};
+	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	subpass.colorAttachmentCount = 0;
+	subpass.pDepthStencilAttachment = &depthAttachmentRef;
+
+	// The last frame's pre-pass has to be done with the depth buffer before this one clears it
+	std::array<VkSubpassDependency, 2> dependencies = {};
+	dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+	dependencies[0].dstSubpass = 0;
+	dependencies[0].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	dependencies[0].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	dependencies[0].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+	dependencies[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+	// So have the last frame's cloud passes, which sample it. The semaphore the submission waits on (see Frame) gets the
+	// compute queue's reads done; this orders the clear and the layout transition out of the read only layout after them.
+	// A read before a write only needs the execution dependency, there is nothing to make visible
+	dependencies[1].srcSubpass = VK_SUBPASS_EXTERNAL;
+	dependencies[1].dstSubpass = 0;
+	dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	dependencies[1].srcAccessMask = 0;
+	dependencies[1].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+	dependencies[1].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+	VkRenderPassCreateInfo renderPassInfo = {};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+	renderPassInfo.attachmentCount = 1;
+	renderPassInfo.pAttachments = &depthAttachment;
+	renderPassInfo.subpassCount = 1;
+	renderPassInfo.pSubpasses = &subpass;
+	renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+	renderPassInfo.pDependencies = dependencies.data();
+
+	if (vkCreateRenderPass(logicalDevice, &renderPassInfo, nullptr, &sceneDepthRenderPass) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create scene depth render pass");
+	}
+}
 
 //----------------------------------------------
 //-------------- Pipelines ---------------------
@@ -273,20 +697,54 @@ void Renderer::CreateAllPipeLines(VkRenderPass renderPass, unsigned int subpass)
 {
 	cloudComputePipelineLayout = VulkanInitializers::CreatePipelineLayout( logicalDevice, { pingPongCloudResultSetLayout, cloudComputeSetLayout, 
 																							cameraSetLayout, timeSetLayout, 
-																							sunAndSkySetLayout, keyPressQuerySetLayout });
+																							sunAndSkySetLayout, keyPressQuerySetLayout,
+																							cloudQualitySetLayout, horizonBandSetLayout });
 	reprojectionPipelineLayout = VulkanInitializers::CreatePipelineLayout( logicalDevice, { pingPongCloudResultSetLayout, cameraSetLayout, 
 																							cameraSetLayout, timeSetLayout });
+	cloudUpsamplePipelineLayout = VulkanInitializers::CreatePipelineLayout( logicalDevice, { cloudUpsampleSetLayout, cameraSetLayout });
+	motionBlurPipelineLayout = VulkanInitializers::CreatePipelineLayout( logicalDevice, { pingPongCloudResultSetLayout, motionBlurSetLayout, 
+																						  cameraSetLayout, cameraSetLayout });
+	godRaysPipelineLayout = VulkanInitializers::CreatePipelineLayout( logicalDevice, { godRaysSetLayout, cameraSetLayout, 
+																					   sunAndSkySetLayout, cloudQualitySetLayout });
+	transmittanceLUTPipelineLayout = VulkanInitializers::CreatePipelineLayout( logicalDevice, { lutOutputSetLayout });
+	multipleScatteringLUTPipelineLayout = VulkanInitializers::CreatePipelineLayout( logicalDevice, { lutOutputSetLayout, atmosphereSetLayout });
+	skyViewLUTPipelineLayout = VulkanInitializers::CreatePipelineLayout( logicalDevice, { lutOutputSetLayout, atmosphereSetLayout, sunAndSkySetLayout });
+	aerialPerspectivePipelineLayout = VulkanInitializers::CreatePipelineLayout( logicalDevice, { lutOutputSetLayout, atmosphereSetLayout, 
+																								 sunAndSkySetLayout, cameraSetLayout });
 	graphicsPipelineLayout = VulkanInitializers::CreatePipelineLayout( logicalDevice, { graphicsSetLayout, cameraSetLayout });	
-	postProcess_GodRays_PipelineLayout = VulkanInitializers::CreatePipelineLayout( logicalDevice, { pingPongCloudResultSetLayout, godRaysSetLayout, 
-																									cameraSetLayout, sunAndSkySetLayout });
 	postProcess_ToneMap_PipelineLayout = VulkanInitializers::CreatePipelineLayout( logicalDevice, { toneMapSetLayout, timeSetLayout });
 	postProcess_TXAA_PipelineLayout = VulkanInitializers::CreatePipelineLayout(logicalDevice, { TXAASetLayout, cameraSetLayout, 
 																								cameraSetLayout, timeSetLayout});
+	postProcess_Fused_PipelineLayout = VulkanInitializers::CreatePipelineLayout(logicalDevice, { toneMapSetLayout, TXAASetLayout, cameraSetLayout,
+																								 cameraSetLayout, timeSetLayout });
+	postProcess_Present_PipelineLayout = VulkanInitializers::CreatePipelineLayout(logicalDevice, { TXAASetLayout });
+	autoExposurePipelineLayout = VulkanInitializers::CreatePipelineLayout(logicalDevice, { toneMapSetLayout });
 	
-	CreateComputePipeline(cloudComputePipelineLayout, cloudComputePipeline, "CloudScapes/shaders/cloudRayMarch.comp.spv");
-	CreateComputePipeline(reprojectionPipelineLayout, reprojectionPipeline, "CloudScapes/shaders/reprojection.comp.spv");
+	CreateComputePipeline(cloudComputePipelineLayout, cloudComputePipeline, "CloudScapes/shaders/" + cloudRayMarchShaderName + ".comp.spv", cloudComputeWorkgroupSize);
+	CreateComputePipeline(reprojectionPipelineLayout, reprojectionPipeline, "CloudScapes/shaders/reprojection.comp.spv", reprojectionWorkgroupSize);
+	CreateComputePipeline(cloudUpsamplePipelineLayout, cloudUpsamplePipeline, "CloudScapes/shaders/cloudUpsample.comp.spv", cloudUpsampleWorkgroupSize);
+	CreateComputePipeline(motionBlurPipelineLayout, motionBlurPipeline, "CloudScapes/shaders/motionBlur.comp.spv", motionBlurWorkgroupSize);
+	CreateComputePipeline(godRaysPipelineLayout, godRaysDownsamplePipeline, "CloudScapes/shaders/godRaysDownsample.comp.spv", godRaysWorkgroupSize);
+	for (uint32_t pass = 0; pass < GOD_RAYS_BLUR_PASSES; pass++)
+	{
+		CreateComputePipeline(godRaysPipelineLayout, godRaysBlurPipelines[pass], "CloudScapes/shaders/godRaysBlur.comp.spv", godRaysWorkgroupSize, pass);
+	}
+	CreateComputePipeline(cloudComputePipelineLayout, horizonBandPipeline, "CloudScapes/shaders/cloudHorizonBand.comp.spv", horizonBandWorkgroupSize);
+	CreateComputePipeline(transmittanceLUTPipelineLayout, transmittanceLUTPipeline, "CloudScapes/shaders/transmittanceLUT.comp.spv", atmosphereLUTWorkgroupSize);
+	CreateComputePipeline(multipleScatteringLUTPipelineLayout, multipleScatteringLUTPipeline, "CloudScapes/shaders/multipleScatteringLUT.comp.spv", atmosphereLUTWorkgroupSize);
+	CreateComputePipeline(skyViewLUTPipelineLayout, skyViewLUTPipeline, "CloudScapes/shaders/skyViewLUT.comp.spv", skyViewLUTWorkgroupSize);
+	CreateComputePipeline(aerialPerspectivePipelineLayout, aerialPerspectivePipeline, "CloudScapes/shaders/aerialPerspective.comp.spv", aerialPerspectiveWorkgroupSize);
+	// The fused kernel declares its own workgroup size, the specialization constants of the size go unused
+	CreateComputePipeline(postProcess_Fused_PipelineLayout, postProcess_Fused_PipeLine, "CloudScapes/shaders/postProcess_Fused.comp.spv",
+						  { FUSED_POST_PROCESS_TILE_SIZE, FUSED_POST_PROCESS_TILE_SIZE });
+	// Same for the auto exposure passes, one invocation per histogram bin
+	CreateComputePipeline(autoExposurePipelineLayout, luminanceHistogramPipeline, "CloudScapes/shaders/luminanceHistogram.comp.spv",
+						  { LUMINANCE_HISTOGRAM_WORKGROUP_SIZE, LUMINANCE_HISTOGRAM_WORKGROUP_SIZE });
+	CreateComputePipeline(autoExposurePipelineLayout, exposureAveragePipeline, "CloudScapes/shaders/exposureAverage.comp.spv",
+						  { LUMINANCE_HISTOGRAM_BINS, 1 });
 	CreateGraphicsPipeline(renderPass, 0);
 	CreatePostProcessPipeLines(renderPass);
+	CreateSceneDepthPipeline();
 }
 
 // Reference: https://vulkan-tutorial.com/Drawing_a_triangle/Graphics_pipeline_basics/Conclusion
@@ -412,15 +870,20 @@ void Renderer::CreateGraphicsPipeline(VkRenderPass renderPass, unsigned int subp
 	vkDestroyShaderModule(device->GetVkDevice(), vertShaderModule, nullptr);
 	vkDestroyShaderModule(device->GetVkDevice(), fragShaderModule, nullptr);
 }
-void Renderer::CreateComputePipeline(VkPipelineLayout& _computePipelineLayout, VkPipeline& _computePipeline, const std::string &filename)
+void Renderer::CreateComputePipeline(VkPipelineLayout& _computePipelineLayout, VkPipeline& _computePipeline, const std::string &filename, 
+									 const WorkgroupSize& workgroupSize, uint32_t variant)
 {
 	VkShaderModule compShaderModule = ShaderModule::createShaderModule(filename, device->GetVkDevice());
 
+	// The compute shaders declare their local size with specialization constants 0 and 1, 'variant' goes to constant 2
+	WorkgroupSpecialization specialization(workgroupSize, variant);
+
 	VkPipelineShaderStageCreateInfo compShaderStageInfo = {};
 	compShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 	compShaderStageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
 	compShaderStageInfo.module = compShaderModule;
 	compShaderStageInfo.pName = "main";
+	compShaderStageInfo.pSpecializationInfo = &specialization.info;
 
 	VkComputePipelineCreateInfo pipelineInfo = {};
 	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
@@ -478,16 +941,17 @@ void Renderer::CreatePostProcessPipeLines(VkRenderPass renderPass)
 	VkPipelineMultisampleStateCreateInfo multiSampleState =
 		VulkanInitializers::pipelineMultisampleStateCreateInfo(VK_SAMPLE_COUNT_1_BIT, 0);
 
-	// No Dynamic states
-	//std::vector<VkDynamicState> dynamicStateEnables = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
-	//VkPipelineDynamicStateCreateInfo dynamicState =
-	//	VulkanInitializers::pipelineDynamicStateCreateInfo( dynamicStateEnables, 0 );
+	// The tone mapping pass runs at the render resolution, which can change without the pipelines being
+	// recreated --> its viewport and scissor are set when the command buffers are recorded. The TXAA pass draws the whole window
+	std::vector<VkDynamicState> dynamicStateEnables = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+	VkPipelineDynamicStateCreateInfo dynamicState =
+		VulkanInitializers::pipelineDynamicStateCreateInfo( dynamicStateEnables, 0 );
 
 	std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages; //Defined later on and changes per pipeline binding since we are creating many pipelines here
 
 	// -------- Create Base PostProcess pipeline Info ---------
 	VkGraphicsPipelineCreateInfo postProcessPipelineCreateInfo =
-		VulkanInitializers::graphicsPipelineCreateInfo(postProcess_GodRays_PipelineLayout, renderPass, 0);
+		VulkanInitializers::graphicsPipelineCreateInfo(postProcess_ToneMap_PipelineLayout, renderPass, 0);
 
 	postProcessPipelineCreateInfo.pVertexInputState = &emptyVertexInputState;; //defined above
 	postProcessPipelineCreateInfo.pInputAssemblyState = &inputAssemblyState; //defined above
@@ -496,7 +960,7 @@ void Renderer::CreatePostProcessPipeLines(VkRenderPass renderPass)
 	postProcessPipelineCreateInfo.pMultisampleState = &multiSampleState; //defined above
 	postProcessPipelineCreateInfo.pViewportState = &viewportState; //defined above
 	postProcessPipelineCreateInfo.pDepthStencilState = &depthStencilState; //defined above
-	postProcessPipelineCreateInfo.pDynamicState = nullptr; //defined above
+	postProcessPipelineCreateInfo.pDynamicState = &dynamicState; //defined above
 	postProcessPipelineCreateInfo.subpass = 0; // no subpasses
 	postProcessPipelineCreateInfo.stageCount = shaderStages.size(); //reserving memory for the shader stages that will soon be defined
 	postProcessPipelineCreateInfo.pStages = shaderStages.data();
@@ -509,21 +973,6 @@ void Renderer::CreatePostProcessPipeLines(VkRenderPass renderPass)
 		ShaderModule::createShaderModule("CloudScapes/shaders/postProcess_GenericVertShader.vert.spv", logicalDevice);
 	shaderStages[0] = VulkanInitializers::loadShader(VK_SHADER_STAGE_VERTEX_BIT, generic_vertShaderModule);
 
-	// -------- God Rays pipeline -----------------------------------------
-	VkShaderModule godRays_fragShaderModule =
-		ShaderModule::createShaderModule("CloudScapes/shaders/postProcess_GodRays.frag.spv", logicalDevice);
-
-	// Assign each shader module to the appropriate stage in the pipeline
-	shaderStages[1] = VulkanInitializers::loadShader(VK_SHADER_STAGE_FRAGMENT_BIT, godRays_fragShaderModule);
-
-	postProcessPipelineCreateInfo.layout = postProcess_GodRays_PipelineLayout;
-
-	if (vkCreateGraphicsPipelines(logicalDevice, postProcessPipeLineCache, 1, &postProcessPipelineCreateInfo, nullptr, &postProcess_GodRays_PipeLine) != VK_SUCCESS) {
-		throw std::runtime_error("Failed to create post process pipeline");
-	}
-
-	vkDestroyShaderModule(device->GetVkDevice(), godRays_fragShaderModule, nullptr);
-
 	// -------- Tone Map Post -----------------------------------------
 	VkShaderModule toneMap_fragShaderModule =
 		ShaderModule::createShaderModule("CloudScapes/shaders/postProcess_ToneMap.frag.spv", logicalDevice);
@@ -543,6 +992,7 @@ void Renderer::CreatePostProcessPipeLines(VkRenderPass renderPass)
 	// BlendAttachmentState in addition to defining the blend state also defines if the shaders can write to the framebuffer with the color write mask
 	// Color Write Mask Reference: https://www.khronos.org/registry/vulkan/specs/1.0/man/html/VkColorComponentFlagBits.html
 	blendAttachmentState = VulkanInitializers::pipelineColorBlendAttachmentState(0xf, VK_FALSE);
+	postProcessPipelineCreateInfo.pDynamicState = nullptr;
 
 	// -------- Anti Aliasing  pipeline -----------------------------------------
 	VkShaderModule TXAA_fragShaderModule =
@@ -558,8 +1008,199 @@ void Renderer::CreatePostProcessPipeLines(VkRenderPass renderPass)
 	}
 
 	vkDestroyShaderModule(device->GetVkDevice(), TXAA_fragShaderModule, nullptr);
+
+	// -------- Present pipeline (fused post processing) ---------------------
+	// Copies the TXAA history the fused post process kernel wrote to the swapchain image, same states as the TXAA pass
+	VkShaderModule present_fragShaderModule =
+		ShaderModule::createShaderModule("CloudScapes/shaders/postProcess_Present.frag.spv", logicalDevice);
+
+	shaderStages[1] = VulkanInitializers::loadShader(VK_SHADER_STAGE_FRAGMENT_BIT, present_fragShaderModule);
+
+	postProcessPipelineCreateInfo.layout = postProcess_Present_PipelineLayout;
+
+	if (vkCreateGraphicsPipelines(logicalDevice, postProcessPipeLineCache, 1, &postProcessPipelineCreateInfo, nullptr, &postProcess_Present_PipeLine) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create post process pipeline");
+	}
+
+	vkDestroyShaderModule(device->GetVkDevice(), present_fragShaderModule, nullptr);
 	vkDestroyShaderModule(device->GetVkDevice(), generic_vertShaderModule, nullptr);
 }
+void Renderer::CreateSceneDepthPipeline()
+{
+	// Only depth is written, so the geometry's vertex shader is all it needs; without color attachments
+	// a pipeline doesn't need a fragment shader (or a color blend state)
+	VkShaderModule vertShaderModule = ShaderModule::createShaderModule("CloudScapes/shaders/geometryPlain.vert.spv", logicalDevice);
+	VkPipelineShaderStageCreateInfo vertShaderStageInfo = VulkanInitializers::loadShader(VK_SHADER_STAGE_VERTEX_BIT, vertShaderModule);
+
+	VkVertexInputBindingDescription vertexInputBinding = Vertex::getBindingDescription();
+	std::array<VkVertexInputAttributeDescription, 3> vertexInputAttributes = Vertex::getAttributeDescriptions();
+
+	VkPipelineVertexInputStateCreateInfo vertexInputState = VulkanInitializers::pipelineVertexInputStateCreateInfo();
+	vertexInputState.vertexBindingDescriptionCount = 1;
+	vertexInputState.pVertexBindingDescriptions = &vertexInputBinding;
+	vertexInputState.vertexAttributeDescriptionCount = static_cast<uint32_t>(vertexInputAttributes.size());
+	vertexInputState.pVertexAttributeDescriptions = vertexInputAttributes.data();
+
+	VkPipelineInputAssemblyStateCreateInfo inputAssemblyState =
+		VulkanInitializers::pipelineInputAssemblyStateCreateInfo(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, 0, VK_FALSE);
+
+	// Both faces: the depth has to be right whichever way the models are wound
+	VkPipelineRasterizationStateCreateInfo rasterizationState =
+		VulkanInitializers::pipelineRasterizationStateCreateInfo(VK_POLYGON_MODE_FILL, VK_CULL_MODE_NONE, VK_FRONT_FACE_CLOCKWISE, 0);
+
+	VkPipelineMultisampleStateCreateInfo multisamplingState =
+		VulkanInitializers::pipelineMultisampleStateCreateInfo(VK_SAMPLE_COUNT_1_BIT, 0);
+
+	VkPipelineDepthStencilStateCreateInfo depthStencilState =
+		VulkanInitializers::pipelineDepthStencilStateCreateInfo(VK_TRUE, VK_TRUE, VK_COMPARE_OP_LESS);
+
+	// The depth buffer is at the cloud resolution, which changes with the render scale --> viewport and scissor are set when recording
+	VkPipelineViewportStateCreateInfo viewportState = VulkanInitializers::pipelineViewportStateCreateInfo(1, 1, 0);
+
+	std::vector<VkDynamicState> dynamicStateEnables = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+	VkPipelineDynamicStateCreateInfo dynamicState = VulkanInitializers::pipelineDynamicStateCreateInfo(dynamicStateEnables, 0);
+
+	VkGraphicsPipelineCreateInfo pipelineInfo = VulkanInitializers::graphicsPipelineCreateInfo(graphicsPipelineLayout, sceneDepthRenderPass);
+	pipelineInfo.stageCount = 1;
+	pipelineInfo.pStages = &vertShaderStageInfo;
+	pipelineInfo.pVertexInputState = &vertexInputState;
+	pipelineInfo.pInputAssemblyState = &inputAssemblyState;
+	pipelineInfo.pViewportState = &viewportState;
+	pipelineInfo.pRasterizationState = &rasterizationState;
+	pipelineInfo.pMultisampleState = &multisamplingState;
+	pipelineInfo.pDepthStencilState = &depthStencilState;
+	pipelineInfo.pColorBlendState = nullptr;
+	pipelineInfo.pDynamicState = &dynamicState;
+	pipelineInfo.subpass = 0;
+
+	if (vkCreateGraphicsPipelines(logicalDevice, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &sceneDepthPipeline) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create scene depth pipeline");
+	}
+
+	vkDestroyShaderModule(logicalDevice, vertShaderModule, nullptr);
+}
+
+//----------------------------------------------
+//-------------- Workgroup Sizes ---------------
+//----------------------------------------------
+// Picks the workgroup size each compute pipeline is specialized with: the tuned size from the cache file if this
+// device was tuned before, otherwise a default the device is guaranteed to support
+void Renderer::SelectComputeWorkgroupSizes()
+{
+	workgroupTuner = new WorkgroupTuner(device, physicalDevice, computeCommandPool, "workgroupSizes.cache");
+
+	// The float16 variant needs fewer registers, so it is tuned separately
+	if (!workgroupTuner->GetCachedSize(cloudRayMarchShaderName, cloudComputeWorkgroupSize))
+	{
+		cloudComputeWorkgroupSize = workgroupTuner->GetDefaultSize();
+	}
+	if (!workgroupTuner->GetCachedSize("reprojection", reprojectionWorkgroupSize))
+	{
+		reprojectionWorkgroupSize = workgroupTuner->GetDefaultSize();
+	}
+	if (!workgroupTuner->GetCachedSize("cloudUpsample", cloudUpsampleWorkgroupSize))
+	{
+		cloudUpsampleWorkgroupSize = workgroupTuner->GetDefaultSize();
+	}
+	if (!workgroupTuner->GetCachedSize("motionBlur", motionBlurWorkgroupSize))
+	{
+		motionBlurWorkgroupSize = workgroupTuner->GetDefaultSize();
+	}
+	if (!workgroupTuner->GetCachedSize("cloudHorizonBand", horizonBandWorkgroupSize))
+	{
+		horizonBandWorkgroupSize = workgroupTuner->GetDefaultSize();
+	}
+
+	// The atmosphere passes are tiny (the aerial perspective pass is a 32x32 grid of threads), not worth tuning
+	skyViewLUTWorkgroupSize = workgroupTuner->GetDefaultSize();
+	atmosphereLUTWorkgroupSize = workgroupTuner->GetDefaultSize();
+	aerialPerspectiveWorkgroupSize = workgroupTuner->GetDefaultSize();
+
+	// Same for the god rays, at a quarter of the render resolution
+	godRaysWorkgroupSize = workgroupTuner->GetDefaultSize();
+}
+
+// Times every candidate workgroup size for both compute pipelines with the real descriptor sets bound,
+// rebuilds the pipelines with the winners and writes them to the cache file for the next run.
+// Needs the pipeline layouts, descriptor sets and resources to exist already.
+void Renderer::AutotuneComputeWorkgroupSizes()
+{
+	reprojectionWorkgroupSize = workgroupTuner->Tune("reprojection",
+		[this](const WorkgroupSize& size) {
+			VkPipeline pipeline;
+			CreateComputePipeline(reprojectionPipelineLayout, pipeline, "CloudScapes/shaders/reprojection.comp.spv", size);
+			return pipeline;
+		},
+		[this](VkCommandBuffer commandBuffer, const WorkgroupSize& size) {
+			RecordReprojectionDispatch(commandBuffer, pingPongCloudResultSet1, size);
+		});
+
+	cloudComputeWorkgroupSize = workgroupTuner->Tune(cloudRayMarchShaderName,
+		[this](const WorkgroupSize& size) {
+			VkPipeline pipeline;
+			CreateComputePipeline(cloudComputePipelineLayout, pipeline, "CloudScapes/shaders/" + cloudRayMarchShaderName + ".comp.spv", size);
+			return pipeline;
+		},
+		[this](VkCommandBuffer commandBuffer, const WorkgroupSize& size) {
+			RecordCloudRayMarchDispatch(commandBuffer, pingPongCloudResultSet1, size);
+		});
+
+	// The upsampling pass only runs (and only has its images) with reduced resolution clouds
+	if (cloudResolutionDivisor > 1)
+	{
+		cloudUpsampleWorkgroupSize = workgroupTuner->Tune("cloudUpsample",
+			[this](const WorkgroupSize& size) {
+				VkPipeline pipeline;
+				CreateComputePipeline(cloudUpsamplePipelineLayout, pipeline, "CloudScapes/shaders/cloudUpsample.comp.spv", size);
+				return pipeline;
+			},
+			[this](VkCommandBuffer commandBuffer, const WorkgroupSize& size) {
+				RecordCloudUpsampleDispatch(commandBuffer, cloudUpsampleSet1, size);
+			});
+	}
+
+	// Same for the motion blur pass
+	if (motionBlurEnabled)
+	{
+		motionBlurWorkgroupSize = workgroupTuner->Tune("motionBlur",
+			[this](const WorkgroupSize& size) {
+				VkPipeline pipeline;
+				CreateComputePipeline(motionBlurPipelineLayout, pipeline, "CloudScapes/shaders/motionBlur.comp.spv", size);
+				return pipeline;
+			},
+			[this](VkCommandBuffer commandBuffer, const WorkgroupSize& size) {
+				RecordMotionBlurDispatch(commandBuffer, pingPongCloudResultSet1, size);
+			});
+	}
+
+	// And the horizon band pass
+	if (sky->IsHorizonBandEnabled())
+	{
+		horizonBandWorkgroupSize = workgroupTuner->Tune("cloudHorizonBand",
+			[this](const WorkgroupSize& size) {
+				VkPipeline pipeline;
+				CreateComputePipeline(cloudComputePipelineLayout, pipeline, "CloudScapes/shaders/cloudHorizonBand.comp.spv", size);
+				return pipeline;
+			},
+			[this](VkCommandBuffer commandBuffer, const WorkgroupSize& size) {
+				RecordHorizonBandDispatch(commandBuffer, pingPongCloudResultSet1, size);
+			});
+	}
+
+	workgroupTuner->SaveCache();
+
+	// Replace the pipelines built with the old sizes
+	vkDestroyPipeline(logicalDevice, cloudComputePipeline, nullptr);
+	vkDestroyPipeline(logicalDevice, reprojectionPipeline, nullptr);
+	vkDestroyPipeline(logicalDevice, cloudUpsamplePipeline, nullptr);
+	vkDestroyPipeline(logicalDevice, motionBlurPipeline, nullptr);
+	vkDestroyPipeline(logicalDevice, horizonBandPipeline, nullptr);
+	CreateComputePipeline(cloudComputePipelineLayout, cloudComputePipeline, "CloudScapes/shaders/" + cloudRayMarchShaderName + ".comp.spv", cloudComputeWorkgroupSize);
+	CreateComputePipeline(reprojectionPipelineLayout, reprojectionPipeline, "CloudScapes/shaders/reprojection.comp.spv", reprojectionWorkgroupSize);
+	CreateComputePipeline(cloudUpsamplePipelineLayout, cloudUpsamplePipeline, "CloudScapes/shaders/cloudUpsample.comp.spv", cloudUpsampleWorkgroupSize);
+	CreateComputePipeline(motionBlurPipelineLayout, motionBlurPipeline, "CloudScapes/shaders/motionBlur.comp.spv", motionBlurWorkgroupSize);
+	CreateComputePipeline(cloudComputePipelineLayout, horizonBandPipeline, "CloudScapes/shaders/cloudHorizonBand.comp.spv", horizonBandWorkgroupSize);
+}
 
 //----------------------------------------------
 //-------------- Frame Resources ---------------
@@ -610,6 +1251,16 @@ void Renderer::RecreateFrameResources()
 	RecordAllCommandBuffers();
 }
 
+void Renderer::DestroyCommandBuffers()
+{
+	vkFreeCommandBuffers(logicalDevice, graphicsCommandPool, static_cast<uint32_t>(graphicsCommandBuffer1.size()), graphicsCommandBuffer1.data());
+	vkFreeCommandBuffers(logicalDevice, graphicsCommandPool, static_cast<uint32_t>(graphicsCommandBuffer2.size()), graphicsCommandBuffer2.data());
+	vkFreeCommandBuffers(logicalDevice, computeCommandPool, 1, &computeCommandBuffer1);
+	vkFreeCommandBuffers(logicalDevice, computeCommandPool, 1, &computeCommandBuffer2);
+	vkFreeCommandBuffers(logicalDevice, computeCommandPool, 1, &skyViewLUTCommandBuffer);
+	vkFreeCommandBuffers(logicalDevice, graphicsCommandPool, 1, &sceneDepthCommandBuffer);
+}
+
 void Renderer::CreateFrameBuffers(VkRenderPass renderPass)
 {
 	frameBuffers.resize(swapChain->GetCount());
@@ -641,16 +1292,275 @@ void Renderer::CreateFrameBuffers(VkRenderPass renderPass)
 //----------------------------------------------
 void Renderer::RecordAllCommandBuffers()
 {
-	VkImage currFrameImage = currentCloudsResultTexture->GetTextureImage();
-	VkImage prevFrameImage = previousCloudsResultTexture->GetTextureImage();
+	// Every command buffer resets and writes its own timestamp queries: the two compute command buffers get query sets 0 and 1,
+	// the graphics command buffers (one per swapchain image, twice) the ones after that and the scene depth pre-pass the last one.
+	// The swapchain image count can change on a resize, and nothing is in flight here, so the profiler is simply recreated
+	const uint32_t swapChainImageCount = swapChain->GetCount();
+	std::vector<std::string> passNames(RendererPassCount);
+	passNames[SceneDepthPass] = "scene depth";
+	passNames[AerialPerspectivePass] = "aerial perspective";
+	passNames[HorizonBandPass] = "horizon band";
+	passNames[ReprojectionPass] = "reprojection";
+	passNames[RayMarchPass] = "ray march";
+	passNames[MotionBlurPass] = "motion blur";
+	passNames[CloudUpsamplePass] = "cloud upsample";
+	passNames[GodRaysPass] = "god rays";
+	passNames[AutoExposurePass] = "auto exposure";
+	passNames[PostProcessPass] = "post process";
+
+	delete gpuProfiler;
+	gpuProfiler = new GpuProfiler(device, physicalDevice, computeCommandPool, 3 + 2 * swapChainImageCount, passNames);
+
+	RecordSceneDepthCommandBuffer(2 + 2 * swapChainImageCount);
+
+	// Both compute command buffers record the same graph, with the descriptor sets of their ping pong variant
+	BuildComputeFrameGraph();
+
+	RecordComputeCommandBuffer(computeCommandBuffer1, 0, 0);
+	RecordGraphicsCommandBuffer(graphicsCommandBuffer1, pingPongCloudResultSet1, toneMapSet1, TXAASet1, 2);
+
+	RecordComputeCommandBuffer(computeCommandBuffer2, 1, 1);
+	RecordGraphicsCommandBuffer(graphicsCommandBuffer2, pingPongCloudResultSet2, toneMapSet2, TXAASet2, 2 + swapChainImageCount);
+
+	RecordSkyViewLUTCommandBuffer();
+}
+void Renderer::RecordSkyViewLUTCommandBuffer()
+{
+	VkCommandBufferAllocateInfo commandBufferAllocateInfo = {};
+	commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	commandBufferAllocateInfo.commandPool = computeCommandPool;
+	commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	commandBufferAllocateInfo.commandBufferCount = 1;
+
+	if (vkAllocateCommandBuffers(logicalDevice, &commandBufferAllocateInfo, &skyViewLUTCommandBuffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to allocate sky-view LUT command buffer");
+	}
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+	beginInfo.pInheritanceInfo = nullptr;
+
+	if (vkBeginCommandBuffer(skyViewLUTCommandBuffer, &beginInfo) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to begin recording sky-view LUT command buffer");
+	}
+
+	// Previous frames may still be sampling the LUT --> wait for them before overwriting it
+	VkMemoryBarrier lutReadBarrier = {};
+	lutReadBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	lutReadBarrier.srcAccessMask = 0;
+	lutReadBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+
+	vkCmdPipelineBarrier(skyViewLUTCommandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+						 0, 1, &lutReadBarrier, 0, nullptr, 0, nullptr);
+
+	// One thread per LUT texel
+	uint32_t numBlocksX = (sky->skyViewLUTTexture->GetWidth() + skyViewLUTWorkgroupSize.x - 1) / skyViewLUTWorkgroupSize.x;
+	uint32_t numBlocksY = (sky->skyViewLUTTexture->GetHeight() + skyViewLUTWorkgroupSize.y - 1) / skyViewLUTWorkgroupSize.y;
+	uint32_t numBlocksZ = 1;
+
+	vkCmdBindPipeline(skyViewLUTCommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, skyViewLUTPipeline);
+	vkCmdBindDescriptorSets(skyViewLUTCommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, skyViewLUTPipelineLayout, 0, 1, &skyViewLUTSet, 0, nullptr);
+	vkCmdBindDescriptorSets(skyViewLUTCommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, skyViewLUTPipelineLayout, 1, 1, &atmosphereSet, 0, nullptr);
+	vkCmdBindDescriptorSets(skyViewLUTCommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, skyViewLUTPipelineLayout, 2, 1, &sunAndSkySet, 0, nullptr);
+	vkCmdDispatch(skyViewLUTCommandBuffer, numBlocksX, numBlocksY, numBlocksZ);
+
+	// The ray march recorded in the frame's compute command buffer (submitted right after this one) samples the LUT
+	VkMemoryBarrier lutWriteBarrier = {};
+	lutWriteBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	lutWriteBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	lutWriteBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+	vkCmdPipelineBarrier(skyViewLUTCommandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+						 0, 1, &lutWriteBarrier, 0, nullptr, 0, nullptr);
+
+	if (vkEndCommandBuffer(skyViewLUTCommandBuffer) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to record sky-view LUT command buffer");
+	}
+}
+void Renderer::RecordSceneDepthCommandBuffer(uint32_t querySet)
+{
+	VkCommandBufferAllocateInfo commandBufferAllocateInfo = {};
+	commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	commandBufferAllocateInfo.commandPool = graphicsCommandPool;
+	commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	commandBufferAllocateInfo.commandBufferCount = 1;
+
+	if (vkAllocateCommandBuffers(logicalDevice, &commandBufferAllocateInfo, &sceneDepthCommandBuffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to allocate scene depth command buffer");
+	}
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+	beginInfo.pInheritanceInfo = nullptr;
+
+	if (vkBeginCommandBuffer(sceneDepthCommandBuffer, &beginInfo) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to begin recording scene depth command buffer");
+	}
+
+	gpuProfiler->RecordReset(sceneDepthCommandBuffer, querySet);
+	gpuProfiler->RecordBeginPass(sceneDepthCommandBuffer, querySet, SceneDepthPass);
+
+	// Cleared to the far plane: pixels without geometry read 1.0 and the clouds behind them are ray marched as usual
+	VkClearValue clearValue = {};
+	clearValue.depthStencil = { 1.0f, 0 };
+
+	VkRenderPassBeginInfo renderPassInfo = {};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassInfo.renderPass = sceneDepthRenderPass;
+	renderPassInfo.framebuffer = sceneDepthFrameBuffer;
+	renderPassInfo.renderArea.offset = { 0, 0 };
+	renderPassInfo.renderArea.extent = { cloud_width, cloud_height };
+	renderPassInfo.clearValueCount = 1;
+	renderPassInfo.pClearValues = &clearValue;
+
+	vkCmdBeginRenderPass(sceneDepthCommandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+	VkViewport cloudViewport = { 0.0f, 0.0f, static_cast<float>(cloud_width), static_cast<float>(cloud_height), 0.0f, 1.0f };
+	VkRect2D cloudScissor = { { 0, 0 }, { cloud_width, cloud_height } };
+	vkCmdSetViewport(sceneDepthCommandBuffer, 0, 1, &cloudViewport);
+	vkCmdSetScissor(sceneDepthCommandBuffer, 0, 1, &cloudScissor);
+
+	// Every model of the scene, each with the graphics set that holds its model matrix (see WriteToAndUpdateGraphicsDescriptorSets)
+	vkCmdBindPipeline(sceneDepthCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, sceneDepthPipeline);
+	vkCmdBindDescriptorSets(sceneDepthCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipelineLayout, 1, 1, &cameraSet, 0, nullptr);
+
+	const std::vector<Model*>& models = scene->GetModels();
+	for (size_t m = 0; m < models.size(); m++)
+	{
+		vkCmdBindDescriptorSets(sceneDepthCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipelineLayout, 0, 1, &graphicsSets[m], 0, nullptr);
+
+		VkDeviceSize geomOffsets[] = { 0 };
+		const VkBuffer geomVertices = models[m]->getVertexBuffer();
+		vkCmdBindVertexBuffers(sceneDepthCommandBuffer, 0, 1, &geomVertices, geomOffsets);
+		vkCmdBindIndexBuffer(sceneDepthCommandBuffer, models[m]->getIndexBuffer(), 0, VK_INDEX_TYPE_UINT32);
+		// getIndexBufferSize is in bytes
+		const uint32_t indexCount = models[m]->getIndexBufferSize() / sizeof(uint32_t);
+		vkCmdDrawIndexed(sceneDepthCommandBuffer, indexCount, 1, 0, 0, 0);
+	}
+
+	vkCmdEndRenderPass(sceneDepthCommandBuffer);
+
+	gpuProfiler->RecordEndPass(sceneDepthCommandBuffer, querySet, SceneDepthPass);
+
+	if (vkEndCommandBuffer(sceneDepthCommandBuffer) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to record scene depth command buffer");
+	}
+}
+// The compute work of a frame as a frame graph. Every pass is added and says what it reads and writes; the graph drops the
+// passes nothing uses (motion blur, upsampling, god rays and auto exposure when they are off) and puts the barriers only where
+// a pass depends on one that ran since the last barrier. The callbacks pick the descriptor sets of the ping pong variant
+void Renderer::BuildComputeFrameGraph()
+{
+	computeFrameGraph.Clear();
+
+	// Resources that keep their contents from frame to frame are carried over, so the graph orders
+	// their first access after the previous compute submission
+	const uint32_t aerialPerspective = computeFrameGraph.AddResource("aerial perspective", true);
+	const uint32_t horizonBand = computeFrameGraph.AddResource("horizon band", true);
+	// Cloud color, ray-start hints and light history of both ping pong images; the passes always use them together
+	const uint32_t cloudState = computeFrameGraph.AddResource("clouds", true);
+	const uint32_t occlusionMask = computeFrameGraph.AddResource("occlusion mask");
+	const uint32_t motionBlurred = computeFrameGraph.AddResource("motion blurred clouds");
+	const uint32_t upsampled = computeFrameGraph.AddResource("upsampled clouds");
+	const uint32_t godRays = computeFrameGraph.AddResource("god rays");
+	const uint32_t exposure = computeFrameGraph.AddResource("exposure", true);
+
+	// What the graphics passes read as the clouds of this frame
+	uint32_t postProcessInput = cloudState;
+	if (motionBlurEnabled) {
+		postProcessInput = motionBlurred;
+	}
+	if (cloudResolutionDivisor > 1) {
+		postProcessInput = upsampled;
+	}
+
+	// The graphics queue reads the post processing inputs: the fused kernel in its compute shader, the separate passes in their
+	// fragment shaders. If the compute work goes to a queue of the graphics family, the graph's first barrier waits for the
+	// previous frame's reads before the images are rewritten. A compute only family can't name the fragment stage; there the
+	// compute submission waits on the scene depth semaphore, which is signalled after the previous frame's graphics work (see Frame)
+	const QueueFamilyIndices& queueFamilyIndices = device->GetInstance()->GetQueueFamilyIndices();
+	VkPipelineStageFlags graphicsReadStages = 0;
+	if (queueFamilyIndices[QueueFlags::Compute] == queueFamilyIndices[QueueFlags::Graphics]) {
+		graphicsReadStages = fusedPostProcessEnabled ? VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT : VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	}
+
+	// The next frame reprojects the clouds, the graphics queue reads the rest
+	computeFrameGraph.MarkOutput(cloudState);
+	computeFrameGraph.MarkOutput(postProcessInput, graphicsReadStages);
+	if (godRaysEnabled) {
+		// The tone mapping samples godRaysTexture2, which the next frame's blur rewrites
+		computeFrameGraph.MarkOutput(godRays, graphicsReadStages);
+	}
+	if (autoExposureEnabled) {
+		// exposureAverage.comp reads, adapts and writes the exposure back while the previous frame's tone mapping may still read it
+		computeFrameGraph.MarkOutput(exposure, graphicsReadStages);
+	}
 
-	RecordComputeCommandBuffer(computeCommandBuffer1, pingPongCloudResultSet1);
-	RecordGraphicsCommandBuffer(graphicsCommandBuffer1, currFrameImage, pingPongCloudResultSet1, toneMapSet1, TXAASet1);
+	const VkPipelineStageFlags computeStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+
+	computeFrameGraph.AddPass("aerial perspective", AerialPerspectivePass, computeStage, {}, { aerialPerspective },
+		[this](VkCommandBuffer cmd, uint32_t /*variant*/) {
+			RecordAerialPerspectiveDispatch(cmd);
+		});
+
+	// This frame's slice of the horizon band; culled unless the ray march uses the band
+	computeFrameGraph.AddPass("horizon band", HorizonBandPass, computeStage, {}, { horizonBand },
+		[this](VkCommandBuffer cmd, uint32_t variant) {
+			vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, horizonBandPipeline);
+			RecordHorizonBandDispatch(cmd, variant == 0 ? pingPongCloudResultSet1 : pingPongCloudResultSet2, horizonBandWorkgroupSize);
+		});
+
+	// Carries the ray-start hints and the clouds of the pixels that aren't ray marched this frame over
+	computeFrameGraph.AddPass("reprojection", ReprojectionPass, computeStage, { cloudState }, { cloudState },
+		[this](VkCommandBuffer cmd, uint32_t variant) {
+			vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, reprojectionPipeline);
+			RecordReprojectionDispatch(cmd, variant == 0 ? pingPongCloudResultSet1 : pingPongCloudResultSet2, reprojectionWorkgroupSize);
+		});
+
+	std::vector<uint32_t> rayMarchReads = { aerialPerspective, cloudState };
+	if (sky->IsHorizonBandEnabled()) {
+		rayMarchReads.push_back(horizonBand);
+	}
+	computeFrameGraph.AddPass("ray march", RayMarchPass, computeStage, rayMarchReads, { cloudState, occlusionMask },
+		[this](VkCommandBuffer cmd, uint32_t variant) {
+			vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, cloudComputePipeline);
+			RecordCloudRayMarchDispatch(cmd, variant == 0 ? pingPongCloudResultSet1 : pingPongCloudResultSet2, cloudComputeWorkgroupSize);
+		});
+
+	computeFrameGraph.AddPass("motion blur", MotionBlurPass, computeStage, { cloudState }, { motionBlurred },
+		[this](VkCommandBuffer cmd, uint32_t variant) {
+			vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, motionBlurPipeline);
+			RecordMotionBlurDispatch(cmd, variant == 0 ? pingPongCloudResultSet1 : pingPongCloudResultSet2, motionBlurWorkgroupSize);
+		});
+
+	computeFrameGraph.AddPass("cloud upsample", CloudUpsamplePass, computeStage, { motionBlurEnabled ? motionBlurred : cloudState }, { upsampled },
+		[this](VkCommandBuffer cmd, uint32_t variant) {
+			vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, cloudUpsamplePipeline);
+			RecordCloudUpsampleDispatch(cmd, variant == 0 ? cloudUpsampleSet1 : cloudUpsampleSet2, cloudUpsampleWorkgroupSize);
+		});
+
+	// Only needs the occlusion mask, so it shares a barrier with the passes after the ray march
+	computeFrameGraph.AddPass("god rays", GodRaysPass, computeStage, { occlusionMask }, { godRays },
+		[this](VkCommandBuffer cmd, uint32_t /*variant*/) {
+			RecordGodRaysDispatches(cmd);
+		});
+
+	std::vector<uint32_t> autoExposureReads = { postProcessInput };
+	if (godRaysEnabled) {
+		autoExposureReads.push_back(godRays);
+	}
+	computeFrameGraph.AddPass("auto exposure", AutoExposurePass, computeStage, autoExposureReads, { exposure },
+		[this](VkCommandBuffer cmd, uint32_t variant) {
+			RecordAutoExposureDispatches(cmd, variant == 0 ? toneMapSet1 : toneMapSet2);
+		});
 
-	RecordComputeCommandBuffer(computeCommandBuffer2, pingPongCloudResultSet2);
-	RecordGraphicsCommandBuffer(graphicsCommandBuffer2, prevFrameImage, pingPongCloudResultSet2, toneMapSet2, TXAASet2);
+	computeFrameGraph.Compile();
 }
-void Renderer::RecordComputeCommandBuffer(VkCommandBuffer &computeCmdBuffer, VkDescriptorSet& pingPongFrameSet)
+void Renderer::RecordComputeCommandBuffer(VkCommandBuffer &computeCmdBuffer, uint32_t variant, uint32_t querySet)
 {
 	VkCommandBufferAllocateInfo commandBufferAllocateInfo = {};
 	commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -680,12 +1590,22 @@ void Renderer::RecordComputeCommandBuffer(VkCommandBuffer &computeCmdBuffer, VkD
 	//-----------------------------------------------------
 	//--- Compute Pipeline Binding, Dispatch & Barriers ---
 	//-----------------------------------------------------
-	uint32_t numBlocksX = (window_width + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE;
-	uint32_t numBlocksY = (window_height + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE;
-	uint32_t numBlocksZ = 1;
+	gpuProfiler->RecordReset(computeCmdBuffer, querySet);
+	computeFrameGraph.Record(computeCmdBuffer, variant, gpuProfiler, querySet);
 
-	//Bind the compute piepline
-	vkCmdBindPipeline(computeCmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, reprojectionPipeline);
+	//---------- End Recording ----------
+	if (vkEndCommandBuffer(computeCmdBuffer) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to record the compute command buffer");
+	}
+}
+// Binds the descriptor sets and records the dispatch; the pipeline itself is bound by the caller so that the 
+// workgroup size autotuner can record the same work with differently specialized pipelines
+void Renderer::RecordReprojectionDispatch(VkCommandBuffer &computeCmdBuffer, VkDescriptorSet& pingPongFrameSet, const WorkgroupSize& workgroupSize)
+{
+	// The reprojection pass touches every pixel of the cloud images
+	uint32_t numBlocksX = (cloud_width + workgroupSize.x - 1) / workgroupSize.x;
+	uint32_t numBlocksY = (cloud_height + workgroupSize.y - 1) / workgroupSize.y;
+	uint32_t numBlocksZ = 1;
 
 	//Bind Descriptor Sets for compute
 	vkCmdBindDescriptorSets(computeCmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, reprojectionPipelineLayout, 0, 1, &pingPongFrameSet, 0, nullptr);
@@ -696,6 +1616,13 @@ void Renderer::RecordComputeCommandBuffer(VkCommandBuffer &computeCmdBuffer, VkD
 	// Dispatch the compute kernel
 	// similar to a kernel call --> void vkCmdDispatch(commandBuffer, groupCountX, groupCountY, groupCountZ);	
 	vkCmdDispatch(computeCmdBuffer, numBlocksX, numBlocksY, numBlocksZ);
+}
+void Renderer::RecordCloudRayMarchDispatch(VkCommandBuffer &computeCmdBuffer, VkDescriptorSet& pingPongFrameSet, const WorkgroupSize& workgroupSize)
+{
+	// The ray march only updates 1 pixel in every 4x4 block each frame
+	uint32_t numBlocksX = ((cloud_width + 3) / 4 + workgroupSize.x - 1) / workgroupSize.x;
+	uint32_t numBlocksY = ((cloud_height + 3) / 4 + workgroupSize.y - 1) / workgroupSize.y;
+	uint32_t numBlocksZ = 1;
 
 	//Bind Descriptor Sets for compute
 	vkCmdBindDescriptorSets(computeCmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cloudComputePipelineLayout, 0, 1, &pingPongFrameSet, 0, nullptr);
@@ -704,24 +1631,195 @@ void Renderer::RecordComputeCommandBuffer(VkCommandBuffer &computeCmdBuffer, VkD
 	vkCmdBindDescriptorSets(computeCmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cloudComputePipelineLayout, 3, 1, &timeSet, 0, nullptr);
 	vkCmdBindDescriptorSets(computeCmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cloudComputePipelineLayout, 4, 1, &sunAndSkySet, 0, nullptr);
 	vkCmdBindDescriptorSets(computeCmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cloudComputePipelineLayout, 5, 1, &keyPressQuerySet, 0, nullptr);
-
-	//Bind the compute piepline
-	vkCmdBindPipeline(computeCmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cloudComputePipeline);
+	vkCmdBindDescriptorSets(computeCmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cloudComputePipelineLayout, 6, 1, &cloudQualitySet, 0, nullptr);
+	vkCmdBindDescriptorSets(computeCmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cloudComputePipelineLayout, 7, 1, &horizonBandSet, 0, nullptr);
 
 	// Dispatch the compute kernel
-	// similar to a kernel call --> void vkCmdDispatch(commandBuffer, groupCountX, groupCountY, groupCountZ);	
-	numBlocksX = (std::ceil(window_width / 4) + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE;
-	numBlocksY = (std::ceil(window_height / 4) + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE;
+	vkCmdDispatch(computeCmdBuffer, numBlocksX, numBlocksY, numBlocksZ);
+}
+void Renderer::RecordHorizonBandDispatch(VkCommandBuffer &computeCmdBuffer, VkDescriptorSet& pingPongFrameSet, const WorkgroupSize& workgroupSize)
+{
+	// One thread per texel of the slice of columns ray marched this frame
+	const HorizonBand& horizonBand = sky->GetHorizonBand();
+	uint32_t numBlocksX = (horizonBand.columnCount + workgroupSize.x - 1) / workgroupSize.x;
+	uint32_t numBlocksY = (sky->horizonBandTexture->GetHeight() + workgroupSize.y - 1) / workgroupSize.y;
+	uint32_t numBlocksZ = 1;
+
+	// Same pipeline layout (and sets) as the ray march, whose functions the pass reuses
+	vkCmdBindDescriptorSets(computeCmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cloudComputePipelineLayout, 0, 1, &pingPongFrameSet, 0, nullptr);
+	vkCmdBindDescriptorSets(computeCmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cloudComputePipelineLayout, 1, 1, &cloudComputeSet, 0, nullptr);
+	vkCmdBindDescriptorSets(computeCmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cloudComputePipelineLayout, 2, 1, &cameraSet, 0, nullptr);
+	vkCmdBindDescriptorSets(computeCmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cloudComputePipelineLayout, 3, 1, &timeSet, 0, nullptr);
+	vkCmdBindDescriptorSets(computeCmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cloudComputePipelineLayout, 4, 1, &sunAndSkySet, 0, nullptr);
+	vkCmdBindDescriptorSets(computeCmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cloudComputePipelineLayout, 5, 1, &keyPressQuerySet, 0, nullptr);
+	vkCmdBindDescriptorSets(computeCmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cloudComputePipelineLayout, 6, 1, &cloudQualitySet, 0, nullptr);
+	vkCmdBindDescriptorSets(computeCmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cloudComputePipelineLayout, 7, 1, &horizonBandSet, 0, nullptr);
 
 	vkCmdDispatch(computeCmdBuffer, numBlocksX, numBlocksY, numBlocksZ);
+}
+// The previous frame's ray march may still be sampling the volume; the frame graph orders this pass after it (the aerial
+// perspective is a carried over resource), so there is no barrier here
+void Renderer::RecordAerialPerspectiveDispatch(VkCommandBuffer &computeCmdBuffer)
+{
+	// One thread per column of froxels, each walks all the depth slices
+	uint32_t numBlocksX = (sky->aerialPerspectiveTexture->GetWidth() + aerialPerspectiveWorkgroupSize.x - 1) / aerialPerspectiveWorkgroupSize.x;
+	uint32_t numBlocksY = (sky->aerialPerspectiveTexture->GetHeight() + aerialPerspectiveWorkgroupSize.y - 1) / aerialPerspectiveWorkgroupSize.y;
+	uint32_t numBlocksZ = 1;
 
-	//---------- End Recording ----------
-	if (vkEndCommandBuffer(computeCmdBuffer) != VK_SUCCESS) {
-		throw std::runtime_error("Failed to record the compute command buffer");
+	vkCmdBindPipeline(computeCmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, aerialPerspectivePipeline);
+	vkCmdBindDescriptorSets(computeCmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, aerialPerspectivePipelineLayout, 0, 1, &aerialPerspectiveSet, 0, nullptr);
+	vkCmdBindDescriptorSets(computeCmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, aerialPerspectivePipelineLayout, 1, 1, &atmosphereSet, 0, nullptr);
+	vkCmdBindDescriptorSets(computeCmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, aerialPerspectivePipelineLayout, 2, 1, &sunAndSkySet, 0, nullptr);
+	vkCmdBindDescriptorSets(computeCmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, aerialPerspectivePipelineLayout, 3, 1, &cameraSet, 0, nullptr);
+	vkCmdDispatch(computeCmdBuffer, numBlocksX, numBlocksY, numBlocksZ);
+}
+void Renderer::BuildAtmosphereLUTs()
+{
+	// Transmittance and multiple scattering only depend on the atmosphere itself --> build them once and wait for them
+	VkCommandBuffer commandBuffer = beginSingleTimeCommands(device, computeCommandPool);
+
+	VkMemoryBarrier lutWriteBarrier = {};
+	lutWriteBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	lutWriteBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	lutWriteBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+	uint32_t numBlocksX = (sky->transmittanceLUTTexture->GetWidth() + atmosphereLUTWorkgroupSize.x - 1) / atmosphereLUTWorkgroupSize.x;
+	uint32_t numBlocksY = (sky->transmittanceLUTTexture->GetHeight() + atmosphereLUTWorkgroupSize.y - 1) / atmosphereLUTWorkgroupSize.y;
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, transmittanceLUTPipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, transmittanceLUTPipelineLayout, 0, 1, &transmittanceLUTSet, 0, nullptr);
+	vkCmdDispatch(commandBuffer, numBlocksX, numBlocksY, 1);
+
+	// The multiple scattering LUT samples the transmittance LUT
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+						 0, 1, &lutWriteBarrier, 0, nullptr, 0, nullptr);
+
+	numBlocksX = (sky->multipleScatteringLUTTexture->GetWidth() + atmosphereLUTWorkgroupSize.x - 1) / atmosphereLUTWorkgroupSize.x;
+	numBlocksY = (sky->multipleScatteringLUTTexture->GetHeight() + atmosphereLUTWorkgroupSize.y - 1) / atmosphereLUTWorkgroupSize.y;
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, multipleScatteringLUTPipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, multipleScatteringLUTPipelineLayout, 0, 1, &multipleScatteringLUTSet, 0, nullptr);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, multipleScatteringLUTPipelineLayout, 1, 1, &atmosphereSet, 0, nullptr);
+	vkCmdDispatch(commandBuffer, numBlocksX, numBlocksY, 1);
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+						 0, 1, &lutWriteBarrier, 0, nullptr, 0, nullptr);
+
+	endSingleTimeCommands(device, computeCommandPool, device->GetQueue(QueueFlags::Compute), commandBuffer);
+}
+void Renderer::RecordMotionBlurDispatch(VkCommandBuffer &computeCmdBuffer, VkDescriptorSet& pingPongFrameSet, const WorkgroupSize& workgroupSize)
+{
+	// One thread per cloud pixel
+	uint32_t numBlocksX = (cloud_width + workgroupSize.x - 1) / workgroupSize.x;
+	uint32_t numBlocksY = (cloud_height + workgroupSize.y - 1) / workgroupSize.y;
+	uint32_t numBlocksZ = 1;
+
+	vkCmdBindDescriptorSets(computeCmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, motionBlurPipelineLayout, 0, 1, &pingPongFrameSet, 0, nullptr);
+	vkCmdBindDescriptorSets(computeCmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, motionBlurPipelineLayout, 1, 1, &motionBlurSet, 0, nullptr);
+	vkCmdBindDescriptorSets(computeCmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, motionBlurPipelineLayout, 2, 1, &cameraSet, 0, nullptr);
+	vkCmdBindDescriptorSets(computeCmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, motionBlurPipelineLayout, 3, 1, &cameraOldSet, 0, nullptr);
+
+	vkCmdDispatch(computeCmdBuffer, numBlocksX, numBlocksY, numBlocksZ);
+}
+// Records the whole god rays chain: the downsampling pass into godRaysTexture1, then the blur passes ping ponging
+// between the two god rays textures. Every pass reads what the one before it wrote, hence the barriers in between
+void Renderer::RecordGodRaysDispatches(VkCommandBuffer &computeCmdBuffer)
+{
+	uint32_t numBlocksX = (godRays_width + godRaysWorkgroupSize.x - 1) / godRaysWorkgroupSize.x;
+	uint32_t numBlocksY = (godRays_height + godRaysWorkgroupSize.y - 1) / godRaysWorkgroupSize.y;
+	uint32_t numBlocksZ = 1;
+
+	// Sets 1 to 3 are the same for every pass
+	vkCmdBindDescriptorSets(computeCmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, godRaysPipelineLayout, 1, 1, &cameraSet, 0, nullptr);
+	vkCmdBindDescriptorSets(computeCmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, godRaysPipelineLayout, 2, 1, &sunAndSkySet, 0, nullptr);
+	vkCmdBindDescriptorSets(computeCmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, godRaysPipelineLayout, 3, 1, &cloudQualitySet, 0, nullptr);
+
+	vkCmdBindDescriptorSets(computeCmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, godRaysPipelineLayout, 0, 1, &godRaysDownsampleSet, 0, nullptr);
+	vkCmdBindPipeline(computeCmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, godRaysDownsamplePipeline);
+	vkCmdDispatch(computeCmdBuffer, numBlocksX, numBlocksY, numBlocksZ);
+
+	VkMemoryBarrier passBarrier = {};
+	passBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	passBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	passBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+	for (uint32_t pass = 0; pass < GOD_RAYS_BLUR_PASSES; pass++)
+	{
+		vkCmdPipelineBarrier(computeCmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+							 0, 1, &passBarrier, 0, nullptr, 0, nullptr);
+
+		// Even passes read godRaysTexture1 and write godRaysTexture2, odd passes the other way around
+		VkDescriptorSet& blurSet = (pass % 2 == 0) ? godRaysBlurSet1 : godRaysBlurSet2;
+		vkCmdBindDescriptorSets(computeCmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, godRaysPipelineLayout, 0, 1, &blurSet, 0, nullptr);
+		vkCmdBindPipeline(computeCmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, godRaysBlurPipelines[pass]);
+		vkCmdDispatch(computeCmdBuffer, numBlocksX, numBlocksY, numBlocksZ);
 	}
 }
-void Renderer::RecordGraphicsCommandBuffer(std::vector<VkCommandBuffer> &graphicsCmdBuffer, VkImage &Image_for_barrier, 
-											VkDescriptorSet& pingPongCloudResultSet, VkDescriptorSet& toneMapSet, VkDescriptorSet& TXAASet)
+// Records both auto exposure passes: the luminance histogram over the render resolution clouds, then the single workgroup
+// that turns it into the exposure (and clears it). The tone map set holds everything they read and the exposure buffer
+void Renderer::RecordAutoExposureDispatches(VkCommandBuffer &computeCmdBuffer, VkDescriptorSet& toneMapSet)
+{
+	// Every invocation counts a block of pixels
+	const uint32_t pixelsPerWorkgroup = LUMINANCE_HISTOGRAM_WORKGROUP_SIZE * LUMINANCE_HISTOGRAM_PIXELS_PER_INVOCATION;
+	uint32_t numBlocksX = (render_width + pixelsPerWorkgroup - 1) / pixelsPerWorkgroup;
+	uint32_t numBlocksY = (render_height + pixelsPerWorkgroup - 1) / pixelsPerWorkgroup;
+	uint32_t numBlocksZ = 1;
+
+	vkCmdBindDescriptorSets(computeCmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, autoExposurePipelineLayout, 0, 1, &toneMapSet, 0, nullptr);
+	vkCmdBindPipeline(computeCmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, luminanceHistogramPipeline);
+	vkCmdDispatch(computeCmdBuffer, numBlocksX, numBlocksY, numBlocksZ);
+
+	VkMemoryBarrier histogramBarrier = {};
+	histogramBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	histogramBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	histogramBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+	vkCmdPipelineBarrier(computeCmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+						 0, 1, &histogramBarrier, 0, nullptr, 0, nullptr);
+
+	vkCmdBindPipeline(computeCmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, exposureAveragePipeline);
+	vkCmdDispatch(computeCmdBuffer, 1, 1, 1);
+}
+void Renderer::RecordCloudUpsampleDispatch(VkCommandBuffer &computeCmdBuffer, VkDescriptorSet& cloudUpsampleSet, const WorkgroupSize& workgroupSize)
+{
+	// One thread per pixel at the render resolution
+	uint32_t numBlocksX = (render_width + workgroupSize.x - 1) / workgroupSize.x;
+	uint32_t numBlocksY = (render_height + workgroupSize.y - 1) / workgroupSize.y;
+	uint32_t numBlocksZ = 1;
+
+	vkCmdBindDescriptorSets(computeCmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cloudUpsamplePipelineLayout, 0, 1, &cloudUpsampleSet, 0, nullptr);
+	vkCmdBindDescriptorSets(computeCmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cloudUpsamplePipelineLayout, 1, 1, &cameraSet, 0, nullptr);
+
+	vkCmdDispatch(computeCmdBuffer, numBlocksX, numBlocksY, numBlocksZ);
+}
+// Tone mapping, god rays composite and TXAA in one dispatch over the window (postProcess_Fused.comp), recorded into a graphics
+// command buffer ahead of the render pass. The present draw of the render pass reads the history it writes
+void Renderer::RecordFusedPostProcessDispatch(VkCommandBuffer &graphicsCmdBuffer, VkDescriptorSet& toneMapSet, VkDescriptorSet& TXAASet)
+{
+	// One thread per window pixel
+	uint32_t numBlocksX = (window_width + FUSED_POST_PROCESS_TILE_SIZE - 1) / FUSED_POST_PROCESS_TILE_SIZE;
+	uint32_t numBlocksY = (window_height + FUSED_POST_PROCESS_TILE_SIZE - 1) / FUSED_POST_PROCESS_TILE_SIZE;
+	uint32_t numBlocksZ = 1;
+
+	vkCmdBindDescriptorSets(graphicsCmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, postProcess_Fused_PipelineLayout, 0, 1, &toneMapSet, 0, nullptr);
+	vkCmdBindDescriptorSets(graphicsCmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, postProcess_Fused_PipelineLayout, 1, 1, &TXAASet, 0, nullptr);
+	vkCmdBindDescriptorSets(graphicsCmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, postProcess_Fused_PipelineLayout, 2, 1, &cameraSet, 0, nullptr);
+	vkCmdBindDescriptorSets(graphicsCmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, postProcess_Fused_PipelineLayout, 3, 1, &cameraOldSet, 0, nullptr);
+	vkCmdBindDescriptorSets(graphicsCmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, postProcess_Fused_PipelineLayout, 4, 1, &timeSet, 0, nullptr);
+	vkCmdBindPipeline(graphicsCmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, postProcess_Fused_PipeLine);
+	vkCmdDispatch(graphicsCmdBuffer, numBlocksX, numBlocksY, numBlocksZ);
+
+	// The present draw reads the history in its fragment shader
+	VkMemoryBarrier historyBarrier = {};
+	historyBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	historyBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	historyBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+	vkCmdPipelineBarrier(graphicsCmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+						 0, 1, &historyBarrier, 0, nullptr, 0, nullptr);
+}
+void Renderer::RecordGraphicsCommandBuffer(std::vector<VkCommandBuffer> &graphicsCmdBuffer, VkDescriptorSet& pingPongCloudResultSet, 
+											VkDescriptorSet& toneMapSet, VkDescriptorSet& TXAASet, uint32_t firstQuerySet)
 {
 	graphicsCmdBuffer.resize(swapChain->GetCount());
 
@@ -776,22 +1874,23 @@ void Renderer::RecordGraphicsCommandBuffer(std::vector<VkCommandBuffer> &graphic
 		//---------------------------------------------------------
 		//--- Graphics and Clouds Pipeline Binding and Dispatch ---
 		//---------------------------------------------------------
-		// Define a memory barrier to transition the vertex buffer from a compute storage object to a vertex input
-		// Each element of the pMemoryBarriers, pBufferMemoryBarriers and pImageMemoryBarriers arrays specifies two halves of a memory dependency, as defined above.
+		// The clouds, the god rays and the exposure buffer the compute passes wrote are made visible to the post processing by 
+		// a global memory barrier the frame graph records (an image barrier couldn't cover the exposure buffer). The submissions 
+		// themselves are ordered by the semaphore the graphics submission waits on (see Frame).
 		// Reference: https://vulkan.lunarg.com/doc/view/1.0.30.0/linux/vkspec.chunked/ch06s05.html#synchronization-memory-barriers
-		VkImageMemoryBarrier imageMemoryBarrier = {};
-		imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-		imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
-		imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
-		imageMemoryBarrier.image = Image_for_barrier;
-		imageMemoryBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
-		imageMemoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
-		imageMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-		// A pipeline barrier inserts an execution dependency and a set of memory dependencies between a set of commands earlier in the command buffer and a set of commands later in the command buffer.
-		// Reference: https://vulkan.lunarg.com/doc/view/1.0.30.0/linux/vkspec.chunked/ch06s05.html
-		vkCmdPipelineBarrier(graphicsCmdBuffer[i], VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-			0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+		// The fused post processing reads them in its compute kernel, the separate passes in their fragment shaders
+		const VkPipelineStageFlags cloudReadStage = fusedPostProcessEnabled ? VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT : VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		computeFrameGraph.RecordOutputBarrier(graphicsCmdBuffer[i], cloudReadStage);
+
+		// Query resets aren't allowed inside a render pass
+		gpuProfiler->RecordReset(graphicsCmdBuffer[i], firstQuerySet + i);
+		gpuProfiler->RecordBeginPass(graphicsCmdBuffer[i], firstQuerySet + i, PostProcessPass);
+
+		// Dispatches aren't allowed inside a render pass either: the fused kernel writes the TXAA history before it begins
+		if (fusedPostProcessEnabled)
+		{
+			RecordFusedPostProcessDispatch(graphicsCmdBuffer[i], toneMapSet, TXAASet);
+		}
 
 		vkCmdBeginRenderPass(graphicsCmdBuffer[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
 		// VK_SUBPASS_CONTENTS_INLINE: The render pass commands will be embedded in the primary command
@@ -807,7 +1906,7 @@ void Renderer::RecordGraphicsCommandBuffer(std::vector<VkCommandBuffer> &graphic
 		vkCmdBindPipeline(graphicsCommandBuffer[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
 
 		// Bind graphics descriptor set
-		vkCmdBindDescriptorSets(graphicsCommandBuffer[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipelineLayout, 0, 1, &graphicsSet, 0, nullptr);
+		vkCmdBindDescriptorSets(graphicsCommandBuffer[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipelineLayout, 0, 1, &graphicsSets[0], 0, nullptr);
 		vkCmdBindDescriptorSets(graphicsCommandBuffer[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipelineLayout, 1, 1, &cameraSet, 0, nullptr);
 
 		// Bind the vertex and index buffers
@@ -823,31 +1922,42 @@ void Renderer::RecordGraphicsCommandBuffer(std::vector<VkCommandBuffer> &graphic
 		//-----------------------------
 		//--- PostProcess Pipelines ---
 		//-----------------------------
-		//// God Rays Pipeline
-		//vkCmdBindDescriptorSets(graphicsCmdBuffer[i], VK_PIPELINE_BIND_POINT_GRAPHICS, postProcess_GodRays_PipelineLayout, 0, 1, &pingPongCloudResultSet, 0, NULL);
-		//vkCmdBindDescriptorSets(graphicsCmdBuffer[i], VK_PIPELINE_BIND_POINT_GRAPHICS, postProcess_GodRays_PipelineLayout, 1, 1, &godRaysSet, 0, NULL);
-		//vkCmdBindDescriptorSets(graphicsCmdBuffer[i], VK_PIPELINE_BIND_POINT_GRAPHICS, postProcess_GodRays_PipelineLayout, 2, 1, &cameraSet, 0, NULL);
-		//vkCmdBindDescriptorSets(graphicsCmdBuffer[i], VK_PIPELINE_BIND_POINT_GRAPHICS, postProcess_GodRays_PipelineLayout, 3, 1, &sunAndSkySet, 0, NULL);
-		//vkCmdBindPipeline(graphicsCmdBuffer[i], VK_PIPELINE_BIND_POINT_GRAPHICS, postProcess_GodRays_PipeLine);
-		//vkCmdDraw(graphicsCmdBuffer[i], 3, 1, 0, 0);
-
-		// Tone Map Pass Pipeline
-		vkCmdBindDescriptorSets(graphicsCmdBuffer[i], VK_PIPELINE_BIND_POINT_GRAPHICS, postProcess_ToneMap_PipelineLayout, 0, 1, &toneMapSet, 0, NULL);
-		vkCmdBindDescriptorSets(graphicsCmdBuffer[i], VK_PIPELINE_BIND_POINT_GRAPHICS, postProcess_ToneMap_PipelineLayout, 1, 1, &timeSet, 0, NULL);
-		vkCmdBindPipeline(graphicsCmdBuffer[i], VK_PIPELINE_BIND_POINT_GRAPHICS, postProcess_ToneMap_PipeLine);
-		vkCmdDraw(graphicsCmdBuffer[i], 3, 1, 0, 0);
-
-		// Temporal Anti-Aliasing Pass Pipeline
-		vkCmdBindDescriptorSets(graphicsCmdBuffer[i], VK_PIPELINE_BIND_POINT_GRAPHICS, postProcess_TXAA_PipelineLayout, 0, 1, &TXAASet, 0, NULL);
-		vkCmdBindDescriptorSets(graphicsCmdBuffer[i], VK_PIPELINE_BIND_POINT_GRAPHICS, postProcess_TXAA_PipelineLayout, 1, 1, &cameraSet, 0, NULL);
-		vkCmdBindDescriptorSets(graphicsCmdBuffer[i], VK_PIPELINE_BIND_POINT_GRAPHICS, postProcess_TXAA_PipelineLayout, 2, 1, &cameraOldSet, 0, NULL);
-		vkCmdBindDescriptorSets(graphicsCmdBuffer[i], VK_PIPELINE_BIND_POINT_GRAPHICS, postProcess_TXAA_PipelineLayout, 3, 1, &timeSet, 0, NULL);
-		vkCmdBindPipeline(graphicsCmdBuffer[i], VK_PIPELINE_BIND_POINT_GRAPHICS, postProcess_TXAA_PipeLine);
-		vkCmdDraw(graphicsCmdBuffer[i], 3, 1, 0, 0);
+		if (fusedPostProcessEnabled)
+		{
+			// The history the fused kernel wrote is this frame's image
+			vkCmdBindDescriptorSets(graphicsCmdBuffer[i], VK_PIPELINE_BIND_POINT_GRAPHICS, postProcess_Present_PipelineLayout, 0, 1, &TXAASet, 0, NULL);
+			vkCmdBindPipeline(graphicsCmdBuffer[i], VK_PIPELINE_BIND_POINT_GRAPHICS, postProcess_Present_PipeLine);
+			vkCmdDraw(graphicsCmdBuffer[i], 3, 1, 0, 0);
+		}
+		else
+		{
+			// Everything up to the TXAA pass works at the render resolution, in the top left corner of the framebuffer.
+			// Those passes only write to storage images, the TXAA pass upscales to and draws the whole window
+			VkViewport renderScaleViewport = { 0.0f, 0.0f, static_cast<float>(render_width), static_cast<float>(render_height), 0.0f, 1.0f };
+			VkRect2D renderScaleScissor = { { 0, 0 }, { render_width, render_height } };
+			vkCmdSetViewport(graphicsCmdBuffer[i], 0, 1, &renderScaleViewport);
+			vkCmdSetScissor(graphicsCmdBuffer[i], 0, 1, &renderScaleScissor);
+
+			// Tone Map Pass Pipeline, also adds the god rays the compute passes made
+			vkCmdBindDescriptorSets(graphicsCmdBuffer[i], VK_PIPELINE_BIND_POINT_GRAPHICS, postProcess_ToneMap_PipelineLayout, 0, 1, &toneMapSet, 0, NULL);
+			vkCmdBindDescriptorSets(graphicsCmdBuffer[i], VK_PIPELINE_BIND_POINT_GRAPHICS, postProcess_ToneMap_PipelineLayout, 1, 1, &timeSet, 0, NULL);
+			vkCmdBindPipeline(graphicsCmdBuffer[i], VK_PIPELINE_BIND_POINT_GRAPHICS, postProcess_ToneMap_PipeLine);
+			vkCmdDraw(graphicsCmdBuffer[i], 3, 1, 0, 0);
+
+			// Temporal Anti-Aliasing Pass Pipeline
+			vkCmdBindDescriptorSets(graphicsCmdBuffer[i], VK_PIPELINE_BIND_POINT_GRAPHICS, postProcess_TXAA_PipelineLayout, 0, 1, &TXAASet, 0, NULL);
+			vkCmdBindDescriptorSets(graphicsCmdBuffer[i], VK_PIPELINE_BIND_POINT_GRAPHICS, postProcess_TXAA_PipelineLayout, 1, 1, &cameraSet, 0, NULL);
+			vkCmdBindDescriptorSets(graphicsCmdBuffer[i], VK_PIPELINE_BIND_POINT_GRAPHICS, postProcess_TXAA_PipelineLayout, 2, 1, &cameraOldSet, 0, NULL);
+			vkCmdBindDescriptorSets(graphicsCmdBuffer[i], VK_PIPELINE_BIND_POINT_GRAPHICS, postProcess_TXAA_PipelineLayout, 3, 1, &timeSet, 0, NULL);
+			vkCmdBindPipeline(graphicsCmdBuffer[i], VK_PIPELINE_BIND_POINT_GRAPHICS, postProcess_TXAA_PipeLine);
+			vkCmdDraw(graphicsCmdBuffer[i], 3, 1, 0, 0);
+		}
 
 		//---------- End RenderPass ---------
 		vkCmdEndRenderPass(graphicsCmdBuffer[i]);
 
+		gpuProfiler->RecordEndPass(graphicsCmdBuffer[i], firstQuerySet + i, PostProcessPass);
+
 		//---------- End Recording ----------
 		if (vkEndCommandBuffer(graphicsCmdBuffer[i]) != VK_SUCCESS) {
 			throw std::runtime_error("Failed to record the graphics command buffer");
@@ -869,8 +1979,33 @@ void Renderer::CreateDescriptorPool()
 		// ------------ Curr and Prev Cloud Results -----------------
 		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 }, // Current Cloud Result
 		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 }, // Previous Cloud Result
+		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 }, // Current Cloud Distance
+		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 }, // Previous Cloud Distance
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 }, // Previous Cloud Result (sampled for the reprojection)
+		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 }, // Current Light History
+		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 }, // Previous Light History
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 }, // Scene Depth
 		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 }, // Current Cloud Result
 		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 }, // Previous Cloud Result
+		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 }, // Current Cloud Distance
+		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 }, // Previous Cloud Distance
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 }, // Previous Cloud Result (sampled for the reprojection)
+		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 }, // Current Light History
+		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 }, // Previous Light History
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 }, // Scene Depth
+		// ------------ Cloud Upsampling (2 sets --> curr and prev pingponged cloud results) -----------------
+		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 }, // Reduced resolution Cloud Result
+		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 }, // Upsampled Cloud Result
+		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 }, // Reduced resolution Cloud Result
+		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 }, // Upsampled Cloud Result
+		// ------------ Motion Blur -----------------
+		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 }, // Motion blurred Cloud Result
+		// ------------ Horizon Band -----------------
+		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 }, // Horizon Band
+		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 }, // Horizon Band Distance
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 }, // Horizon Band
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 }, // Horizon Band Distance
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1 }, // HorizonBand
 		// ------------ Compute ------------------------------
 		// Samplers for all the cloud Textures
 		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 }, // low frequency texture
@@ -878,10 +2013,20 @@ void Renderer::CreateDescriptorPool()
 		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 }, // curl noise texture
 		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 }, // Weather Map
 		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 }, //God Rays Mask
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 }, // Sky-View LUT
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 }, // Transmittance LUT
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 }, // Aerial Perspective
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 }, // Blue Noise
+		// ------------ Atmosphere LUT passes ----------------
+		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 }, // Transmittance LUT
+		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 }, // Multiple Scattering LUT
+		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 }, // Sky-View LUT
+		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 }, // Aerial Perspective
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 }, // Transmittance LUT
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 }, // Multiple Scattering LUT
 
 		// ------------ Graphics -----------------------------
-		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1 }, //model matrix
-		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 }, //texture sampler for model
+		// One set per model in modelDescriptorPool, see CreateAllDescriptorSets
 
 		// -------- Can be attached to multiple pipelines ------
 		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1 }, // Camera
@@ -889,23 +2034,34 @@ void Renderer::CreateDescriptorPool()
 		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1 }, // Time
 		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1 }, // SunAndSky
 		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1 }, // KeyPress
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1 }, // CloudQuality
 
 		// ------------ PostProcess pipelines -----------------
-		// GodRays -- GreyScale Image of where light is in the sky
-		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 },
-		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 },
+		// GodRays (3 sets --> downsampling and both blur directions, each samples one image and writes another)
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 }, // Occlusion mask
+		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 }, // God rays 1
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 }, // God rays 1
+		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 }, // God rays 2
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 }, // God rays 2
+		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 }, // God rays 1
 		
-		// Tone Map Pass (2 sets --> curr and prev pingponged cloud results)
+		// Tone Map Pass (2 sets --> curr and prev pingponged cloud results, each also samples the god rays and reads the exposure)
 		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 },
 		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 },
 		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1 }, // Exposure
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 },
 		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 },
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1 }, // Exposure
 
-		// Anti Aliasing  (2 sets --> curr and prev pingponged frames)
+		// Anti Aliasing  (2 sets --> curr and prev pingponged frames, each also samples the tone mapped frame)
 		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 },
 		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 },
 		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 },
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 },
 		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 },
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 },
 	};
 	
 	VulkanInitializers::CreateDescriptorPool(logicalDevice, static_cast<uint32_t>(poolSizes.size()), poolSizes.data(), descriptorPool);
@@ -923,8 +2079,40 @@ void Renderer::CreateAllDescriptorSetLayouts()
 	// Ping Pong Set 1
 	VkDescriptorSetLayoutBinding currentCloudResultLayoutBinding = { 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_ALL, nullptr };
 	VkDescriptorSetLayoutBinding previousCloudResultLayoutBinding = { 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_ALL, nullptr };
-	std::array<VkDescriptorSetLayoutBinding, 2> pingPongFrameBindings = { currentCloudResultLayoutBinding, previousCloudResultLayoutBinding };
+	VkDescriptorSetLayoutBinding currentCloudDistanceLayoutBinding = { 2, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr };
+	VkDescriptorSetLayoutBinding previousCloudDistanceLayoutBinding = { 3, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr };
+	VkDescriptorSetLayoutBinding previousCloudResultSamplerLayoutBinding = { 4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr };
+	VkDescriptorSetLayoutBinding currentLightHistoryLayoutBinding = { 5, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr };
+	VkDescriptorSetLayoutBinding previousLightHistoryLayoutBinding = { 6, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr };
+	VkDescriptorSetLayoutBinding sceneDepthLayoutBinding = { 7, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr };
+	std::array<VkDescriptorSetLayoutBinding, 8> pingPongFrameBindings = { currentCloudResultLayoutBinding, previousCloudResultLayoutBinding,
+																		currentCloudDistanceLayoutBinding, previousCloudDistanceLayoutBinding,
+																		previousCloudResultSamplerLayoutBinding,
+																		currentLightHistoryLayoutBinding, previousLightHistoryLayoutBinding,
+																		sceneDepthLayoutBinding };
 	VulkanInitializers::CreateDescriptorSetLayout(logicalDevice, static_cast<uint32_t>(pingPongFrameBindings.size()), pingPongFrameBindings.data(), pingPongCloudResultSetLayout);
+
+	// Cloud Upsampling
+	VkDescriptorSetLayoutBinding cloudLowResLayoutBinding = { 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr };
+	VkDescriptorSetLayoutBinding cloudUpsampledLayoutBinding = { 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr };
+	std::array<VkDescriptorSetLayoutBinding, 2> cloudUpsampleBindings = { cloudLowResLayoutBinding, cloudUpsampledLayoutBinding };
+	VulkanInitializers::CreateDescriptorSetLayout(logicalDevice, static_cast<uint32_t>(cloudUpsampleBindings.size()), cloudUpsampleBindings.data(), cloudUpsampleSetLayout);
+
+	// Motion Blur
+	VkDescriptorSetLayoutBinding motionBlurredLayoutBinding = { 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr };
+	VulkanInitializers::CreateDescriptorSetLayout(logicalDevice, 1, &motionBlurredLayoutBinding, motionBlurSetLayout);
+
+	// Horizon Band
+	// The ray march layout already uses 7 sets, and 8 is all some GPUs allow --> the band's uniform buffer shares its set
+	VkDescriptorSetLayoutBinding horizonBandImageLayoutBinding = { 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr };
+	VkDescriptorSetLayoutBinding horizonBandDistanceImageLayoutBinding = { 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr };
+	VkDescriptorSetLayoutBinding horizonBandSamplerLayoutBinding = { 2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr };
+	VkDescriptorSetLayoutBinding horizonBandDistanceSamplerLayoutBinding = { 3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr };
+	VkDescriptorSetLayoutBinding horizonBandUniformLayoutBinding = { 4, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr };
+	std::array<VkDescriptorSetLayoutBinding, 5> horizonBandBindings = { horizonBandImageLayoutBinding, horizonBandDistanceImageLayoutBinding,
+																	   horizonBandSamplerLayoutBinding, horizonBandDistanceSamplerLayoutBinding,
+																	   horizonBandUniformLayoutBinding };
+	VulkanInitializers::CreateDescriptorSetLayout(logicalDevice, static_cast<uint32_t>(horizonBandBindings.size()), horizonBandBindings.data(), horizonBandSetLayout);
 	
 	//-------------------- Computes Pipeline --------------------
 	VkDescriptorSetLayoutBinding cloudLowFrequencyNoiseSetLayoutBinding = { 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr };
@@ -932,11 +2120,28 @@ void Renderer::CreateAllDescriptorSetLayouts()
 	VkDescriptorSetLayoutBinding cloudCurlNoiseSetLayoutBinding = { 2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr };
 	VkDescriptorSetLayoutBinding weatherMapSetLayoutBinding = { 3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr };
 	VkDescriptorSetLayoutBinding godRaysCreationDataSetLayoutBinding = { 4, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr };
-
-	std::array<VkDescriptorSetLayoutBinding, 5> cloudRayMarchBindings = { cloudLowFrequencyNoiseSetLayoutBinding, cloudHighFrequencyNoiseSetLayoutBinding,
-																cloudCurlNoiseSetLayoutBinding, weatherMapSetLayoutBinding, godRaysCreationDataSetLayoutBinding };
+	VkDescriptorSetLayoutBinding skyViewLUTSamplerSetLayoutBinding = { 5, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr };
+	VkDescriptorSetLayoutBinding transmittanceLUTSamplerSetLayoutBinding = { 6, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr };
+	VkDescriptorSetLayoutBinding aerialPerspectiveSamplerSetLayoutBinding = { 7, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr };
+	VkDescriptorSetLayoutBinding blueNoiseSamplerSetLayoutBinding = { 8, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr };
+
+	std::array<VkDescriptorSetLayoutBinding, 9> cloudRayMarchBindings = { cloudLowFrequencyNoiseSetLayoutBinding, cloudHighFrequencyNoiseSetLayoutBinding,
+																cloudCurlNoiseSetLayoutBinding, weatherMapSetLayoutBinding, godRaysCreationDataSetLayoutBinding,
+																skyViewLUTSamplerSetLayoutBinding, transmittanceLUTSamplerSetLayoutBinding,
+																aerialPerspectiveSamplerSetLayoutBinding, blueNoiseSamplerSetLayoutBinding };
 	VulkanInitializers::CreateDescriptorSetLayout(logicalDevice, static_cast<uint32_t>(cloudRayMarchBindings.size()), cloudRayMarchBindings.data(), cloudComputeSetLayout);
 
+	//-------------------- Atmosphere LUT Pipelines --------------------
+	// Every LUT pass writes a single image (2D or 3D)
+	VkDescriptorSetLayoutBinding lutOutputImageSetLayoutBinding = { 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr };
+	VulkanInitializers::CreateDescriptorSetLayout(logicalDevice, 1, &lutOutputImageSetLayoutBinding, lutOutputSetLayout);
+
+	VkDescriptorSetLayoutBinding transmittanceLUTSetLayoutBinding = { 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr };
+	VkDescriptorSetLayoutBinding multipleScatteringLUTSetLayoutBinding = { 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr };
+
+	std::array<VkDescriptorSetLayoutBinding, 2> atmosphereBindings = { transmittanceLUTSetLayoutBinding, multipleScatteringLUTSetLayoutBinding };
+	VulkanInitializers::CreateDescriptorSetLayout(logicalDevice, static_cast<uint32_t>(atmosphereBindings.size()), atmosphereBindings.data(), atmosphereSetLayout);
+
 	//-------------------- Graphics Pipeline --------------------
 	VkDescriptorSetLayoutBinding modelSetLayoutBinding = { 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT, nullptr };
 	VkDescriptorSetLayoutBinding samplerSetLayoutBinding = { 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr };
@@ -969,43 +2174,66 @@ void Renderer::CreateAllDescriptorSetLayouts()
 	std::array<VkDescriptorSetLayoutBinding, 1> keyPressQueryBindings = { keyPressQuerySetLayoutBinding };
 	VulkanInitializers::CreateDescriptorSetLayout(logicalDevice, static_cast<uint32_t>(keyPressQueryBindings.size()), keyPressQueryBindings.data(), keyPressQuerySetLayout);
 
+	//CloudQuality
+	VkDescriptorSetLayoutBinding cloudQualitySetLayoutBinding = { 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_ALL, nullptr };
+
+	std::array<VkDescriptorSetLayoutBinding, 1> cloudQualityBindings = { cloudQualitySetLayoutBinding };
+	VulkanInitializers::CreateDescriptorSetLayout(logicalDevice, static_cast<uint32_t>(cloudQualityBindings.size()), cloudQualityBindings.data(), cloudQualitySetLayout);
+
 	//-------------------- Post Process --------------------
-	//God Rays
-	VkDescriptorSetLayoutBinding godRaysSetLayoutBinding = { 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr };
+	//God Rays, compute passes
+	VkDescriptorSetLayoutBinding godRaysInputSetLayoutBinding = { 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr };
+	VkDescriptorSetLayoutBinding godRaysOutputSetLayoutBinding = { 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr };
 
-	std::array<VkDescriptorSetLayoutBinding, 1> godRaysBindings = { godRaysSetLayoutBinding };
+	std::array<VkDescriptorSetLayoutBinding, 2> godRaysBindings = { godRaysInputSetLayoutBinding, godRaysOutputSetLayoutBinding };
 	VulkanInitializers::CreateDescriptorSetLayout(logicalDevice, static_cast<uint32_t>(godRaysBindings.size()), godRaysBindings.data(), godRaysSetLayout);
 
-	//Tone Map Pass
-	VkDescriptorSetLayoutBinding toneMapInputImageSetLayoutBinding = { 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr };
+	//Tone Map Pass, also bound by the fused post process kernel (as is the TXAA set) and the auto exposure passes
+	VkDescriptorSetLayoutBinding toneMapInputImageSetLayoutBinding = { 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT, nullptr };
 	VkDescriptorSetLayoutBinding toneMapWriteImageSetLayoutBinding = { 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr };
+	VkDescriptorSetLayoutBinding toneMapGodRaysSetLayoutBinding = { 2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT, nullptr };
+	VkDescriptorSetLayoutBinding toneMapExposureSetLayoutBinding = { 3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT, nullptr };
 
-	std::array<VkDescriptorSetLayoutBinding, 2> toneMapBindings = { toneMapInputImageSetLayoutBinding, toneMapWriteImageSetLayoutBinding };
+	std::array<VkDescriptorSetLayoutBinding, 4> toneMapBindings = { toneMapInputImageSetLayoutBinding, toneMapWriteImageSetLayoutBinding,
+																	toneMapGodRaysSetLayoutBinding, toneMapExposureSetLayoutBinding };
 	VulkanInitializers::CreateDescriptorSetLayout(logicalDevice, static_cast<uint32_t>(toneMapBindings.size()), toneMapBindings.data(), toneMapSetLayout);
 
 	//TXAA Pass
-	VkDescriptorSetLayoutBinding TXAAPrevFrameSetLayoutBinding = { 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr };
-	VkDescriptorSetLayoutBinding TXAACurrentFrameSetLayoutBinding = { 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr };
+	VkDescriptorSetLayoutBinding TXAAPrevFrameSetLayoutBinding = { 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT, nullptr };
+	VkDescriptorSetLayoutBinding TXAACurrentFrameSetLayoutBinding = { 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT, nullptr };
+	VkDescriptorSetLayoutBinding TXAAToneMappedFrameSetLayoutBinding = { 2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr };
 
-	std::array<VkDescriptorSetLayoutBinding, 2> TXAABindings = { TXAAPrevFrameSetLayoutBinding, TXAACurrentFrameSetLayoutBinding };
+	std::array<VkDescriptorSetLayoutBinding, 3> TXAABindings = { TXAAPrevFrameSetLayoutBinding, TXAACurrentFrameSetLayoutBinding, 
+																 TXAAToneMappedFrameSetLayoutBinding };
 	VulkanInitializers::CreateDescriptorSetLayout(logicalDevice, static_cast<uint32_t>(TXAABindings.size()), TXAABindings.data(), TXAASetLayout);
 }
 void Renderer::CreateAllDescriptorSets()
 {
 	// Initialize descriptor sets
 	cloudComputeSet = VulkanInitializers::CreateDescriptorSet(logicalDevice, descriptorPool, cloudComputeSetLayout);
-	graphicsSet = VulkanInitializers::CreateDescriptorSet(logicalDevice, descriptorPool, graphicsSetLayout);
+	transmittanceLUTSet = VulkanInitializers::CreateDescriptorSet(logicalDevice, descriptorPool, lutOutputSetLayout);
+	multipleScatteringLUTSet = VulkanInitializers::CreateDescriptorSet(logicalDevice, descriptorPool, lutOutputSetLayout);
+	skyViewLUTSet = VulkanInitializers::CreateDescriptorSet(logicalDevice, descriptorPool, lutOutputSetLayout);
+	aerialPerspectiveSet = VulkanInitializers::CreateDescriptorSet(logicalDevice, descriptorPool, lutOutputSetLayout);
+	atmosphereSet = VulkanInitializers::CreateDescriptorSet(logicalDevice, descriptorPool, atmosphereSetLayout);
 
 	pingPongCloudResultSet1 = VulkanInitializers::CreateDescriptorSet(logicalDevice, descriptorPool, pingPongCloudResultSetLayout);
 	pingPongCloudResultSet2 = VulkanInitializers::CreateDescriptorSet(logicalDevice, descriptorPool, pingPongCloudResultSetLayout);
+	cloudUpsampleSet1 = VulkanInitializers::CreateDescriptorSet(logicalDevice, descriptorPool, cloudUpsampleSetLayout);
+	cloudUpsampleSet2 = VulkanInitializers::CreateDescriptorSet(logicalDevice, descriptorPool, cloudUpsampleSetLayout);
+	motionBlurSet = VulkanInitializers::CreateDescriptorSet(logicalDevice, descriptorPool, motionBlurSetLayout);
+	horizonBandSet = VulkanInitializers::CreateDescriptorSet(logicalDevice, descriptorPool, horizonBandSetLayout);
 
 	cameraSet = VulkanInitializers::CreateDescriptorSet(logicalDevice, descriptorPool, cameraSetLayout);
 	cameraOldSet = VulkanInitializers::CreateDescriptorSet(logicalDevice, descriptorPool, cameraSetLayout);
 	timeSet = VulkanInitializers::CreateDescriptorSet(logicalDevice, descriptorPool, timeSetLayout);
 	sunAndSkySet = VulkanInitializers::CreateDescriptorSet(logicalDevice, descriptorPool, sunAndSkySetLayout);
 	keyPressQuerySet = VulkanInitializers::CreateDescriptorSet(logicalDevice, descriptorPool, keyPressQuerySetLayout);
+	cloudQualitySet = VulkanInitializers::CreateDescriptorSet(logicalDevice, descriptorPool, cloudQualitySetLayout);
 
-	godRaysSet = VulkanInitializers::CreateDescriptorSet(logicalDevice, descriptorPool, godRaysSetLayout);
+	godRaysDownsampleSet = VulkanInitializers::CreateDescriptorSet(logicalDevice, descriptorPool, godRaysSetLayout);
+	godRaysBlurSet1 = VulkanInitializers::CreateDescriptorSet(logicalDevice, descriptorPool, godRaysSetLayout);
+	godRaysBlurSet2 = VulkanInitializers::CreateDescriptorSet(logicalDevice, descriptorPool, godRaysSetLayout);
 	toneMapSet1 = VulkanInitializers::CreateDescriptorSet(logicalDevice, descriptorPool, toneMapSetLayout);
 	toneMapSet2 = VulkanInitializers::CreateDescriptorSet(logicalDevice, descriptorPool, toneMapSetLayout);
 
@@ -1015,6 +2243,32 @@ void Renderer::CreateAllDescriptorSets()
 	//Create other things in the Scene like terrain models
 	scene->CreateModelsInScene(graphicsCommandPool);
 
+	// Every model has its own model matrix and texture, so its own graphics set. The number of models is only known now
+	const uint32_t modelCount = static_cast<uint32_t>(scene->GetModels().size());
+	if (modelCount == 0) {
+		throw std::runtime_error("The scene has no models");
+	}
+
+	std::array<VkDescriptorPoolSize, 2> modelPoolSizes = {};
+	modelPoolSizes[0] = { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, modelCount }; //model matrix
+	modelPoolSizes[1] = { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, modelCount }; //texture sampler for model
+
+	VkDescriptorPoolCreateInfo modelPoolInfo = {};
+	modelPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	modelPoolInfo.poolSizeCount = static_cast<uint32_t>(modelPoolSizes.size());
+	modelPoolInfo.pPoolSizes = modelPoolSizes.data();
+	modelPoolInfo.maxSets = modelCount;
+
+	if (vkCreateDescriptorPool(logicalDevice, &modelPoolInfo, nullptr, &modelDescriptorPool) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create model descriptor pool");
+	}
+
+	graphicsSets.resize(modelCount);
+	for (uint32_t m = 0; m < modelCount; m++)
+	{
+		graphicsSets[m] = VulkanInitializers::CreateDescriptorSet(logicalDevice, modelDescriptorPool, graphicsSetLayout);
+	}
+
 	//Write to and Update DescriptorSets
 	WriteToAndUpdateAllDescriptorSets();
 }
@@ -1022,12 +2276,16 @@ void Renderer::CreateAllDescriptorSets()
 void Renderer::WriteToAndUpdateAllDescriptorSets()
 {
 	WriteToAndUpdatePingPongDescriptorSets();
+	WriteToAndUpdateCloudUpsampleSets();
+	WriteToAndUpdateMotionBlurSet();
+	WriteToAndUpdateHorizonBandSet();
 	WriteToAndUpdateComputeDescriptorSets();
+	WriteToAndUpdateAtmosphereSets();
 	WriteToAndUpdateGraphicsDescriptorSets();
 	WriteToAndUpdateRemainingDescriptorSets();
 	
 	//Post Process Sets
-	WriteToAndUpdateGodRaysSet();
+	WriteToAndUpdateGodRaysSets();
 	WriteToAndUpdateToneMapSet();
 	WriteToAndUpdateTXAASet();
 }
@@ -1045,7 +2303,35 @@ void Renderer::WriteToAndUpdatePingPongDescriptorSets()
 	previousFrameTextureInfo.imageView = previousCloudsResultTexture->GetTextureImageView();
 	previousFrameTextureInfo.sampler = previousCloudsResultTexture->GetTextureSampler();
 
-	std::array<VkWriteDescriptorSet, 2> writePingPongSet1Info = {};
+	// Ray-start hints
+	VkDescriptorImageInfo currentCloudDistanceTextureInfo = {};
+	currentCloudDistanceTextureInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+	currentCloudDistanceTextureInfo.imageView = currentCloudDistanceTexture->GetTextureImageView();
+	currentCloudDistanceTextureInfo.sampler = currentCloudDistanceTexture->GetTextureSampler();
+
+	VkDescriptorImageInfo previousCloudDistanceTextureInfo = {};
+	previousCloudDistanceTextureInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+	previousCloudDistanceTextureInfo.imageView = previousCloudDistanceTexture->GetTextureImageView();
+	previousCloudDistanceTextureInfo.sampler = previousCloudDistanceTexture->GetTextureSampler();
+
+	// Light history
+	VkDescriptorImageInfo currentLightHistoryTextureInfo = {};
+	currentLightHistoryTextureInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+	currentLightHistoryTextureInfo.imageView = currentLightHistoryTexture->GetTextureImageView();
+	currentLightHistoryTextureInfo.sampler = currentLightHistoryTexture->GetTextureSampler();
+
+	VkDescriptorImageInfo previousLightHistoryTextureInfo = {};
+	previousLightHistoryTextureInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+	previousLightHistoryTextureInfo.imageView = previousLightHistoryTexture->GetTextureImageView();
+	previousLightHistoryTextureInfo.sampler = previousLightHistoryTexture->GetTextureSampler();
+
+	// Scene depth, the same for both sets
+	VkDescriptorImageInfo sceneDepthInfo = {};
+	sceneDepthInfo.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+	sceneDepthInfo.imageView = sceneDepthImageView;
+	sceneDepthInfo.sampler = sceneDepthSampler;
+
+	std::array<VkWriteDescriptorSet, 8> writePingPongSet1Info = {};
 	
 	writePingPongSet1Info[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
 	writePingPongSet1Info[0].pNext = NULL;
@@ -1063,7 +2349,55 @@ void Renderer::WriteToAndUpdatePingPongDescriptorSets()
 	writePingPongSet1Info[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
 	writePingPongSet1Info[1].pImageInfo = &previousFrameTextureInfo;
 
-	std::array<VkWriteDescriptorSet, 2> writePingPongSet2Info = {};
+	writePingPongSet1Info[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writePingPongSet1Info[2].pNext = NULL;
+	writePingPongSet1Info[2].dstSet = pingPongCloudResultSet1;
+	writePingPongSet1Info[2].dstBinding = 2;
+	writePingPongSet1Info[2].descriptorCount = 1;
+	writePingPongSet1Info[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	writePingPongSet1Info[2].pImageInfo = &currentCloudDistanceTextureInfo;
+
+	writePingPongSet1Info[3].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writePingPongSet1Info[3].pNext = NULL;
+	writePingPongSet1Info[3].dstSet = pingPongCloudResultSet1;
+	writePingPongSet1Info[3].dstBinding = 3;
+	writePingPongSet1Info[3].descriptorCount = 1;
+	writePingPongSet1Info[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	writePingPongSet1Info[3].pImageInfo = &previousCloudDistanceTextureInfo;
+
+	writePingPongSet1Info[4].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writePingPongSet1Info[4].pNext = NULL;
+	writePingPongSet1Info[4].dstSet = pingPongCloudResultSet1;
+	writePingPongSet1Info[4].dstBinding = 4;
+	writePingPongSet1Info[4].descriptorCount = 1;
+	writePingPongSet1Info[4].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	writePingPongSet1Info[4].pImageInfo = &previousFrameTextureInfo;
+
+	writePingPongSet1Info[5].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writePingPongSet1Info[5].pNext = NULL;
+	writePingPongSet1Info[5].dstSet = pingPongCloudResultSet1;
+	writePingPongSet1Info[5].dstBinding = 5;
+	writePingPongSet1Info[5].descriptorCount = 1;
+	writePingPongSet1Info[5].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	writePingPongSet1Info[5].pImageInfo = &currentLightHistoryTextureInfo;
+
+	writePingPongSet1Info[6].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writePingPongSet1Info[6].pNext = NULL;
+	writePingPongSet1Info[6].dstSet = pingPongCloudResultSet1;
+	writePingPongSet1Info[6].dstBinding = 6;
+	writePingPongSet1Info[6].descriptorCount = 1;
+	writePingPongSet1Info[6].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	writePingPongSet1Info[6].pImageInfo = &previousLightHistoryTextureInfo;
+
+	writePingPongSet1Info[7].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writePingPongSet1Info[7].pNext = NULL;
+	writePingPongSet1Info[7].dstSet = pingPongCloudResultSet1;
+	writePingPongSet1Info[7].dstBinding = 7;
+	writePingPongSet1Info[7].descriptorCount = 1;
+	writePingPongSet1Info[7].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	writePingPongSet1Info[7].pImageInfo = &sceneDepthInfo;
+
+	std::array<VkWriteDescriptorSet, 8> writePingPongSet2Info = {};
 
 	writePingPongSet2Info[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
 	writePingPongSet2Info[0].pNext = NULL;
@@ -1081,9 +2415,209 @@ void Renderer::WriteToAndUpdatePingPongDescriptorSets()
 	writePingPongSet2Info[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
 	writePingPongSet2Info[1].pImageInfo = &currentFrameTextureInfo;
 
+	writePingPongSet2Info[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writePingPongSet2Info[2].pNext = NULL;
+	writePingPongSet2Info[2].dstSet = pingPongCloudResultSet2;
+	writePingPongSet2Info[2].dstBinding = 2;
+	writePingPongSet2Info[2].descriptorCount = 1;
+	writePingPongSet2Info[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	writePingPongSet2Info[2].pImageInfo = &previousCloudDistanceTextureInfo;
+
+	writePingPongSet2Info[3].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writePingPongSet2Info[3].pNext = NULL;
+	writePingPongSet2Info[3].dstSet = pingPongCloudResultSet2;
+	writePingPongSet2Info[3].dstBinding = 3;
+	writePingPongSet2Info[3].descriptorCount = 1;
+	writePingPongSet2Info[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	writePingPongSet2Info[3].pImageInfo = &currentCloudDistanceTextureInfo;
+
+	writePingPongSet2Info[4].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writePingPongSet2Info[4].pNext = NULL;
+	writePingPongSet2Info[4].dstSet = pingPongCloudResultSet2;
+	writePingPongSet2Info[4].dstBinding = 4;
+	writePingPongSet2Info[4].descriptorCount = 1;
+	writePingPongSet2Info[4].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	writePingPongSet2Info[4].pImageInfo = &currentFrameTextureInfo;
+
+	writePingPongSet2Info[5].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writePingPongSet2Info[5].pNext = NULL;
+	writePingPongSet2Info[5].dstSet = pingPongCloudResultSet2;
+	writePingPongSet2Info[5].dstBinding = 5;
+	writePingPongSet2Info[5].descriptorCount = 1;
+	writePingPongSet2Info[5].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	writePingPongSet2Info[5].pImageInfo = &previousLightHistoryTextureInfo;
+
+	writePingPongSet2Info[6].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writePingPongSet2Info[6].pNext = NULL;
+	writePingPongSet2Info[6].dstSet = pingPongCloudResultSet2;
+	writePingPongSet2Info[6].dstBinding = 6;
+	writePingPongSet2Info[6].descriptorCount = 1;
+	writePingPongSet2Info[6].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	writePingPongSet2Info[6].pImageInfo = &currentLightHistoryTextureInfo;
+
+	writePingPongSet2Info[7].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writePingPongSet2Info[7].pNext = NULL;
+	writePingPongSet2Info[7].dstSet = pingPongCloudResultSet2;
+	writePingPongSet2Info[7].dstBinding = 7;
+	writePingPongSet2Info[7].descriptorCount = 1;
+	writePingPongSet2Info[7].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	writePingPongSet2Info[7].pImageInfo = &sceneDepthInfo;
+
 	vkUpdateDescriptorSets(logicalDevice, static_cast<uint32_t>(writePingPongSet1Info.size()), writePingPongSet1Info.data(), 0, nullptr);
 	vkUpdateDescriptorSets(logicalDevice, static_cast<uint32_t>(writePingPongSet2Info.size()), writePingPongSet2Info.data(), 0, nullptr);
 }
+void Renderer::WriteToAndUpdateMotionBlurSet()
+{
+	// Without motion blur the blurred texture doesn't exist and the set is never bound
+	if (!motionBlurEnabled)
+	{
+		return;
+	}
+
+	VkDescriptorImageInfo motionBlurredCloudsTextureInfo = {};
+	motionBlurredCloudsTextureInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+	motionBlurredCloudsTextureInfo.imageView = cloudsMotionBlurredTexture->GetTextureImageView();
+	motionBlurredCloudsTextureInfo.sampler = cloudsMotionBlurredTexture->GetTextureSampler();
+
+	std::array<VkWriteDescriptorSet, 1> writeMotionBlurSetInfo = {};
+
+	writeMotionBlurSetInfo[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writeMotionBlurSetInfo[0].pNext = NULL;
+	writeMotionBlurSetInfo[0].dstSet = motionBlurSet;
+	writeMotionBlurSetInfo[0].dstBinding = 0;
+	writeMotionBlurSetInfo[0].descriptorCount = 1;
+	writeMotionBlurSetInfo[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	writeMotionBlurSetInfo[0].pImageInfo = &motionBlurredCloudsTextureInfo;
+
+	vkUpdateDescriptorSets(logicalDevice, static_cast<uint32_t>(writeMotionBlurSetInfo.size()), writeMotionBlurSetInfo.data(), 0, nullptr);
+}
+void Renderer::WriteToAndUpdateHorizonBandSet()
+{
+	// The band textures are written as storage images by the horizon band pass and sampled by the ray march.
+	// The set is bound (and written) even with the band disabled, the ray march layout needs it
+	VkDescriptorImageInfo horizonBandTextureInfo = {};
+	horizonBandTextureInfo.imageLayout = sky->horizonBandTexture->GetTextureLayout();
+	horizonBandTextureInfo.imageView = sky->horizonBandTexture->GetTextureImageView();
+	horizonBandTextureInfo.sampler = sky->horizonBandTexture->GetTextureSampler();
+
+	VkDescriptorImageInfo horizonBandDistanceTextureInfo = {};
+	horizonBandDistanceTextureInfo.imageLayout = sky->horizonBandDistanceTexture->GetTextureLayout();
+	horizonBandDistanceTextureInfo.imageView = sky->horizonBandDistanceTexture->GetTextureImageView();
+	horizonBandDistanceTextureInfo.sampler = sky->horizonBandDistanceTexture->GetTextureSampler();
+
+	VkDescriptorBufferInfo horizonBandBufferInfo = {};
+	horizonBandBufferInfo.buffer = sky->GetHorizonBandBuffer();
+	horizonBandBufferInfo.offset = 0;
+	horizonBandBufferInfo.range = sizeof(HorizonBand);
+
+	std::array<VkWriteDescriptorSet, 5> writeHorizonBandSetInfo = {};
+
+	writeHorizonBandSetInfo[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writeHorizonBandSetInfo[0].pNext = NULL;
+	writeHorizonBandSetInfo[0].dstSet = horizonBandSet;
+	writeHorizonBandSetInfo[0].dstBinding = 0;
+	writeHorizonBandSetInfo[0].descriptorCount = 1;
+	writeHorizonBandSetInfo[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	writeHorizonBandSetInfo[0].pImageInfo = &horizonBandTextureInfo;
+
+	writeHorizonBandSetInfo[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writeHorizonBandSetInfo[1].pNext = NULL;
+	writeHorizonBandSetInfo[1].dstSet = horizonBandSet;
+	writeHorizonBandSetInfo[1].dstBinding = 1;
+	writeHorizonBandSetInfo[1].descriptorCount = 1;
+	writeHorizonBandSetInfo[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	writeHorizonBandSetInfo[1].pImageInfo = &horizonBandDistanceTextureInfo;
+
+	writeHorizonBandSetInfo[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writeHorizonBandSetInfo[2].pNext = NULL;
+	writeHorizonBandSetInfo[2].dstSet = horizonBandSet;
+	writeHorizonBandSetInfo[2].dstBinding = 2;
+	writeHorizonBandSetInfo[2].descriptorCount = 1;
+	writeHorizonBandSetInfo[2].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	writeHorizonBandSetInfo[2].pImageInfo = &horizonBandTextureInfo;
+
+	writeHorizonBandSetInfo[3].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writeHorizonBandSetInfo[3].pNext = NULL;
+	writeHorizonBandSetInfo[3].dstSet = horizonBandSet;
+	writeHorizonBandSetInfo[3].dstBinding = 3;
+	writeHorizonBandSetInfo[3].descriptorCount = 1;
+	writeHorizonBandSetInfo[3].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	writeHorizonBandSetInfo[3].pImageInfo = &horizonBandDistanceTextureInfo;
+
+	writeHorizonBandSetInfo[4].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writeHorizonBandSetInfo[4].pNext = NULL;
+	writeHorizonBandSetInfo[4].dstSet = horizonBandSet;
+	writeHorizonBandSetInfo[4].dstBinding = 4;
+	writeHorizonBandSetInfo[4].descriptorCount = 1;
+	writeHorizonBandSetInfo[4].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	writeHorizonBandSetInfo[4].pBufferInfo = &horizonBandBufferInfo;
+
+	vkUpdateDescriptorSets(logicalDevice, static_cast<uint32_t>(writeHorizonBandSetInfo.size()), writeHorizonBandSetInfo.data(), 0, nullptr);
+}
+void Renderer::WriteToAndUpdateCloudUpsampleSets()
+{
+	// Nothing to upsample at full resolution --> the upsampled texture doesn't exist and the sets are never bound
+	if (cloudResolutionDivisor == 1)
+	{
+		return;
+	}
+
+	// With motion blur on both sets upsample the blurred clouds
+	Texture2D* upsampleInput1 = motionBlurEnabled ? cloudsMotionBlurredTexture : currentCloudsResultTexture;
+	Texture2D* upsampleInput2 = motionBlurEnabled ? cloudsMotionBlurredTexture : previousCloudsResultTexture;
+
+	VkDescriptorImageInfo currentCloudsTextureInfo = {};
+	currentCloudsTextureInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+	currentCloudsTextureInfo.imageView = upsampleInput1->GetTextureImageView();
+	currentCloudsTextureInfo.sampler = upsampleInput1->GetTextureSampler();
+
+	VkDescriptorImageInfo previousCloudsTextureInfo = {};
+	previousCloudsTextureInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+	previousCloudsTextureInfo.imageView = upsampleInput2->GetTextureImageView();
+	previousCloudsTextureInfo.sampler = upsampleInput2->GetTextureSampler();
+
+	VkDescriptorImageInfo upsampledCloudsTextureInfo = {};
+	upsampledCloudsTextureInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+	upsampledCloudsTextureInfo.imageView = cloudsUpsampledTexture->GetTextureImageView();
+	upsampledCloudsTextureInfo.sampler = cloudsUpsampledTexture->GetTextureSampler();
+
+	// Set 1 upsamples what pingPongCloudResultSet1 rendered into, Set 2 what pingPongCloudResultSet2 rendered into
+	std::array<VkWriteDescriptorSet, 4> writeCloudUpsampleSetsInfo = {};
+
+	writeCloudUpsampleSetsInfo[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writeCloudUpsampleSetsInfo[0].pNext = NULL;
+	writeCloudUpsampleSetsInfo[0].dstSet = cloudUpsampleSet1;
+	writeCloudUpsampleSetsInfo[0].dstBinding = 0;
+	writeCloudUpsampleSetsInfo[0].descriptorCount = 1;
+	writeCloudUpsampleSetsInfo[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	writeCloudUpsampleSetsInfo[0].pImageInfo = &currentCloudsTextureInfo;
+
+	writeCloudUpsampleSetsInfo[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writeCloudUpsampleSetsInfo[1].pNext = NULL;
+	writeCloudUpsampleSetsInfo[1].dstSet = cloudUpsampleSet1;
+	writeCloudUpsampleSetsInfo[1].dstBinding = 1;
+	writeCloudUpsampleSetsInfo[1].descriptorCount = 1;
+	writeCloudUpsampleSetsInfo[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	writeCloudUpsampleSetsInfo[1].pImageInfo = &upsampledCloudsTextureInfo;
+
+	writeCloudUpsampleSetsInfo[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writeCloudUpsampleSetsInfo[2].pNext = NULL;
+	writeCloudUpsampleSetsInfo[2].dstSet = cloudUpsampleSet2;
+	writeCloudUpsampleSetsInfo[2].dstBinding = 0;
+	writeCloudUpsampleSetsInfo[2].descriptorCount = 1;
+	writeCloudUpsampleSetsInfo[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	writeCloudUpsampleSetsInfo[2].pImageInfo = &previousCloudsTextureInfo;
+
+	writeCloudUpsampleSetsInfo[3].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writeCloudUpsampleSetsInfo[3].pNext = NULL;
+	writeCloudUpsampleSetsInfo[3].dstSet = cloudUpsampleSet2;
+	writeCloudUpsampleSetsInfo[3].dstBinding = 1;
+	writeCloudUpsampleSetsInfo[3].descriptorCount = 1;
+	writeCloudUpsampleSetsInfo[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	writeCloudUpsampleSetsInfo[3].pImageInfo = &upsampledCloudsTextureInfo;
+
+	vkUpdateDescriptorSets(logicalDevice, static_cast<uint32_t>(writeCloudUpsampleSetsInfo.size()), writeCloudUpsampleSetsInfo.data(), 0, nullptr);
+}
 void Renderer::WriteToAndUpdateComputeDescriptorSets()
 {
 	//------------------------------------------
@@ -1119,7 +2653,31 @@ void Renderer::WriteToAndUpdateComputeDescriptorSets()
 	godRaysCreationDataTextureInfo.imageView = godRaysCreationDataTexture->GetTextureImageView();
 	godRaysCreationDataTextureInfo.sampler = godRaysCreationDataTexture->GetTextureSampler();
 
-	std::array<VkWriteDescriptorSet, 5> writeComputeTextureInfo = {};
+	// Sky-View LUT
+	VkDescriptorImageInfo skyViewLUTInfo = {};
+	skyViewLUTInfo.imageLayout = sky->skyViewLUTTexture->GetTextureLayout();
+	skyViewLUTInfo.imageView = sky->skyViewLUTTexture->GetTextureImageView();
+	skyViewLUTInfo.sampler = sky->skyViewLUTTexture->GetTextureSampler();
+
+	// Transmittance LUT
+	VkDescriptorImageInfo transmittanceLUTInfo = {};
+	transmittanceLUTInfo.imageLayout = sky->transmittanceLUTTexture->GetTextureLayout();
+	transmittanceLUTInfo.imageView = sky->transmittanceLUTTexture->GetTextureImageView();
+	transmittanceLUTInfo.sampler = sky->transmittanceLUTTexture->GetTextureSampler();
+
+	// Aerial Perspective
+	VkDescriptorImageInfo aerialPerspectiveInfo = {};
+	aerialPerspectiveInfo.imageLayout = sky->aerialPerspectiveTexture->GetTextureLayout();
+	aerialPerspectiveInfo.imageView = sky->aerialPerspectiveTexture->GetTextureImageView();
+	aerialPerspectiveInfo.sampler = sky->aerialPerspectiveTexture->GetTextureSampler();
+
+	// Blue Noise
+	VkDescriptorImageInfo blueNoiseInfo = {};
+	blueNoiseInfo.imageLayout = sky->blueNoiseTexture->GetTextureLayout();
+	blueNoiseInfo.imageView = sky->blueNoiseTexture->GetTextureImageView();
+	blueNoiseInfo.sampler = sky->blueNoiseTexture->GetTextureSampler();
+
+	std::array<VkWriteDescriptorSet, 9> writeComputeTextureInfo = {};
 	
 	writeComputeTextureInfo[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
 	writeComputeTextureInfo[0].pNext = NULL;
@@ -1161,46 +2719,140 @@ void Renderer::WriteToAndUpdateComputeDescriptorSets()
 	writeComputeTextureInfo[4].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
 	writeComputeTextureInfo[4].pImageInfo = &godRaysCreationDataTextureInfo;
 
+	writeComputeTextureInfo[5].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writeComputeTextureInfo[5].pNext = NULL;
+	writeComputeTextureInfo[5].dstSet = cloudComputeSet;
+	writeComputeTextureInfo[5].dstBinding = 5;
+	writeComputeTextureInfo[5].descriptorCount = 1;
+	writeComputeTextureInfo[5].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	writeComputeTextureInfo[5].pImageInfo = &skyViewLUTInfo;
+
+	writeComputeTextureInfo[6].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writeComputeTextureInfo[6].pNext = NULL;
+	writeComputeTextureInfo[6].dstSet = cloudComputeSet;
+	writeComputeTextureInfo[6].dstBinding = 6;
+	writeComputeTextureInfo[6].descriptorCount = 1;
+	writeComputeTextureInfo[6].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	writeComputeTextureInfo[6].pImageInfo = &transmittanceLUTInfo;
+
+	writeComputeTextureInfo[7].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writeComputeTextureInfo[7].pNext = NULL;
+	writeComputeTextureInfo[7].dstSet = cloudComputeSet;
+	writeComputeTextureInfo[7].dstBinding = 7;
+	writeComputeTextureInfo[7].descriptorCount = 1;
+	writeComputeTextureInfo[7].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	writeComputeTextureInfo[7].pImageInfo = &aerialPerspectiveInfo;
+
+	writeComputeTextureInfo[8].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writeComputeTextureInfo[8].pNext = NULL;
+	writeComputeTextureInfo[8].dstSet = cloudComputeSet;
+	writeComputeTextureInfo[8].dstBinding = 8;
+	writeComputeTextureInfo[8].descriptorCount = 1;
+	writeComputeTextureInfo[8].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	writeComputeTextureInfo[8].pImageInfo = &blueNoiseInfo;
+
 	vkUpdateDescriptorSets(logicalDevice, static_cast<uint32_t>(writeComputeTextureInfo.size()), writeComputeTextureInfo.data(), 0, nullptr);
 }
+void Renderer::WriteToAndUpdateAtmosphereSets()
+{
+	// The images the LUT passes write to
+	VkDescriptorImageInfo transmittanceLUTImageInfo = {};
+	transmittanceLUTImageInfo.imageLayout = sky->transmittanceLUTTexture->GetTextureLayout();
+	transmittanceLUTImageInfo.imageView = sky->transmittanceLUTTexture->GetTextureImageView();
+	transmittanceLUTImageInfo.sampler = sky->transmittanceLUTTexture->GetTextureSampler();
+
+	VkDescriptorImageInfo multipleScatteringLUTImageInfo = {};
+	multipleScatteringLUTImageInfo.imageLayout = sky->multipleScatteringLUTTexture->GetTextureLayout();
+	multipleScatteringLUTImageInfo.imageView = sky->multipleScatteringLUTTexture->GetTextureImageView();
+	multipleScatteringLUTImageInfo.sampler = sky->multipleScatteringLUTTexture->GetTextureSampler();
+
+	VkDescriptorImageInfo skyViewLUTImageInfo = {};
+	skyViewLUTImageInfo.imageLayout = sky->skyViewLUTTexture->GetTextureLayout();
+	skyViewLUTImageInfo.imageView = sky->skyViewLUTTexture->GetTextureImageView();
+	skyViewLUTImageInfo.sampler = sky->skyViewLUTTexture->GetTextureSampler();
+
+	VkDescriptorImageInfo aerialPerspectiveImageInfo = {};
+	aerialPerspectiveImageInfo.imageLayout = sky->aerialPerspectiveTexture->GetTextureLayout();
+	aerialPerspectiveImageInfo.imageView = sky->aerialPerspectiveTexture->GetTextureImageView();
+	aerialPerspectiveImageInfo.sampler = sky->aerialPerspectiveTexture->GetTextureSampler();
+
+	std::array<VkDescriptorSet, 4> lutOutputSets = { transmittanceLUTSet, multipleScatteringLUTSet, skyViewLUTSet, aerialPerspectiveSet };
+	std::array<VkDescriptorImageInfo*, 4> lutOutputImageInfos = { &transmittanceLUTImageInfo, &multipleScatteringLUTImageInfo,
+																  &skyViewLUTImageInfo, &aerialPerspectiveImageInfo };
+
+	// The LUTs the atmosphere integration samples; same image infos, but used through samplers
+	std::array<VkWriteDescriptorSet, 6> writeAtmosphereInfo = {};
+
+	for (size_t i = 0; i < lutOutputSets.size(); i++)
+	{
+		writeAtmosphereInfo[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writeAtmosphereInfo[i].pNext = NULL;
+		writeAtmosphereInfo[i].dstSet = lutOutputSets[i];
+		writeAtmosphereInfo[i].dstBinding = 0;
+		writeAtmosphereInfo[i].descriptorCount = 1;
+		writeAtmosphereInfo[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		writeAtmosphereInfo[i].pImageInfo = lutOutputImageInfos[i];
+	}
+
+	writeAtmosphereInfo[4].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writeAtmosphereInfo[4].pNext = NULL;
+	writeAtmosphereInfo[4].dstSet = atmosphereSet;
+	writeAtmosphereInfo[4].dstBinding = 0;
+	writeAtmosphereInfo[4].descriptorCount = 1;
+	writeAtmosphereInfo[4].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	writeAtmosphereInfo[4].pImageInfo = &transmittanceLUTImageInfo;
+
+	writeAtmosphereInfo[5].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writeAtmosphereInfo[5].pNext = NULL;
+	writeAtmosphereInfo[5].dstSet = atmosphereSet;
+	writeAtmosphereInfo[5].dstBinding = 1;
+	writeAtmosphereInfo[5].descriptorCount = 1;
+	writeAtmosphereInfo[5].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	writeAtmosphereInfo[5].pImageInfo = &multipleScatteringLUTImageInfo;
+
+	vkUpdateDescriptorSets(logicalDevice, static_cast<uint32_t>(writeAtmosphereInfo.size()), writeAtmosphereInfo.data(), 0, nullptr);
+}
 void Renderer::WriteToAndUpdateGraphicsDescriptorSets()
 {
 	//---------------------------------
 	//---- Graphics DescriptorSets ----
 	//---------------------------------
-	// We know we are only drawing one model but change this if creating multiple models
-	std::vector<Model*> models = scene->GetModels();
-
-	// Model
-	VkDescriptorBufferInfo modelBufferInfo = {};
-	modelBufferInfo.buffer = models[0]->GetModelBuffer();
-	modelBufferInfo.offset = 0;
-	modelBufferInfo.range = sizeof(ModelBufferObject);
-
-	// Texture
-	VkDescriptorImageInfo imageInfo = {};
-	imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-	imageInfo.imageView = models[0]->GetTextureView();
-	imageInfo.sampler = models[0]->GetTextureSampler();
-
-	std::array<VkWriteDescriptorSet, 2> writeGraphicsSetInfo = {};
-
-	writeGraphicsSetInfo[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	writeGraphicsSetInfo[0].dstSet = graphicsSet;
-	writeGraphicsSetInfo[0].dstBinding = 0;
-	writeGraphicsSetInfo[0].descriptorCount = 1;
-	writeGraphicsSetInfo[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	writeGraphicsSetInfo[0].pBufferInfo = &modelBufferInfo;
-
-	writeGraphicsSetInfo[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	writeGraphicsSetInfo[1].pNext = NULL;
-	writeGraphicsSetInfo[1].dstSet = graphicsSet;
-	writeGraphicsSetInfo[1].dstBinding = 1;
-	writeGraphicsSetInfo[1].descriptorCount = 1;
-	writeGraphicsSetInfo[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	writeGraphicsSetInfo[1].pImageInfo = &imageInfo;
-
-	vkUpdateDescriptorSets(logicalDevice, static_cast<uint32_t>(writeGraphicsSetInfo.size()), writeGraphicsSetInfo.data(), 0, nullptr);
+	// One set per model, in the order of the scene's models
+	const std::vector<Model*>& models = scene->GetModels();
+
+	for (size_t m = 0; m < models.size(); m++)
+	{
+		// Model
+		VkDescriptorBufferInfo modelBufferInfo = {};
+		modelBufferInfo.buffer = models[m]->GetModelBuffer();
+		modelBufferInfo.offset = 0;
+		modelBufferInfo.range = sizeof(ModelBufferObject);
+
+		// Texture
+		VkDescriptorImageInfo imageInfo = {};
+		imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		imageInfo.imageView = models[m]->GetTextureView();
+		imageInfo.sampler = models[m]->GetTextureSampler();
+
+		std::array<VkWriteDescriptorSet, 2> writeGraphicsSetInfo = {};
+
+		writeGraphicsSetInfo[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writeGraphicsSetInfo[0].dstSet = graphicsSets[m];
+		writeGraphicsSetInfo[0].dstBinding = 0;
+		writeGraphicsSetInfo[0].descriptorCount = 1;
+		writeGraphicsSetInfo[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		writeGraphicsSetInfo[0].pBufferInfo = &modelBufferInfo;
+
+		writeGraphicsSetInfo[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writeGraphicsSetInfo[1].pNext = NULL;
+		writeGraphicsSetInfo[1].dstSet = graphicsSets[m];
+		writeGraphicsSetInfo[1].dstBinding = 1;
+		writeGraphicsSetInfo[1].descriptorCount = 1;
+		writeGraphicsSetInfo[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		writeGraphicsSetInfo[1].pImageInfo = &imageInfo;
+
+		vkUpdateDescriptorSets(logicalDevice, static_cast<uint32_t>(writeGraphicsSetInfo.size()), writeGraphicsSetInfo.data(), 0, nullptr);
+	}
 }
 void Renderer::WriteToAndUpdateRemainingDescriptorSets()
 {
@@ -1289,49 +2941,111 @@ void Renderer::WriteToAndUpdateRemainingDescriptorSets()
 	writeKeyPressQuerySetInfo[0].pBufferInfo = &keyPressQueryBufferInfo;
 
 	vkUpdateDescriptorSets(logicalDevice, static_cast<uint32_t>(writeKeyPressQuerySetInfo.size()), writeKeyPressQuerySetInfo.data(), 0, nullptr);
+
+	// CloudQuality Descriptor
+	VkDescriptorBufferInfo cloudQualityBufferInfo = {};
+	cloudQualityBufferInfo.buffer = sky->GetCloudQualityBuffer();
+	cloudQualityBufferInfo.offset = 0;
+	cloudQualityBufferInfo.range = sizeof(CloudQuality);
+
+	std::array<VkWriteDescriptorSet, 1> writeCloudQualitySetInfo = {};
+	writeCloudQualitySetInfo[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writeCloudQualitySetInfo[0].pNext = NULL;
+	writeCloudQualitySetInfo[0].dstSet = cloudQualitySet;
+	writeCloudQualitySetInfo[0].dstBinding = 0;
+	writeCloudQualitySetInfo[0].descriptorCount = 1;
+	writeCloudQualitySetInfo[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	writeCloudQualitySetInfo[0].pBufferInfo = &cloudQualityBufferInfo;
+
+	vkUpdateDescriptorSets(logicalDevice, static_cast<uint32_t>(writeCloudQualitySetInfo.size()), writeCloudQualitySetInfo.data(), 0, nullptr);
 }
 
-void Renderer::WriteToAndUpdateGodRaysSet()
+void Renderer::WriteToAndUpdateGodRaysSets()
 {
 	VkDescriptorImageInfo godRaysDataTextureInfo = {};
 	godRaysDataTextureInfo.imageLayout = godRaysCreationDataTexture->GetTextureLayout();
 	godRaysDataTextureInfo.imageView = godRaysCreationDataTexture->GetTextureImageView();
 	godRaysDataTextureInfo.sampler = godRaysCreationDataTexture->GetTextureSampler();
 
-	std::array<VkWriteDescriptorSet, 1> writeGodRaysPassInfo = {};
-	writeGodRaysPassInfo[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	writeGodRaysPassInfo[0].pNext = NULL;
-	writeGodRaysPassInfo[0].dstSet = godRaysSet;
-	writeGodRaysPassInfo[0].dstBinding = 0;
-	writeGodRaysPassInfo[0].descriptorCount = 1;
-	writeGodRaysPassInfo[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	writeGodRaysPassInfo[0].pImageInfo = &godRaysDataTextureInfo;
+	VkDescriptorImageInfo godRays1TextureInfo = {};
+	godRays1TextureInfo.imageLayout = godRaysTexture1->GetTextureLayout();
+	godRays1TextureInfo.imageView = godRaysTexture1->GetTextureImageView();
+	godRays1TextureInfo.sampler = godRaysTexture1->GetTextureSampler();
+
+	VkDescriptorImageInfo godRays2TextureInfo = {};
+	godRays2TextureInfo.imageLayout = godRaysTexture2->GetTextureLayout();
+	godRays2TextureInfo.imageView = godRaysTexture2->GetTextureImageView();
+	godRays2TextureInfo.sampler = godRaysTexture2->GetTextureSampler();
+
+	// Each set: binding 0 is sampled, binding 1 written
+	const VkDescriptorSet sets[3] = { godRaysDownsampleSet, godRaysBlurSet1, godRaysBlurSet2 };
+	const VkDescriptorImageInfo* inputs[3] = { &godRaysDataTextureInfo, &godRays1TextureInfo, &godRays2TextureInfo };
+	const VkDescriptorImageInfo* outputs[3] = { &godRays1TextureInfo, &godRays2TextureInfo, &godRays1TextureInfo };
+
+	std::array<VkWriteDescriptorSet, 6> writeGodRaysPassInfo = {};
+	for (uint32_t i = 0; i < 3; i++)
+	{
+		writeGodRaysPassInfo[2 * i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writeGodRaysPassInfo[2 * i].pNext = NULL;
+		writeGodRaysPassInfo[2 * i].dstSet = sets[i];
+		writeGodRaysPassInfo[2 * i].dstBinding = 0;
+		writeGodRaysPassInfo[2 * i].descriptorCount = 1;
+		writeGodRaysPassInfo[2 * i].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		writeGodRaysPassInfo[2 * i].pImageInfo = inputs[i];
+
+		writeGodRaysPassInfo[2 * i + 1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writeGodRaysPassInfo[2 * i + 1].pNext = NULL;
+		writeGodRaysPassInfo[2 * i + 1].dstSet = sets[i];
+		writeGodRaysPassInfo[2 * i + 1].dstBinding = 1;
+		writeGodRaysPassInfo[2 * i + 1].descriptorCount = 1;
+		writeGodRaysPassInfo[2 * i + 1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		writeGodRaysPassInfo[2 * i + 1].pImageInfo = outputs[i];
+	}
 
 	vkUpdateDescriptorSets(logicalDevice, static_cast<uint32_t>(writeGodRaysPassInfo.size()), writeGodRaysPassInfo.data(), 0, nullptr);
 }
 void Renderer::WriteToAndUpdateToneMapSet()
 {
-	VkDescriptorImageInfo toneMapPassImage1Info = {};
-	toneMapPassImage1Info.imageLayout = currentCloudsResultTexture->GetTextureLayout();
-	toneMapPassImage1Info.imageView = currentCloudsResultTexture->GetTextureImageView();
-	toneMapPassImage1Info.sampler = currentCloudsResultTexture->GetTextureSampler();
+	// With motion blur on both sets tone map the blurred clouds, with reduced resolution clouds the upsampled clouds
+	Texture2D* toneMapInput1 = motionBlurEnabled ? cloudsMotionBlurredTexture : currentCloudsResultTexture;
+	Texture2D* toneMapInput2 = motionBlurEnabled ? cloudsMotionBlurredTexture : previousCloudsResultTexture;
+	if (cloudResolutionDivisor > 1)
+	{
+		toneMapInput1 = cloudsUpsampledTexture;
+		toneMapInput2 = cloudsUpsampledTexture;
+	}
 
-	VkDescriptorImageInfo currentFrameImageInfo = {};
-	currentFrameImageInfo.imageLayout = currentFrameTexture->GetTextureLayout();
-	currentFrameImageInfo.imageView = currentFrameTexture->GetTextureImageView();
-	currentFrameImageInfo.sampler = currentFrameTexture->GetTextureSampler();
+	VkDescriptorImageInfo toneMapPassImage1Info = {};
+	toneMapPassImage1Info.imageLayout = toneMapInput1->GetTextureLayout();
+	toneMapPassImage1Info.imageView = toneMapInput1->GetTextureImageView();
+	toneMapPassImage1Info.sampler = toneMapInput1->GetTextureSampler();
 
 	VkDescriptorImageInfo toneMapPassImage2Info = {};
-	toneMapPassImage2Info.imageLayout = previousCloudsResultTexture->GetTextureLayout(); 
-	toneMapPassImage2Info.imageView = previousCloudsResultTexture->GetTextureImageView();
-	toneMapPassImage2Info.sampler = previousCloudsResultTexture->GetTextureSampler();
-
-	VkDescriptorImageInfo previousFrameImageInfo = {};
-	previousFrameImageInfo.imageLayout = previousFrameTexture->GetTextureLayout();
-	previousFrameImageInfo.imageView = previousFrameTexture->GetTextureImageView();
-	previousFrameImageInfo.sampler = previousFrameTexture->GetTextureSampler();
-
-	std::array<VkWriteDescriptorSet, 2> writeToneMapPass1Info = {};
+	toneMapPassImage2Info.imageLayout = toneMapInput2->GetTextureLayout(); 
+	toneMapPassImage2Info.imageView = toneMapInput2->GetTextureImageView();
+	toneMapPassImage2Info.sampler = toneMapInput2->GetTextureSampler();
+
+	// Both sets write the same render resolution image, the TXAA pass keeps the history
+	VkDescriptorImageInfo toneMappedFrameImageInfo = {};
+	toneMappedFrameImageInfo.imageLayout = toneMappedFrameTexture->GetTextureLayout();
+	toneMappedFrameImageInfo.imageView = toneMappedFrameTexture->GetTextureImageView();
+	toneMappedFrameImageInfo.sampler = toneMappedFrameTexture->GetTextureSampler();
+
+	// Result of the last god rays blur pass (GOD_RAYS_BLUR_PASSES is odd), the same for both sets. Written on the compute 
+	// queue (RecordGodRaysDispatches), made visible by the frame graph's output barrier like the clouds
+	VkDescriptorImageInfo godRaysImageInfo = {};
+	godRaysImageInfo.imageLayout = godRaysTexture2->GetTextureLayout();
+	godRaysImageInfo.imageView = godRaysTexture2->GetTextureImageView();
+	godRaysImageInfo.sampler = godRaysTexture2->GetTextureSampler();
+
+	// The auto exposure, the same for both sets. The compute queue writes it every frame; the global memory barrier the frame 
+	// graph records ahead of the post processing makes it visible (see RecordGraphicsCommandBuffer), an image barrier wouldn't
+	VkDescriptorBufferInfo exposureBufferInfo = {};
+	exposureBufferInfo.buffer = exposureBuffer;
+	exposureBufferInfo.offset = 0;
+	exposureBufferInfo.range = sizeof(ExposureData);
+
+	std::array<VkWriteDescriptorSet, 4> writeToneMapPass1Info = {};
 
 	writeToneMapPass1Info[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
 	writeToneMapPass1Info[0].pNext = NULL;
@@ -1347,9 +3061,25 @@ void Renderer::WriteToAndUpdateToneMapSet()
 	writeToneMapPass1Info[1].dstBinding = 1;
 	writeToneMapPass1Info[1].descriptorCount = 1;
 	writeToneMapPass1Info[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-	writeToneMapPass1Info[1].pImageInfo = &currentFrameImageInfo;
-
-	std::array<VkWriteDescriptorSet, 2> writeToneMapPass2Info = {};
+	writeToneMapPass1Info[1].pImageInfo = &toneMappedFrameImageInfo;
+
+	writeToneMapPass1Info[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writeToneMapPass1Info[2].pNext = NULL;
+	writeToneMapPass1Info[2].dstSet = toneMapSet1;
+	writeToneMapPass1Info[2].dstBinding = 2;
+	writeToneMapPass1Info[2].descriptorCount = 1;
+	writeToneMapPass1Info[2].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	writeToneMapPass1Info[2].pImageInfo = &godRaysImageInfo;
+
+	writeToneMapPass1Info[3].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writeToneMapPass1Info[3].pNext = NULL;
+	writeToneMapPass1Info[3].dstSet = toneMapSet1;
+	writeToneMapPass1Info[3].dstBinding = 3;
+	writeToneMapPass1Info[3].descriptorCount = 1;
+	writeToneMapPass1Info[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	writeToneMapPass1Info[3].pBufferInfo = &exposureBufferInfo;
+
+	std::array<VkWriteDescriptorSet, 4> writeToneMapPass2Info = {};
 
 	writeToneMapPass2Info[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
 	writeToneMapPass2Info[0].pNext = NULL;
@@ -1365,7 +3095,23 @@ void Renderer::WriteToAndUpdateToneMapSet()
 	writeToneMapPass2Info[1].dstBinding = 1;
 	writeToneMapPass2Info[1].descriptorCount = 1;
 	writeToneMapPass2Info[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-	writeToneMapPass2Info[1].pImageInfo = &previousFrameImageInfo;
+	writeToneMapPass2Info[1].pImageInfo = &toneMappedFrameImageInfo;
+
+	writeToneMapPass2Info[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writeToneMapPass2Info[2].pNext = NULL;
+	writeToneMapPass2Info[2].dstSet = toneMapSet2;
+	writeToneMapPass2Info[2].dstBinding = 2;
+	writeToneMapPass2Info[2].descriptorCount = 1;
+	writeToneMapPass2Info[2].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	writeToneMapPass2Info[2].pImageInfo = &godRaysImageInfo;
+
+	writeToneMapPass2Info[3].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writeToneMapPass2Info[3].pNext = NULL;
+	writeToneMapPass2Info[3].dstSet = toneMapSet2;
+	writeToneMapPass2Info[3].dstBinding = 3;
+	writeToneMapPass2Info[3].descriptorCount = 1;
+	writeToneMapPass2Info[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	writeToneMapPass2Info[3].pBufferInfo = &exposureBufferInfo;
 
 	vkUpdateDescriptorSets(logicalDevice, static_cast<uint32_t>(writeToneMapPass1Info.size()), writeToneMapPass1Info.data(), 0, nullptr);
 	vkUpdateDescriptorSets(logicalDevice, static_cast<uint32_t>(writeToneMapPass2Info.size()), writeToneMapPass2Info.data(), 0, nullptr);
@@ -1382,7 +3128,12 @@ void Renderer::WriteToAndUpdateTXAASet()
 	previousFrameImageInfo.imageView = previousFrameTexture->GetTextureImageView();
 	previousFrameImageInfo.sampler = previousFrameTexture->GetTextureSampler();
 
-	std::array<VkWriteDescriptorSet, 2> writeTXAAPass1Info = {};
+	VkDescriptorImageInfo toneMappedFrameImageInfo = {};
+	toneMappedFrameImageInfo.imageLayout = toneMappedFrameTexture->GetTextureLayout();
+	toneMappedFrameImageInfo.imageView = toneMappedFrameTexture->GetTextureImageView();
+	toneMappedFrameImageInfo.sampler = toneMappedFrameTexture->GetTextureSampler();
+
+	std::array<VkWriteDescriptorSet, 3> writeTXAAPass1Info = {};
 
 	writeTXAAPass1Info[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
 	writeTXAAPass1Info[0].pNext = NULL;
@@ -1400,7 +3151,15 @@ void Renderer::WriteToAndUpdateTXAASet()
 	writeTXAAPass1Info[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
 	writeTXAAPass1Info[1].pImageInfo = &currentFrameImageInfo;
 
-	std::array<VkWriteDescriptorSet, 2> writeTXAAPass2Info = {};
+	writeTXAAPass1Info[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writeTXAAPass1Info[2].pNext = NULL;
+	writeTXAAPass1Info[2].dstSet = TXAASet1;
+	writeTXAAPass1Info[2].dstBinding = 2;
+	writeTXAAPass1Info[2].descriptorCount = 1;
+	writeTXAAPass1Info[2].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	writeTXAAPass1Info[2].pImageInfo = &toneMappedFrameImageInfo;
+
+	std::array<VkWriteDescriptorSet, 3> writeTXAAPass2Info = {};
 
 	writeTXAAPass2Info[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
 	writeTXAAPass2Info[0].pNext = NULL;
@@ -1418,6 +3177,14 @@ void Renderer::WriteToAndUpdateTXAASet()
 	writeTXAAPass2Info[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
 	writeTXAAPass2Info[1].pImageInfo = &previousFrameImageInfo;
 
+	writeTXAAPass2Info[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writeTXAAPass2Info[2].pNext = NULL;
+	writeTXAAPass2Info[2].dstSet = TXAASet2;
+	writeTXAAPass2Info[2].dstBinding = 2;
+	writeTXAAPass2Info[2].descriptorCount = 1;
+	writeTXAAPass2Info[2].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	writeTXAAPass2Info[2].pImageInfo = &toneMappedFrameImageInfo;
+
 	vkUpdateDescriptorSets(logicalDevice, static_cast<uint32_t>(writeTXAAPass1Info.size()), writeTXAAPass1Info.data(), 0, nullptr);
 	vkUpdateDescriptorSets(logicalDevice, static_cast<uint32_t>(writeTXAAPass2Info.size()), writeTXAAPass2Info.data(), 0, nullptr);
 }
@@ -1427,23 +3194,191 @@ void Renderer::WriteToAndUpdateTXAASet()
 //--------------------------------------------------------
 void Renderer::CreateResources()
 {
+	CreateRenderScaleResources();
+
+	//TXAA history, reconstructed at the window resolution from the render resolution frames
+	currentFrameTexture = new Texture2D(device, window_width, window_height, VK_FORMAT_R8G8B8A8_SNORM);
+	currentFrameTexture->createEmptyTexture(logicalDevice, physicalDevice, computeCommandPool);
+
+	previousFrameTexture = new Texture2D(device, window_width, window_height, VK_FORMAT_R8G8B8A8_SNORM);
+	previousFrameTexture->createEmptyTexture(logicalDevice, physicalDevice, computeCommandPool);
+}
+// The targets below are written by a compute shader that doesn't declare their format and only sampled afterwards,
+// so any format the GPU can write to and filter works. The narrowest that holds what they store saves bandwidth:
+// - the occlusion mask is a fraction between 0 and 1, 8 bits are enough for something that gets blurred anyway
+// - the first god rays image only ever holds the blurred mask; it is blurred twice more, so it keeps 16 bits
+// - the second god rays image and the upsampled clouds end up with HDR color that is never negative, and nothing reads their alpha
+// The cloud results, ray-start hints and light history are read back with imageLoad by later passes (and need their alpha),
+// so they keep the RGBA16F their shaders declare. RGBA16F is the fallback of every target, every GPU can write and filter it
+void Renderer::SelectIntermediateFormats(bool narrow)
+{
+	if (!narrow)
+	{
+		occlusionMaskFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
+		godRaysBlurFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
+		godRaysFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
+		cloudsUpsampledFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
+		return;
+	}
+
+	occlusionMaskFormat = FormatUtils::FindStorageImageFormat(physicalDevice, { VK_FORMAT_R8_UNORM, VK_FORMAT_R16_SFLOAT, VK_FORMAT_R16G16B16A16_SFLOAT });
+	godRaysBlurFormat = FormatUtils::FindStorageImageFormat(physicalDevice, { VK_FORMAT_R16_SFLOAT, VK_FORMAT_R16G16B16A16_SFLOAT });
+	godRaysFormat = FormatUtils::FindStorageImageFormat(physicalDevice, { VK_FORMAT_B10G11R11_UFLOAT_PACK32, VK_FORMAT_R16G16B16A16_SFLOAT });
+	cloudsUpsampledFormat = FormatUtils::FindStorageImageFormat(physicalDevice, { VK_FORMAT_B10G11R11_UFLOAT_PACK32, VK_FORMAT_R16G16B16A16_SFLOAT });
+}
+// Prints an estimate of the memory traffic of the targets SelectIntermediateFormats picks the formats of, next to what
+// it would be in RGBA16F. Every pass that writes or reads one of them counts as one write or read of the whole image
+void Renderer::ReportIntermediateTargetTraffic() const
+{
+	struct TargetTraffic
+	{
+		uint32_t width;
+		uint32_t height;
+		VkFormat format;
+		uint32_t accesses;	// full image writes and reads per frame
+	};
+	const uint32_t histogramReads = autoExposureEnabled ? 1 : 0;
+
+	std::vector<TargetTraffic> targets;
+	// Written by the ray march, read by the god rays downsampling pass
+	targets.push_back({ cloud_width, cloud_height, occlusionMaskFormat, godRaysEnabled ? 2u : 1u });
+	if (godRaysEnabled)
+	{
+		// Written by the downsampling pass and the second blur pass, read by the first and the last blur pass
+		targets.push_back({ godRays_width, godRays_height, godRaysBlurFormat, 4 });
+		// Written by the first and the last blur pass, read by the second one, the tone mapping and the luminance histogram
+		targets.push_back({ godRays_width, godRays_height, godRaysFormat, 4 + histogramReads });
+	}
+	else
+	{
+		// Stays black, but the tone mapping and the luminance histogram still read it
+		targets.push_back({ godRays_width, godRays_height, godRaysFormat, 1 + histogramReads });
+	}
+	if (cloudResolutionDivisor > 1)
+	{
+		// Written by the upsampling pass, read by the tone mapping and the luminance histogram
+		targets.push_back({ render_width, render_height, cloudsUpsampledFormat, 2 + histogramReads });
+	}
+
+	uint64_t bytes = 0;
+	uint64_t wideBytes = 0;
+	for (const TargetTraffic& target : targets)
+	{
+		const uint64_t texelAccesses = uint64_t(target.width) * target.height * target.accesses;
+		bytes += texelAccesses * FormatUtils::GetTexelSize(target.format);
+		wideBytes += texelAccesses * FormatUtils::GetTexelSize(VK_FORMAT_R16G16B16A16_SFLOAT);
+	}
+
+	std::cout << "Intermediate targets: about " << bytes / (1024.0 * 1024.0) << " MB moved per frame ("
+			  << wideBytes / (1024.0 * 1024.0) << " MB in RGBA16F)" << std::endl;
+}
+void Renderer::CreateRenderScaleResources()
+{
+	render_width = std::max(1u, static_cast<uint32_t>(window_width * renderScale + 0.5f));
+	render_height = std::max(1u, static_cast<uint32_t>(window_height * renderScale + 0.5f));
+
+	//Everything the cloud compute passes render into lives at the (possibly reduced) cloud resolution
+	cloud_width = (render_width + cloudResolutionDivisor - 1) / cloudResolutionDivisor;
+	cloud_height = (render_height + cloudResolutionDivisor - 1) / cloudResolutionDivisor;
+
 	//To store the results of the compute shader that will be passed on to the frag shader
-	currentCloudsResultTexture = new Texture2D(device, window_width, window_height, VK_FORMAT_R16G16B16A16_SFLOAT);
+	currentCloudsResultTexture = new Texture2D(device, cloud_width, cloud_height, VK_FORMAT_R16G16B16A16_SFLOAT);
 	currentCloudsResultTexture->createEmptyTexture(logicalDevice, physicalDevice, computeCommandPool);
 
 	//Stores the results of the previous Frame
-	previousCloudsResultTexture = new Texture2D(device, window_width, window_height, VK_FORMAT_R16G16B16A16_SFLOAT);
+	previousCloudsResultTexture = new Texture2D(device, cloud_width, cloud_height, VK_FORMAT_R16G16B16A16_SFLOAT);
 	previousCloudsResultTexture->createEmptyTexture(logicalDevice, physicalDevice, computeCommandPool);
 
-	//To store the results of the compute shader that will be passed on to the frag shader
-	godRaysCreationDataTexture = new Texture2D(device, window_width, window_height, VK_FORMAT_R16G16B16A16_SFLOAT);
-	godRaysCreationDataTexture->createEmptyTexture(logicalDevice, physicalDevice, computeCommandPool);
+	//Reduced resolution clouds get upsampled to the render resolution before the post processing passes
+	if (cloudResolutionDivisor > 1)
+	{
+		cloudsUpsampledTexture = new Texture2D(device, render_width, render_height, cloudsUpsampledFormat);
+		cloudsUpsampledTexture->createEmptyTexture(logicalDevice, physicalDevice, computeCommandPool);
+	}
 
-	currentFrameTexture = new Texture2D(device, window_width, window_height, VK_FORMAT_R8G8B8A8_SNORM);
-	currentFrameTexture->createEmptyTexture(logicalDevice, physicalDevice, computeCommandPool);
+	//Motion blurred clouds, the ping ponged results stay unblurred for the reprojection
+	if (motionBlurEnabled)
+	{
+		cloudsMotionBlurredTexture = new Texture2D(device, cloud_width, cloud_height, VK_FORMAT_R16G16B16A16_SFLOAT);
+		cloudsMotionBlurredTexture->createEmptyTexture(logicalDevice, physicalDevice, computeCommandPool);
+	}
 
-	previousFrameTexture = new Texture2D(device, window_width, window_height, VK_FORMAT_R8G8B8A8_SNORM);
-	previousFrameTexture->createEmptyTexture(logicalDevice, physicalDevice, computeCommandPool);
+	//Occlusion mask of the god rays, written by the ray march. Clamped to the edge: the blur reaches off screen
+	godRaysCreationDataTexture = new Texture2D(device, cloud_width, cloud_height, occlusionMaskFormat);
+	godRaysCreationDataTexture->createEmptyTexture(logicalDevice, physicalDevice, computeCommandPool, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE);
+
+	//The god rays passes ping pong between these. Allocated even with the god rays off: the tone mapping pass 
+	//always samples godRaysTexture2, which then stays cleared to black
+	godRays_width = (render_width + GOD_RAYS_RESOLUTION_DIVISOR - 1) / GOD_RAYS_RESOLUTION_DIVISOR;
+	godRays_height = (render_height + GOD_RAYS_RESOLUTION_DIVISOR - 1) / GOD_RAYS_RESOLUTION_DIVISOR;
+
+	godRaysTexture1 = new Texture2D(device, godRays_width, godRays_height, godRaysBlurFormat);
+	godRaysTexture1->createEmptyTexture(logicalDevice, physicalDevice, computeCommandPool, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE);
+
+	godRaysTexture2 = new Texture2D(device, godRays_width, godRays_height, godRaysFormat);
+	godRaysTexture2->createEmptyTexture(logicalDevice, physicalDevice, computeCommandPool, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE);
+
+	//Ray-start hints written by the ray march and carried over frame to frame by the reprojection pass
+	//Distances are stored in km so half floats are plenty
+	currentCloudDistanceTexture = new Texture2D(device, cloud_width, cloud_height, VK_FORMAT_R16G16B16A16_SFLOAT);
+	currentCloudDistanceTexture->createEmptyTexture(logicalDevice, physicalDevice, computeCommandPool);
+
+	previousCloudDistanceTexture = new Texture2D(device, cloud_width, cloud_height, VK_FORMAT_R16G16B16A16_SFLOAT);
+	previousCloudDistanceTexture->createEmptyTexture(logicalDevice, physicalDevice, computeCommandPool);
+
+	//Light history of the ray march, carried over like the ray-start hints. Starts out cleared, i.e. without history
+	currentLightHistoryTexture = new Texture2D(device, cloud_width, cloud_height, VK_FORMAT_R16G16B16A16_SFLOAT);
+	currentLightHistoryTexture->createEmptyTexture(logicalDevice, physicalDevice, computeCommandPool);
+
+	previousLightHistoryTexture = new Texture2D(device, cloud_width, cloud_height, VK_FORMAT_R16G16B16A16_SFLOAT);
+	previousLightHistoryTexture->createEmptyTexture(logicalDevice, physicalDevice, computeCommandPool);
+
+	//Output of the tone mapping pass
+	toneMappedFrameTexture = new Texture2D(device, render_width, render_height, VK_FORMAT_R8G8B8A8_SNORM);
+	toneMappedFrameTexture->createEmptyTexture(logicalDevice, physicalDevice, computeCommandPool);
+
+	//Scene depth, drawn at the cloud resolution so that every cloud pixel reads exactly the depth of its own ray
+	VkFormat depthFormat = FormatUtils::FindDepthFormat(physicalDevice);
+	Image::createImage(device, cloud_width, cloud_height, depthFormat, VK_IMAGE_TILING_OPTIMAL, 
+		VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, sceneDepthImage, sceneDepthImageMemory);
+	Image::createImageView(device, sceneDepthImageView, sceneDepthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
+	Image::createSampler(device, sceneDepthSampler, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE, 1.0f);
+
+	VkFramebufferCreateInfo framebufferInfo = {};
+	framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+	framebufferInfo.renderPass = sceneDepthRenderPass;
+	framebufferInfo.attachmentCount = 1;
+	framebufferInfo.pAttachments = &sceneDepthImageView;
+	framebufferInfo.width = cloud_width;
+	framebufferInfo.height = cloud_height;
+	framebufferInfo.layers = 1;
+
+	if (vkCreateFramebuffer(logicalDevice, &framebufferInfo, nullptr, &sceneDepthFrameBuffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create scene depth framebuffer");
+	}
+
+	//Cleared (to "no geometry") and put in its sampled layout right away by an empty pre-pass: 
+	//the compute passes can run before the first frame does, the workgroup autotuning dispatches them
+	VkClearValue clearValue = {};
+	clearValue.depthStencil = { 1.0f, 0 };
+
+	VkRenderPassBeginInfo renderPassInfo = {};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassInfo.renderPass = sceneDepthRenderPass;
+	renderPassInfo.framebuffer = sceneDepthFrameBuffer;
+	renderPassInfo.renderArea.offset = { 0, 0 };
+	renderPassInfo.renderArea.extent = { cloud_width, cloud_height };
+	renderPassInfo.clearValueCount = 1;
+	renderPassInfo.pClearValues = &clearValue;
+
+	VkCommandBuffer clearCommandBuffer = beginSingleTimeCommands(device, graphicsCommandPool);
+	vkCmdBeginRenderPass(clearCommandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+	vkCmdEndRenderPass(clearCommandBuffer);
+	endSingleTimeCommands(device, graphicsCommandPool, device->GetQueue(QueueFlags::Graphics), clearCommandBuffer);
+
+	ReportIntermediateTargetTraffic();
 }
 
 //--------------------------------------------------------
@@ -22,14 +22,89 @@
 #include "Texture3D.h"
 #include "Sky.h"
 #include "FormatUtils.h"
+#include "WorkgroupTuner.h"
+#include "GpuProfiler.h"
+#include "QualityGovernor.h"
+#include "FrameGraph.h"
+#include <chrono>
+
+// Frames in a row the camera, sun and sky and the animation time have to stay unchanged before the renderer idles.
+// The first 16 ray march every pixel once with the final view, the next 16 let the reprojection and TXAA history settle
+#define CONVERGENCE_STATIC_FRAMES 32
+// With auto exposure the view also waits this many more frames for the exposure to settle (exposureAverage.comp moves
+// it 5% of the way per frame, so it is within 4% of its target by then)
+#define AUTO_EXPOSURE_SETTLE_FRAMES 64
+
+// Range of the render scale: the fraction of the window resolution the clouds, god rays and tone mapping run at
+#define MIN_RENDER_SCALE 0.5f
+#define MAX_RENDER_SCALE 1.0f
+
+// Radial blur passes of the god rays (godRaysBlur.comp), has to match the shader. Odd, so that the last pass
+// writes godRaysTexture2 (the passes ping pong between the two god rays textures, starting from godRaysTexture1)
+#define GOD_RAYS_BLUR_PASSES 3
+static_assert(GOD_RAYS_BLUR_PASSES % 2 == 1, "The tone mapping pass reads the god rays from godRaysTexture2");
+// The god rays are blurred at 1/GOD_RAYS_RESOLUTION_DIVISOR of the render resolution
+#define GOD_RAYS_RESOLUTION_DIVISOR 4
+
+// Window pixels along each side of a workgroup of the fused post process kernel, has to match TILE_SIZE in postProcess_Fused.comp.
+// Fixed rather than tuned: the kernel's shared memory tile is sized for it
+#define FUSED_POST_PROCESS_TILE_SIZE 16
+
+// Bins of the luminance histogram of the auto exposure, has to match HISTOGRAM_BINS in luminanceHistogram.comp and exposureAverage.comp
+#define LUMINANCE_HISTOGRAM_BINS 256
+// Exposure of the tone mapping without auto exposure, and the exposure auto exposure starts adapting from
+#define FIXED_EXPOSURE 2.5f
+// Render resolution pixels each invocation of luminanceHistogram.comp counts along x and y, and its workgroup size
+#define LUMINANCE_HISTOGRAM_PIXELS_PER_INVOCATION 2
+#define LUMINANCE_HISTOGRAM_WORKGROUP_SIZE 16
+
+// Passes timed by the GpuProfiler, in the order they run in a frame
+enum RendererPass {
+	SceneDepthPass,		// depth of the scene geometry, drawn on the graphics queue ahead of the compute work
+	AerialPerspectivePass,
+	HorizonBandPass,
+	ReprojectionPass,
+	RayMarchPass,
+	MotionBlurPass,
+	CloudUpsamplePass,
+	GodRaysPass,		// downsampling and all the blur passes
+	AutoExposurePass,	// luminance histogram and exposure
+	PostProcessPass,	// everything the graphics command buffer draws
+	RendererPassCount,
+};
+
+// Storage buffer of the auto exposure, same layout as ExposureBuffer in the shaders. Only ever written on the GPU
+// after this initial state is uploaded, the tone mapping reads the exposure straight from it
+struct ExposureData
+{
+	float exposure = FIXED_EXPOSURE;
+	float averageLuminance = 1.0f;	// of the last frame, what the exposure adapts to
+	uint32_t histogram[LUMINANCE_HISTOGRAM_BINS] = {};
+};
 
-static constexpr unsigned int WORKGROUP_SIZE = 32;
+// Startup options for the renderer, mostly set from the command line (see main.cpp)
+struct RendererOptions
+{
+	bool autotuneWorkgroups = false;			// time all supported compute workgroup sizes at startup and cache the fastest
+	unsigned int cloudResolutionDivisor = 1;	// 1, 2 or 4: clouds are ray marched and reprojected at 1/divisor of the render resolution
+	float renderScale = 1.0f;					// MIN_RENDER_SCALE to MAX_RENDER_SCALE: render resolution relative to the window, TXAA upscales to the window
+	bool allowFloat16RayMarch = true;			// use the float16 ray marcher (cloudRayMarchFP16.comp) if the GPU supports it
+	bool motionBlur = false;					// blur the clouds along their screen space motion (motionBlur.comp)
+	bool godRays = false;						// light shafts through the clouds (godRaysDownsample.comp, godRaysBlur.comp)
+	bool fusedPostProcess = true;				// tone mapping and TXAA in one compute kernel (postProcess_Fused.comp) instead of two draws
+	bool autoExposure = true;					// adapt the tone mapping exposure to the frame's brightness (luminanceHistogram.comp, exposureAverage.comp)
+	bool idleWhenConverged = true;				// stop submitting work once a static view has converged (see Renderer::IsConverged)
+	float frameBudgetMilliseconds = 0.0f;		// > 0: the QualityGovernor adjusts the cloud quality to hold this GPU frame time
+	float horizonBandElevation = 6.0f;			// > 0: clouds up to this many degrees above the horizon come from the horizon band (cloudHorizonBand.comp)
+	bool narrowFormats = true;					// intermediate targets in the narrowest format the GPU can write (see Renderer::SelectIntermediateFormats)
+};
 
 class Renderer 
 {
 public:
 	Renderer() = delete; // To enforce the creation of a the type of renderer we want without leaving the vulkan device, vulkan swapchain, etc as assumptions or nullptrs
-	Renderer(VulkanDevice* device, VkPhysicalDevice physicalDevice, VulkanSwapChain* swapChain, Scene* scene, Sky* sky, Camera* camera, Camera* cameraOld, uint32_t width, uint32_t height);
+	Renderer(VulkanDevice* device, VkPhysicalDevice physicalDevice, VulkanSwapChain* swapChain, Scene* scene, Sky* sky, Camera* camera, Camera* cameraOld, uint32_t width, uint32_t height,
+			 const RendererOptions& options = RendererOptions());
 	~Renderer();
 
 	void DestroyOnWindowResize();
@@ -39,7 +114,26 @@ public:
 
 	void Frame();
 
+	// True once the view has been static for CONVERGENCE_STATIC_FRAMES frames (plus AUTO_EXPOSURE_SETTLE_FRAMES with auto exposure):
+	// Frame() then submits nothing and the last presented image stays on screen until the camera, the sun and sky or the animation time change
+	bool IsConverged() const;
+
+	// The render resolution can be changed at any time; only the render resolution targets are reallocated,
+	// the swapchain, the pipelines and the TXAA history at the window resolution are kept
+	void SetRenderScale(float scale);
+	float GetRenderScale() const;
+
+	// Starts over as if the current view was the first one: the reprojected clouds, the ray-start hints, the light history,
+	// the TXAA history, the exposure and the horizon band are cleared, so the frames that follow don't depend on earlier ones
+	void ResetHistory();
+	// The window resolution image of the last frame (the TXAA history it wrote and copied to the swapchain), RGBA8 top row first.
+	// Waits for the GPU
+	void ReadFinalImage(std::vector<uint8_t>& pixels, uint32_t& width, uint32_t& height);
+	unsigned int GetConvergenceFrames() const;
+	GpuProfiler* GetGpuProfiler() const;
+
 	void CreateRenderPass();
+	void CreateSceneDepthRenderPass();
 
 	// Descriptors
 	void CreateDescriptorPool();
@@ -51,30 +145,60 @@ public:
 	void WriteToAndUpdateGraphicsDescriptorSets();
 	void WriteToAndUpdatePingPongDescriptorSets();
 	void WriteToAndUpdateRemainingDescriptorSets();
-	void WriteToAndUpdateGodRaysSet();
+	void WriteToAndUpdateGodRaysSets();
 	void WriteToAndUpdateToneMapSet();
 	void WriteToAndUpdateTXAASet();
+	void WriteToAndUpdateCloudUpsampleSets();
+	void WriteToAndUpdateMotionBlurSet();
+	void WriteToAndUpdateHorizonBandSet();
+	void WriteToAndUpdateAtmosphereSets();
 
 	// Pipelines
 	void CreateAllPipeLines(VkRenderPass renderPass, unsigned int subpass);
 	void CreateGraphicsPipeline(VkRenderPass renderPass, unsigned int subpass);
-	void CreateComputePipeline(VkPipelineLayout& _computePipelineLayout, VkPipeline& _computePipeline, const std::string &filename);
+	void CreateComputePipeline(VkPipelineLayout& _computePipelineLayout, VkPipeline& _computePipeline, const std::string &filename, 
+								const WorkgroupSize& workgroupSize, uint32_t variant = 0);
 	void CreatePostProcessPipeLines(VkRenderPass renderPass);
+	void CreateSceneDepthPipeline();
+
+	// Compute Workgroup Sizes
+	void SelectComputeWorkgroupSizes();
+	void AutotuneComputeWorkgroupSizes();
 
 	// Frame Resources
 	void CreateFrameResources();
 	void DestroyFrameResources();
 	void RecreateFrameResources();
 	void CreateFrameBuffers(VkRenderPass renderPass);
+	void DestroyCommandBuffers();
 
 	// Command Buffers
 	void RecordAllCommandBuffers();
-	void RecordComputeCommandBuffer(VkCommandBuffer &computeCmdBuffer, VkDescriptorSet& pingPongFrameSet);
-	void RecordGraphicsCommandBuffer(std::vector<VkCommandBuffer> &graphicsCmdBuffer, VkImage &Image_for_barrier, 
-									VkDescriptorSet& pingPongFrameSet, VkDescriptorSet& toneMapSet, VkDescriptorSet& TXAASet);
+	void BuildComputeFrameGraph();
+	void RecordComputeCommandBuffer(VkCommandBuffer &computeCmdBuffer, uint32_t variant, uint32_t querySet);
+	void RecordAutoExposureDispatches(VkCommandBuffer &computeCmdBuffer, VkDescriptorSet& toneMapSet);
+	void RecordReprojectionDispatch(VkCommandBuffer &computeCmdBuffer, VkDescriptorSet& pingPongFrameSet, const WorkgroupSize& workgroupSize);
+	void RecordCloudRayMarchDispatch(VkCommandBuffer &computeCmdBuffer, VkDescriptorSet& pingPongFrameSet, const WorkgroupSize& workgroupSize);
+	void RecordCloudUpsampleDispatch(VkCommandBuffer &computeCmdBuffer, VkDescriptorSet& cloudUpsampleSet, const WorkgroupSize& workgroupSize);
+	void RecordMotionBlurDispatch(VkCommandBuffer &computeCmdBuffer, VkDescriptorSet& pingPongFrameSet, const WorkgroupSize& workgroupSize);
+	void RecordGodRaysDispatches(VkCommandBuffer &computeCmdBuffer);
+	void RecordHorizonBandDispatch(VkCommandBuffer &computeCmdBuffer, VkDescriptorSet& pingPongFrameSet, const WorkgroupSize& workgroupSize);
+	void RecordSkyViewLUTCommandBuffer();
+	void RecordSceneDepthCommandBuffer(uint32_t querySet);
+	void RecordAerialPerspectiveDispatch(VkCommandBuffer &computeCmdBuffer);
+
+	// Atmosphere LUTs that never change (transmittance and multiple scattering), built once at startup
+	void BuildAtmosphereLUTs();
+	void RecordFusedPostProcessDispatch(VkCommandBuffer &graphicsCmdBuffer, VkDescriptorSet& toneMapSet, VkDescriptorSet& TXAASet);
+	void RecordGraphicsCommandBuffer(std::vector<VkCommandBuffer> &graphicsCmdBuffer, VkDescriptorSet& pingPongFrameSet, 
+									VkDescriptorSet& toneMapSet, VkDescriptorSet& TXAASet, uint32_t firstQuerySet);
 
 	// Resource Creation and Recreation
 	void CreateResources();
+	void CreateRenderScaleResources();		// everything at the render (or cloud) resolution
+	void SelectIntermediateFormats(bool narrow);
+	void ReportIntermediateTargetTraffic() const;
+	void DestroyRenderScaleResources();
 
 	//Create and save 3D textures
 	void Save3DTextureAsImage();
@@ -95,11 +219,60 @@ private:
 	uint32_t window_width;
 	uint32_t window_height;
 
+	// Resolution everything up to the tone mapping runs at, renderScale times the window resolution. 
+	// The TXAA pass reconstructs the window resolution image from it
+	float renderScale;
+	uint32_t render_width;
+	uint32_t render_height;
+
+	// Resolution the clouds are ray marched and reprojected at; the render resolution divided by cloudResolutionDivisor
+	unsigned int cloudResolutionDivisor;
+	uint32_t cloud_width;
+	uint32_t cloud_height;
+
+	// Optional motion blur pass after the ray march; everything downstream reads its result instead of the ping ponged one
+	bool motionBlurEnabled;
+
+	// Optional god rays passes after the ray march; the tone mapping pass adds their result either way (black when off)
+	bool godRaysEnabled;
+	uint32_t godRays_width;
+	uint32_t godRays_height;
+
+	// Tone mapping and TXAA as one compute dispatch in the graphics command buffers; the render pass then only copies the
+	// TXAA history to the swapchain image. Off --> the separate tone mapping and TXAA draws (the reference path)
+	bool fusedPostProcessEnabled;
+
+	// Auto exposure: the compute command buffers build a luminance histogram of the frame and adapt the exposure to it,
+	// all on the GPU. Off --> the exposure stays at FIXED_EXPOSURE. Lives as long as the renderer, the exposure carries over
+	bool autoExposureEnabled;
+	VkBuffer exposureBuffer;
+	VkDeviceMemory exposureBufferMemory;
+
+	// Static view convergence, counted from the dirty flags of the camera, the sky and the scene time
+	bool idleWhenConverged;
+	unsigned int staticFrameCount = 0;
+	unsigned int convergenceFrames;	// static frames until the view counts as converged
+	bool historyReset = false;		// set by ResetHistory, the next frame restarts the horizon band
+
+	// Per pass GPU timings; every command buffer owns a query set (see RecordAllCommandBuffers)
+	GpuProfiler* gpuProfiler = nullptr;
+	// The passes of the compute command buffers, what they read and write; decides which passes run and where the barriers go
+	FrameGraph computeFrameGraph;
+	// Only exists with a frame budget. Falls back to CPU frame times when the GPU can't write timestamps
+	QualityGovernor* qualityGovernor = nullptr;
+	std::chrono::steady_clock::time_point lastFrameTime;
+
 	// We create a vector of command buffers because we want a command buffer for each frame of the swap chain
 	std::vector<VkCommandBuffer> graphicsCommandBuffer1;
 	VkCommandBuffer computeCommandBuffer1;
 	std::vector<VkCommandBuffer> graphicsCommandBuffer2;
 	VkCommandBuffer computeCommandBuffer2;
+	VkCommandBuffer skyViewLUTCommandBuffer; // only submitted (ahead of the frame's compute work) when the sky-view LUT is out of date
+	VkCommandBuffer sceneDepthCommandBuffer; // submitted to the graphics queue ahead of the compute work every frame
+	VkSemaphore sceneDepthSemaphore; // the compute submission waits on it before the cloud passes read the scene depth
+	VkSemaphore cloudComputeSemaphore; // the next scene depth submission waits on it before clearing the depth the cloud passes read
+	bool cloudComputeSemaphorePending = false; // false until the first compute submission signalled it
+	VkSemaphore cloudResultSemaphore; // the graphics submission of a frame waits on it before post processing reads the compute passes' outputs
 	VkCommandPool graphicsCommandPool;
 	VkCommandPool computeCommandPool;
 
@@ -110,13 +283,62 @@ private:
 	VkPipeline cloudComputePipeline;
 	VkPipeline reprojectionPipeline;
 
+	// Ray march shader variant: "cloudRayMarch" or, with float16 support, "cloudRayMarchFP16". Also the name its workgroup size is tuned under
+	std::string cloudRayMarchShaderName;
+
+	// Workgroup sizes the compute pipelines are specialized with; either tuned for this device or a safe default
+	WorkgroupTuner* workgroupTuner;
+	bool autotuneWorkgroups;
+	WorkgroupSize cloudComputeWorkgroupSize;
+	WorkgroupSize reprojectionWorkgroupSize;
+	WorkgroupSize cloudUpsampleWorkgroupSize;
+	WorkgroupSize motionBlurWorkgroupSize;
+	WorkgroupSize horizonBandWorkgroupSize;
+	WorkgroupSize skyViewLUTWorkgroupSize;
+	WorkgroupSize atmosphereLUTWorkgroupSize;
+	WorkgroupSize aerialPerspectiveWorkgroupSize;
+	WorkgroupSize godRaysWorkgroupSize;
+
+	// Upsamples reduced resolution clouds to the window resolution
+	VkPipelineLayout cloudUpsamplePipelineLayout;
+	VkPipeline cloudUpsamplePipeline;
+
+	// Blurs the clouds along each pixel's velocity
+	VkPipelineLayout motionBlurPipelineLayout;
+	VkPipeline motionBlurPipeline;
+
+	// God rays: shrink the occlusion mask of the ray march, then blur it towards the sun in a few passes.
+	// One pipeline per blur pass, they only differ in the pass index they are specialized with
+	VkPipelineLayout godRaysPipelineLayout;
+	VkPipeline godRaysDownsamplePipeline;
+	VkPipeline godRaysBlurPipelines[GOD_RAYS_BLUR_PASSES];
+
+	// Ray marches a slice of the horizon band each frame; same pipeline layout as the ray march
+	VkPipeline horizonBandPipeline;
+
+	// Fill the atmosphere LUTs owned by the Sky
+	VkPipelineLayout transmittanceLUTPipelineLayout;
+	VkPipeline transmittanceLUTPipeline;
+	VkPipelineLayout multipleScatteringLUTPipelineLayout;
+	VkPipeline multipleScatteringLUTPipeline;
+	VkPipelineLayout skyViewLUTPipelineLayout;
+	VkPipeline skyViewLUTPipeline;
+	VkPipelineLayout aerialPerspectivePipelineLayout;
+	VkPipeline aerialPerspectivePipeline;
+
 	VkPipelineCache postProcessPipeLineCache;
-	VkPipelineLayout postProcess_GodRays_PipelineLayout;
 	VkPipelineLayout postProcess_ToneMap_PipelineLayout;
 	VkPipelineLayout postProcess_TXAA_PipelineLayout;
-	VkPipeline postProcess_GodRays_PipeLine;
 	VkPipeline postProcess_ToneMap_PipeLine;
 	VkPipeline postProcess_TXAA_PipeLine;
+	VkPipelineLayout postProcess_Fused_PipelineLayout;
+	VkPipelineLayout postProcess_Present_PipelineLayout;
+	VkPipeline postProcess_Fused_PipeLine;
+	VkPipeline postProcess_Present_PipeLine;
+
+	VkPipelineLayout autoExposurePipelineLayout;
+	VkPipeline luminanceHistogramPipeline;
+	VkPipeline exposureAveragePipeline;
 
 	VkRenderPass renderPass;
 
@@ -126,12 +348,48 @@ private:
 	VkDeviceMemory depthImageMemory;
 	VkImageView depthImageView;
 
+	// Depth of the scene geometry at the cloud resolution. The ray march ends its rays there and skips pixels whose
+	// geometry is in front of the cloud layer; the reprojection pass drops the clouds it would carry over into them
+	VkRenderPass sceneDepthRenderPass;
+	VkPipeline sceneDepthPipeline;	// same pipeline layout as the geometry pipeline, vertex stage only
+	VkFramebuffer sceneDepthFrameBuffer;
+	VkImage sceneDepthImage;
+	VkDeviceMemory sceneDepthImageMemory;
+	VkImageView sceneDepthImageView;
+	VkSampler sceneDepthSampler;
+
+	// TXAA history at the window resolution, ping ponged
 	Texture2D* currentFrameTexture;
 	Texture2D* previousFrameTexture;
 
+	// Tone mapped image at the render resolution, the input of the TXAA pass
+	Texture2D* toneMappedFrameTexture;
+
 	Texture2D* currentCloudsResultTexture;
 	Texture2D* previousCloudsResultTexture;
-	Texture2D* godRaysCreationDataTexture;
+	Texture2D* godRaysCreationDataTexture;	// occlusion mask of the god rays, written by the ray march
+
+	// The god rays passes ping pong between these two, at 1/GOD_RAYS_RESOLUTION_DIVISOR of the render resolution
+	Texture2D* godRaysTexture1;
+	Texture2D* godRaysTexture2;
+
+	// Ray-start hints (first hit and saturation distance of each pixel's last ray march), ping ponged like the cloud results
+	Texture2D* currentCloudDistanceTexture;
+	Texture2D* previousCloudDistanceTexture;
+	Texture2D* currentLightHistoryTexture;		// light energy of the ray march averaged over the revisits of a pixel
+	Texture2D* previousLightHistoryTexture;
+
+	// Render resolution clouds, only used (and allocated) when the clouds are rendered at a reduced resolution
+	Texture2D* cloudsUpsampledTexture = nullptr;
+
+	// Motion blurred clouds at the cloud resolution, only used (and allocated) with motion blur on
+	Texture2D* cloudsMotionBlurredTexture = nullptr;
+
+	// Formats of the targets that are only written by one compute pass and sampled afterwards (see SelectIntermediateFormats)
+	VkFormat occlusionMaskFormat;
+	VkFormat godRaysBlurFormat;		// godRaysTexture1, only ever holds a single value
+	VkFormat godRaysFormat;			// godRaysTexture2, ends up with the rgb god rays
+	VkFormat cloudsUpsampledFormat;
 	
 	VkDescriptorPool descriptorPool;
 
@@ -145,6 +403,8 @@ private:
 	VkDescriptorSet sunAndSkySet;
 	VkDescriptorSetLayout keyPressQuerySetLayout;
 	VkDescriptorSet keyPressQuerySet;
+	VkDescriptorSetLayout cloudQualitySetLayout;
+	VkDescriptorSet cloudQualitySet;
 
 	//Descriptor Set Layouts for each pipeline
 	VkDescriptorSetLayout cloudComputeSetLayout;	// Compute shader binding layout
@@ -152,17 +412,44 @@ private:
 
 	// Descriptor Sets for each pipeline
 	VkDescriptorSet cloudComputeSet;	// Compute shader descriptor Set
-	VkDescriptorSet graphicsSet; // Graphics ( Regular Geometric Meshes ) specific descriptor sets
+	std::vector<VkDescriptorSet> graphicsSets; // Graphics ( Regular Geometric Meshes ) specific descriptor sets, one per model of the scene
+	VkDescriptorPool modelDescriptorPool; // holds the graphics sets; created once the scene's models exist, so it is sized for them
 
 	// Descriptor Sets for pingPonged Cloud Results
 	VkDescriptorSetLayout pingPongCloudResultSetLayout;
 	VkDescriptorSet pingPongCloudResultSet1;
 	VkDescriptorSet pingPongCloudResultSet2;
 
+	// Descriptor Sets for upsampling the pingPonged Cloud Results
+	VkDescriptorSetLayout cloudUpsampleSetLayout;
+	VkDescriptorSet cloudUpsampleSet1;
+	VkDescriptorSet cloudUpsampleSet2;
+
+	// Descriptor Set the motion blur pass writes through; the same for both ping pong frames
+	VkDescriptorSetLayout motionBlurSetLayout;
+	VkDescriptorSet motionBlurSet;
+
+	// Descriptor Set of the horizon band: written by the horizon band pass, sampled by the ray march
+	VkDescriptorSetLayout horizonBandSetLayout;
+	VkDescriptorSet horizonBandSet;
+
+	// Descriptor Sets the atmosphere LUT passes write through; all of them are a single storage image
+	VkDescriptorSetLayout lutOutputSetLayout;
+	VkDescriptorSet transmittanceLUTSet;
+	VkDescriptorSet multipleScatteringLUTSet;
+	VkDescriptorSet skyViewLUTSet;
+	VkDescriptorSet aerialPerspectiveSet;
+
+	// Transmittance and multiple scattering LUTs, sampled by every pass that integrates the atmosphere
+	VkDescriptorSetLayout atmosphereSetLayout;
+	VkDescriptorSet atmosphereSet;
+
 	//Descriptors used in Post Process pipelines
-	//God Rays
+	//God Rays: every pass samples one image and writes another
 	VkDescriptorSetLayout godRaysSetLayout;
-	VkDescriptorSet godRaysSet;
+	VkDescriptorSet godRaysDownsampleSet;	// occlusion mask --> godRaysTexture1
+	VkDescriptorSet godRaysBlurSet1;		// godRaysTexture1 --> godRaysTexture2
+	VkDescriptorSet godRaysBlurSet2;		// godRaysTexture2 --> godRaysTexture1
 
 	//Tone Map
 	VkDescriptorSetLayout toneMapSetLayout;
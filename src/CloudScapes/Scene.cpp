@@ -68,11 +68,24 @@ void Scene::UpdateTime()
 	duration<float> nextDeltaTime = duration_cast<duration<float>>(currentTime - startTime);
 	startTime = currentTime;
 
-	time._time.x = nextDeltaTime.count();
-	time._time.y += time._time.x;
+	// frameCount keeps going while paused: the ray march still has to visit every pixel of the 4x4 blocks
+	if (!animationPaused)
+	{
+		time._time.x = nextDeltaTime.count();
+		time._time.y += time._time.x;
+		timeDirty = true;
+	}
+	else
+	{
+		time._time.x = 0.0f;
+	}
 
 	time.frameCount += 1;
 	time.frameCount = time.frameCount % 16;
+	if (time.frameCount == 0)
+	{
+		time.frameCycle += 1;
+	}
 
 	//count++;
 	//if (count % 300 == 0)
@@ -114,6 +127,7 @@ void Scene::InitializeTime()
 	time.haltonSeq4.w = HaltonSequenceAt(16, 3);
 
 	time.frameCount = 0;
+	time.frameCycle = 0;
 
 	memcpy(time_mappedData, &time, sizeof(Time));
 }
@@ -121,6 +135,38 @@ glm::vec2 Scene::GetTime() const
 {
 	return time._time;
 }
+void Scene::SetFixedTime(float seconds)
+{
+	animationPaused = true;
+	startTime = high_resolution_clock::now();
+
+	time._time = glm::vec2(0.0f, seconds);
+	time.frameCount = 0;
+	time.frameCycle = 0;
+	timeDirty = true;
+
+	memcpy(time_mappedData, &time, sizeof(Time));
+}
+void Scene::SetAnimationPaused(bool paused)
+{
+	if (paused != animationPaused)
+	{
+		animationPaused = paused;
+		timeDirty = true;
+	}
+}
+bool Scene::IsAnimationPaused() const
+{
+	return animationPaused;
+}
+bool Scene::IsTimeDirty() const
+{
+	return timeDirty;
+}
+void Scene::ClearTimeDirty()
+{
+	timeDirty = false;
+}
 //Reference: https://en.wikipedia.org/wiki/Halton_sequence
 float Scene::HaltonSequenceAt(int index, int base)
 {
@@ -18,6 +18,7 @@ struct Time
 	glm::vec4 haltonSeq4;
 	glm::vec2 _time = glm::vec2(0.0f, 0.0f); //stores delta time and total time packed as a vec2 so vulkan offsetting doesnt become an issue later
 	int frameCount = 1;
+	int frameCycle = 0; //number of times frameCount wrapped around, picks the blue noise layer of the ray march
 };
 
 struct KeyPressQuery
@@ -44,6 +45,11 @@ private:
 
 	high_resolution_clock::time_point startTime = high_resolution_clock::now();
 
+	// With the animation paused the total time (which drives the wind and the cloud noise) stops advancing.
+	// timeDirty is set whenever it does advance, the renderer uses it to notice a static view
+	bool animationPaused = false;
+	bool timeDirty = true;
+
 public:
 	Scene() = delete;
 	Scene(VulkanDevice* device);
@@ -57,7 +63,15 @@ public:
 	void UpdateTime();
 	void InitializeTime();
 	glm::vec2 GetTime() const;
-	float HaltonSequenceAt(int index, int base);
+	static float HaltonSequenceAt(int index, int base);
+
+	// Pauses the animation at 'seconds' and restarts the frame counters (the halton jitter and the 4x4 ray march pattern),
+	// so that the frames that follow are the same on every run
+	void SetFixedTime(float seconds);
+	void SetAnimationPaused(bool paused);
+	bool IsAnimationPaused() const;
+	bool IsTimeDirty() const;
+	void ClearTimeDirty();
 
 	int count = 0;
 
@@ -1,12 +1,41 @@
 #include "Sky.h"
+#include <stdexcept>
 
 #define PI_BY_2 1.57f
 
-Sky::Sky(VulkanDevice* device, VkDevice logicalDevice) : device(device), logicalDevice(logicalDevice)
+#define SKY_VIEW_LUT_WIDTH 256
+#define SKY_VIEW_LUT_HEIGHT 128
+#define TRANSMITTANCE_LUT_WIDTH 256
+#define TRANSMITTANCE_LUT_HEIGHT 64
+#define MULTIPLE_SCATTERING_LUT_SIZE 32
+#define AERIAL_PERSPECTIVE_SIZE 32
+
+#define HORIZON_BAND_WIDTH 4096			// columns around the full circle of azimuth
+#define HORIZON_BAND_HEIGHT 128
+#define HORIZON_BAND_REFRESH_FRAMES 64		// every column is ray marched again after this many frames
+#define HORIZON_BAND_MIN_ELEVATION 0.06f	// the clouds fade in above this (cloudFadeOutPoint in cloudRayMarch.glsl)
+// The band is ray marched from one point. The clouds it shows are 50 km and more away, so they barely move while the camera
+// stays within this distance (in m) of that point; beyond it the band is ray marched again from the new position
+#define HORIZON_BAND_MAX_CAMERA_OFFSET 500.0f
+
+#define DEFAULT_SUN_ELEVATION 0.26f // ~15 degrees, late afternoon
+#define SUN_ILLUMINANCE 20.0f
+
+Sky::Sky(VulkanDevice* device, VkDevice logicalDevice) : device(device), logicalDevice(logicalDevice),
+	sunElevation(DEFAULT_SUN_ELEVATION), sunAzimuth(0.0f)
 {
 	BufferUtils::CreateBuffer(device, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, sizeof(SunAndSky), VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, sunAndSkyBuffer, sunAndSkyBufferMemory);
 	vkMapMemory(device->GetVkDevice(), sunAndSkyBufferMemory, 0, sizeof(SunAndSky), 0, &sunAndSky_mappedData);
 	memcpy(sunAndSky_mappedData, &sunAndSky, sizeof(SunAndSky));
+
+	BufferUtils::CreateBuffer(device, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, sizeof(CloudQuality), VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, cloudQualityBuffer, cloudQualityBufferMemory);
+	vkMapMemory(device->GetVkDevice(), cloudQualityBufferMemory, 0, sizeof(CloudQuality), 0, &cloudQuality_mappedData);
+	memcpy(cloudQuality_mappedData, &cloudQuality, sizeof(CloudQuality));
+
+	BufferUtils::CreateBuffer(device, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, sizeof(HorizonBand), VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, horizonBandBuffer, horizonBandBufferMemory);
+	vkMapMemory(device->GetVkDevice(), horizonBandBufferMemory, 0, sizeof(HorizonBand), 0, &horizonBand_mappedData);
+	memcpy(horizonBand_mappedData, &horizonBand, sizeof(HorizonBand));
+	sunAndSkyDirty = true;
 }
 
 Sky::~Sky()
@@ -15,10 +44,25 @@ Sky::~Sky()
 	delete cloudDetailsTexture;
 	delete cloudMotionTexture;
 	delete weatherMapTexture;
+	delete skyViewLUTTexture;
+	delete transmittanceLUTTexture;
+	delete multipleScatteringLUTTexture;
+	delete aerialPerspectiveTexture;
+	delete blueNoiseTexture;
+	delete horizonBandTexture;
+	delete horizonBandDistanceTexture;
 
 	vkUnmapMemory(device->GetVkDevice(), sunAndSkyBufferMemory);
 	vkDestroyBuffer(device->GetVkDevice(), sunAndSkyBuffer, nullptr);
 	vkFreeMemory(device->GetVkDevice(), sunAndSkyBufferMemory, nullptr);
+
+	vkUnmapMemory(device->GetVkDevice(), cloudQualityBufferMemory);
+	vkDestroyBuffer(device->GetVkDevice(), cloudQualityBuffer, nullptr);
+	vkFreeMemory(device->GetVkDevice(), cloudQualityBufferMemory, nullptr);
+
+	vkUnmapMemory(device->GetVkDevice(), horizonBandBufferMemory);
+	vkDestroyBuffer(device->GetVkDevice(), horizonBandBuffer, nullptr);
+	vkFreeMemory(device->GetVkDevice(), horizonBandBufferMemory, nullptr);
 }
 
 //Create the textures that will be passed to the compute shader to create clouds
@@ -55,6 +99,41 @@ void Sky::CreateCloudResources(VkCommandPool computeCommandPool)
 	weatherMapTexture->createTextureFromFile(logicalDevice, computeCommandPool, weatherMapTexture_path, 4,
 		VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
 		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_SAMPLER_ADDRESS_MODE_REPEAT, 16.0f);
+
+	// Blue Noise 2D Texture Array, regenerate with the BlueNoiseGenerator tool
+	const std::string BlueNoise_folder_path = "../../src/CloudScapes/textures/BlueNoise/";
+	const std::string BlueNoise_textureBaseName = "BlueNoise";
+	const std::string BlueNoise_fileExtension = ".png";
+	blueNoiseTexture = new Texture2DArray(device, 64, 64, 16, VK_FORMAT_R8G8B8A8_UNORM);
+	blueNoiseTexture->createTextureArrayFromMany2DTextures(computeCommandPool,
+		BlueNoise_folder_path, BlueNoise_textureBaseName, BlueNoise_fileExtension);
+
+	// Horizon band, filled by the cloudHorizonBand compute pass. Repeat so that the azimuth wraps around
+	VkPhysicalDevice physicalDevice = device->GetInstance()->GetPhysicalDevice();
+	horizonBandTexture = new Texture2D(device, HORIZON_BAND_WIDTH, HORIZON_BAND_HEIGHT, VK_FORMAT_R16G16B16A16_SFLOAT);
+	horizonBandTexture->createEmptyTexture(logicalDevice, physicalDevice, computeCommandPool, VK_SAMPLER_ADDRESS_MODE_REPEAT);
+	horizonBandDistanceTexture = new Texture2D(device, HORIZON_BAND_WIDTH, HORIZON_BAND_HEIGHT, VK_FORMAT_R16G16B16A16_SFLOAT);
+	horizonBandDistanceTexture->createEmptyTexture(logicalDevice, physicalDevice, computeCommandPool, VK_SAMPLER_ADDRESS_MODE_REPEAT);
+}
+
+//Create the LUTs of the atmosphere; all of them are filled on the GPU by the atmosphere compute passes (see Renderer)
+void Sky::CreateAtmosphereResources(VkCommandPool computeCommandPool)
+{
+	VkPhysicalDevice physicalDevice = device->GetInstance()->GetPhysicalDevice();
+
+	transmittanceLUTTexture = new Texture2D(device, TRANSMITTANCE_LUT_WIDTH, TRANSMITTANCE_LUT_HEIGHT, VK_FORMAT_R16G16B16A16_SFLOAT);
+	transmittanceLUTTexture->createEmptyTexture(logicalDevice, physicalDevice, computeCommandPool, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE);
+
+	multipleScatteringLUTTexture = new Texture2D(device, MULTIPLE_SCATTERING_LUT_SIZE, MULTIPLE_SCATTERING_LUT_SIZE, VK_FORMAT_R16G16B16A16_SFLOAT);
+	multipleScatteringLUTTexture->createEmptyTexture(logicalDevice, physicalDevice, computeCommandPool, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE);
+
+	// Repeat so that the longitude wraps around
+	skyViewLUTTexture = new Texture2D(device, SKY_VIEW_LUT_WIDTH, SKY_VIEW_LUT_HEIGHT, VK_FORMAT_R16G16B16A16_SFLOAT);
+	skyViewLUTTexture->createEmptyTexture(logicalDevice, physicalDevice, computeCommandPool, VK_SAMPLER_ADDRESS_MODE_REPEAT);
+	skyViewLUTDirty = true;
+
+	aerialPerspectiveTexture = new Texture3D(device, AERIAL_PERSPECTIVE_SIZE, AERIAL_PERSPECTIVE_SIZE, AERIAL_PERSPECTIVE_SIZE, VK_FORMAT_R16G16B16A16_SFLOAT);
+	aerialPerspectiveTexture->createEmpty3DTexture(computeCommandPool, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE);
 }
 
 VkBuffer Sky::GetSunAndSkyBuffer() const
@@ -66,9 +145,122 @@ void Sky::UpdateSunAndSky()
 	//float angle = time.frameCount*0.000001f;
 	//rotMat = glm::rotate(rotMat, angle, rotationAxis);
 
-	sunAndSky.sunLocation = rotMat * glm::vec4(0.0f, 1.0f, 0.0f, 0.0f);
-	sunAndSky.sunDirection = glm::vec4(1.0f, 1.0f, 1.0f, 0.0f);
-	sunAndSky.lightColor = glm::vec4(1.0f, 1.0f, 0.57f, 1.0f);
-	sunAndSky.sunIntensity = 5.0;
-	memcpy(sunAndSky_mappedData, &sunAndSky, sizeof(SunAndSky));
-}
\ No newline at end of file
+	glm::vec3 towardsSun = glm::vec3(glm::cos(sunElevation) * glm::sin(sunAzimuth),
+									 glm::sin(sunElevation),
+									 -glm::cos(sunElevation) * glm::cos(sunAzimuth));
+
+	SunAndSky newSunAndSky;
+	newSunAndSky.sunLocation = rotMat * glm::vec4(0.0f, 1.0f, 0.0f, 0.0f);
+	newSunAndSky.sunDirection = glm::vec4(towardsSun, 0.0f);
+	newSunAndSky.lightColor = glm::vec4(1.0f, 1.0f, 0.57f, 1.0f);
+	newSunAndSky.sunIntensity = SUN_ILLUMINANCE;
+
+	// Only touch the GPU copy (and invalidate the sky-view LUT) when something changed
+	if (memcmp(&newSunAndSky, &sunAndSky, sizeof(SunAndSky)) != 0)
+	{
+		sunAndSky = newSunAndSky;
+		memcpy(sunAndSky_mappedData, &sunAndSky, sizeof(SunAndSky));
+		skyViewLUTDirty = true;
+		sunAndSkyDirty = true;
+	}
+}
+
+bool Sky::IsSkyViewLUTDirty() const
+{
+	return skyViewLUTDirty;
+}
+void Sky::MarkSkyViewLUTUpToDate()
+{
+	skyViewLUTDirty = false;
+}
+
+bool Sky::IsSunAndSkyDirty() const
+{
+	return sunAndSkyDirty;
+}
+void Sky::ClearSunAndSkyDirty()
+{
+	sunAndSkyDirty = false;
+}
+
+void Sky::MoveSun(float deltaElevation, float deltaAzimuth)
+{
+	// Keep the sun between a bit below the horizon (dusk) and the zenith
+	sunElevation = glm::clamp(sunElevation + deltaElevation, -0.2f, PI_BY_2);
+	sunAzimuth += deltaAzimuth;
+}
+void Sky::SetSun(float elevation, float azimuth)
+{
+	sunElevation = glm::clamp(elevation, -0.2f, PI_BY_2);
+	sunAzimuth = azimuth;
+}
+
+VkBuffer Sky::GetCloudQualityBuffer() const
+{
+	return cloudQualityBuffer;
+}
+CloudQuality& Sky::GetCloudQuality()
+{
+	return cloudQuality;
+}
+void Sky::UpdateCloudQuality()
+{
+	memcpy(cloudQuality_mappedData, &cloudQuality, sizeof(CloudQuality));
+}
+void Sky::EnableHorizonBand(float maxElevationDegrees)
+{
+	const float maxElevation = glm::sin(glm::radians(maxElevationDegrees));
+	if (maxElevation <= HORIZON_BAND_MIN_ELEVATION)
+	{
+		throw std::runtime_error("The horizon band has to reach higher than the point where the clouds fade in (~3.5 degrees)");
+	}
+
+	horizonBandEnabled = true;
+	horizonBand.maxElevation = maxElevation;
+	horizonBand.active = 0;
+	horizonBand.columnCount = HORIZON_BAND_WIDTH / HORIZON_BAND_REFRESH_FRAMES;
+	horizonBandMarchedColumns = 0;
+	memcpy(horizonBand_mappedData, &horizonBand, sizeof(HorizonBand));
+}
+bool Sky::IsHorizonBandEnabled() const
+{
+	return horizonBandEnabled;
+}
+VkBuffer Sky::GetHorizonBandBuffer() const
+{
+	return horizonBandBuffer;
+}
+const HorizonBand& Sky::GetHorizonBand() const
+{
+	return horizonBand;
+}
+
+void Sky::AdvanceHorizonBand(const glm::vec3& cameraPosition, bool invalidate)
+{
+	if (!horizonBandEnabled)
+	{
+		return;
+	}
+
+	if (invalidate || horizonBandMarchedColumns == 0 ||
+		glm::distance(cameraPosition, glm::vec3(horizonBand.origin)) > HORIZON_BAND_MAX_CAMERA_OFFSET)
+	{
+		// Start over; until the band is complete again the ray march marches the horizon itself
+		horizonBand.origin = glm::vec4(cameraPosition, 1.0f);
+		horizonBand.active = 0;
+		horizonBand.firstColumn = 0;
+		horizonBandMarchedColumns = horizonBand.columnCount;
+	}
+	else
+	{
+		// Round robin over the columns; once all of them were ray marched from this origin the band can be used
+		horizonBand.firstColumn = (horizonBand.firstColumn + horizonBand.columnCount) % HORIZON_BAND_WIDTH;
+		horizonBandMarchedColumns += horizonBand.columnCount;
+		if (horizonBandMarchedColumns >= HORIZON_BAND_WIDTH)
+		{
+			horizonBand.active = 1;
+		}
+	}
+
+	memcpy(horizonBand_mappedData, &horizonBand, sizeof(HorizonBand));
+}
@@ -5,13 +5,47 @@
 #include "BufferUtils.h"
 #include "Texture2D.h"
 #include "Texture3D.h"
+#include "Texture2DArray.h"
 
 struct SunAndSky
 {
 	glm::vec4 sunLocation = glm::vec4(0.0, 1.0, -10.0, 0.0f);
-	glm::vec4 sunDirection = glm::vec4(1.0f, 1.0f, 1.0f, 0.0f);
+	glm::vec4 sunDirection = glm::vec4(1.0f, 1.0f, 1.0f, 0.0f);	// xyz = unit vector towards the sun
 	glm::vec4 lightColor = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f);
-	float sunIntensity = 1.0;
+	float sunIntensity = 1.0;	// sun illuminance, scales everything the atmosphere LUTs produce
+};
+
+// Runtime quality parameters for the cloud ray march. All distances are in km along the view ray.
+// Far away a cloud covers few pixels, so the ray march can take longer steps, skip the detail noise and
+// use fewer light samples there without a visible difference.
+struct CloudQuality
+{
+	int lodEnabled = 1;							// 0 --> every sample is evaluated at full quality
+	float stepGrowthStartDistance = 20.0f;		// step length starts growing beyond this distance
+	float stepGrowthPerKm = 0.04f;				// step length multiplier added per km beyond the start distance
+	float maxStepScale = 4.0f;					// step length never grows beyond this multiple of the base step
+	float detailFadeStartDistance = 30.0f;		// high frequency (detail) erosion fades out between these two distances
+	float detailFadeEndDistance = 60.0f;
+	float curlFadeStartDistance = 15.0f;		// curl noise distortion fades out between these two distances
+	float curlFadeEndDistance = 40.0f;
+	float farLightSampleDistance = 40.0f;		// samples beyond this use the reduced cone light sample count
+	int nearLightSamples = 6;
+	int farLightSamples = 3;
+	float minMarchSteps = 24.0f;				// steps of a ray looking straight up ...
+	float maxMarchSteps = 40.0f;				// ... and of a ray grazing the horizon
+	int godRaySamples = 100;					// mask samples each god rays pixel averages, spread over the blur passes (godRaysBlur.comp)
+	int amortizedLightSamples = 2;				// cone light samples per step, rotated and averaged over the revisits of a pixel; 0 --> all every time
+};
+
+// Panoramic band of the distant clouds just above the horizon, see cloudHorizonBand.comp.
+// Same layout as HorizonBandUBO in cloudRayMarch.glsl
+struct HorizonBand
+{
+	glm::vec4 origin = glm::vec4(0.0f);		// camera position (as in CameraUBO) the band is ray marched from
+	float maxElevation = 0.0f;				// y of the highest view direction the band covers; it starts where the clouds fade in
+	int active = 0;							// 1 once every column was ray marched from 'origin', the ray march only uses the band then
+	int firstColumn = 0;					// the columns ray marched this frame
+	int columnCount = 0;
 };
 
 class Sky
@@ -25,6 +59,28 @@ private:
 	VkDeviceMemory sunAndSkyBufferMemory;
 	void* sunAndSky_mappedData;
 
+	// The sky-view LUT only depends on the sun, so it is only rebuilt after SunAndSky actually changed
+	bool skyViewLUTDirty = true;
+
+	// Set whenever the sun or the cloud quality parameters change, i.e. whenever the clouds would look different
+	bool sunAndSkyDirty = true;
+
+	// Time of day: angles of the sun in radians. Azimuth 0 puts the sun towards -z
+	float sunElevation;
+	float sunAzimuth;
+
+	CloudQuality cloudQuality;
+	VkBuffer cloudQualityBuffer;
+	VkDeviceMemory cloudQualityBufferMemory;
+	void* cloudQuality_mappedData;
+
+	HorizonBand horizonBand;
+	VkBuffer horizonBandBuffer;
+	VkDeviceMemory horizonBandBufferMemory;
+	void* horizonBand_mappedData;
+	bool horizonBandEnabled = false;
+	int horizonBandMarchedColumns = 0;	// columns ray marched from the current origin so far
+
 	glm::vec3 rotationAxis = glm::vec3(1, 0, 0);
 	glm::mat4 rotMat = glm::mat4(1.0f);
 
@@ -37,6 +93,13 @@ public:
 	Texture3D* cloudBaseShapeTexture;
 	Texture3D* cloudDetailsTexture;
 	Texture2D* cloudMotionTexture;
+	Texture2D* skyViewLUTTexture;
+	Texture2D* transmittanceLUTTexture;
+	Texture2D* multipleScatteringLUTTexture;
+	Texture3D* aerialPerspectiveTexture;
+	Texture2DArray* blueNoiseTexture;
+	Texture2D* horizonBandTexture;
+	Texture2D* horizonBandDistanceTexture;
 	/*
 	3D cloudBaseShapeTexture
 	4 channels
@@ -56,10 +119,74 @@ public:
 	128^2 resolution
 	Uses curl noise. Which is non divergent and is used to fake fluid motion.
 	We use this noise to distort our cloud shapes and add a sense of turbulence.
+
+	2D skyViewLUTTexture
+	4 channels (rgb used)
+	256x128 resolution
+	Sky luminance for every view direction above the horizon (latitude-longitude).
+	Filled by the skyViewLUT compute pass so the ray marcher can replace the per pixel sky model with one texture fetch.
+
+	2D transmittanceLUTTexture
+	4 channels (rgb used)
+	256x64 resolution
+	Transmittance to the top of the atmosphere for every altitude and view zenith angle. Computed once.
+
+	2D multipleScatteringLUTTexture
+	4 channels (rgb used)
+	32x32 resolution
+	Contribution of all higher scattering orders for every altitude and sun zenith angle. Computed once.
+
+	3D aerialPerspectiveTexture
+	4 channels
+	32^3 resolution
+	In-scattering (rgb) and transmittance (a) between the camera and every froxel of the view frustum. Rebuilt every frame.
+
+	2D blueNoiseTexture
+	2 channels (rg used)
+	64^2 resolution, 16 layers
+	Spatiotemporal blue noise made offline by BlueNoiseGenerator. Tiled over the screen by the ray march,
+	r offsets the steps along the view ray and g rotates the light sample cone.
+
+	2D horizonBandTexture
+	4 channels
+	4096x128 resolution
+	Cylindrical panorama of the clouds between the horizon fade and HorizonBand::maxElevation, azimuth along x.
+	Lit cloud color premultiplied by the coverage (rgb) and coverage (a), without the aerial perspective.
+	A slice of columns is ray marched every frame (see AdvanceHorizonBand), so it refreshes every 64 frames.
+
+	2D horizonBandDistanceTexture
+	4 channels (r used)
+	4096x128 resolution
+	Distance to the first cloud hit in km, premultiplied by the coverage so that it filters like the band.
 	*/
 	
 	void CreateCloudResources(VkCommandPool computeCommandPool);
+	void CreateAtmosphereResources(VkCommandPool computeCommandPool);
 
 	VkBuffer GetSunAndSkyBuffer() const;
 	void UpdateSunAndSky();
+
+	bool IsSkyViewLUTDirty() const;
+	void MarkSkyViewLUTUpToDate(); // Call once the sky-view LUT rebuild has been submitted
+
+	bool IsSunAndSkyDirty() const;
+	void ClearSunAndSkyDirty();
+
+	// Moves the sun across the sky (angles in radians), takes effect with the next UpdateSunAndSky
+	void MoveSun(float deltaElevation, float deltaAzimuth);
+	// Puts the sun at an absolute position, clamped like MoveSun
+	void SetSun(float elevation, float azimuth);
+
+	VkBuffer GetCloudQualityBuffer() const;
+	CloudQuality& GetCloudQuality();
+	void UpdateCloudQuality(); // Copies the current quality parameters to the GPU, call after changing them
+
+	// The band covers view directions up to 'maxElevationDegrees' above the horizon. Off by default
+	void EnableHorizonBand(float maxElevationDegrees);
+	bool IsHorizonBandEnabled() const;
+	VkBuffer GetHorizonBandBuffer() const;
+	const HorizonBand& GetHorizonBand() const;
+	// Picks the columns of the band to ray march this frame. Starts over from 'cameraPosition' if the camera moved too 
+	// far from where the band was ray marched from, or if 'invalidate' is set (the sun or the cloud quality changed)
+	void AdvanceHorizonBand(const glm::vec3& cameraPosition, bool invalidate);
 };
\ No newline at end of file
@@ -22,7 +22,8 @@ Texture2D::~Texture2D()
 
 //This function creates a texture that can be written to
 //And thus can be used to prepare a texture target that is used to store compute shader calculations
-void Texture2D::createEmptyTexture(VkDevice logicalDevice, VkPhysicalDevice physicalDevice, VkCommandPool commandPool)
+void Texture2D::createEmptyTexture(VkDevice logicalDevice, VkPhysicalDevice physicalDevice, VkCommandPool commandPool,
+									VkSamplerAddressMode addressMode)
 {
 	// Get device properties for the requested texture format
 	VkFormatProperties formatProperties;
@@ -44,7 +45,9 @@ void Texture2D::createEmptyTexture(VkDevice logicalDevice, VkPhysicalDevice phys
 	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
 	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 	// Image will be sampled in the fragment shader and used as storage target in the compute shader
-	imageInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT;
+	// Transfer destination so that it can be cleared: compute passes read back their own results from previous frames
+	// Transfer source so that the CPU can read it back (Renderer::ReadFinalImage)
+	imageInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
 
 	//The samples flag is related to multisampling. This is only relevant for images that will be used as attachments, so stick to one sample
 	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
@@ -70,9 +73,14 @@ void Texture2D::createEmptyTexture(VkDevice logicalDevice, VkPhysicalDevice phys
 	VkCommandBuffer layoutCmd = beginSingleTimeCommands(device, commandPool);
 	textureLayout = VK_IMAGE_LAYOUT_GENERAL;
 	Image::setImageLayout(layoutCmd, textureImage, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, textureLayout);
+
+	// Start from zeros instead of whatever was in the memory before
+	VkClearColorValue clearColor = {};
+	VkImageSubresourceRange clearRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+	vkCmdClearColorImage(layoutCmd, textureImage, textureLayout, &clearColor, 1, &clearRange);
 	endSingleTimeCommands(device, commandPool, device->GetQueue(QueueFlags::Compute), layoutCmd);
 
-	Image::createSampler(device, textureSampler, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER, 1.0f);
+	Image::createSampler(device, textureSampler, addressMode, 1.0f);
 	Image::createImageView(device, textureImageView, textureImage, textureFormat, VK_IMAGE_ASPECT_COLOR_BIT);
 }
 
@@ -18,7 +18,8 @@ public:
 	void createTextureSampler(VkSamplerAddressMode addressMode, float maxAnisotropy);
 	void createTextureImageView();
 
-	void createEmptyTexture(VkDevice logicalDevice, VkPhysicalDevice physicalDevice, VkCommandPool commandPool);
+	void createEmptyTexture(VkDevice logicalDevice, VkPhysicalDevice physicalDevice, VkCommandPool commandPool,
+							VkSamplerAddressMode addressMode = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER);
 	void createTextureFromFile(VkDevice logicalDevice, VkCommandPool commandPool, const std::string texture_path, int numChannels,
 								VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, 
 								VkSamplerAddressMode addressMode, float maxAnisotropy);
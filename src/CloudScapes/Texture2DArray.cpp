@@ -0,0 +1,196 @@
+#include "Texture2DArray.h"
+
+Texture2DArray::Texture2DArray(VulkanDevice* device, uint32_t width, uint32_t height, uint32_t numLayers, VkFormat format)
+	: device(device), width(width), height(height), numLayers(numLayers), textureFormat(format)
+{}
+
+Texture2DArray::~Texture2DArray()
+{
+	if (textureSampler != VK_NULL_HANDLE) {
+		vkDestroySampler(device->GetVkDevice(), textureSampler, nullptr);
+	}
+	if (textureImageView != VK_NULL_HANDLE) {
+		vkDestroyImageView(device->GetVkDevice(), textureImageView, nullptr);
+	}
+	if (textureImage != VK_NULL_HANDLE) {
+		vkDestroyImage(device->GetVkDevice(), textureImage, nullptr);
+	}
+	if (textureImageMemory != VK_NULL_HANDLE) {
+		vkFreeMemory(device->GetVkDevice(), textureImageMemory, nullptr);
+	}
+}
+
+void Texture2DArray::createTextureArrayImage(VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties)
+{
+	//-------------
+	//--- Image ---
+	//-------------
+
+	VkImageCreateInfo imageInfo = {};
+	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageInfo.extent.width = width;
+	imageInfo.extent.height = height;
+	imageInfo.extent.depth = 1;
+	imageInfo.mipLevels = 1;
+	imageInfo.arrayLayers = numLayers; // every layer is a separate 2D image, no filtering happens across layers
+	imageInfo.format = textureFormat;
+	imageInfo.tiling = tiling;
+	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	imageInfo.usage = usage;
+	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageInfo.flags = 0;
+
+	if (vkCreateImage(device->GetVkDevice(), &imageInfo, nullptr, &textureImage) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create 2D texture array!");
+	}
+
+	VkMemoryRequirements memReqs = {};
+	vkGetImageMemoryRequirements(device->GetVkDevice(), textureImage, &memReqs);
+
+	VkMemoryAllocateInfo memAllocInfo{};
+	memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	memAllocInfo.allocationSize = memReqs.size;
+	memAllocInfo.memoryTypeIndex = device->GetInstance()->GetMemoryTypeIndex(memReqs.memoryTypeBits, properties);
+
+	if (vkAllocateMemory(device->GetVkDevice(), &memAllocInfo, nullptr, &textureImageMemory) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to allocate device memory for the 2D texture array");
+	}
+	vkBindImageMemory(device->GetVkDevice(), textureImage, textureImageMemory, 0);
+}
+
+void Texture2DArray::createTextureArraySampler(VkFilter filter, VkSamplerAddressMode addressMode)
+{
+	VkSamplerCreateInfo samplerInfo = {};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = filter;
+	samplerInfo.minFilter = filter;
+	samplerInfo.addressModeU = addressMode;
+	samplerInfo.addressModeV = addressMode;
+	samplerInfo.addressModeW = addressMode;
+	samplerInfo.anisotropyEnable = VK_FALSE;
+	samplerInfo.maxAnisotropy = 1.0f;
+	samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+	samplerInfo.unnormalizedCoordinates = VK_FALSE;
+	samplerInfo.compareEnable = VK_FALSE;
+	samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerInfo.mipLodBias = 0.0f;
+	samplerInfo.minLod = 0.0f;
+	samplerInfo.maxLod = 0.0f;
+
+	if (vkCreateSampler(device->GetVkDevice(), &samplerInfo, nullptr, &textureSampler) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create texture sampler!");
+	}
+}
+
+void Texture2DArray::createTextureArrayImageView()
+{
+	VkImageViewCreateInfo viewInfo = {};
+	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.image = textureImage;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+	viewInfo.format = textureFormat;
+
+	viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	viewInfo.subresourceRange.baseMipLevel = 0;
+	viewInfo.subresourceRange.levelCount = 1;
+	viewInfo.subresourceRange.baseArrayLayer = 0;
+	viewInfo.subresourceRange.layerCount = numLayers;
+
+	if (vkCreateImageView(device->GetVkDevice(), &viewInfo, nullptr, &textureImageView) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create 2D texture array image view!");
+	}
+}
+
+void Texture2DArray::createTextureArrayFromMany2DTextures(VkCommandPool commandPool,
+	const std::string folder_path, const std::string textureBaseName, const std::string fileExtension)
+{
+	uint8_t* pixels = ImageLoadingUtility::loadMany2DTextures(folder_path, textureBaseName, fileExtension, width, height, numLayers);
+	const VkDeviceSize layerSize = width * height * 4;
+	const VkDeviceSize imageSize = layerSize * numLayers;
+
+	// Create the staging buffer
+	VkBuffer stagingBuffer;
+	VkDeviceMemory stagingBufferMemory;
+	BufferUtils::CreateBuffer(device, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, imageSize,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+
+	void *data;
+	vkMapMemory(device->GetVkDevice(), stagingBufferMemory, 0, imageSize, 0, &data);
+	memcpy(data, pixels, static_cast<size_t>(imageSize));
+	vkUnmapMemory(device->GetVkDevice(), stagingBufferMemory);
+	delete[] pixels;
+
+	createTextureArrayImage(VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	// Layers are tightly packed one after the other in the staging buffer, so a single copy fills all of them
+	VkCommandBuffer copyCmd = beginSingleTimeCommands(device, commandPool);
+	Image::setImageLayout(copyCmd, textureImage, VK_IMAGE_ASPECT_COLOR_BIT,
+		VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, numLayers);
+
+	VkBufferImageCopy region = {};
+	region.bufferOffset = 0;
+	region.bufferRowLength = 0;
+	region.bufferImageHeight = 0;
+	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	region.imageSubresource.mipLevel = 0;
+	region.imageSubresource.baseArrayLayer = 0;
+	region.imageSubresource.layerCount = numLayers;
+	region.imageOffset = { 0, 0, 0 };
+	region.imageExtent = { width, height, 1 };
+	vkCmdCopyBufferToImage(copyCmd, stagingBuffer, textureImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+	textureLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	Image::setImageLayout(copyCmd, textureImage, VK_IMAGE_ASPECT_COLOR_BIT,
+		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, textureLayout, numLayers);
+	endSingleTimeCommands(device, commandPool, copyCmd);
+
+	vkDestroyBuffer(device->GetVkDevice(), stagingBuffer, nullptr);
+	vkFreeMemory(device->GetVkDevice(), stagingBufferMemory, nullptr);
+
+	// Noise is fetched texel by texel, never filtered
+	createTextureArraySampler(VK_FILTER_NEAREST, VK_SAMPLER_ADDRESS_MODE_REPEAT);
+	createTextureArrayImageView();
+}
+
+uint32_t Texture2DArray::GetWidth() const
+{
+	return width;
+}
+uint32_t Texture2DArray::GetHeight() const
+{
+	return height;
+}
+uint32_t Texture2DArray::GetNumLayers() const
+{
+	return numLayers;
+}
+VkFormat Texture2DArray::GetTextureFormat() const
+{
+	return textureFormat;
+}
+VkImageLayout Texture2DArray::GetTextureLayout() const
+{
+	return textureLayout;
+}
+VkImage Texture2DArray::GetTextureImage() const
+{
+	return textureImage;
+}
+VkDeviceMemory Texture2DArray::GetTextureImageMemory() const
+{
+	return textureImageMemory;
+}
+VkImageView Texture2DArray::GetTextureImageView() const
+{
+	return textureImageView;
+}
+VkSampler Texture2DArray::GetTextureSampler() const
+{
+	return textureSampler;
+}
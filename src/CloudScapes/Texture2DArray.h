@@ -0,0 +1,43 @@
+#pragma once
+
+#include "VulkanDevice.h"
+#include "BufferUtils.h"
+#include "imageLoadingUtility.h"
+#include "Image.h"
+
+// Array of same sized 2D textures sampled as a sampler2DArray, e.g. the blue noise layers
+class Texture2DArray
+{
+public:
+	Texture2DArray() = delete;	// https://stackoverflow.com/questions/5513881/meaning-of-delete-after-function-declaration
+	Texture2DArray(VulkanDevice* device, uint32_t width, uint32_t height, uint32_t numLayers, VkFormat format);
+	~Texture2DArray();
+
+	void createTextureArrayImage(VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties);
+	void createTextureArraySampler(VkFilter filter, VkSamplerAddressMode addressMode);
+	void createTextureArrayImageView();
+	// One layer per image, the images are numbered from 1 like the ones of Texture3D::create3DTextureFromMany2DTextures
+	void createTextureArrayFromMany2DTextures(VkCommandPool commandPool,
+		const std::string folder_path, const std::string textureBaseName, const std::string fileExtension);
+
+	uint32_t GetWidth() const;
+	uint32_t GetHeight() const;
+	uint32_t GetNumLayers() const;
+	VkFormat GetTextureFormat() const;
+	VkImageLayout GetTextureLayout() const;
+	VkImage GetTextureImage() const;
+	VkDeviceMemory GetTextureImageMemory() const;
+	VkImageView GetTextureImageView() const;
+	VkSampler GetTextureSampler() const;
+private:
+	VulkanDevice* device; //member variable because it is needed for the destructor
+
+	uint32_t width, height, numLayers;
+	VkFormat textureFormat;
+	VkImageLayout textureLayout;
+
+	VkImage textureImage = VK_NULL_HANDLE;
+	VkDeviceMemory textureImageMemory = VK_NULL_HANDLE;
+	VkImageView textureImageView = VK_NULL_HANDLE;
+	VkSampler textureSampler = VK_NULL_HANDLE;
+};
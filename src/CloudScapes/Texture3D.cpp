@@ -154,6 +154,25 @@ void Texture3D::create3DTextureImageView()
 	}
 }
 
+void Texture3D::createEmpty3DTexture(VkCommandPool commandPool, VkSamplerAddressMode addressMode)
+{
+	create3DTextureImage(VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+						 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	VkCommandBuffer layoutCmd = beginSingleTimeCommands(device, commandPool);
+	textureLayout = VK_IMAGE_LAYOUT_GENERAL;
+	Image::setImageLayout(layoutCmd, textureImage3D, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, textureLayout);
+
+	// Start from zeros instead of whatever was in the memory before
+	VkClearColorValue clearColor = {};
+	VkImageSubresourceRange clearRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+	vkCmdClearColorImage(layoutCmd, textureImage3D, textureLayout, &clearColor, 1, &clearRange);
+	endSingleTimeCommands(device, commandPool, device->GetQueue(QueueFlags::Compute), layoutCmd);
+
+	create3DTextureSampler(addressMode, 1.0f);
+	create3DTextureImageView();
+}
+
 void Texture3D::create3DTextureFromMany2DTextures(VkDevice logicalDevice, VkCommandPool commandPool,
 	const std::string folder_path, const std::string textureBaseName, const std::string fileExtension,
 	int num2DImages, int numChannels)
@@ -17,6 +17,8 @@ public:
 	void create3DTextureImage(VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties);
 	void create3DTextureSampler(VkSamplerAddressMode addressMode, float maxAnisotropy);
 	void create3DTextureImageView();
+	// Storage + sampled texture in VK_IMAGE_LAYOUT_GENERAL, cleared to zero, for volumes filled by compute shaders
+	void createEmpty3DTexture(VkCommandPool commandPool, VkSamplerAddressMode addressMode);
 	void create3DTextureFromMany2DTextures(VkDevice logicalDevice, VkCommandPool commandPool,
 		const std::string folder_path, const std::string textureBaseName, const std::string fileExtension,
 		int num2DImages, int numChannels);
@@ -1,4 +1,5 @@
 #include "VulkanInstance.h"
+#include <cstring>
 
 #ifdef NDEBUG
 const bool ENABLE_VALIDATION = false;
@@ -24,6 +25,25 @@ namespace {
         return extensions;
     }
 
+    // Check if the Vulkan implementation supports an instance extension
+    bool checkInstanceExtensionSupport(const char* extensionName)
+    {
+        uint32_t extensionCount;
+        vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, nullptr);
+
+        std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+        vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, availableExtensions.data());
+
+        for (const auto& extension : availableExtensions)
+        {
+            if (std::strcmp(extension.extensionName, extensionName) == 0)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
     // Callback function to allow messages from validation layers to be received
     VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(VkDebugReportFlagsEXT flags,
 												VkDebugReportObjectTypeEXT objType,
@@ -61,6 +81,15 @@ VulkanInstance::VulkanInstance(const char* applicationName, unsigned int additio
 	{
         extensions.push_back(additionalExtensions[i]);
     }
+
+#ifdef VK_KHR_get_physical_device_properties2
+    // Optional: lets PickPhysicalDevice ask for the features of device extensions (e.g. float16 arithmetic)
+    if (checkInstanceExtensionSupport(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME))
+    {
+        extensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+        physicalDeviceProperties2Enabled = true;
+    }
+#endif
     createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
     createInfo.ppEnabledExtensionNames = extensions.data();
 
@@ -247,6 +276,16 @@ namespace
 
         return requiredExtensionSet.empty();
     }
+
+    // Check the physical device for the core features CreateDevice enables. The intermediate render targets are written
+    // by shaders that don't declare their format, so the renderer can pick the narrowest format the GPU supports
+    bool checkDeviceFeatureSupport(VkPhysicalDevice device)
+    {
+        VkPhysicalDeviceFeatures supportedFeatures;
+        vkGetPhysicalDeviceFeatures(device, &supportedFeatures);
+
+        return supportedFeatures.samplerAnisotropy == VK_TRUE && supportedFeatures.shaderStorageImageWriteWithoutFormat == VK_TRUE;
+    }
 }
 
 void VulkanInstance::PickPhysicalDevice(std::vector<const char*> deviceExtensions, QueueFlagBits requiredQueues, VkSurfaceKHR surface) 
@@ -304,6 +343,7 @@ void VulkanInstance::PickPhysicalDevice(std::vector<const char*> deviceExtension
 
         if (queueSupport &&
             checkDeviceExtensionSupport(device, deviceExtensions) &&
+            checkDeviceFeatureSupport(device) &&
             (!requiredQueues[QueueFlags::Present] || (!surfaceFormats.empty() && ! presentModes.empty()))
 		   ) 
 		{
@@ -320,6 +360,48 @@ void VulkanInstance::PickPhysicalDevice(std::vector<const char*> deviceExtension
     }
 
     vkGetPhysicalDeviceMemoryProperties(physicalDevice, &deviceMemoryProperties);
+
+    probeShaderFloat16();
+}
+
+// Checks if the picked GPU supports float16 shader arithmetic. If it does, its extension is added to the ones CreateDevice enables.
+// Needs headers that know VK_KHR_shader_float16_int8; with older ones the float16 path is simply never used
+void VulkanInstance::probeShaderFloat16()
+{
+    shaderFloat16Supported = false;
+
+#ifdef VK_KHR_shader_float16_int8
+    if (!physicalDeviceProperties2Enabled || !checkDeviceExtensionSupport(physicalDevice, { VK_KHR_SHADER_FLOAT16_INT8_EXTENSION_NAME }))
+    {
+        return;
+    }
+
+    // Instance extension function, has to be loaded by hand
+    auto getPhysicalDeviceFeatures2 = (PFN_vkGetPhysicalDeviceFeatures2KHR)vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceFeatures2KHR");
+    if (getPhysicalDeviceFeatures2 == nullptr)
+    {
+        return;
+    }
+
+    VkPhysicalDeviceFloat16Int8FeaturesKHR float16Int8Features = {};
+    float16Int8Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FLOAT16_INT8_FEATURES_KHR;
+
+    VkPhysicalDeviceFeatures2KHR features = {};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
+    features.pNext = &float16Int8Features;
+    getPhysicalDeviceFeatures2(physicalDevice, &features);
+
+    if (float16Int8Features.shaderFloat16 == VK_TRUE)
+    {
+        shaderFloat16Supported = true;
+        deviceExtensions.push_back(VK_KHR_SHADER_FLOAT16_INT8_EXTENSION_NAME);
+    }
+#endif
+}
+
+bool VulkanInstance::SupportsShaderFloat16() const
+{
+    return shaderFloat16Supported;
 }
 
 VulkanDevice* VulkanInstance::CreateDevice(QueueFlagBits requiredQueues) 
@@ -355,6 +437,7 @@ VulkanDevice* VulkanInstance::CreateDevice(QueueFlagBits requiredQueues)
     // --- Specify the set of device features used ---
     VkPhysicalDeviceFeatures deviceFeatures = {};
 	deviceFeatures.samplerAnisotropy = VK_TRUE;
+    deviceFeatures.shaderStorageImageWriteWithoutFormat = VK_TRUE; // see checkDeviceFeatureSupport
 
     // --- Create logical device ---
     VkDeviceCreateInfo createInfo = {};
@@ -365,6 +448,17 @@ VulkanDevice* VulkanInstance::CreateDevice(QueueFlagBits requiredQueues)
 
     createInfo.pEnabledFeatures = &deviceFeatures;
 
+#ifdef VK_KHR_shader_float16_int8
+    // Float16 arithmetic for the ray marcher, see probeShaderFloat16
+    VkPhysicalDeviceFloat16Int8FeaturesKHR float16Int8Features = {};
+    float16Int8Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FLOAT16_INT8_FEATURES_KHR;
+    float16Int8Features.shaderFloat16 = VK_TRUE;
+    if (shaderFloat16Supported)
+    {
+        createInfo.pNext = &float16Int8Features;
+    }
+#endif
+
     // Enable device-specific extensions and validation layers
     createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
     createInfo.ppEnabledExtensionNames = deviceExtensions.data();
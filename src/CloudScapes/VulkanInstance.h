@@ -26,6 +26,10 @@ public:
     
     uint32_t GetMemoryTypeIndex(uint32_t types, VkMemoryPropertyFlags properties) const;
 
+    // True if the picked GPU can do float16 arithmetic in shaders (VK_KHR_shader_float16_int8 with shaderFloat16).
+    // The extension and feature are then enabled on the device created by CreateDevice
+    bool SupportsShaderFloat16() const;
+
     void PickPhysicalDevice(std::vector<const char*> deviceExtensions, QueueFlagBits requiredQueues, VkSurfaceKHR surface = VK_NULL_HANDLE);
 
     VulkanDevice* CreateDevice(QueueFlagBits requiredQueues);
@@ -34,6 +38,7 @@ public:
 
 private:
     void initDebugReport();
+    void probeShaderFloat16();
 
     VkInstance instance;
     VkDebugReportCallbackEXT debugReportCallback;
@@ -44,4 +49,6 @@ private:
     std::vector<VkSurfaceFormatKHR> surfaceFormats;
     std::vector<VkPresentModeKHR> presentModes;
     VkPhysicalDeviceMemoryProperties deviceMemoryProperties;
+    bool physicalDeviceProperties2Enabled = false; // VK_KHR_get_physical_device_properties2, needed to query extension features
+    bool shaderFloat16Supported = false;
 };
\ No newline at end of file
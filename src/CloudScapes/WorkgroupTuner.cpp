@@ -0,0 +1,340 @@
+#include "WorkgroupTuner.h"
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+
+namespace
+{
+	// Every candidate is timed this many times; the median is kept so that a single hiccup
+	// (driver compiling something in the background, OS scheduling for software drivers) doesn't decide the result
+	static constexpr int NUM_TIMING_RUNS = 5;
+	// Dispatches recorded back to back inside a single timed run
+	static constexpr int NUM_DISPATCHES_PER_RUN = 4;
+
+	// Sizes we try, roughly ordered from smallest to largest. Anything the device can't run is filtered out.
+	const WorkgroupSize ALL_CANDIDATE_SIZES[] = {
+		{ 8, 8 }, { 16, 4 }, { 16, 8 }, { 8, 16 }, { 32, 4 }, { 16, 16 }, { 32, 8 }, { 64, 4 }, { 32, 16 }, { 32, 32 }
+	};
+
+	// The renderer used 32x32 before tuning existed; keep that as the preferred default on devices that support it.
+	// 128 invocations (16x8) is the minimum every Vulkan implementation has to support.
+	const WorkgroupSize PREFERRED_DEFAULT_SIZES[] = {
+		{ 32, 32 }, { 16, 16 }, { 16, 8 }
+	};
+
+	bool fitsDeviceLimits(const WorkgroupSize& size, const VkPhysicalDeviceLimits& limits)
+	{
+		return size.x <= limits.maxComputeWorkGroupSize[0] &&
+			   size.y <= limits.maxComputeWorkGroupSize[1] &&
+			   size.x * size.y <= limits.maxComputeWorkGroupInvocations;
+	}
+
+	// Vulkan 1.0 has no device UUID (that comes with VK_KHR_external_memory_capabilities / Vulkan 1.1),
+	// so identify the device by vendor, device and driver version plus the pipeline cache UUID, which the
+	// driver guarantees to change whenever compiled pipelines (and therefore their performance) could change.
+	std::string makeDeviceKey(const VkPhysicalDeviceProperties& properties)
+	{
+		std::ostringstream key;
+		key << std::hex << std::setfill('0');
+		key << std::setw(4) << properties.vendorID << "-" << std::setw(4) << properties.deviceID << "-" << std::setw(8) << properties.driverVersion << "-";
+		for (uint32_t i = 0; i < VK_UUID_SIZE; i++)
+		{
+			key << std::setw(2) << static_cast<unsigned int>(properties.pipelineCacheUUID[i]);
+		}
+		return key.str();
+	}
+}
+
+WorkgroupSpecialization::WorkgroupSpecialization(const WorkgroupSize& workgroupSize, uint32_t variant)
+{
+	data.size = workgroupSize;
+	data.variant = variant;
+
+	mapEntries[0].constantID = 0;
+	mapEntries[0].offset = offsetof(Data, size) + offsetof(WorkgroupSize, x);
+	mapEntries[0].size = sizeof(uint32_t);
+
+	mapEntries[1].constantID = 1;
+	mapEntries[1].offset = offsetof(Data, size) + offsetof(WorkgroupSize, y);
+	mapEntries[1].size = sizeof(uint32_t);
+
+	mapEntries[2].constantID = 2;
+	mapEntries[2].offset = offsetof(Data, variant);
+	mapEntries[2].size = sizeof(uint32_t);
+
+	info.mapEntryCount = 3;
+	info.pMapEntries = mapEntries;
+	info.dataSize = sizeof(Data);
+	info.pData = &data;
+}
+
+WorkgroupTuner::WorkgroupTuner(VulkanDevice* device, VkPhysicalDevice physicalDevice, VkCommandPool computeCommandPool, const std::string& cacheFilePath)
+	: device(device), logicalDevice(device->GetVkDevice()), computeCommandPool(computeCommandPool), cacheFilePath(cacheFilePath)
+{
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+	deviceKey = makeDeviceKey(properties);
+	timestampPeriod = properties.limits.timestampPeriod;
+
+	for (const WorkgroupSize& size : ALL_CANDIDATE_SIZES)
+	{
+		if (fitsDeviceLimits(size, properties.limits))
+		{
+			candidateSizes.push_back(size);
+		}
+	}
+
+	// Timestamps are only usable if the queue family we dispatch on actually writes them
+	uint32_t queueFamilyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+	const int computeFamilyIndex = device->GetInstance()->GetQueueFamilyIndices()[QueueFlags::Compute];
+	timestampsSupported = computeFamilyIndex >= 0 && queueFamilies[computeFamilyIndex].timestampValidBits > 0;
+
+	if (timestampsSupported)
+	{
+		VkQueryPoolCreateInfo queryPoolInfo = {};
+		queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		queryPoolInfo.queryCount = 2;
+
+		if (vkCreateQueryPool(logicalDevice, &queryPoolInfo, nullptr, &timestampQueryPool) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create timestamp query pool");
+		}
+	}
+
+	LoadCache();
+}
+
+WorkgroupTuner::~WorkgroupTuner()
+{
+	if (timestampQueryPool != VK_NULL_HANDLE)
+	{
+		vkDestroyQueryPool(logicalDevice, timestampQueryPool, nullptr);
+	}
+}
+
+const std::vector<WorkgroupSize>& WorkgroupTuner::GetCandidateSizes() const
+{
+	return candidateSizes;
+}
+
+WorkgroupSize WorkgroupTuner::GetDefaultSize() const
+{
+	for (const WorkgroupSize& preferred : PREFERRED_DEFAULT_SIZES)
+	{
+		for (const WorkgroupSize& candidate : candidateSizes)
+		{
+			if (candidate.x == preferred.x && candidate.y == preferred.y)
+			{
+				return preferred;
+			}
+		}
+	}
+	return WorkgroupSize{ 16, 8 };
+}
+
+bool WorkgroupTuner::GetCachedSize(const std::string& pipelineName, WorkgroupSize& size) const
+{
+	auto it = cachedSizes.find(pipelineName);
+	if (it == cachedSizes.end())
+	{
+		return false;
+	}
+	size = it->second;
+	return true;
+}
+
+//----------------------------------------------
+//-------------- Tuning ------------------------
+//----------------------------------------------
+WorkgroupSize WorkgroupTuner::Tune(const std::string& pipelineName, const CreatePipelineFunction& createPipeline, const RecordDispatchFunction& recordDispatch)
+{
+	WorkgroupSize bestSize = GetDefaultSize();
+	double bestTime = -1.0;
+
+	std::cout << "Autotuning workgroup size for '" << pipelineName << "'" << std::endl;
+
+	for (const WorkgroupSize& candidate : candidateSizes)
+	{
+		VkPipeline pipeline = createPipeline(candidate);
+
+		// First run is a warm up: caches, lazy driver work and clock ramp up shouldn't count against the first candidate
+		TimeCandidate(pipeline, candidate, recordDispatch);
+		std::vector<double> timings;
+		for (int i = 0; i < NUM_TIMING_RUNS; i++)
+		{
+			timings.push_back(TimeCandidate(pipeline, candidate, recordDispatch));
+		}
+		std::sort(timings.begin(), timings.end());
+		const double medianTime = timings[timings.size() / 2];
+
+		vkDestroyPipeline(logicalDevice, pipeline, nullptr);
+
+		std::cout << "    " << candidate.x << "x" << candidate.y << ": " << medianTime << " ms" << std::endl;
+
+		if (bestTime < 0.0 || medianTime < bestTime)
+		{
+			bestTime = medianTime;
+			bestSize = candidate;
+		}
+	}
+
+	std::cout << "    picked " << bestSize.x << "x" << bestSize.y << std::endl;
+
+	cachedSizes[pipelineName] = bestSize;
+	return bestSize;
+}
+
+// Returns the average time of a single dispatch in milliseconds
+double WorkgroupTuner::TimeCandidate(VkPipeline pipeline, const WorkgroupSize& size, const RecordDispatchFunction& recordDispatch)
+{
+	VkCommandBufferAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandPool = computeCommandPool;
+	allocInfo.commandBufferCount = 1;
+
+	VkCommandBuffer commandBuffer;
+	if (vkAllocateCommandBuffers(logicalDevice, &allocInfo, &commandBuffer) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to allocate autotuning command buffer");
+	}
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+	if (timestampsSupported)
+	{
+		vkCmdResetQueryPool(commandBuffer, timestampQueryPool, 0, 2);
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestampQueryPool, 0);
+	}
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+
+	// Serialize the dispatches the same way consecutive frames would be, otherwise small workgroups
+	// get to overlap their tails with the next dispatch and look better than they are
+	VkMemoryBarrier memoryBarrier = {};
+	memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+	for (int i = 0; i < NUM_DISPATCHES_PER_RUN; i++)
+	{
+		if (i > 0)
+		{
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+								 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+		}
+		recordDispatch(commandBuffer, size);
+	}
+
+	if (timestampsSupported)
+	{
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampQueryPool, 1);
+	}
+
+	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to record autotuning command buffer");
+	}
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &commandBuffer;
+
+	VkQueue computeQueue = device->GetQueue(QueueFlags::Compute);
+	auto cpuStart = std::chrono::high_resolution_clock::now();
+	if (vkQueueSubmit(computeQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to submit autotuning command buffer");
+	}
+	vkQueueWaitIdle(computeQueue);
+	auto cpuEnd = std::chrono::high_resolution_clock::now();
+
+	double milliseconds = std::chrono::duration<double, std::milli>(cpuEnd - cpuStart).count();
+
+	if (timestampsSupported)
+	{
+		uint64_t timestamps[2];
+		if (vkGetQueryPoolResults(logicalDevice, timestampQueryPool, 0, 2, sizeof(timestamps), timestamps, sizeof(uint64_t),
+								  VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT) == VK_SUCCESS)
+		{
+			// timestampPeriod is the number of nanoseconds per tick
+			milliseconds = static_cast<double>(timestamps[1] - timestamps[0]) * timestampPeriod / 1000000.0;
+		}
+	}
+
+	vkFreeCommandBuffers(logicalDevice, computeCommandPool, 1, &commandBuffer);
+
+	return milliseconds / NUM_DISPATCHES_PER_RUN;
+}
+
+//----------------------------------------------
+//-------------- Cache File --------------------
+//----------------------------------------------
+// One entry per line: <device key> <pipeline name> <size x> <size y>
+void WorkgroupTuner::LoadCache()
+{
+	std::ifstream file(cacheFilePath);
+	if (!file.is_open())
+	{
+		return; // Nothing tuned yet
+	}
+
+	std::string line;
+	while (std::getline(file, line))
+	{
+		std::istringstream entry(line);
+		std::string key, pipelineName;
+		WorkgroupSize size;
+		if (!(entry >> key >> pipelineName >> size.x >> size.y))
+		{
+			continue;
+		}
+
+		if (key != deviceKey)
+		{
+			otherDeviceEntries.push_back(line);
+			continue;
+		}
+
+		// A driver update could in theory lower the limits; ignore stale entries the device can't run anymore
+		bool stillSupported = false;
+		for (const WorkgroupSize& candidate : candidateSizes)
+		{
+			stillSupported |= (candidate.x == size.x && candidate.y == size.y);
+		}
+		if (stillSupported)
+		{
+			cachedSizes[pipelineName] = size;
+		}
+	}
+}
+
+void WorkgroupTuner::SaveCache() const
+{
+	std::ofstream file(cacheFilePath, std::ios::trunc);
+	if (!file.is_open())
+	{
+		std::cout << "Could not write workgroup size cache to " << cacheFilePath << std::endl;
+		return;
+	}
+
+	for (const std::string& line : otherDeviceEntries)
+	{
+		file << line << "\n";
+	}
+	for (const auto& entry : cachedSizes)
+	{
+		file << deviceKey << " " << entry.first << " " << entry.second.x << " " << entry.second.y << "\n";
+	}
+}
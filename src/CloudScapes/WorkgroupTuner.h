@@ -0,0 +1,88 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <functional>
+#include <string>
+#include <vector>
+#include <map>
+#include "VulkanDevice.h"
+
+// Local size of a compute workgroup. Compute shaders declare their local size through the specialization
+// constants 0 (x) and 1 (y), so any of these can be baked into a pipeline at creation time.
+struct WorkgroupSize
+{
+	uint32_t x;
+	uint32_t y;
+};
+
+// Specialization data handed to a compute pipeline so that 'local_size_x_id = 0' and 'local_size_y_id = 1'
+// pick up the workgroup size chosen on the CPU side. Constant 2 is a free 'variant' for shaders that are built
+// into several pipelines (e.g. one per pass of godRaysBlur.comp), shaders that don't declare it ignore it.
+// The map entries point into 'data', so this object has to outlive the vkCreateComputePipelines call it is used in.
+struct WorkgroupSpecialization
+{
+	WorkgroupSpecialization(const WorkgroupSize& workgroupSize, uint32_t variant = 0);
+
+	struct Data
+	{
+		WorkgroupSize size;
+		uint32_t variant;
+	} data;
+	VkSpecializationMapEntry mapEntries[3];
+	VkSpecializationInfo info;
+};
+
+/*
+	The best workgroup size for a compute shader depends on the GPU (register file size, wave/warp width,
+	number of cores for software rasterizers like lavapipe, etc.) and on the shader itself (a register
+	heavy ray marcher wants smaller groups than a cheap reprojection pass).
+
+	The WorkgroupTuner builds a pipeline for every candidate size the device supports, times a few
+	dispatches of it with timestamp queries on the compute queue, and keeps the fastest one.
+	Results are persisted in a small text file keyed by the device so the (slow) tuning only has to be
+	done once per GPU/driver combination.
+*/
+class WorkgroupTuner
+{
+public:
+	using CreatePipelineFunction = std::function<VkPipeline(const WorkgroupSize&)>;
+	using RecordDispatchFunction = std::function<void(VkCommandBuffer, const WorkgroupSize&)>;
+
+	WorkgroupTuner() = delete;
+	WorkgroupTuner(VulkanDevice* device, VkPhysicalDevice physicalDevice, VkCommandPool computeCommandPool, const std::string& cacheFilePath);
+	~WorkgroupTuner();
+
+	// Candidate sizes that fit inside the device limits
+	const std::vector<WorkgroupSize>& GetCandidateSizes() const;
+	// Size used when nothing was tuned for this device yet
+	WorkgroupSize GetDefaultSize() const;
+
+	// Returns true and fills 'size' if the cache file already holds a tuned size for this pipeline on this device
+	bool GetCachedSize(const std::string& pipelineName, WorkgroupSize& size) const;
+
+	// Times every candidate size and returns the fastest one. 'createPipeline' builds the pipeline for a candidate
+	// (the tuner destroys it afterwards), 'recordDispatch' binds descriptor sets and records a single dispatch.
+	WorkgroupSize Tune(const std::string& pipelineName, const CreatePipelineFunction& createPipeline, const RecordDispatchFunction& recordDispatch);
+
+	void SaveCache() const;
+
+private:
+	void LoadCache();
+	double TimeCandidate(VkPipeline pipeline, const WorkgroupSize& size, const RecordDispatchFunction& recordDispatch);
+
+	VulkanDevice* device;
+	VkDevice logicalDevice;
+	VkCommandPool computeCommandPool;
+	VkQueryPool timestampQueryPool = VK_NULL_HANDLE;
+
+	// Nanoseconds per timestamp tick, and whether the compute queue can write timestamps at all.
+	// Without timestamps we fall back to timing the whole submission on the CPU.
+	float timestampPeriod;
+	bool timestampsSupported;
+
+	std::string cacheFilePath;
+	std::string deviceKey;
+	std::vector<WorkgroupSize> candidateSizes;
+	std::map<std::string, WorkgroupSize> cachedSizes;	// entries for this device, keyed by pipeline name
+	std::vector<std::string> otherDeviceEntries;		// cache lines belonging to other devices, written back untouched
+};
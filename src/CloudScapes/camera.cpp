@@ -74,6 +74,29 @@ void Camera::RecomputeAttributes()
 	float tan_fovy = tan(glm::radians(fovy / 2));
 	float len = glm::length(ref - eyePos);
 	aspect = width / (float)height;
+
+	dirty = true;
+}
+
+glm::vec3 Camera::GetPosition() const
+{
+	return eyePos;
+}
+
+bool Camera::IsDirty() const
+{
+	return dirty;
+}
+void Camera::ClearDirty()
+{
+	dirty = false;
+}
+
+void Camera::LookAt(glm::vec3 eyePos, glm::vec3 ref)
+{
+	this->eyePos = eyePos;
+	this->ref = ref;
+	RecomputeAttributes();
 }
 
 void Camera::RotateAboutUp(float deg)
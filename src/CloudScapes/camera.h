@@ -35,6 +35,8 @@ public:
 	glm::mat4 GetViewProj() const;
 	void RecomputeAttributes();
 
+	// Places the camera at 'eyePos' looking at 'ref', like the constructor
+	void LookAt(glm::vec3 eyePos, glm::vec3 ref);
 	void RotateAboutUp(float deg);
 	void RotateAboutRight(float deg);
 
@@ -42,6 +44,12 @@ public:
 	void TranslateAlongRight(float amt);
 	void TranslateAlongUp(float amt);
 
+	glm::vec3 GetPosition() const;
+
+	// Set whenever the camera moves or turns; the renderer uses it to notice a static view
+	bool IsDirty() const;
+	void ClearDirty();
+
 private:
 	VulkanDevice* device; //member variable because it is needed for the destructor
 
@@ -65,4 +73,6 @@ private:
 	float aspect;
 	float near_clip;  // Near clip plane distance
 	float far_clip;  // Far clip plane distance
+
+	bool dirty = true;
 };
\ No newline at end of file
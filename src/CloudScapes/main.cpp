@@ -4,6 +4,9 @@
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 
 #include <vulkan/vulkan.h>
+#include <cstring>
+#include <cstdlib>
+#include <map>
 #include "VulkanInstance.h"
 #include "Window.h"
 #include "Renderer.h"
@@ -11,6 +14,7 @@
 #include "Scene.h"
 #include "Camera.h"
 #include "Image.h"
+#include "RegressionRun.h"
 
 VulkanDevice* device; // manages both the logical device (VkDevice) and the physical Device (VkPhysicalDevice)
 VulkanSwapChain* swapChain;
@@ -18,6 +22,8 @@ Renderer* renderer;
 
 Camera* camera;
 Camera* cameraOld;
+Sky* sky;
+Scene* scene;
 
 int window_height = 720; //1080;//
 int window_width = 1284; // 1280; //1920;//
@@ -38,6 +44,19 @@ namespace
 	double previousY = 0.0f;
 	float deltaForRotation = 0.25f;
 	float deltaForMovement = 10.0f;
+	float deltaForSun = 0.005f; // radians per frame the sun moves while its key is held
+	double convergedEventWait = 0.1; // seconds the loop sleeps waiting for input while the renderer idles on a converged view
+	float deltaForRenderScale = 0.125f; // render scale step of the - and = keys
+
+	// glfwGetKey only reports whether a key is held down; toggles should only flip once per key press
+	std::map<int, bool> keyWasDown;
+	bool keyPressedThisFrame(GLFWwindow* window, int key)
+	{
+		bool isDown = (glfwGetKey(window, key) == GLFW_PRESS);
+		bool pressed = isDown && !keyWasDown[key];
+		keyWasDown[key] = isDown;
+		return pressed;
+	}
 
 	void keyboardInputs(GLFWwindow* window)
 	{
@@ -82,6 +101,45 @@ namespace
 
 		camera->UpdateBuffer();
 		camera->CopyToGPUMemory();
+
+		// Toggle the distance based level of detail of the cloud ray march
+		if (keyPressedThisFrame(window, GLFW_KEY_L)) {
+			CloudQuality& quality = sky->GetCloudQuality();
+			quality.lodEnabled = !quality.lodEnabled;
+			sky->UpdateCloudQuality();
+		}
+
+		// Render resolution; only the render resolution targets are reallocated
+		float renderScaleStep = 0.0f;
+		if (keyPressedThisFrame(window, GLFW_KEY_MINUS)) {
+			renderScaleStep -= deltaForRenderScale;
+		}
+		if (keyPressedThisFrame(window, GLFW_KEY_EQUAL)) {
+			renderScaleStep += deltaForRenderScale;
+		}
+		if (renderScaleStep != 0.0f) {
+			renderer->SetRenderScale(renderer->GetRenderScale() + renderScaleStep);
+			std::cout << "Render scale " << renderer->GetRenderScale() * 100.0f << "%" << std::endl;
+		}
+
+		// Pause the cloud animation; a paused, static view converges and the renderer stops drawing
+		if (keyPressedThisFrame(window, GLFW_KEY_P)) {
+			scene->SetAnimationPaused(!scene->IsAnimationPaused());
+		}
+
+		// Time of day; the sky-view LUT is rebuilt on its own once the sun actually moved
+		if (glfwGetKey(window, GLFW_KEY_T) == GLFW_PRESS) {
+			sky->MoveSun(deltaForSun, 0.0f);
+		}
+		if (glfwGetKey(window, GLFW_KEY_G) == GLFW_PRESS) {
+			sky->MoveSun(-deltaForSun, 0.0f);
+		}
+		if (glfwGetKey(window, GLFW_KEY_F) == GLFW_PRESS) {
+			sky->MoveSun(0.0f, -deltaForSun);
+		}
+		if (glfwGetKey(window, GLFW_KEY_H) == GLFW_PRESS) {
+			sky->MoveSun(0.0f, deltaForSun);
+		}
 	}
 	
 	void mouseDownCallback(GLFWwindow* window, int button, int action, int mods) 
@@ -126,7 +184,141 @@ namespace
 int main(int argc, char** argv) 
 {
     static constexpr char* applicationName = "Meteoros";
-    InitializeWindow(window_width, window_height, applicationName);
+
+	// Command line options
+	// --autotune : time every compute workgroup size this GPU supports and cache the fastest ones (workgroupSizes.cache)
+	// --cloud-resolution full|half|quarter : resolution the clouds are ray marched at before being upsampled to the window
+	// --no-fp16 : use the fp32 ray marcher even if the GPU supports float16 arithmetic (to compare the two)
+	// --motion-blur : blur the clouds along their screen space motion
+	// --god-rays : light shafts through the gaps in the clouds
+	// --separate-post-process : tone map and TXAA in two draws instead of the fused compute kernel (to compare the two)
+	// --fixed-exposure : tone map with a constant exposure instead of adapting it to the brightness of the frame
+	// --wide-formats : keep every intermediate render target in RGBA16F (to compare the bandwidth with the narrow formats)
+	// --paused : start with the cloud animation paused (P toggles it)
+	// --no-idle : keep rendering every frame even once a static view has converged
+	// --frame-budget <ms> : lower or raise the cloud quality at runtime to hold this GPU frame time
+	// --render-scale <0.5-1.0> : render at this fraction of the window resolution, TXAA upscales to the window (- and = change it)
+	// --no-light-history : evaluate every cone light sample on every march instead of amortizing them over the revisits of a pixel
+	// --horizon-band <degrees> : clouds up to this elevation come from the incrementally updated horizon band, 0 turns it off
+	// --regression <folder> : render the views of <folder>/regression.txt in a hidden window, compare them against the reference
+	//                         images and baseline timings in that folder, then quit; the exit code is 1 if anything regressed
+	// --regression-update : with --regression, write the reference images and the baseline timings instead of comparing
+	// --regression-report <file> : where --regression writes its JSON report, regression_report.json by default
+	RendererOptions rendererOptions;
+	bool startPaused = false;
+	bool lightHistory = true;
+	std::string regressionFolder;
+	bool regressionUpdate = false;
+	std::string regressionReport = "regression_report.json";
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::strcmp(argv[i], "--autotune") == 0)
+		{
+			rendererOptions.autotuneWorkgroups = true;
+		}
+		else if (std::strcmp(argv[i], "--no-fp16") == 0)
+		{
+			rendererOptions.allowFloat16RayMarch = false;
+		}
+		else if (std::strcmp(argv[i], "--motion-blur") == 0)
+		{
+			rendererOptions.motionBlur = true;
+		}
+		else if (std::strcmp(argv[i], "--god-rays") == 0)
+		{
+			rendererOptions.godRays = true;
+		}
+		else if (std::strcmp(argv[i], "--separate-post-process") == 0)
+		{
+			rendererOptions.fusedPostProcess = false;
+		}
+		else if (std::strcmp(argv[i], "--fixed-exposure") == 0)
+		{
+			rendererOptions.autoExposure = false;
+		}
+		else if (std::strcmp(argv[i], "--wide-formats") == 0)
+		{
+			rendererOptions.narrowFormats = false;
+		}
+		else if (std::strcmp(argv[i], "--paused") == 0)
+		{
+			startPaused = true;
+		}
+		else if (std::strcmp(argv[i], "--no-light-history") == 0)
+		{
+			lightHistory = false;
+		}
+		else if (std::strcmp(argv[i], "--no-idle") == 0)
+		{
+			rendererOptions.idleWhenConverged = false;
+		}
+		else if (std::strcmp(argv[i], "--frame-budget") == 0 && i + 1 < argc)
+		{
+			i++;
+			rendererOptions.frameBudgetMilliseconds = static_cast<float>(std::atof(argv[i]));
+			if (rendererOptions.frameBudgetMilliseconds <= 0.0f) {
+				throw std::runtime_error("--frame-budget expects a frame time in milliseconds");
+			}
+		}
+		else if (std::strcmp(argv[i], "--render-scale") == 0 && i + 1 < argc)
+		{
+			i++;
+			rendererOptions.renderScale = static_cast<float>(std::atof(argv[i]));
+			if (rendererOptions.renderScale < MIN_RENDER_SCALE || rendererOptions.renderScale > MAX_RENDER_SCALE) {
+				throw std::runtime_error("--render-scale expects a scale between 0.5 and 1.0");
+			}
+		}
+		else if (std::strcmp(argv[i], "--horizon-band") == 0 && i + 1 < argc)
+		{
+			i++;
+			rendererOptions.horizonBandElevation = static_cast<float>(std::atof(argv[i]));
+			if (rendererOptions.horizonBandElevation < 0.0f || rendererOptions.horizonBandElevation > 30.0f) {
+				throw std::runtime_error("--horizon-band expects an elevation in degrees between 0 and 30");
+			}
+		}
+		else if (std::strcmp(argv[i], "--regression") == 0 && i + 1 < argc)
+		{
+			i++;
+			regressionFolder = argv[i];
+		}
+		else if (std::strcmp(argv[i], "--regression-update") == 0)
+		{
+			regressionUpdate = true;
+		}
+		else if (std::strcmp(argv[i], "--regression-report") == 0 && i + 1 < argc)
+		{
+			i++;
+			regressionReport = argv[i];
+		}
+		else if (std::strcmp(argv[i], "--cloud-resolution") == 0 && i + 1 < argc)
+		{
+			i++;
+			if (std::strcmp(argv[i], "full") == 0) {
+				rendererOptions.cloudResolutionDivisor = 1;
+			}
+			else if (std::strcmp(argv[i], "half") == 0) {
+				rendererOptions.cloudResolutionDivisor = 2;
+			}
+			else if (std::strcmp(argv[i], "quarter") == 0) {
+				rendererOptions.cloudResolutionDivisor = 4;
+			}
+			else {
+				throw std::runtime_error("--cloud-resolution expects full, half or quarter");
+			}
+		}
+	}
+
+	// The regression run renders every frame of its views, and a quality that follows the frame time would make them differ
+	const bool regressionRun = !regressionFolder.empty();
+	if (regressionRun)
+	{
+		if (rendererOptions.frameBudgetMilliseconds > 0.0f) {
+			throw std::runtime_error("--regression can't be combined with --frame-budget");
+		}
+		rendererOptions.idleWhenConverged = false;
+	}
+
+    InitializeWindow(window_width, window_height, applicationName, !regressionRun);
 
     unsigned int glfwExtensionCount = 0;
     const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
@@ -158,21 +350,43 @@ int main(int argc, char** argv)
 						window_width, window_height, 45.0f, window_width / window_height, 0.1f, 1000.0f);
 	cameraOld = new Camera(device, glm::vec3(0.0f, 0.0f, 2.0f), glm::vec3(0.0f, 0.0f, 1.0f),
 						window_width, window_height, 45.0f, window_width / window_height, 0.1f, 1000.0f);
-	Scene* scene = new Scene(device);
-	Sky* sky = new Sky(device, device->GetVkDevice());
-	renderer = new Renderer(device, instance->GetPhysicalDevice(), swapChain, scene, sky, camera, cameraOld, static_cast<uint32_t>(window_width), static_cast<uint32_t>(window_height));
+	scene = new Scene(device);
+	scene->SetAnimationPaused(startPaused);
+	sky = new Sky(device, device->GetVkDevice());
+	if (!lightHistory)
+	{
+		sky->GetCloudQuality().amortizedLightSamples = 0;
+		sky->UpdateCloudQuality();
+	}
+	renderer = new Renderer(device, instance->GetPhysicalDevice(), swapChain, scene, sky, camera, cameraOld, 
+							static_cast<uint32_t>(window_width), static_cast<uint32_t>(window_height), rendererOptions);
 
 	glfwSetWindowSizeCallback(GetGLFWWindow(), resizeCallback);
 	glfwSetMouseButtonCallback(GetGLFWWindow(), mouseDownCallback);
 	glfwSetScrollCallback(GetGLFWWindow(), scrollCallback);
 	glfwSetCursorPosCallback(GetGLFWWindow(), mouseMoveCallback);
 	
+	// The regression run takes the place of the interactive loop
+	int exitCode = 0;
+	if (regressionRun)
+	{
+		RegressionRun regression(regressionFolder, regressionUpdate);
+		exitCode = regression.Run(device, renderer, camera, cameraOld, sky, scene) ? 0 : 1;
+		regression.WriteReport(regressionReport);
+	}
+
 	int x = 0;
 	// Reference: https://vulkan-tutorial.com/Drawing_a_triangle/Drawing/Rendering_and_presentation
-    while (!ShouldQuit()) 
+    while (!regressionRun && !ShouldQuit()) 
 	{
 		//Mouse inputs and window resize callbacks
-		glfwPollEvents();
+		//Nothing is drawn while the renderer idles on a converged view, so just wait for the next input
+		if (renderer->IsConverged()) {
+			glfwWaitEventsTimeout(convergedEventWait);
+		}
+		else {
+			glfwPollEvents();
+		}
 		keyboardInputs(GetGLFWWindow());
 		// Update Uniforms
 		scene->UpdateTime();
@@ -209,4 +423,6 @@ int main(int argc, char** argv)
     delete device;
     delete instance;
     DestroyWindow();
+
+	return exitCode;
 }
\ No newline at end of file
@@ -0,0 +1,221 @@
+// Physically based atmosphere shared by the atmosphere LUT passes (transmittanceLUT, multipleScatteringLUT, skyViewLUT,
+// aerialPerspective) and the cloud ray march. Included by those shaders, not compiled on its own.
+//
+// Reference: Sebastien Hillaire, "A Scalable and Production Ready Sky and Atmosphere Rendering Technique" (EGSR 2020)
+// Reference: Eric Bruneton, "Precomputed Atmospheric Scattering" (2008, and the 2017 reimplementation) for the LUT parameterizations
+//
+// All distances in here are in km, measured from the center of the planet unless said otherwise.
+// The cloud renderer works in meters with its own (larger) planet; only directions and altitudes are shared with it.
+
+//--------------------------------------------------------
+//					ATMOSPHERE PARAMETERS
+//--------------------------------------------------------
+// Earth-like atmosphere, values from Bruneton 2017 / Hillaire 2020
+
+#define ATMOSPHERE_PI 3.14159265
+
+#define ATMOSPHERE_BOTTOM_RADIUS_KM 6360.0
+#define ATMOSPHERE_TOP_RADIUS_KM 6460.0
+
+#define RAYLEIGH_SCATTERING vec3(5.802e-3, 13.558e-3, 33.1e-3) // per km
+#define RAYLEIGH_SCALE_HEIGHT_KM 8.0
+
+#define MIE_SCATTERING vec3(3.996e-3)
+#define MIE_EXTINCTION vec3(4.40e-3)
+#define MIE_SCALE_HEIGHT_KM 1.2
+#define MIE_PHASE_G 0.8
+
+// Ozone only absorbs, in a tent shaped layer around 25 km
+#define OZONE_ABSORPTION vec3(0.650e-3, 1.881e-3, 0.085e-3)
+#define OZONE_CENTER_KM 25.0
+#define OZONE_HALF_WIDTH_KM 15.0
+
+#define GROUND_ALBEDO vec3(0.3)
+
+// Angular radius of the sun disk
+#define SUN_ANGULAR_RADIUS 0.004675
+// Luminance of the sun disk relative to the sun illuminance (sunAndSky.sunIntensity)
+#define SUN_DISK_LUMINANCE 2000.0
+
+//--------------------------------------------------------
+//					PARTICIPATING MEDIUM
+//--------------------------------------------------------
+
+struct MediumSample
+{
+	vec3 rayleighScattering;
+	vec3 mieScattering;
+	vec3 scattering;	// rayleigh + mie
+	vec3 extinction;	// scattering + absorption
+};
+
+MediumSample sampleMedium(in float altitudeKm)
+{
+	altitudeKm = max(altitudeKm, 0.0);
+	float rayleighDensity = exp(-altitudeKm / RAYLEIGH_SCALE_HEIGHT_KM);
+	float mieDensity = exp(-altitudeKm / MIE_SCALE_HEIGHT_KM);
+	float ozoneDensity = max(0.0, 1.0 - abs(altitudeKm - OZONE_CENTER_KM) / OZONE_HALF_WIDTH_KM);
+
+	MediumSample medium;
+	medium.rayleighScattering = RAYLEIGH_SCATTERING * rayleighDensity;
+	medium.mieScattering = MIE_SCATTERING * mieDensity;
+	medium.scattering = medium.rayleighScattering + medium.mieScattering;
+	medium.extinction = medium.rayleighScattering + MIE_EXTINCTION * mieDensity + OZONE_ABSORPTION * ozoneDensity;
+	return medium;
+}
+
+float atmosphereRayleighPhase(in float cosTheta)
+{
+	return 3.0 / (16.0 * ATMOSPHERE_PI) * (1.0 + cosTheta * cosTheta);
+}
+
+// Cornette-Shanks phase function, a Henyey-Greenstein that behaves better for the strong forward scattering of aerosols
+float atmosphereMiePhase(in float cosTheta)
+{
+	const float g = MIE_PHASE_G;
+	float k = 3.0 / (8.0 * ATMOSPHERE_PI) * (1.0 - g * g) / (2.0 + g * g);
+	return k * (1.0 + cosTheta * cosTheta) / pow(1.0 + g * g - 2.0 * g * cosTheta, 1.5);
+}
+
+//--------------------------------------------------------
+//					GEOMETRY
+//--------------------------------------------------------
+
+// Distance along the ray to the nearest intersection in front of the origin with a sphere centered at the planet center, -1 if none
+float raySphereNearest(in vec3 origin, in vec3 dir, in float radius)
+{
+	float b = dot(origin, dir);
+	float c = dot(origin, origin) - radius * radius;
+	float discriminant = b * b - c;
+	if(discriminant < 0.0)
+	{
+		return -1.0;
+	}
+	float sqrtDiscriminant = sqrt(discriminant);
+	float t0 = -b - sqrtDiscriminant;
+	float t1 = -b + sqrtDiscriminant;
+	if(t0 >= 0.0)
+	{
+		return t0;
+	}
+	return (t1 >= 0.0) ? t1 : -1.0;
+}
+
+// Length of the part of the ray that is inside the atmosphere (the ray stops at the ground). 'hitsGround' tells whether it does
+float atmosphereRayLength(in vec3 origin, in vec3 dir, out bool hitsGround)
+{
+	float groundDistance = raySphereNearest(origin, dir, ATMOSPHERE_BOTTOM_RADIUS_KM);
+	float topDistance = raySphereNearest(origin, dir, ATMOSPHERE_TOP_RADIUS_KM);
+	hitsGround = (groundDistance > 0.0);
+	if(hitsGround)
+	{
+		return groundDistance;
+	}
+	return max(topDistance, 0.0);
+}
+
+//--------------------------------------------------------
+//					LUT PARAMETERIZATIONS
+//--------------------------------------------------------
+
+// Transmittance LUT (Bruneton): x = distance to the top of the atmosphere remapped between its min and max for the altitude,
+// y = altitude remapped through the distance to the horizon. r = distance from the planet center, mu = cos(view zenith angle)
+vec2 transmittanceLUTUV(in float r, in float mu)
+{
+	float H = sqrt(ATMOSPHERE_TOP_RADIUS_KM * ATMOSPHERE_TOP_RADIUS_KM - ATMOSPHERE_BOTTOM_RADIUS_KM * ATMOSPHERE_BOTTOM_RADIUS_KM);
+	float rho = sqrt(max(0.0, r * r - ATMOSPHERE_BOTTOM_RADIUS_KM * ATMOSPHERE_BOTTOM_RADIUS_KM));
+	float discriminant = r * r * (mu * mu - 1.0) + ATMOSPHERE_TOP_RADIUS_KM * ATMOSPHERE_TOP_RADIUS_KM;
+	float d = max(0.0, -r * mu + sqrt(max(discriminant, 0.0)));
+	float dMin = ATMOSPHERE_TOP_RADIUS_KM - r;
+	float dMax = rho + H;
+	return vec2((d - dMin) / (dMax - dMin), rho / H);
+}
+
+void transmittanceLUTParameters(in vec2 uv, out float r, out float mu)
+{
+	float H = sqrt(ATMOSPHERE_TOP_RADIUS_KM * ATMOSPHERE_TOP_RADIUS_KM - ATMOSPHERE_BOTTOM_RADIUS_KM * ATMOSPHERE_BOTTOM_RADIUS_KM);
+	float rho = H * uv.y;
+	r = sqrt(rho * rho + ATMOSPHERE_BOTTOM_RADIUS_KM * ATMOSPHERE_BOTTOM_RADIUS_KM);
+	float dMin = ATMOSPHERE_TOP_RADIUS_KM - r;
+	float dMax = rho + H;
+	float d = dMin + uv.x * (dMax - dMin);
+	mu = (d == 0.0) ? 1.0 : (H * H - rho * rho - d * d) / (2.0 * r * d);
+	mu = clamp(mu, -1.0, 1.0);
+}
+
+// Transmittance from a point at distance r from the planet center to the top of the atmosphere, looking at cos(zenith) = mu
+vec3 getTransmittanceToTop(in sampler2D transmittanceLUT, in float r, in float mu)
+{
+	return textureLod(transmittanceLUT, transmittanceLUTUV(r, mu), 0.0).rgb;
+}
+
+// Same but zero if the planet is in the way (night side / sun below the local horizon)
+vec3 getSunTransmittance(in sampler2D transmittanceLUT, in vec3 position, in vec3 sunDir)
+{
+	float r = length(position);
+	vec3 up = position / r;
+	if(raySphereNearest(position, sunDir, ATMOSPHERE_BOTTOM_RADIUS_KM) > 0.0)
+	{
+		return vec3(0.0);
+	}
+	return getTransmittanceToTop(transmittanceLUT, r, dot(up, sunDir));
+}
+
+// Multiple scattering LUT (Hillaire): x = cos(sun zenith angle), y = altitude, both linear
+vec2 multipleScatteringLUTUV(in float r, in float muS)
+{
+	return vec2(muS * 0.5 + 0.5, (r - ATMOSPHERE_BOTTOM_RADIUS_KM) / (ATMOSPHERE_TOP_RADIUS_KM - ATMOSPHERE_BOTTOM_RADIUS_KM));
+}
+
+vec3 getMultipleScattering(in sampler2D multipleScatteringLUT, in vec3 position, in vec3 sunDir)
+{
+	float r = length(position);
+	vec2 uv = clamp(multipleScatteringLUTUV(r, dot(position / r, sunDir)), vec2(0.0), vec2(1.0));
+	return textureLod(multipleScatteringLUT, uv, 0.0).rgb;
+}
+
+// Position of a viewer at the given altitude, directly above the planet center
+vec3 atmosphereViewerPosition(in float altitudeKm)
+{
+	return vec3(0.0, ATMOSPHERE_BOTTOM_RADIUS_KM + max(altitudeKm, 0.001), 0.0);
+}
+
+//--------------------------------------------------------
+//					SCATTERING INTEGRATION
+//--------------------------------------------------------
+
+// Single scattering (plus the multiple scattering approximation) in-scattered along a ray segment, for a sun of illuminance 1.
+// Returns the luminance in rgb and writes the transmittance of the segment.
+vec3 integrateScatteredLuminance(in sampler2D transmittanceLUT, in sampler2D multipleScatteringLUT,
+								 in vec3 origin, in vec3 dir, in float rayLength, in vec3 sunDir, in int numSteps,
+								 out vec3 transmittance)
+{
+	float cosTheta = dot(dir, sunDir);
+	float rayleighPhase = atmosphereRayleighPhase(cosTheta);
+	float miePhase = atmosphereMiePhase(cosTheta);
+
+	vec3 luminance = vec3(0.0);
+	transmittance = vec3(1.0);
+	float dt = rayLength / float(numSteps);
+
+	for(int i = 0; i < numSteps; i++)
+	{
+		vec3 position = origin + (float(i) + 0.5) * dt * dir;
+		float altitude = length(position) - ATMOSPHERE_BOTTOM_RADIUS_KM;
+		MediumSample medium = sampleMedium(altitude);
+
+		vec3 sunTransmittance = getSunTransmittance(transmittanceLUT, position, sunDir);
+		vec3 multipleScattering = getMultipleScattering(multipleScatteringLUT, position, sunDir);
+
+		vec3 inScattering = sunTransmittance * (medium.rayleighScattering * rayleighPhase + medium.mieScattering * miePhase) +
+							multipleScattering * medium.scattering;
+
+		// Energy conserving integration over the step (Hillaire 2015)
+		vec3 stepTransmittance = exp(-medium.extinction * dt);
+		vec3 safeExtinction = max(medium.extinction, vec3(1e-7));
+		luminance += transmittance * (inScattering - inScattering * stepTransmittance) / safeExtinction;
+		transmittance *= stepTransmittance;
+	}
+
+	return luminance;
+}
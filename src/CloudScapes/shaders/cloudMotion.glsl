@@ -0,0 +1,54 @@
+// Where the clouds seen through a pixel were on screen last frame, shared by the reprojection and the motion blur passes
+// The includer declares the CameraUBO as 'camera' and the CameraOldUBO as 'cameraOld'
+//
+// Every cloud pixel has a depth: the first hit distance the ray march leaves in the cloud distance images (x, in km, see
+// cloudRayMarch.glsl). Pixels without one (no cloud found, or an invalidated hint) fall back to the bottom of the cloud layer.
+// Reprojecting that point with last frame's camera gives the pixel's velocity.
+
+#define EARTH_RADIUS 6371000.0 // earth's actual radius in km = 6371
+#define ATMOSPHERE_RADIUS_INNER (EARTH_RADIUS + 7500.0) // must match cloudRayMarch.glsl
+
+#define METERS_TO_KM 0.001
+#define KM_TO_METERS 1000.0
+
+// Unjittered view ray through a uv of the cloud images; they are stored flipped in y (see cloudRayMarch.glsl)
+vec3 viewRayDirection(in vec2 imageUV)
+{
+    vec3 camRight = normalize(vec3(camera.view[0][0], camera.view[1][0], camera.view[2][0]));
+    vec3 camUp    = normalize(vec3(camera.view[0][1], camera.view[1][1], camera.view[2][1]));
+    vec3 camLook  = -normalize(vec3(camera.view[0][2], camera.view[1][2], camera.view[2][2]));
+
+    vec2 ndc = vec2(imageUV.x, 1.0 - imageUV.y) * 2.0 - 1.0;
+    return normalize(camLook + ndc.x * camera.tanFovBy2.x * camRight + ndc.y * camera.tanFovBy2.y * camUp);
+}
+
+// Distance along the ray to the bottom of the cloud layer. The camera is always below it, so this is the far root
+float innerShellDistance(in vec3 origin, in vec3 dir)
+{
+    vec3 earthCenter = vec3(origin.x, -EARTH_RADIUS, origin.z); // earth below the camera
+    vec3 oc = origin - earthCenter;
+    float b = dot(oc, dir);
+    float c = dot(oc, oc) - ATMOSPHERE_RADIUS_INNER * ATMOSPHERE_RADIUS_INNER;
+    return -b + sqrt(max(b * b - c, 0.0));
+}
+
+// Distance to the clouds seen along dir, from a cloud distance hint (see cloudRayMarch.glsl)
+float cloudDepth(in vec3 origin, in vec3 dir, in vec4 distanceHint)
+{
+    return (distanceHint.z >= 0.0) ? distanceHint.x * KM_TO_METERS : innerShellDistance(origin, dir);
+}
+
+// uv in the cloud images a world space point had last frame. Outside [0,1] when it was off screen
+vec2 previousImageUV(in vec3 worldPoint)
+{
+    // camera space <x,y,z> to uv space <u,v,1>; -z because in camera space we look down negative z
+    vec3 oldCameraRayDir = (cameraOld.view * vec4(worldPoint, 1.0)).xyz;
+    if(oldCameraRayDir.z >= 0.0)
+    {
+        return vec2(-1.0); // behind last frame's camera
+    }
+    oldCameraRayDir /= -oldCameraRayDir.z;
+    vec2 old_uv = vec2(oldCameraRayDir.x / cameraOld.tanFovBy2.x, oldCameraRayDir.y / cameraOld.tanFovBy2.y) * 0.5 + 0.5;
+    old_uv.y = 1.0 - old_uv.y;
+    return old_uv;
+}
@@ -0,0 +1,1136 @@
+// Cloud ray march, included by cloudRayMarch.comp (float) and cloudRayMarchFP16.comp (float16 density and lighting math)
+
+// The workgroup size is given through specialization constants 0 and 1 so the renderer
+// can pick the best size per device (see WorkgroupTuner)
+layout (local_size_x_id = 0, local_size_y_id = 1) in;
+
+layout (set = 0, binding = 0, rgba16f) uniform writeonly image2D currentFrameResultImage;
+layout (set = 0, binding = 1, rgba16f) uniform readonly image2D previousFrameResultImage;
+// Ray-start hints, see the "Ray-Start Hints" defines below. Holds last frame's hints reprojected to this frame
+// by the reprojection pass; the pixels ray marched this frame overwrite theirs with fresh values
+layout (set = 0, binding = 2, rgba16f) uniform image2D currentCloudDistanceImage;
+// Light history, see the "Light History" defines below. Carried over by the reprojection pass like the hints
+layout (set = 0, binding = 5, rgba16f) uniform image2D currentLightHistoryImage;
+// Depth of the scene geometry at the cloud resolution, see sceneDepth.glsl
+layout (set = 0, binding = 7) uniform sampler2D sceneDepthSampler;
+layout (set = 1, binding = 0) uniform sampler3D cloudBaseShapeSampler;
+layout (set = 1, binding = 1) uniform sampler3D cloudDetailsHighFreqSampler; // Dont use alpha channel
+layout (set = 1, binding = 2) uniform sampler2D curlNoiseSampler; // Don't use alpha channel
+layout (set = 1, binding = 3) uniform sampler2D weatherMapSampler; // Don't use alpha channel
+layout (set = 1, binding = 4) uniform writeonly image2D godRaysCreationDataImage; // r = light let through along the ray, see godRaysDownsample.comp. Format picked by the renderer
+layout (set = 1, binding = 5) uniform sampler2D skyViewLUTSampler; // sky luminance per view direction, see skyViewLUT.comp
+layout (set = 1, binding = 6) uniform sampler2D transmittanceLUTSampler; // see transmittanceLUT.comp
+layout (set = 1, binding = 7) uniform sampler3D aerialPerspectiveSampler; // rgb = in-scattering, a = transmittance, see aerialPerspective.comp
+layout (set = 1, binding = 8) uniform sampler2DArray blueNoiseSampler; // tiled spatiotemporal blue noise, see BlueNoiseGenerator
+
+layout (set = 2, binding = 0) uniform CameraUBO
+{
+	mat4 view;
+	mat4 proj;
+	vec4 eye;
+	vec2 tanFovBy2;
+} camera;
+
+layout (set = 3, binding = 0) uniform TimeUBO
+{
+    vec4 haltonSeq1;
+    vec4 haltonSeq2;
+    vec4 haltonSeq3;
+    vec4 haltonSeq4;
+    vec2 time; //stores delat time and total time
+	int frameCountMod16;
+	int frameCycle; // number of completed 16 frame cycles
+};
+
+layout (set = 4, binding = 0) uniform SunAndSkyUBO
+{
+    vec4 sunLocation;
+	vec4 sunDirection;
+	vec4 lightColor;
+	float sunIntensity;
+} sunAndSky;
+
+// Runtime quality parameters, see CloudQuality in Sky.h. Distances are in km
+layout (set = 6, binding = 0) uniform CloudQualityUBO
+{
+    int lodEnabled;
+    float stepGrowthStartDistance;
+    float stepGrowthPerKm;
+    float maxStepScale;
+    float detailFadeStartDistance;
+    float detailFadeEndDistance;
+    float curlFadeStartDistance;
+    float curlFadeEndDistance;
+    float farLightSampleDistance;
+    int nearLightSamples;
+    int farLightSamples;
+    float minMarchSteps;
+    float maxMarchSteps;
+    int godRaySamples;
+    int amortizedLightSamples;
+} quality;
+
+// Panoramic band of the distant clouds just above the horizon, written by cloudHorizonBand.comp and sampled
+// by the ray march in place of marching those long rays. See HorizonBand in Sky.h
+layout (set = 7, binding = 0, rgba16f) uniform writeonly image2D horizonBandImage;
+layout (set = 7, binding = 1, rgba16f) uniform writeonly image2D horizonBandDistanceImage;
+layout (set = 7, binding = 2) uniform sampler2D horizonBandSampler; // rgb = lit cloud color * coverage, a = coverage
+layout (set = 7, binding = 3) uniform sampler2D horizonBandDistanceSampler; // r = first hit in km * coverage
+layout (set = 7, binding = 4) uniform HorizonBandUBO
+{
+    vec4 origin; // camera position the band is ray marched from, negated like camera.eye
+    float maxElevation;
+    int active;
+    int firstColumn;
+    int columnCount;
+} horizonBand;
+
+#include "atmosphere.glsl"
+#include "sceneDepth.glsl"
+
+//--------------------------------------------------------
+//					PRECISION
+//--------------------------------------------------------
+// The density and lighting math works on normalized densities and energies, which float16 holds well enough.
+// cloudRayMarchFP16.comp defines RAY_MARCH_FP16 to run it in float16, which halves the registers it needs.
+// Positions, distances along the ray and the earth/atmosphere intersections always stay float:
+// at the scale of the earth radius float16 can't even represent them.
+// Values have to be converted explicitly with mfloat(...), float16 is never implicitly converted to
+#ifdef RAY_MARCH_FP16
+#define mfloat float16_t
+#define mvec3 f16vec3
+#define mvec4 f16vec4
+#else
+#define mfloat float
+#define mvec3 vec3
+#define mvec4 vec4
+#endif
+
+struct Ray {
+    vec3 origin;
+    vec3 direction;
+};
+
+struct Intersection {
+    vec3 normal;
+    vec3 point;
+    bool valid;
+    float t;
+};
+
+//Global Defines for Debug Views
+#define BACKGROUND_SKY 0
+#define CLOUD_DENSITY 0
+#define TEXTURE_CURL_NOISE 0
+#define TEXTURE_HIGH_FREQ 0
+#define TEXTURE_LOW_FREQ 0
+#define HEIGHT_GRADIENT 0
+#define T_TESTS 0
+#define HG_TEST 0
+#define BEERS_TEST 0
+#define SAMPLE_COST_HEATMAP 0 // texture fetches per ray: blue = none, green = ~250, red = 500 or more
+
+#if SAMPLE_COST_HEATMAP
+int sampleCost = 0;
+#define COUNT_TEXTURE_FETCHES(n) sampleCost += n
+#else
+#define COUNT_TEXTURE_FETCHES(n)
+#endif
+
+//Global Defines for math constants
+#define PI 3.14159265
+#define THREE_OVER_SIXTEEN_PI 0.05968310365946075
+#define ONE_OVER_FOUR_PI 0.07957747154594767
+#define E 2.718281828459
+
+//Global Defines for Colors
+#define BLACK vec3(0,0,0)
+#define WHITE vec3(1,1,1)
+
+//Global Defines for Earth and Cloud Layers 
+#define EARTH_RADIUS 6371000.0 // earth's actual radius in km = 6371
+#define ATMOSPHERE_RADIUS_INNER (EARTH_RADIUS + 7500.0) //paper suggests values of 15000-35000m above
+#define ATMOSPHERE_RADIUS_OUTER (EARTH_RADIUS + 20000.0)
+#define ATMOSPHERE_THICKNESS (ATMOSPHERE_RADIUS_OUTER - ATMOSPHERE_RADIUS_INNER)
+
+// Global Defines for the Atmosphere (see atmosphere.glsl)
+#define CLOUD_LAYER_ALTITUDE_KM 10.0 // where the sun light color for the clouds is looked up
+#define AERIAL_PERSPECTIVE_MAX_DISTANCE_KM 256.0 // must match aerialPerspective.comp
+
+// Ray-Start Hints
+// Every ray marched pixel stores where its ray first found cloud and where it became opaque so that the next march
+// of that pixel can skip the empty stretch in front of the clouds and stop soon after saturation.
+// Layout: x = first hit distance (km), y = saturation distance (km, negative if the ray never saturated),
+//		   z = accumulated uncertainty (km) from camera motion and wind since the hint was created (negative = invalid hint),
+//		   w = age of the hint in frames
+#define METERS_TO_KM 0.001
+#define KM_TO_METERS 1000.0
+#define HINT_SAFETY_MARGIN_KM 1.0 // always start this much before (and stop this much after) the hinted distances
+#define HINT_RELATIVE_MARGIN 0.05 // plus a fraction of the hinted distance, since far samples move more with the jitter
+#define INVALID_DISTANCE_HINT vec4(0.0, 0.0, -1.0, 0.0)
+
+// Clouds fade in above this y of the view direction, below it only the sky is drawn
+#define CLOUD_FADE_OUT_POINT 0.06
+
+// Global Wind Defines
+#define WIND_DIRECTION vec3(1.0,0.0,0.0)
+#define CLOUD_SPEED 0.080
+#define CLOUD_TOP_OFFSET 1.0// this offset pushes the tops of the clouds along this wind direction by this many units
+
+// Cone light sampling
+#define NUM_CONE_SAMPLES 6
+
+// Light History
+// With quality.amortizedLightSamples > 0 every in-cloud step only evaluates that many of the cone light samples, a different 
+// subset each time the pixel is ray marched. The light energy of the ray is then averaged over the revisits of the pixel:
+// x = mean, y = mean of the squares, z = number of marches averaged, w = the coverage they saw
+#define LIGHT_HISTORY_MAX_LENGTH 8.0 // marches averaged at most, so the lighting still follows the clouds
+#define LIGHT_HISTORY_SIGMA 2.5 // a march this many standard deviations away from the mean rejects the history ...
+#define LIGHT_HISTORY_RELATIVE_TOLERANCE 0.15 // ... plus this fraction of the mean, a short history has next to no variance yet
+#define LIGHT_HISTORY_MAX_COVERAGE_CHANGE 0.2 // a different cloud moved into the pixel
+
+// Number of ray march steps for rays going straight up and towards the horizon: quality.minMarchSteps/maxMarchSteps
+// (24 and 40 unless the frame budget governor lowered them). The step offsets come from blue noise, whose error is mostly
+// high frequency and gets removed by the reprojection and TXAA, so fewer steps are needed than with the Halton offsets
+// that were shared by all pixels (run BlueNoiseGenerator --compare for the numbers)
+
+//--------------------------------------------------------
+//					TOOL BOX FUNCTIONS
+//--------------------------------------------------------
+
+vec2 getJitterOffset (in int index, ivec2 dim) 
+{
+    //index is a value from 0-15
+    //Use pre generated halton sequence to jitter point --> halton sequence is a low discrepancy sampling pattern
+    vec2 jitter = vec2(0.0);
+    index = index/2;
+    if(index < 4)
+    {
+        jitter.x = haltonSeq1[index];
+        jitter.y = haltonSeq2[index];
+    }
+    else
+    {
+        index -= 4;
+        jitter.x = haltonSeq3[index];
+        jitter.y = haltonSeq4[index];
+    }
+    return jitter/dim;
+}
+
+float getJitterOffset (in int index, float maxOffset) 
+{
+    //index is a value from 0-15
+    //Use pre generated halton sequence to jitter point --> halton sequence is a low discrepancy sampling pattern
+    float jitter = 0.0;
+    index = index/2;
+    if(index < 4)
+    {
+        jitter = haltonSeq1[index];
+    }
+    else
+    {
+        index -= 4;
+        jitter = haltonSeq2[index];
+    }
+    return jitter*maxOffset;
+}
+
+// Blue noise for this invocation: x offsets the ray march steps, y rotates the light sample cone.
+// Indexed by the invocation (not the pixel), because the pixels ray marched together are 4 pixels apart. The layer
+// only changes once every pixel has been ray marched, since a pixel is only ray marched once every 16 frames
+vec2 getBlueNoise(in ivec2 invocation)
+{
+    ivec3 size = textureSize(blueNoiseSampler, 0);
+    ivec3 texel = ivec3(invocation % size.xy, frameCycle % size.z);
+    return texelFetch(blueNoiseSampler, texel, 0).rg;
+}
+
+// Maps values from one range to another
+// Defined for float and, in the float16 variant, for float16_t as well
+#define DEFINE_REMAP_FUNCTIONS(T) \
+T remap(in T value, in T original_min, in T original_max, in T new_min, in T new_max) \
+{ \
+	return new_min + ( ((value - original_min) / (original_max - original_min)) * (new_max - new_min) ); \
+} \
+ \
+T remapClamped(in T value, in T original_min, in T original_max, in T new_min, in T new_max) \
+{ \
+    T t = new_min + ( ((value - original_min) / (original_max - original_min)) * (new_max - new_min) ); \
+    return clamp(t, new_min, new_max); \
+} \
+ \
+T remapClampedBeforeAndAfter(in T value, in T original_min, in T original_max, in T new_min, in T new_max) \
+{ \
+    value = clamp(value, original_min, original_max); \
+    T t = new_min + ( ((value - original_min) / (original_max - original_min)) * (new_max - new_min) ); \
+    return clamp(t, new_min, new_max); \
+}
+
+DEFINE_REMAP_FUNCTIONS(float)
+#ifdef RAY_MARCH_FP16
+DEFINE_REMAP_FUNCTIONS(float16_t)
+#endif
+
+float getRelativeHeightInAtmosphere(in vec3 point, in vec3 earthCenter, in vec3 startPosOnInnerShell, in vec3 rayDir, in vec3 eye)
+{
+	float lengthOfRayfromCamera = length(point - eye);
+	float lengthOfRayToInnerShell = length(startPosOnInnerShell - eye);
+	vec3 pointToEarthDir = normalize(point - earthCenter);
+	// assuming RayDir is normalised
+	float cosTheta = dot(rayDir, pointToEarthDir);
+
+    // CosTheta is an approximation whose error gets relatively big near the horizon and could lead to problems.
+    // However, the actual calculationis involve a lot of trig and thats expensive;
+    // No longer drawing clouds that close to the horizon and so the cosTheta Approximation is fine
+
+	float numerator = abs(cosTheta * (lengthOfRayfromCamera - lengthOfRayToInnerShell));
+	return numerator/ATMOSPHERE_THICKNESS;
+	// return clamp( length(point.y - projectedPos.y) / ATMOSPHERE_THICKNESS, 0.0, 1.0);
+}
+
+vec3 getRelativePositionInAtmosphere(in vec3 pos, in vec3 earthCenter)
+{
+   	return vec3( ( pos - vec3(earthCenter.x, ATMOSPHERE_RADIUS_INNER - EARTH_RADIUS, earthCenter.z) )/ ATMOSPHERE_THICKNESS );
+}
+
+//Compute Ray for ray marching based on NDC point
+Ray castRay( vec2 screenPoint, vec3 eye, int pixelID, ivec2 dim )
+{
+	Ray r;
+
+    // Extract camera information from uniform
+	vec3 camRight = normalize(vec3( camera.view[0][0], 
+				    				camera.view[1][0], 
+				    				camera.view[2][0] ));
+	vec3 camUp =    normalize(vec3( camera.view[0][1], 
+				    				camera.view[1][1], 
+				    				camera.view[2][1] ));
+	vec3 camLook =  -normalize(vec3(camera.view[0][2], 
+				    				camera.view[1][2], 
+				    				camera.view[2][2] ));
+
+	// Compute ndc space point from screenspace point //[-1,1] to [0,1] range
+    vec2 NDC_Space_Point = screenPoint * 2.0 - 1.0; 
+
+    //Jitter point with halton sequence
+    NDC_Space_Point += getJitterOffset(pixelID, dim);
+
+    //convert to camera space
+    vec3 cam_x = NDC_Space_Point.x * camera.tanFovBy2.x * camRight;
+    vec3 cam_y = NDC_Space_Point.y * camera.tanFovBy2.y * camUp;
+    //convert to world space
+    vec3 ref = eye+camLook;
+    vec3 p = ref + cam_x + cam_y; //facing the screen
+
+    r.origin = eye;
+    r.direction = normalize(p - eye);
+
+    return r;
+}
+
+//Sphere Intersection Testing
+Intersection raySphereIntersection(in vec3 rO, in vec3 rD, in vec3 sphereCenter, in float sphereRadius)
+{
+    Intersection isect;
+    isect.valid = false;
+    isect.point = vec3(0.0);
+    isect.normal = vec3(0.0, 1.0, 0.0);
+
+    // Transform Ray such that the spheres move down, such that the camera is close to the sky dome
+    // Only change sphere origin because you can't translate a direction
+    rO -= sphereCenter;
+    rO /= sphereRadius;
+
+    float A = dot(rD, rD);
+    float B = 2.0*dot(rD, rO);
+    float C = dot(rO, rO) - 1.0; //uniform sphere
+    float discriminant = B*B - 4.0*A*C;
+
+    //If the discriminant is negative, then there is no real root
+    if(discriminant < 0.0)
+    {
+        return isect;
+    }
+
+    float t = (-B - sqrt(discriminant))/(2.0*A);
+    
+    if(t < 0.0) 
+    {
+        t = (-B + sqrt(discriminant))/(2.0*A);
+    }
+
+    if(t >= 0.0)
+    {
+        vec3 p = vec3(rO + t*rD);
+        isect.valid = true;
+        isect.normal = normalize(p);
+
+        p *= sphereRadius;
+        p += sphereCenter;
+
+        isect.point = p;
+        isect.t = length(p-rO);
+    }
+
+    return isect;
+}
+
+//--------------------------------------------------------
+//						LIGHTING
+//--------------------------------------------------------
+
+/*
+    Note:
+        - Apply this result whenever you calculate radiance of your sample 
+
+    Functionality:
+        - Combine 2 HG functions with max() to retain baseline forward scattering and achieve silver lining highlights
+    
+        eccentricity = 0.6
+    
+        silver_intensity = user controlled param [0, 1]
+                            Controls intensity of the effect of using 2 HG functions and the spread away from the sun
+                            Increase this to add intensity on clouds near the sun 
+
+        silver_spread = user contorlled param [0, 1]
+                            Decrease this to increase brightness that's spread throughout clouds away from the sun
+*/
+// Evaluated once per ray, so it stays float: close to the sun the denominator cancels out, which float16 can't resolve
+float HenyeyGreenstein(float cos_angle, float eccentricity)
+{
+	float numerator =  1.0 - eccentricity * eccentricity;
+	float denominator = pow((1.0 + eccentricity * eccentricity - 2.0 * eccentricity * cos_angle), 1.5);
+    return (numerator / denominator) * ONE_OVER_FOUR_PI;
+}
+
+float HGModified(float cos_angle, float eccentricity, float silver_intensity, float silver_spread)
+{
+    return max( HenyeyGreenstein(cos_angle, eccentricity),  
+                silver_intensity * HenyeyGreenstein(cos_angle, 0.99 - silver_spread) );
+}
+
+/*
+    Note: 
+        - Only do this when you look away from sun
+        - Ramp down this affect as angle b/w viewRay and lightRay decrease
+        - attenuation_reduction_factor = 0.25;
+    	- influence_reduction_factor = 0.7;
+
+    Functionality: 
+        - Attenuation value for the second function was reduced to push light further into the cloud
+        - Reduce its influence so to not overpower the result. 
+        - density_along_light_ray comes from cone sampling 
+*/
+mfloat BeerLambertModified(mfloat density_along_light_ray, mfloat attenuation_reduction_factor, mfloat influence_reduction_factor)
+{
+    return max( exp(density_along_light_ray) , 
+    			exp(density_along_light_ray * attenuation_reduction_factor) * influence_reduction_factor );
+}
+
+/*
+	Notes:
+		- dl is the density sampled along the light ray for the given sample position.
+		- ds_loded is the low lod sample of density at the given sample position.
+*/
+mfloat GetLightEnergy(mfloat height_fraction, mfloat dl, mfloat ds_loded, mfloat phase_probability, mfloat cos_angle, float step_size, mfloat brightness)
+{
+    // Attenuation – difference from slides – reduce the secondary component when we look toward the sun.
+    mfloat primary_attenuation = exp(-dl);
+
+
+    // NOTE: in the slides, seconary_attenuation was "secondary_intensity_curve", and primary_attenuation was "primary_intensity_curve". UNSURE IF SAME
+    // FIRST INSTANCE
+    // float secondary_attenuation = exp(-dl * 0.25) * 0.7;
+    mfloat secondary_attenuation = exp(-dl);
+    mfloat attenuation_probability = max( 
+    									remap(cos_angle, mfloat(0.7), mfloat(1.0), secondary_attenuation, secondary_attenuation * mfloat(0.25)), 
+    									primary_attenuation);
+    
+    // --------------------------------------------------------------------------------------------------------------------
+    
+    // // SECOND INSTANCE -------> DARKER THAN THE FIRST INSTANCE
+    // float beerLambertModified = BeerLambertModified(-dl, 0.25, 0.7);
+    // float attenuation_probability = mix(primary_attenuation, beerLambertModified, -cos_angle * 0.5 + 0.5);
+    
+
+    // In-scattering – one difference from presentation slides – we also reduce this effect once light has attenuated to make it directional.
+
+    // // FIRST INSTANCE -----> THIS PRODUCES MORE BANDING EFFECTS
+    // float depth_probability = mix( 0.05 + pow(ds_loded, 
+    //                                           remap(height_fraction, 0.3, 0.85, 0.5, 2.0))
+    //                              , 1.0, clamp( dl / step_size, 0.0, 1.0));
+    
+    // --------------------------------------------------------------------------------------------------------------------
+
+    // // SECOND INSTANCE
+    // float depth_probability = mix(0.05 + pow(ds_loded, clamp(
+    // 														remap(height_fraction, 0.3, 0.85, 0.5, 2.0), 
+    // 														0.6, 2.0)), 
+    // 							1.0, 
+    // 							clamp(dl / step_size, 0.0, 1.0));
+
+
+    // float vertical_probability = pow(clamp(
+    // 										remap(height_fraction, 0.07, 0.14, 0.1, 1.0), 
+    // 										0.1, 1.0), 
+    // 								0.8 );
+
+
+    // THIRD INSTANCE ------> LOOKS ESSENTIALLY SAME AS SECOND INSTANCE
+
+    // MANIPULATE ME 
+    mfloat depth_probability = mfloat(0.05) + pow(ds_loded, clamp(remap(height_fraction * mfloat(0.125), mfloat(0.3), mfloat(0.85), mfloat(0.5), mfloat(2.0)), 
+                                                                mfloat(0.5), mfloat(2.0)));
+    mfloat vertical_probability = pow(clamp(remap(height_fraction * mfloat(1.5), mfloat(0.07), mfloat(0.34), mfloat(0.1), mfloat(1.0)), 
+                                            mfloat(0.1), mfloat(1.0)), mfloat(0.8));
+
+    // MANIPULATE ME 
+    mfloat in_scatter_probability = depth_probability * vertical_probability;
+
+    // float light_energy = attenuation_probability * in_scatter_probability * phase_probability * brightness;						// ORIGINAL (LIGHTEST)
+    mfloat light_energy = attenuation_probability * primary_attenuation * in_scatter_probability * phase_probability * brightness;	// MEDIUM
+    // float light_energy = primary_attenuation * secondary_attenuation * in_scatter_probability * phase_probability * brightness;	// DARKEST
+    return light_energy;
+}
+
+//--------------------------------------------------------
+//					ATMOSPHERE
+//--------------------------------------------------------
+/*
+	The sky, the sun light reaching the clouds and the haze in front of them all come from the precomputed
+	atmosphere LUTs (see atmosphere.glsl and the *LUT.comp / aerialPerspective.comp passes).
+*/
+
+// Inverse of skyViewLUTDirection in skyViewLUT.comp: u = longitude, v = sqrt(elevation / (PI/2))
+vec2 skyViewLUTUV(vec3 dir)
+{
+    float azimuth = atan(dir.z, dir.x);
+    float elevation = asin(clamp(dir.y, 0.0, 1.0));
+    vec2 uv = vec2(azimuth / (2.0 * PI) + 0.5, sqrt(elevation / (PI * 0.5)));
+
+    // u wraps around (repeat sampler), v must not: keep the bilinear footprint inside the LUT
+    float halfTexelV = 0.5 / float(textureSize(skyViewLUTSampler, 0).y);
+    uv.y = clamp(uv.y, halfTexelV, 1.0 - halfTexelV);
+    return uv;
+}
+
+// The sun disk is much smaller than a sky-view LUT texel, so it is added analytically, dimmed by the atmosphere in front of it
+vec3 getSunDiskLuminance(vec3 dir, vec3 sunDir)
+{
+    float cosTheta = dot(sunDir, dir);
+    const float cosSunRadius = cos(SUN_ANGULAR_RADIUS);
+    if(cosTheta < cosSunRadius)
+    {
+        return BLACK;
+    }
+
+    vec3 viewer = atmosphereViewerPosition(0.0);
+    float sunDisk = smoothstep(cosSunRadius, cosSunRadius + 0.00002, cosTheta);
+    return getSunTransmittance(transmittanceLUTSampler, viewer, dir) * SUN_DISK_LUMINANCE * sunAndSky.sunIntensity * sunDisk;
+}
+
+// Sky color (HDR) seen along dir: one fetch into the sky-view LUT plus the sun disk
+vec3 getSkyColor(vec3 dir, vec3 sunDir)
+{
+    return textureLod(skyViewLUTSampler, skyViewLUTUV(dir), 0.0).rgb + getSunDiskLuminance(dir, sunDir);
+}
+
+// Color of the sun light arriving at the cloud layer, relative to the sun at the zenith: white at noon, orange and red at sunset
+vec3 getCloudSunColor(vec3 sunDir)
+{
+    vec3 cloudLayer = atmosphereViewerPosition(CLOUD_LAYER_ALTITUDE_KM);
+    vec3 zenithTransmittance = getTransmittanceToTop(transmittanceLUTSampler, length(cloudLayer), 1.0);
+    return getSunTransmittance(transmittanceLUTSampler, cloudLayer, sunDir) / zenithTransmittance;
+}
+
+// Froxel of the aerial perspective volume for a pixel uv (as stored in the cloud images) and a distance along its view ray.
+// Inverse of the quadratic slice distribution in aerialPerspective.comp
+vec3 aerialPerspectiveUVW(vec2 imageUV, float distanceKm)
+{
+    return vec3(imageUV, sqrt(clamp(distanceKm / AERIAL_PERSPECTIVE_MAX_DISTANCE_KM, 0.0, 1.0)));
+}
+
+// Horizon band: azimuth along u, the y of the view direction along v from CLOUD_FADE_OUT_POINT up to the top of the band
+vec2 horizonBandUV(vec3 dir)
+{
+    ivec2 size = textureSize(horizonBandSampler, 0);
+    float v = (dir.y - CLOUD_FADE_OUT_POINT) / (horizonBand.maxElevation - CLOUD_FADE_OUT_POINT);
+    // u wraps around (repeat sampler), v must not blend the top row with the bottom one
+    return vec2(atan(dir.z, dir.x) / (2.0 * PI) + 0.5, clamp(v, 0.5 / size.y, 1.0 - 0.5 / size.y));
+}
+vec3 horizonBandDirection(vec2 uv)
+{
+    float azimuth = (uv.x - 0.5) * 2.0 * PI;
+    float y = mix(CLOUD_FADE_OUT_POINT, horizonBand.maxElevation, uv.y);
+    float horizontal = sqrt(1.0 - y * y);
+    return vec3(cos(azimuth) * horizontal, y, sin(azimuth) * horizontal);
+}
+
+
+//--------------------------------------------------------
+//					CLOUD SAMPLING
+//--------------------------------------------------------
+
+float getDensityHeightGradientForPoint(in float relativeHeight, in float cloudType)
+{
+    relativeHeight = clamp(relativeHeight, 0.0, 1.0);
+
+    float cumulus = max(0.0, remap(relativeHeight, 0.01, 0.3, 0.0, 1.0) * remap(relativeHeight, 0.6, 0.95, 1.0, 0.0));
+    float stratocumulus = max(0.0, remap(relativeHeight, 0.0, 0.25, 0.0, 1.0) * remap(relativeHeight,  0.3, 0.65, 1.0, 0.0)); 
+    float stratus = max(0.0, remap(relativeHeight, 0, 0.1, 0.0, 1.0) * remap(relativeHeight, 0.2, 0.3, 1.0, 0.0)); 
+
+    float a = mix(stratus, stratocumulus, clamp(cloudType * 2.0, 0.0, 1.0));
+
+    float b = mix(stratocumulus, stratus, clamp((cloudType - 0.5) * 2.0, 0.0, 1.0));
+    return mix(a, b, cloudType);
+}
+
+vec3 skewSamplePointWithWind(in vec3 point, inout float height_fraction)
+{
+    //skew in wind direction
+    point += height_fraction * WIND_DIRECTION * CLOUD_TOP_OFFSET * 0.009;
+    
+    //Animate clouds in wind direction and add a small upward bias to the wind direction
+    point += (WIND_DIRECTION + vec3(0.0, 0.1, 0.0)) * CLOUD_SPEED * time.y;
+    return point;
+}
+
+// The sample point is a position and stays float, the densities are mfloat
+mfloat sampleLowFrequency(vec3 point, in vec3 unskewedSamplePoint, in mfloat relativeHeight, in vec3 earthCenter)
+{
+    COUNT_TEXTURE_FETCHES(1);
+
+    //Read in the low-frequency Perlin-Worley noises and Worley noises
+    mvec4 lowFrequencyNoises = mvec4(texture(cloudBaseShapeSampler, point));// * 0.8);	// MANIPULATE ME 
+
+    //Build an FBM out of the low-frequency Worley Noises that are used to add detail to the Low-frequency Perlin Worley noise
+    mfloat lowFrequencyFBM = (lowFrequencyNoises.g * mfloat(0.625)) + 
+                             (lowFrequencyNoises.b * mfloat(0.25))  + 
+                             (lowFrequencyNoises.a * mfloat(0.125));
+    
+    // lowFrequencyFBM = clamp(abs(lowFrequencyFBM), 0.0, 1.0);  
+    lowFrequencyFBM = clamp(lowFrequencyFBM, mfloat(0.0), mfloat(1.0));                      
+
+    // Define the base cloud shape by dilating it with the low-frequency FBM
+    mfloat baseCloud = remapClamped( lowFrequencyNoises.r, (lowFrequencyFBM - mfloat(0.9)), mfloat(1.0), mfloat(0.0), mfloat(1.0) );
+    
+    // TODO: Use weater map for cloud types and blend between them and their densities
+    // ------------------ only screws it up; but needed for blending cloud types -----------------------
+    // // Get the density-height gradient
+    // vec2 weatherSamplePoint = unskewedSamplePoint.xz;// / 50.0;// / 50.0;//50000.0f;
+    // vec3 weather_data = texture(weatherMapSampler, weatherSamplePoint).rgb;
+    // float cloudType = weather_data.g;
+    // float densityHeightGradient = getDensityHeightGradientForPoint(relativeHeight, weather_data.g);
+
+    // // Apply Height function to the base cloud shape
+    // baseCloud *= densityHeightGradient * 0.5;// * 0.8;
+    // -------------------------------------------------------------------------------------------------
+
+    // Cloud coverage is stored in weather data’s red channel .
+    //WHAT EVEN???? --> increasing cloud coverage apparently reduces base_cloud_with_coverage
+    mfloat cloud_coverage = mfloat(0.6);// weather_data.r;
+
+    // Use remap to apply the cloud coverage attribute.
+    mfloat base_cloud_with_coverage = remapClampedBeforeAndAfter ( baseCloud, cloud_coverage, mfloat(1.0), mfloat(0.0), mfloat(1.0));
+
+    // To ensure that the density increases with coverage in an aesthetically pleasing manner
+    // Multiply the result by the cloud coverage attribute so that smaller clouds are lighter 
+    // and more aesthetically pleasing
+    base_cloud_with_coverage *= cloud_coverage;
+
+    return base_cloud_with_coverage;
+}
+
+// detailWeight and curlWeight fade the erosion and the curl distortion out with distance (see the LOD functions);
+// at a weight of 0 the corresponding texture fetch is skipped entirely
+mfloat erodeCloudWithHighFrequency(in mfloat baseCloud, in vec3 rayDir, in vec3 point, in float height_fraction,
+                                   in float detailWeight, in float curlWeight)
+{
+    if(detailWeight <= 0.0)
+    {
+        return baseCloud;
+    }
+
+    // Add turbulence to the bottom of the clouds (moves the sample position, so float)
+    if(curlWeight > 0.0)
+    {
+        COUNT_TEXTURE_FETCHES(1);
+        vec4 curlNoise = texture(curlNoiseSampler, point.xy);
+        point.xy += curlNoise.xy * (1.0 - height_fraction) * 0.5 * curlWeight;
+    }
+
+    // Sample High Frequency Noises
+    COUNT_TEXTURE_FETCHES(1);
+    mvec4 highFrequencyNoise = mvec4(texture(cloudDetailsHighFreqSampler, point));	// MANIPULATE ME 
+
+    // Build High Frequency FBM
+    mfloat high_freq_FBM = (highFrequencyNoise.r * mfloat(0.625)) + 
+                           (highFrequencyNoise.g * mfloat(0.25))  +
+                           (highFrequencyNoise.b * mfloat(0.125)); 
+
+	//Erode the base shape of the cloud with the distorted high frequency worley noises
+
+	// MANIPULATE ME 
+	mfloat high_freq_modifier = clamp( mix(high_freq_FBM, mfloat(1.0) - high_freq_FBM, mfloat(clamp(height_fraction * 2.0, 0.0, 1.0))), 
+	                                   mfloat(0.0), mfloat(1.0));
+
+    mfloat final_cloud = remap(baseCloud, high_freq_modifier * mfloat(0.005), mfloat(1.0), mfloat(0.0), mfloat(1.0));
+	return mix(baseCloud, final_cloud, mfloat(detailWeight));
+}
+
+//--------------------------------------------------------
+//					LEVEL OF DETAIL
+//--------------------------------------------------------
+// Far away clouds cover only a few pixels, so the expensive parts of a sample can be faded out with distance
+
+// 1 up to fadeStart, 0 beyond fadeEnd
+float lodFade(in float distanceKm, in float fadeStart, in float fadeEnd)
+{
+    if(quality.lodEnabled == 0)
+    {
+        return 1.0;
+    }
+    return 1.0 - smoothstep(fadeStart, fadeEnd, distanceKm);
+}
+
+// Multiplier for the step length at this distance
+float lodStepScale(in float distanceKm)
+{
+    if(quality.lodEnabled == 0)
+    {
+        return 1.0;
+    }
+    return clamp(1.0 + (distanceKm - quality.stepGrowthStartDistance) * quality.stepGrowthPerKm, 1.0, quality.maxStepScale);
+}
+
+int lodLightSamples(in float distanceKm)
+{
+    if(quality.lodEnabled == 0 || distanceKm < quality.farLightSampleDistance)
+    {
+        return clamp(quality.nearLightSamples, 1, NUM_CONE_SAMPLES);
+    }
+    return clamp(quality.farLightSamples, 1, NUM_CONE_SAMPLES);
+}
+
+// start_t and end_t are the intersections with the cloud layer and define the step size. march_start_t and march_end_t
+// are the (possibly shorter) part of that interval that is actually marched when a ray-start hint is available.
+// firstHit_t and saturation_t return the distances that will become the hint for the next march (negative if not found)
+// lightSampleBudget > 0 evaluates only that many cone light samples per step, rotating through the kernel (see "Light History")
+vec3 rayMarch(Ray ray, vec3 earthCenter, in vec3 startPos, in float start_t, in float end_t, in float march_start_t, in float march_end_t,
+			  in vec2 blueNoise, in int lightSampleBudget, inout float accumDensity, out float firstHit_t, out float saturation_t)
+{
+    float _dot = dot(ray.direction, vec3(0.0f, 1.0f, 0.0f));
+
+    // MANIPULATE ME 
+    const float baseDensityFactor = 0.380f;//0.5f; // increase this to get more dense cloud centers    
+    const float maxSteps = floor(mix(quality.minMarchSteps, quality.maxMarchSteps, 1.0f - _dot));
+	
+    const float atmosphereThickness = (end_t - start_t);	
+	const float stepSize = (atmosphereThickness / maxSteps);
+    mfloat transmittance = mfloat(1.0);
+
+    vec3 pos;
+    vec3 samplePoint;
+    mvec3 returnColor = mvec3(0.0);
+    mfloat baseDensity;
+    mfloat density = mfloat(accumDensity); // accumulated in the precision of the lighting math, see PRECISION
+
+    // Lighting data -------------------------------------------------------------------
+    // Henyey-Greenstein
+    // The sun is given by the SunAndSky uniform (see Sky::UpdateSunAndSky)
+    const vec3 lightDir = normalize(sunAndSky.sunDirection.xyz);
+    const float cos_angle = dot(normalize(ray.direction), lightDir);
+    const float eccentricity = 0.6;
+    const float silver_intensity = 0.7;
+    const float silver_spread = 0.1;
+    const mfloat HG_light = mfloat(HGModified(cos_angle, eccentricity, silver_intensity, silver_spread));
+
+    // Random unit vectors for your cone sample.
+    // These are positioned to be facing the sun 
+    // Create random samples within a unit cone facing world up (y direction)
+    // Construct TBN matrix towards light
+    // Then rotate unit cone towards the sun using TBN
+
+    vec3 maxCompUnitVector;
+    if(abs(lightDir[0]) > abs(lightDir[1]) && abs(lightDir[0]) > abs(lightDir[2]))
+    {
+        maxCompUnitVector = vec3(abs(lightDir[0]), 0.0, 0.0);
+    }
+    else if(abs(lightDir[1]) > abs(lightDir[0]) && abs(lightDir[1]) > abs(lightDir[2]))
+    {
+        maxCompUnitVector = vec3(0.0, abs(lightDir[1]), 0.0);
+    }
+    else
+    {
+        maxCompUnitVector = vec3(0.0, 0.0, abs(lightDir[2]));
+    }
+    
+    vec3 zComponent = cross(lightDir, maxCompUnitVector);
+    vec3 xComponent = cross(zComponent, lightDir);
+
+    // Spin the cone around the light direction by a blue noise angle, so that neighbouring pixels
+    // don't all miss (or all hit) the same bits of cloud with their light samples
+    const float coneAngle = blueNoise.y * 2.0 * PI;
+    const float cosCone = cos(coneAngle);
+    const float sinCone = sin(coneAngle);
+    mat3 coneRotation = mat3(cosCone, 0.0, -sinCone,
+                             0.0,     1.0, 0.0,
+                             sinCone, 0.0, cosCone);
+    mat3 sunRotMatrix = mat3(xComponent, lightDir, zComponent) * coneRotation;
+
+    const vec3 noise_kernel[] = 
+    {
+        sunRotMatrix * vec3(0.1, 0.25, -0.15),
+        sunRotMatrix * vec3(0.2, 0.5, 0.2),
+        sunRotMatrix * vec3(-0.2, 0.1, -0.1),
+        sunRotMatrix * vec3(-0.05, 0.75, 0.05),
+        sunRotMatrix * vec3(-0.1, 1.0, 0.0),
+        sunRotMatrix * vec3(0.0, 3.0, 0.0),     // One sample should be at distance 3x cone length
+    };
+    // ---------------------------------------------------------------------------------
+
+    firstHit_t = -1.0;
+    saturation_t = -1.0;
+
+    // Skip the stretch a hint says is empty. Start on the same grid of steps the full march would use,
+    // so that the sample positions don't shift around when a hint becomes available
+    march_start_t = start_t + floor(max(march_start_t - start_t, 0.0) / stepSize) * stepSize;
+    march_end_t = min(march_end_t, end_t);
+
+    // Offset all steps by a fraction of a step: turns the banding of a fixed step grid into blue noise
+    march_start_t += blueNoise.x * stepSize;
+
+    float stepScale = 1.0;
+    int cloudStep = 0; // in-cloud steps so far, rotates the subset of light samples
+
+	for (float t = march_start_t; t < march_end_t; t += stepSize * stepScale)
+	{
+		mvec3 colorPerSample = mvec3(0.0);
+
+        // Level of detail for this sample. Longer steps have to count for more density and light
+        // so that far away clouds keep the same opacity and brightness
+        const float distanceKm = t * METERS_TO_KM;
+        stepScale = lodStepScale(distanceKm);
+        const float detailWeight = lodFade(distanceKm, quality.detailFadeStartDistance, quality.detailFadeEndDistance);
+        const float curlWeight = lodFade(distanceKm, quality.curlFadeStartDistance, quality.curlFadeEndDistance);
+
+		pos = ray.origin + t * ray.direction;
+        samplePoint = getRelativePositionInAtmosphere(pos, earthCenter);
+        samplePoint /= 8.0f; //controls the frequency of how we are sampling the noise texture
+
+		float relativeHeight = getRelativeHeightInAtmosphere(pos, earthCenter, startPos, ray.direction, ray.origin);
+        vec3 skewedSamplePoint = skewSamplePointWithWind(samplePoint, relativeHeight);
+
+		baseDensity = sampleLowFrequency(skewedSamplePoint, pos, mfloat(relativeHeight), earthCenter) * mfloat(baseDensityFactor); //helps for early termination of rays
+
+		if(baseDensity > mfloat(0.0)) // Useful to prevent lighting calculations for zero density points
+		{
+            if(firstHit_t < 0.0)
+            {
+                firstHit_t = t;
+            }
+
+            //Erode Base cloud shape with higher frequency noise (more expensive and so done when we know for sure we are inside the cloud)
+            mfloat highFreqDensity = erodeCloudWithHighFrequency(baseDensity * mfloat(1.4), ray.direction, skewedSamplePoint, relativeHeight,
+                                                                 detailWeight, curlWeight);
+
+            // MANIPULATE ME 
+			density += highFreqDensity * mfloat(0.5 * stepScale);
+
+			// Do Lighting calculations with cone sampling
+			mfloat densityAlongLight = mfloat(0.0);
+			int light_samples = lodLightSamples(distanceKm);
+
+            // Amortized: a subset of the samples that moves on with every step and with every revisit of the pixel
+            // (frameCycle counts them), so that the light history sees all of them over a few marches
+            int evaluated_samples = light_samples;
+            int first_sample = 0;
+            if(lightSampleBudget > 0)
+            {
+                evaluated_samples = min(lightSampleBudget, light_samples);
+                first_sample = (frameCycle * evaluated_samples + cloudStep) % light_samples;
+            }
+            cloudStep++;
+
+			for(int s = 0; s < evaluated_samples; ++s)
+			{
+                int i = (first_sample + s) % light_samples;
+                // With fewer samples than the kernel has, keep the long distance sample (the last one) and drop the ones before it
+                int kernelIndex = (i == light_samples - 1) ? (NUM_CONE_SAMPLES - 1) : i;
+
+				// Add the current step offset to the sample position
+                vec3 lightPos = pos + (stepSize * noise_kernel[kernelIndex] * float(kernelIndex));
+               	vec3 sampleLightPos =  getRelativePositionInAtmosphere(lightPos, earthCenter);
+
+               	// MANIPULATE ME 
+                mfloat currBaseLightDensity = sampleLowFrequency(sampleLightPos, sampleLightPos, mfloat(relativeHeight), earthCenter);
+
+                if(currBaseLightDensity > mfloat(0.0))
+                {
+                	mfloat currLightDensity = erodeCloudWithHighFrequency(mfloat(1.5) * currBaseLightDensity, ray.direction, skewedSamplePoint, relativeHeight,
+                                                                          detailWeight, curlWeight);
+                	densityAlongLight += currLightDensity;
+                }
+			}
+            // Dropped (and skipped) samples would have added density too
+            densityAlongLight *= mfloat(float(NUM_CONE_SAMPLES) / float(evaluated_samples));
+
+            // ------------------------------------------------------------------------------------------------------------------
+            // MANIPULATE ME 
+            mfloat brightness = mfloat(5.0);
+            mfloat totalLightEnergy = GetLightEnergy(mfloat(relativeHeight), densityAlongLight, baseDensity, HG_light, mfloat(cos_angle), stepSize, brightness);
+            transmittance = mix(transmittance, totalLightEnergy, (mfloat(1.0) - density)); 
+            colorPerSample = mvec3(transmittance) * mfloat(stepScale);
+            
+            returnColor += colorPerSample;
+		} //end if
+
+		if(density >= mfloat(1.0)) 
+		{
+            density = mfloat(1.0);
+            saturation_t = t;
+            break;
+        } //end if
+
+	} //end raymarcher for loop
+	accumDensity = float(density);
+	return vec3(returnColor);
+}// end raymarch function
+
+// cloudHorizonBand.comp brings its own main
+#ifndef HORIZON_BAND_PASS
+void main() 
+{
+	ivec2 dim = imageSize(currentFrameResultImage);
+
+    //Actually only raymarch for every 16th pixel because reprojection should handle the other pixels
+    int pixelID = frameCountMod16;
+
+    int pX = int(floor(pixelID/4));
+    int pY = int(floor(mod(pixelID,4)));
+
+    uint pixelX = gl_GlobalInvocationID.x * 4 + pX;
+    uint pixelY = gl_GlobalInvocationID.y * 4 + pY;
+
+    vec2 uv = vec2(pixelX, pixelY) / dim;
+    vec2 imageUV = uv; // uv as stored in the images, before the flip below
+    ivec2 chosenPixel = ivec2(pixelX, pixelY);
+
+	uv.y = 1.0 - uv.y; //cause vulkan inverts y compared to openGL
+	vec3 eyePos = -camera.eye.xyz;
+	Ray ray = castRay(uv, eyePos, pixelID, dim);
+
+	vec3 sunDir = normalize(sunAndSky.sunDirection.xyz);
+	vec3 backgroundCol = BLACK;
+
+	float _dot = dot( vec3(0.0, 1.0, 0.0), ray.direction );
+	const float backgroundColorMultiplier = max(0.620, _dot);
+    vec3 transitionGradient = WHITE;
+    const float cloudFadeOutPoint = CLOUD_FADE_OUT_POINT;
+
+	if ( _dot < 0.0 )
+	{
+		//kill threads because we shouldnt see clouds below the horizon
+		//magic numbers to make the colors look good after a tone map
+		vec3 colorNearHorizon = vec3(0.0, 0.16, 0.51) * 0.4; //dark ocean blue
+		vec3 color2 = vec3(0.0, 0.73, 0.95) * 0.5; //light ocean blue
+		backgroundCol = mix(colorNearHorizon, color2, -ray.direction.y * 5.5);
+
+		imageStore( godRaysCreationDataImage, chosenPixel, vec4(0.0f) );
+		imageStore( currentFrameResultImage, chosenPixel, vec4(backgroundCol, 0.0f) );
+		imageStore( currentCloudDistanceImage, chosenPixel, INVALID_DISTANCE_HINT );
+		return;
+	}
+    else if (_dot < cloudFadeOutPoint )
+    {
+        // Get sky background color from the sky-view LUT
+        backgroundCol = getSkyColor(ray.direction, sunDir);
+		backgroundCol *= backgroundColorMultiplier;
+
+        // No clouds this close to the horizon, nothing blocks the light
+        imageStore( godRaysCreationDataImage, chosenPixel, vec4(1.0f) );
+        imageStore( currentFrameResultImage, chosenPixel, vec4(backgroundCol, 0.0f) );
+        imageStore( currentCloudDistanceImage, chosenPixel, INVALID_DISTANCE_HINT );
+        return;
+    }
+	else
+	{
+		// Get sky background color from the sky-view LUT
+		backgroundCol = getSkyColor(ray.direction, sunDir);
+		backgroundCol *= backgroundColorMultiplier;
+	}	
+
+	vec3 earthCenter = eyePos;
+	earthCenter.y = -EARTH_RADIUS; //move earth below camera
+	Intersection atmosphereInnerIsect = raySphereIntersection(ray.origin, ray.direction, earthCenter, ATMOSPHERE_RADIUS_INNER);
+
+	// Scene geometry in front of the cloud layer hides all of it: nothing to ray march. Like below the horizon the pixel 
+	// keeps the sky without coverage and blocks the god rays; whatever draws the geometry covers it
+	float scene_t = sceneDistance(chosenPixel, ray.direction);
+	if (scene_t <= atmosphereInnerIsect.t)
+	{
+		imageStore( godRaysCreationDataImage, chosenPixel, vec4(0.0f) );
+		imageStore( currentFrameResultImage, chosenPixel, vec4(backgroundCol, 0.0f) );
+		imageStore( currentCloudDistanceImage, chosenPixel, INVALID_DISTANCE_HINT );
+		imageStore( currentLightHistoryImage, chosenPixel, vec4(0.0) );
+		return;
+	}
+
+	// Distant clouds close to the horizon come from the horizon band, while it is complete. Only the aerial perspective 
+	// is applied per pixel, the band is lit but not hazed since the froxels of the volume are in screen space
+	if (horizonBand.active != 0 && _dot < horizonBand.maxElevation)
+	{
+		vec2 bandUV = horizonBandUV(ray.direction);
+		vec4 band = textureLod(horizonBandSampler, bandUV, 0.0);
+		vec3 cloudColor = band.rgb;
+		if (band.a > 0.0)
+		{
+			float bandDistanceKm = textureLod(horizonBandDistanceSampler, bandUV, 0.0).r / band.a;
+			vec4 aerialPerspective = texture(aerialPerspectiveSampler, aerialPerspectiveUVW(imageUV, bandDistanceKm));
+			cloudColor = cloudColor * aerialPerspective.a + aerialPerspective.rgb * band.a;
+		}
+
+		// Same horizon fade as below, on premultiplied colors
+		float fade = smoothstep(0.0, 1.0, min(1.0, remap(ray.direction.y, cloudFadeOutPoint, 0.2f, 0.0f, 1.0f)));
+		float coverage = band.a * fade;
+
+		imageStore( godRaysCreationDataImage, chosenPixel, vec4(1.0 - coverage) );
+		imageStore( currentCloudDistanceImage, chosenPixel, INVALID_DISTANCE_HINT );
+		imageStore( currentFrameResultImage, chosenPixel, vec4(backgroundCol * (1.0 - coverage) + cloudColor * fade, coverage) );
+		return;
+	}
+		
+	// Find the start and end points of the ray march
+	Intersection atmosphereOuterIsect = raySphereIntersection(ray.origin, ray.direction, earthCenter, ATMOSPHERE_RADIUS_OUTER);
+
+	// Narrow the march down with the ray-start hint, if there is a valid one for this pixel
+	vec4 distanceHint = imageLoad(currentCloudDistanceImage, chosenPixel);
+	bool hintIsValid = (distanceHint.z >= 0.0);
+	float march_start_t = atmosphereInnerIsect.t;
+	float march_end_t = atmosphereOuterIsect.t;
+	if(hintIsValid)
+	{
+		float margin = (HINT_SAFETY_MARGIN_KM + HINT_RELATIVE_MARGIN * distanceHint.x + distanceHint.z) * KM_TO_METERS;
+		march_start_t = max(march_start_t, distanceHint.x * KM_TO_METERS - margin);
+		if(distanceHint.y > 0.0)
+		{
+			march_end_t = min(march_end_t, distanceHint.y * KM_TO_METERS + margin);
+		}
+	}
+
+	// Geometry inside the cloud layer ends the march at its surface
+	march_end_t = min(march_end_t, scene_t);
+
+	// Ray March
+	float accumDensity = 0.0;
+	float firstHit_t, saturation_t;
+	vec2 blueNoise = getBlueNoise(ivec2(gl_GlobalInvocationID.xy));
+	vec3 rayMarchResult = rayMarch(ray, earthCenter, atmosphereInnerIsect.point, atmosphereInnerIsect.t, atmosphereOuterIsect.t, 
+								   march_start_t, march_end_t, blueNoise, quality.amortizedLightSamples, accumDensity, firstHit_t, saturation_t);
+
+	// Average the light energy (the ray march result is grey) over the revisits of this pixel, unless this march disagrees 
+	// with the history by more than its spread or sees a different amount of cloud. Without cloud there is nothing to keep
+	float lightEnergy = rayMarchResult.r;
+	vec4 lightHistory = imageLoad(currentLightHistoryImage, chosenPixel);
+	vec4 newLightHistory = vec4(lightEnergy, lightEnergy * lightEnergy, 1.0, accumDensity);
+	if(quality.amortizedLightSamples > 0 && lightHistory.z > 0.0)
+	{
+		float sigma = sqrt(max(lightHistory.y - lightHistory.x * lightHistory.x, 0.0));
+		float tolerance = LIGHT_HISTORY_SIGMA * sigma + LIGHT_HISTORY_RELATIVE_TOLERANCE * lightHistory.x;
+		bool coverageChanged = abs(accumDensity - lightHistory.w) > LIGHT_HISTORY_MAX_COVERAGE_CHANGE;
+		if(abs(lightEnergy - lightHistory.x) <= tolerance && !coverageChanged)
+		{
+			float historyLength = min(lightHistory.z + 1.0, LIGHT_HISTORY_MAX_LENGTH);
+			newLightHistory.xy = mix(lightHistory.xy, newLightHistory.xy, 1.0 / historyLength);
+			newLightHistory.z = historyLength;
+			rayMarchResult = vec3(newLightHistory.x);
+		}
+	}
+	if(accumDensity <= 0.0)
+	{
+		newLightHistory = vec4(0.0);
+	}
+
+	// New hint for the next march of this pixel. Rays that found no cloud don't produce a hint: clouds could drift 
+	// into them anywhere along the ray. A hint that was used keeps its age so that every so often a full march 
+	// happens and catches clouds that appeared in front of the hinted distance
+	vec4 newDistanceHint = INVALID_DISTANCE_HINT;
+	if(firstHit_t >= 0.0)
+	{
+		newDistanceHint.x = firstHit_t * METERS_TO_KM;
+		newDistanceHint.y = (saturation_t >= 0.0) ? saturation_t * METERS_TO_KM : -1.0;
+		newDistanceHint.z = 0.0;
+		newDistanceHint.w = hintIsValid ? distanceHint.w : 0.0;
+	}
+
+	// Light the clouds with the sun color that makes it through the atmosphere, then haze them by their distance
+	// with the aerial perspective volume. The sky behind them already has all of the atmosphere in it
+	rayMarchResult *= getCloudSunColor(sunDir);
+	if(firstHit_t >= 0.0)
+	{
+		vec4 aerialPerspective = texture(aerialPerspectiveSampler, aerialPerspectiveUVW(imageUV, firstHit_t * METERS_TO_KM));
+		rayMarchResult = rayMarchResult * aerialPerspective.a + aerialPerspective.rgb;
+	}
+
+	// Blend and fade out clouds into the horizon (CHANGE THIRD PARAM IN REMAP)
+    accumDensity *= smoothstep(0.0, 1.0, min(1.0, remap(ray.direction.y, cloudFadeOutPoint, 0.2f, 0.0f, 1.0f)));
+    
+    // alpha holds the cloud coverage, the upsampling pass uses it to find cloud edges
+    vec4 finalColor = vec4(mix(backgroundCol, rayMarchResult, accumDensity), accumDensity);
+    
+    // Occlusion mask of the god rays: how much of the light behind the clouds gets through along this ray
+    vec4 godRaysMask = vec4(1.0 - accumDensity);
+
+// Begin debug renders
+#if TEXTURE_LOW_FREQ
+	vec4 lowFrequencyNoises = texture( cloudBaseShapeSampler, vec3(uv, sin(time.y)) );
+	finalColor = vec4(lowFrequencyNoises);
+#elif TEXTURE_HIGH_FREQ
+	vec4 highFrequencyNoises = texture( cloudDetailsHighFreqSampler, vec3(uv, sin(time.y)) );
+	finalColor = vec4(highFrequencyNoises);
+#elif TEXTURE_CURL_NOISE
+	vec4 curlNoise = texture( curlNoiseSampler, uv );
+	finalColor = vec4(curlNoise);
+#elif CLOUD_DENSITY
+	finalColor = vec4( vec3(accumDensity), 1.0 );
+#elif HG_TEST
+    const vec3 lightDir = normalize(sunAndSky.sunDirection.xyz);
+    const float cos_angle = dot(normalize(ray.direction), lightDir);
+    const float eccentricity = 0.6;
+    const float silver_intensity = 0.7;
+    const float silver_spread = 0.1;
+	float HG_light = HGModified(cos_angle, eccentricity, silver_intensity, silver_spread);
+	finalColor = vec4(vec3(HG_light), 1.0);
+#elif BACKGROUND_SKY
+	finalColor = vec4(backgroundCol, 1.0);
+#elif T_TESTS
+    if(atmosphereInnerIsect.valid == false) 
+    {
+        // Renders red if innerIsect not valid
+        finalColor = vec4(1.0, 0.0, 0.0, 1.0);
+    }
+    if(atmosphereOuterIsect.valid == false) 
+    {
+        // Renders green if outerIsect not valid
+        finalColor = vec4(0.0, 1.0, 0.0, 1.0);
+    }
+    else                                    
+    {
+        // Renders blue if both isects valid
+        finalColor = vec4(0.0, 0.0, 1.0, 1.0);
+    }
+#elif BEERS_TEST
+    finalColor = vec4(rayMarchResult, 1.0);
+#elif SAMPLE_COST_HEATMAP
+    float cost = clamp(float(sampleCost) / 500.0, 0.0, 1.0);
+    finalColor = vec4(clamp(vec3(2.0 * cost - 1.0, 1.0 - abs(2.0 * cost - 1.0), 1.0 - 2.0 * cost), 0.0, 1.0), 1.0);
+#endif
+	
+	//Pass the color off to the cloud pipeline's frag shader
+	imageStore( godRaysCreationDataImage, chosenPixel, godRaysMask );
+	imageStore( currentCloudDistanceImage, chosenPixel, newDistanceHint );
+	imageStore( currentLightHistoryImage, chosenPixel, newLightHistory );
+    imageStore( currentFrameResultImage, chosenPixel, finalColor );
+}
+#endif // HORIZON_BAND_PASS
@@ -0,0 +1,13 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// Copies the TXAA history the fused post process kernel (postProcess_Fused.comp) wrote this frame to the swapchain image
+// The history textures are R8G8B8A8_SNORM, loads need the exact format
+layout (set = 0, binding = 1, rgba8_snorm) uniform readonly image2D currentFrameResultImage;
+
+layout(location = 0) out vec4 outColor;
+
+void main()
+{
+	outColor = imageLoad( currentFrameResultImage, ivec2(gl_FragCoord.xy) );
+}
@@ -1,8 +1,17 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
 
 layout(set = 0, binding = 0) uniform sampler2D inputImageSampler;
-layout (set = 0, binding = 1, rgba8) uniform writeonly image2D currentFrameResultImage;
+layout (set = 0, binding = 1, rgba8_snorm) uniform writeonly image2D currentFrameResultImage;
+// Quarter resolution god rays (see godRaysBlur.comp), black with the god rays off
+layout (set = 0, binding = 2) uniform sampler2D godRaysSampler;
+// Exposure adapted to the frame's brightness (see exposureAverage.comp); the luminance histogram follows it in the buffer
+layout (set = 0, binding = 3) readonly buffer ExposureBuffer
+{
+    float exposure;
+    float averageLuminance;
+};
 
 layout (set = 1, binding = 0) uniform TimeUBO
 {
@@ -17,53 +26,7 @@ layout (set = 1, binding = 0) uniform TimeUBO
 layout(location = 0) in vec2 in_uv;
 layout(location = 0) out vec4 outColor;
 
-//Reference: http://filmicworlds.com/blog/filmic-tonemapping-operators/
-//Also https://www.shadertoy.com/view/lslGzl
-//Originally from the game Uncharted 2 by Naughty Dog
-#define A 0.15
-#define B 0.50
-#define C 0.10
-#define D 0.20
-#define E 0.02
-#define F 0.30
-#define INVGAMMA (1.0 / 2.2)
-#define EXPOSURE 2.5
-
-vec3 Uncharted2Tonemap(vec3 x)
-{
-   return ((x*(A*x+C*B)+D*E)/(x*(A*x+B)+D*F))-E/F;
-}
-
-vec3 tonemap(vec3 x, float whiteBalance) 
-{
-   vec3 color = Uncharted2Tonemap(EXPOSURE * x);
-
-   vec3 white = vec3(whiteBalance);
-   vec3 whitemap = 1.0 / Uncharted2Tonemap(white);
-
-   color *= whitemap;
-   return pow(color, vec3(INVGAMMA));
-}
-
-//Replacement for dithering noise function
-//Reference: https://youtu.be/4D5uX8wL1V8?t=11m22s
-//Super fast because of all the binary operations
-//Quality noise without repeating patterns
-float WangHashNoise(uint u, uint v, uint s)
-{
-	//u after a number ensures it is an unsigned int
-	uint seed = (u * 1664525u + v) + s;
-
-	seed = (seed ^ 61u) ^ (seed >> 16u);
-	seed *= 9u;
-	seed = seed ^ (seed >> 4u);
-	seed *= 0x27d4eb2d;
-	seed = seed ^ (seed >> 15u);
-
-	float value = float(seed);
-	value *= (1.0 / 4294967296.0);
-	return value;
-}
+#include "toneMap.glsl"
 
 void main() 
 {
@@ -71,14 +34,10 @@ void main()
 	ivec2 pixelPos = clamp(ivec2(round(float(dim.x) * in_uv.x), round(float(dim.y) * in_uv.y)), ivec2(0.0), ivec2(dim.x - 1, dim.y - 1));
 
 	vec3 in_color = texture(inputImageSampler, in_uv).rgb;
+	// The god rays are smooth enough for the bilinear upsampling of the sampler
+	in_color += texture(godRaysSampler, in_uv).rgb;
 
-	float whitepoint = 100.0f; //changes the point at which something becomes pure white
-	//The white point is the value that is mapped to 1.0 in the regular RGB space.
-	vec3 toneMapped_color = tonemap(in_color, whitepoint);
-
-	//Dithering to prevent banding
-	float noise = WangHashNoise(pixelPos.x, pixelPos.y, uint(time.y))*0.01;
-	toneMapped_color += vec3(noise);
+	vec3 toneMapped_color = toneMapAndDither(in_color, exposure, pixelPos);
 
 	imageStore( currentFrameResultImage, pixelPos, vec4(toneMapped_color, 1.0) );
-}
\ No newline at end of file
+}
@@ -0,0 +1,23 @@
+// Distance to the scene geometry seen through a pixel of the cloud images, shared by the ray march and the reprojection pass
+// The includer declares the CameraUBO as 'camera' and the scene depth buffer as 'sceneDepthSampler'
+//
+// The renderer draws the scene geometry into a depth buffer at the cloud resolution before the cloud passes run
+// (see Renderer::RecordSceneDepthCommandBuffer). It is cleared to the far plane, pixels without geometry read 1.0
+
+#define NO_SCENE_GEOMETRY 1e30
+
+// Distance in meters along the unit view ray 'dir' to the geometry in 'pixel', NO_SCENE_GEOMETRY if there is none
+float sceneDistance(in ivec2 pixel, in vec3 dir)
+{
+    float depth = texelFetch(sceneDepthSampler, pixel, 0).r;
+    if(depth >= 1.0)
+    {
+        return NO_SCENE_GEOMETRY;
+    }
+
+    // Undo the [0,1] depth projection (GLM_FORCE_DEPTH_ZERO_TO_ONE) to get the view space depth,
+    // then go from the depth along the view direction to the distance along this ray
+    float viewDepth = camera.proj[3][2] / (depth + camera.proj[2][2]);
+    vec3 camLook = -normalize(vec3(camera.view[0][2], camera.view[1][2], camera.view[2][2]));
+    return viewDepth / max(dot(dir, camLook), 0.0001);
+}
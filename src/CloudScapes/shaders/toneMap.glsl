@@ -0,0 +1,70 @@
+// Tone mapping and dithering, shared by the tone mapping pass (postProcess_ToneMap.frag) and the fused post process kernel
+// (postProcess_Fused.comp). The includer declares the TimeUBO members (time). The exposure comes from the
+// ExposureBuffer, adapted on the GPU to the brightness of the frame (see exposureAverage.comp)
+
+//Reference: http://filmicworlds.com/blog/filmic-tonemapping-operators/
+//Also https://www.shadertoy.com/view/lslGzl
+//Originally from the game Uncharted 2 by Naughty Dog
+#define A 0.15
+#define B 0.50
+#define C 0.10
+#define D 0.20
+#define E 0.02
+#define F 0.30
+#define INVGAMMA (1.0 / 2.2)
+
+vec3 Uncharted2Tonemap(vec3 x)
+{
+   return ((x*(A*x+C*B)+D*E)/(x*(A*x+B)+D*F))-E/F;
+}
+
+vec3 tonemap(vec3 x, float exposure, float whiteBalance) 
+{
+   vec3 color = Uncharted2Tonemap(exposure * x);
+
+   vec3 white = vec3(whiteBalance);
+   vec3 whitemap = 1.0 / Uncharted2Tonemap(white);
+
+   color *= whitemap;
+   return pow(color, vec3(INVGAMMA));
+}
+
+// The Uncharted 2 curve is done with its single letter constants, they would clash with the includer's names
+#undef A
+#undef B
+#undef C
+#undef D
+#undef E
+#undef F
+
+//Replacement for dithering noise function
+//Reference: https://youtu.be/4D5uX8wL1V8?t=11m22s
+//Super fast because of all the binary operations
+//Quality noise without repeating patterns
+float WangHashNoise(uint u, uint v, uint s)
+{
+	//u after a number ensures it is an unsigned int
+	uint seed = (u * 1664525u + v) + s;
+
+	seed = (seed ^ 61u) ^ (seed >> 16u);
+	seed *= 9u;
+	seed = seed ^ (seed >> 4u);
+	seed *= 0x27d4eb2d;
+	seed = seed ^ (seed >> 15u);
+
+	float value = float(seed);
+	value *= (1.0 / 4294967296.0);
+	return value;
+}
+
+// HDR color of the render resolution pixel 'pixelPos' to the displayed range, dithered so that the 8 bit images don't band
+vec3 toneMapAndDither(vec3 hdrColor, float exposure, ivec2 pixelPos)
+{
+	float whitepoint = 100.0f; //changes the point at which something becomes pure white
+	//The white point is the value that is mapped to 1.0 in the regular RGB space.
+	vec3 toneMapped_color = tonemap(hdrColor, exposure, whitepoint);
+
+	//Dithering to prevent banding
+	float noise = WangHashNoise(pixelPos.x, pixelPos.y, uint(time.y))*0.01;
+	return toneMapped_color + vec3(noise);
+}
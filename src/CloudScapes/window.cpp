@@ -10,7 +10,7 @@ GLFWwindow* GetGLFWWindow()
     return window;
 }
 
-void InitializeWindow(int width, int height, const char* name) 
+void InitializeWindow(int width, int height, const char* name, bool visible) 
 {
     if (!glfwInit()) {
         fprintf(stderr, "Failed to initialize GLFW\n");
@@ -24,6 +24,7 @@ void InitializeWindow(int width, int height, const char* name)
 
     glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
     glfwWindowHint(GLFW_RESIZABLE, GL_TRUE);
+    glfwWindowHint(GLFW_VISIBLE, visible ? GL_TRUE : GL_FALSE);
 	window = glfwCreateWindow(width, height, name, nullptr, nullptr);
     //window = glfwCreateWindow(width, height, name, glfwGetPrimaryMonitor(), nullptr);
 
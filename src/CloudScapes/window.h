@@ -16,6 +16,7 @@
 struct GLFWwindow;
 struct GLFWwindow* GetGLFWWindow();
 
-void InitializeWindow(int width, int height, const char* name);
+// A hidden window still gets a surface and a swapchain, for runs nobody watches (--regression)
+void InitializeWindow(int width, int height, const char* name, bool visible = true);
 bool ShouldQuit();
 void DestroyWindow();
\ No newline at end of file
@@ -0,0 +1,375 @@
+// Micro-benchmarks of the host side hot paths of CloudScapes: what dominates the startup (texture decoding and 3D texture
+// assembly, OBJ parsing) and the per frame work of the CPU (halton sequence, camera matrices, uniform buffer uploads).
+// Every benchmark reports the median and the 99th percentile time of an iteration and the heap allocations per iteration.
+//
+// Runs from bin/ like the renderer, the assets are loaded from the same paths. It needs a Vulkan device (the camera and
+// the scene map their uniform buffers, the 3D texture is uploaded) but no window.
+//
+// Usage:
+//		HostBenchmarks [options]
+//			--filter <text>				only the benchmarks with <text> in their name
+//			--save <file>				write the results as a baseline
+//			--compare <file>			compare against a baseline written by --save; the exit code is 1 if a median
+//										grew by more than the tolerance or an iteration allocates more often
+//			--tolerance <fraction>		default 0.2
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <map>
+#include <new>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include "VulkanInstance.h"
+#include "VulkanInitializers.h"
+#include "ImageLoadingUtility.h"
+#include "Model.h"
+#include "Scene.h"
+#include "Camera.h"
+#include "../../external/stb_image.h"
+
+//--------------------------------------------------------
+//					ALLOCATION COUNTING
+//--------------------------------------------------------
+namespace
+{
+	// Heap allocations of the benchmark thread; the threads of the Vulkan driver don't count
+	thread_local uint64_t allocationCount = 0;
+}
+
+#if defined(__GLIBC__)
+// With glibc malloc itself is replaced, so the allocations of stb_image and tinyobjloader count too
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* pointer, size_t size);
+
+extern "C" void* malloc(size_t size)
+{
+	allocationCount++;
+	return __libc_malloc(size);
+}
+extern "C" void* calloc(size_t count, size_t size)
+{
+	allocationCount++;
+	return __libc_calloc(count, size);
+}
+extern "C" void* realloc(void* pointer, size_t size)
+{
+	allocationCount++;
+	return __libc_realloc(pointer, size);
+}
+#else
+// Elsewhere only the C++ allocations are counted, stb_image's calls to malloc are not
+void* operator new(std::size_t size)
+{
+	allocationCount++;
+	if (void* pointer = std::malloc(size ? size : 1))
+	{
+		return pointer;
+	}
+	throw std::bad_alloc();
+}
+void operator delete(void* pointer) noexcept
+{
+	std::free(pointer);
+}
+#endif
+
+namespace
+{
+	//--------------------------------------------------------
+	//						MEASUREMENT
+	//--------------------------------------------------------
+	struct BenchmarkResult
+	{
+		std::string name;
+		double medianNanoseconds;
+		double p99Nanoseconds;
+		double allocationsPerIteration;
+	};
+
+	// Keeps the optimizer from dropping the work of the benchmarks whose results are otherwise unused
+	volatile float sink;
+
+	// 'samples' timings of 'batch' iterations each; fast iterations are batched so that the clock's resolution doesn't matter
+	BenchmarkResult Measure(const std::string& name, uint32_t samples, uint32_t batch, const std::function<void()>& iteration)
+	{
+		// Warm up: the file cache, lazily created driver state
+		iteration();
+
+		std::vector<double> sampleNanoseconds;
+		sampleNanoseconds.reserve(samples);
+		uint64_t allocations = 0;
+
+		for (uint32_t sample = 0; sample < samples; sample++)
+		{
+			const uint64_t allocationsBefore = allocationCount;
+			const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			for (uint32_t i = 0; i < batch; i++)
+			{
+				iteration();
+			}
+			const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+			allocations += allocationCount - allocationsBefore;
+
+			sampleNanoseconds.push_back(std::chrono::duration<double, std::nano>(end - start).count() / double(batch));
+		}
+
+		// Nearest rank percentiles
+		std::sort(sampleNanoseconds.begin(), sampleNanoseconds.end());
+		const size_t p99Rank = static_cast<size_t>(std::ceil(0.99 * double(samples)));
+
+		BenchmarkResult result;
+		result.name = name;
+		result.medianNanoseconds = sampleNanoseconds[sampleNanoseconds.size() / 2];
+		result.p99Nanoseconds = sampleNanoseconds[std::max<size_t>(p99Rank, 1) - 1];
+		result.allocationsPerIteration = double(allocations) / (double(samples) * double(batch));
+		return result;
+	}
+
+	void PrintResult(const BenchmarkResult& result)
+	{
+		std::printf("%-58s %12.3f us %12.3f us %10.1f\n", result.name.c_str(), result.medianNanoseconds / 1000.0,
+					result.p99Nanoseconds / 1000.0, result.allocationsPerIteration);
+	}
+
+	//--------------------------------------------------------
+	//						BASELINE
+	//--------------------------------------------------------
+	// One benchmark per line: <median ns> <p99 ns> <allocations per iteration> <name>; the names have spaces in them
+	void SaveBaseline(const std::string& filePath, const std::vector<BenchmarkResult>& results)
+	{
+		std::ofstream file(filePath, std::ios::trunc);
+		if (!file.is_open())
+		{
+			throw std::runtime_error("could not write " + filePath);
+		}
+		for (const BenchmarkResult& result : results)
+		{
+			file << result.medianNanoseconds << " " << result.p99Nanoseconds << " " << result.allocationsPerIteration << " " << result.name << "\n";
+		}
+	}
+
+	// False if any benchmark got slower or allocates more than in the baseline
+	bool CompareWithBaseline(const std::string& filePath, const std::vector<BenchmarkResult>& results, double tolerance)
+	{
+		std::ifstream file(filePath);
+		if (!file.is_open())
+		{
+			throw std::runtime_error("could not open " + filePath);
+		}
+
+		std::map<std::string, BenchmarkResult> baseline;
+		std::string line;
+		while (std::getline(file, line))
+		{
+			std::istringstream entry(line);
+			BenchmarkResult result;
+			if ((entry >> result.medianNanoseconds >> result.p99Nanoseconds >> result.allocationsPerIteration >> std::ws) &&
+				std::getline(entry, result.name))
+			{
+				baseline[result.name] = result;
+			}
+		}
+
+		bool passed = true;
+		for (const BenchmarkResult& result : results)
+		{
+			const auto entry = baseline.find(result.name);
+			if (entry == baseline.end())
+			{
+				continue;
+			}
+
+			const BenchmarkResult& base = entry->second;
+			const double change = result.medianNanoseconds / base.medianNanoseconds - 1.0;
+			// Allocation counts are exact; half an allocation per iteration absorbs the odd rehash or reallocation
+			const bool slower = change > tolerance;
+			const bool moreAllocations = result.allocationsPerIteration > base.allocationsPerIteration + 0.5;
+
+			std::printf("%-58s %+8.1f%% %s%s\n", result.name.c_str(), change * 100.0, slower ? " SLOWER" : "",
+						moreAllocations ? " MORE ALLOCATIONS" : "");
+			passed = passed && !slower && !moreAllocations;
+		}
+		return passed;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	std::string filter;
+	std::string savePath;
+	std::string comparePath;
+	double tolerance = 0.2;
+
+	for (int i = 1; i < argc; i++)
+	{
+		const std::string arg = argv[i];
+		const bool hasValue = (i + 1 < argc);
+
+		if (arg == "--filter" && hasValue) {
+			filter = argv[++i];
+		}
+		else if (arg == "--save" && hasValue) {
+			savePath = argv[++i];
+		}
+		else if (arg == "--compare" && hasValue) {
+			comparePath = argv[++i];
+		}
+		else if (arg == "--tolerance" && hasValue) {
+			tolerance = std::atof(argv[++i]);
+		}
+		else
+		{
+			std::cout << "Usage: HostBenchmarks [--filter <text>] [--save <file>] [--compare <file>] [--tolerance <fraction>]" << std::endl;
+			return 1;
+		}
+	}
+
+	try
+	{
+		const std::string cloudTextureFolder = "../../src/CloudScapes/textures/CloudTextures/";
+		const std::string lowFrequencyFolder = cloudTextureFolder + "LowFrequency/";
+		const std::string modelFolder = "../../src/CloudScapes/models/";
+
+		// A device without a surface: nothing is presented
+		VulkanInstance* instance = new VulkanInstance("HostBenchmarks");
+		instance->PickPhysicalDevice({}, QueueFlagBit::GraphicsBit | QueueFlagBit::TransferBit | QueueFlagBit::ComputeBit);
+		VulkanDevice* device = instance->CreateDevice(QueueFlagBit::GraphicsBit | QueueFlagBit::TransferBit | QueueFlagBit::ComputeBit);
+
+		VkDevice logicalDevice = device->GetVkDevice();
+		VkCommandPool commandPool;
+		VulkanInitializers::CreateCommandPool(logicalDevice, commandPool, instance->GetQueueFamilyIndices()[QueueFlags::Graphics]);
+
+		// The same camera and scene main() creates
+		Camera* camera = new Camera(device, glm::vec3(0.0f, 0.0f, 2.0f), glm::vec3(0.0f, 0.0f, 1.0f), 1284, 720, 45.0f, 1284.0f / 720.0f, 0.1f, 1000.0f);
+		Scene* scene = new Scene(device);
+
+		std::vector<BenchmarkResult> results;
+		const auto run = [&](const std::string& name, uint32_t samples, uint32_t batch, const std::function<void()>& iteration)
+		{
+			if (name.find(filter) == std::string::npos)
+			{
+				return;
+			}
+			results.push_back(Measure(name, samples, batch, iteration));
+			PrintResult(results.back());
+		};
+
+		std::printf("%-58s %15s %15s %10s\n", "", "median", "p99", "allocs");
+
+		//--------------------------------------------------------
+		//					STARTUP: TEXTURES
+		//--------------------------------------------------------
+		const std::string slicePath = lowFrequencyFolder + "LowFrequency(1).tga";
+		run("stbi_load, one 128x128 low frequency slice", 200, 1, [&]()
+		{
+			int width, height, channels;
+			stbi_uc* pixels = stbi_load(slicePath.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+			if (!pixels) {
+				throw std::runtime_error("failed to load " + slicePath);
+			}
+			stbi_image_free(pixels);
+		});
+
+		run("loadMany2DTextures, 128 low frequency slices", 20, 1, [&]()
+		{
+			uint8_t* pixels = ImageLoadingUtility::loadMany2DTextures(lowFrequencyFolder, "LowFrequency", ".tga", 128, 128, 128);
+			delete[] pixels;
+		});
+
+		// What Sky::CreateCloudResources does for the base shape texture, decoding, assembly and upload
+		run("create3DTextureFromMany2DTextures, 128^3 low frequency", 10, 1, [&]()
+		{
+			VkImage image;
+			VkDeviceMemory imageMemory;
+			ImageLoadingUtility::create3DTextureFromMany2DTextures(device, logicalDevice, commandPool, lowFrequencyFolder,
+																   "LowFrequency", ".tga", image, imageMemory, VK_FORMAT_R8G8B8A8_UNORM,
+																   128, 128, 128, 128, 4);
+			vkDestroyImage(logicalDevice, image, nullptr);
+			vkFreeMemory(logicalDevice, imageMemory, nullptr);
+		});
+
+		//--------------------------------------------------------
+		//					STARTUP: MODELS
+		//--------------------------------------------------------
+		const std::string teapotPath = modelFolder + "teapot.obj";
+		run("Model::LoadOBJ, teapot.obj", 30, 1, [&]()
+		{
+			std::vector<Vertex> vertices;
+			std::vector<uint32_t> indices;
+			Model::LoadOBJ(teapotPath, vertices, indices);
+		});
+
+		const std::string thinCubePath = modelFolder + "thinCube.obj";
+		run("Model::LoadOBJ, thinCube.obj (the scene's model)", 200, 1, [&]()
+		{
+			std::vector<Vertex> vertices;
+			std::vector<uint32_t> indices;
+			Model::LoadOBJ(thinCubePath, vertices, indices);
+		});
+
+		//--------------------------------------------------------
+		//					PER FRAME
+		//--------------------------------------------------------
+		run("Scene::HaltonSequenceAt, the 16 TXAA jitter values", 200, 1000, [&]()
+		{
+			float sum = 0.0f;
+			for (int index = 1; index <= 16; index++)
+			{
+				sum += Scene::HaltonSequenceAt(index, 3);
+			}
+			sink = sum;
+		});
+
+		run("Camera::RecomputeAttributes", 200, 1000, [&]()
+		{
+			camera->RecomputeAttributes();
+		});
+
+		run("Camera::UpdateBuffer", 200, 1000, [&]()
+		{
+			camera->UpdateBuffer();
+		});
+
+		run("Camera::CopyToGPUMemory, camera UBO upload", 200, 1000, [&]()
+		{
+			camera->CopyToGPUMemory();
+		});
+
+		run("Scene::UpdateTime, clock and time UBO upload", 200, 1000, [&]()
+		{
+			scene->UpdateTime();
+		});
+
+		delete scene;
+		delete camera;
+		vkDestroyCommandPool(logicalDevice, commandPool, nullptr);
+		delete device;
+		delete instance;
+
+		if (!savePath.empty())
+		{
+			SaveBaseline(savePath, results);
+		}
+		if (!comparePath.empty() && !CompareWithBaseline(comparePath, results, tolerance))
+		{
+			return 1;
+		}
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}